@@ -0,0 +1,198 @@
+/***************************************************************************//**
+ * @file
+ * @brief Load adaptive admission of IQ reports, a token bucket per tag.
+ ******************************************************************************/
+
+#include <string.h>
+
+#include "app_config.h"
+#include "admission.h"
+#include "conn.h"
+
+/***************************************************************************************************
+ * Static Variables
+ **************************************************************************************************/
+
+static admission_backlog_fn_t backlog_fn;
+static uint64_t period_start_ns;
+static double cost_ns;                // processing time per report, moving average
+static uint64_t period_busy_ns;       // processing time of the reports of the period
+static double load;                   // share of the event thread for reports, moving average
+static double backlog_factor = 1.0;
+static double capacity;
+
+/***************************************************************************************************
+ * Public Variables
+ **************************************************************************************************/
+
+double admission_target_load = ADMISSION_DEFAULT_LOAD;
+
+/***************************************************************************************************
+ * Static Function Definitions
+ **************************************************************************************************/
+
+static inline void export_add(uint64_t *counter)
+{
+  __atomic_store_n(counter, *counter + 1, __ATOMIC_RELAXED);
+}
+
+static inline void export_rate(admission_tag_t *tag, double rate)
+{
+  __atomic_store(&tag->rate, &rate, __ATOMIC_RELAXED);
+}
+
+// Multiplicative decrease while the receive buffer backs up and the reports
+// take their share of the event thread; a backlog of event dispatch alone
+// doesn't drain by refusing reports.
+static void update_backlog(void)
+{
+  int32_t bytes = admission_backlog();
+
+  if ((bytes > ADMISSION_BACKLOG_HIGH) && (load >= admission_target_load)) {
+    backlog_factor *= ADMISSION_BACKOFF;
+    if (backlog_factor < ADMISSION_MIN_FACTOR) {
+      backlog_factor = ADMISSION_MIN_FACTOR;
+    }
+  } else if ((bytes < ADMISSION_BACKLOG_LOW) || (load < admission_target_load)) {
+    backlog_factor += ADMISSION_RECOVERY;
+    if (backlog_factor > 1.0) {
+      backlog_factor = 1.0;
+    }
+  }
+}
+
+// Offered rates of the period and max-min fair rates of all tags.
+static void update_rates(uint64_t now)
+{
+  admission_tag_t *tags[AOA_MAX_TAGS];
+  conn_properties_t *conn;
+  double dt = (now - period_start_ns) / 1e9;
+  double remaining;
+  uint32_t n = 0;
+
+  period_start_ns = now;
+  for (uint8_t i = 0; ((conn = get_connection_by_index(i)) != NULL) && (n < AOA_MAX_TAGS); i++) {
+    admission_tag_t *t = &conn->admission;
+    double offered = t->period_offered / dt;
+    t->offered_rate = (t->offered_rate > 0) ? t->offered_rate + ADMISSION_EWMA * (offered - t->offered_rate)
+                      : offered;
+    t->period_offered = 0;
+    // Insertion sort by offered rate, a handful of tags
+    uint32_t k = n++;
+    while ((k > 0) && (tags[k - 1]->offered_rate > t->offered_rate)) {
+      tags[k] = tags[k - 1];
+      k--;
+    }
+    tags[k] = t;
+  }
+
+  load = (load > 0) ? load + ADMISSION_EWMA * (period_busy_ns / 1e9 / dt - load) : period_busy_ns / 1e9 / dt;
+  period_busy_ns = 0;
+  update_backlog();
+  remaining = (cost_ns > 0) ? admission_target_load * 1e9 / cost_ns * backlog_factor : 0;
+  __atomic_store(&capacity, &remaining, __ATOMIC_RELAXED);
+  if (remaining <= 0) {
+    return;
+  }
+
+  // A tag offering less than an equal share of what is left gets all it
+  // offers, the leftover goes to the busier ones. Every tag may use its
+  // share, unused tokens expire with the bucket depth.
+  for (uint32_t k = 0; k < n; k++) {
+    double share = remaining / (n - k);
+    export_rate(tags[k], share);
+    remaining -= (tags[k]->offered_rate < share) ? tags[k]->offered_rate : share;
+  }
+}
+
+static void refill(admission_tag_t *tag, uint64_t now)
+{
+  double depth = tag->rate * ADMISSION_BURST_S;
+
+  if (now > tag->refill_ns) {
+    tag->tokens += tag->rate * (now - tag->refill_ns) / 1e9;
+    tag->refill_ns = now;
+  }
+  if (depth < 1.0) {
+    depth = 1.0;
+  }
+  if (tag->tokens > depth) {
+    tag->tokens = depth;
+  }
+}
+
+static inline bool limited(const admission_tag_t *tag)
+{
+  return (admission_target_load > 0) && (tag->rate > 0);
+}
+
+/***************************************************************************************************
+ * Public Function Definitions
+ **************************************************************************************************/
+
+void admission_tag_init(admission_tag_t *tag)
+{
+  memset(tag, 0, sizeof(*tag));
+  tag->tokens = 1.0;
+}
+
+void admission_set_backlog(admission_backlog_fn_t backlog)
+{
+  backlog_fn = backlog;
+}
+
+int32_t admission_backlog(void)
+{
+  return (backlog_fn != NULL) ? backlog_fn() : 0;
+}
+
+void admission_offer(admission_tag_t *tag, uint64_t received)
+{
+  export_add(&tag->offered);
+  tag->period_offered++;
+  if (period_start_ns == 0) {
+    period_start_ns = received;
+  } else if (received - period_start_ns >= ADMISSION_PERIOD_MS * 1000000ull) {
+    update_rates(received);
+  }
+}
+
+bool admission_acquire(admission_tag_t *tag, uint64_t now)
+{
+  if (limited(tag)) {
+    refill(tag, now);
+    if (tag->tokens < 1.0) {
+      return false;
+    }
+    tag->tokens -= 1.0;
+  }
+  export_add(&tag->admitted);
+  return true;
+}
+
+void admission_account(uint64_t ns)
+{
+  period_busy_ns += ns;
+  cost_ns = (cost_ns > 0) ? cost_ns + ADMISSION_EWMA * ((double)ns - cost_ns) : (double)ns;
+}
+
+bool admission_overloaded(const admission_tag_t *tag)
+{
+  return limited(tag) && (tag->rate < tag->offered_rate);
+}
+
+double admission_capacity(void)
+{
+  double value;
+
+  __atomic_load(&capacity, &value, __ATOMIC_RELAXED);
+  return value;
+}
+
+double admission_tag_rate(const admission_tag_t *tag)
+{
+  double rate;
+
+  __atomic_load(&tag->rate, &rate, __ATOMIC_RELAXED);
+  return rate;
+}
@@ -0,0 +1,107 @@
+/***************************************************************************//**
+ * @file
+ * @brief Load adaptive admission of IQ reports, a token bucket per tag.
+ *
+ * Replaces the fixed decimation of the report path. Every tag has a token
+ * bucket; a report in the mailbox of the tag is processed if the tag has a
+ * token (admission_acquire()), otherwise it waits there, where newer reports
+ * of the tag supersede it (see mailbox.h).
+ *
+ * Every ADMISSION_PERIOD_MS the rates are set again:
+ *   capacity  = target load / mean processing time per report, i.e. the
+ *               reports/s the event thread handles within the target load,
+ *               scaled down while the host receive buffer holds more than
+ *               ADMISSION_BACKLOG_HIGH bytes and the reports take at least
+ *               the target load (multiplicative decrease, additive
+ *               increase below ADMISSION_BACKLOG_LOW or the target load)
+ *   tag rate  = max-min fair share of the capacity by the offered rates:
+ *               quiet tags get all they offer, the busy ones share the rest
+ * so a busy tag can't starve a quiet one, and the admitted rate follows the
+ * measured processing time and the backlog. A backlog while the reports take
+ * less than the target load is of event dispatch, refusing reports would not
+ * drain it. An overloaded tag, admitted less than it offers, is served its
+ * newest report (mailbox_take_latest()).
+ *
+ * All functions run on the event thread. The exported figures of a tag
+ * (rate, offered, admitted) are written with relaxed atomics for
+ * the metrics server.
+ ******************************************************************************/
+
+#ifndef ADMISSION_H_
+#define ADMISSION_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ADMISSION_DEFAULT_LOAD    0.7       // share of the event thread for reports
+#define ADMISSION_PERIOD_MS       100
+#define ADMISSION_BURST_S         0.25      // bucket depth, in seconds of the tag rate
+#define ADMISSION_BACKLOG_HIGH    4096      // bytes in the host receive buffer
+#define ADMISSION_BACKLOG_LOW     512
+#define ADMISSION_BACKOFF         0.7
+#define ADMISSION_RECOVERY        0.05
+#define ADMISSION_MIN_FACTOR      0.05
+#define ADMISSION_EWMA            0.2       // weight of the newest period or report
+
+/***************************************************************************************************
+ * Type Definitions
+ **************************************************************************************************/
+
+typedef struct {
+  double tokens;
+  uint64_t refill_ns;
+  double rate;                  // admitted reports/s, 0 until the first period
+  double offered_rate;          // arrivals/s, moving average
+  uint32_t period_offered;
+  // Exported
+  uint64_t offered;
+  uint64_t admitted;
+} admission_tag_t;
+
+// Bytes waiting in the host receive buffer, e.g. uartRxPeek()
+typedef int32_t (*admission_backlog_fn_t)(void);
+
+/***************************************************************************************************
+ * Public variables
+ **************************************************************************************************/
+
+// Target share of the event thread for reports, 0 admits every report
+extern double admission_target_load;
+
+/***************************************************************************************************
+ * Function Declarations
+ **************************************************************************************************/
+
+void admission_tag_init(admission_tag_t *tag);
+
+void admission_set_backlog(admission_backlog_fn_t backlog);
+
+// Bytes in the host receive buffer, 0 if no backlog function is set.
+int32_t admission_backlog(void);
+
+// Counts a report received at received (stage_stats_now()) and sets the
+// rates at the end of a period.
+void admission_offer(admission_tag_t *tag, uint64_t received);
+
+// Takes a token of the tag for a report to process, false if it has none.
+bool admission_acquire(admission_tag_t *tag, uint64_t now);
+
+// True while the tag is admitted less than it offers.
+bool admission_overloaded(const admission_tag_t *tag);
+
+// Processing time of an admitted report, on the event thread.
+void admission_account(uint64_t cost_ns);
+
+// Reports/s the event thread is given for all tags, 0 while not measured.
+double admission_capacity(void);
+double admission_tag_rate(const admission_tag_t *tag);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* ADMISSION_H_ */
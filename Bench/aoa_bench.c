@@ -0,0 +1,552 @@
+/***************************************************************************//**
+ * @file
+ * @brief Benchmark suite of the host hot paths, run with 'make bench'.
+ *
+ * Runs on simulator data, without NCP or broker:
+ *   get_samples/<array>     the sample copy get_samples() does per report
+ *   phase_rotation/<array>  sl_rtl_aox_calculate_iq_sample_phase_rotation()
+ *   estimate/<array>        aoa_calculate(): QA gate, samples, phase rotation,
+ *                           sl_rtl_aox_process()
+ *   make_I_Q/<array>        simulated report
+ *   covariance/<array>      covariance_update() of a report, window of
+ *                           BENCH_COVARIANCE_WINDOW reports
+ *   estimate_cov/<array>    aoa_calculate() with the covariance estimator
+ *                           (-C BENCH_COVARIANCE_WINDOW) instead of
+ *                           sl_rtl_aox_process()
+ *   covariance_q15/<array>  covariance_update_q15(), the same in fixed point
+ *   estimate_q15/<array>    aoa_calculate() with the fixed-point covariance
+ *                           estimator (-C BENCH_COVARIANCE_WINDOW:0:q15)
+ *   estimate_log/<level>    aoa_calculate() of the default array with the
+ *                           console log at -v 0 (quiet) and -v 2 (debug, all
+ *                           messages of every report as before the leveled
+ *                           log), written to the null device
+ *   I_Q_to_CSV              analysis and rendering of one CSV report, without
+ *                           the file write
+ *   tag_lookup_address      get_connection_by_address(), full tag table
+ *   tag_lookup_handle       get_connection_by_handle(), full tag table
+ *   payload                 MQTT topic and JSON payload of an angle
+ *   stage_stats             stamps and histogram update per report, 1 in
+ *                           STAGE_STATS_DEFAULT_SAMPLE_EVERY sampled, the
+ *                           overhead of the stage statistics per report
+ *   track/update            angle_tracker_update() of an estimate, the
+ *                           tracking filter (-F) per tag and report
+ *   track/predict           angle_tracker_predict(), a report without estimate
+ *
+ * Each benchmark is calibrated to -t seconds and measured in BENCH_ROUNDS
+ * rounds, the median is reported. The results are written as JSON (-o) and,
+ * with -b, compared with a former result: a benchmark slower by more than
+ * -r percent is a regression and the exit status is 1. So is a stage_stats
+ * row above STAGE_STATS_MAX_OVERHEAD of the cheapest estimate/<array> row.
+ ******************************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "app_config.h"
+#include "aoa.h"
+#include "aoa_array.h"
+#include "aoa_util.h"
+#include "aoa_serdes.h"
+#include "conn.h"
+#include "log2CSV.h"
+#include "log_level.h"
+#include "iq_analytics.h"
+#include "simd_kernels.h"
+#include "stage_stats.h"
+#include "Simulator_I_Q.h"
+#include "cJSON.h"
+#include "bench_util.h"
+
+#define USAGE "\nUsage: %s [-o <results.json>] [-b <baseline.json>] [-r <tolerance %%>] [-t <seconds>] [-k <kernels>]\n"
+#define BENCH_ROUNDS        5
+#define ARRAY_TYPES         3
+// The rows of each array type and the rows of the default geometry, see main()
+#define BENCH_ARRAY_ROWS    8
+#define BENCH_OTHER_ROWS    9
+#define BENCH_MAX_RESULTS   (ARRAY_TYPES * BENCH_ARRAY_ROWS + BENCH_OTHER_ROWS)
+#define BENCH_COVARIANCE_WINDOW   4
+
+typedef void (*bench_fn_t)(uint32_t iterations);
+
+typedef struct {
+  char name[48];
+  double ns_per_op;
+  uint64_t iterations;
+  double baseline_ns_per_op;    // 0 without baseline
+} bench_result_t;
+
+extern float REFERENCE_SAMPL_RATE;
+extern float SAMPLING_RATE;
+extern float OneSwitchRotate;
+
+static bench_result_t results[BENCH_MAX_RESULTS];
+static uint32_t result_count;
+static double min_time_s = 0.5;
+
+// State of the running benchmark
+static aoa_libitems_t aoa_state;
+static aoa_iq_report_t iq_report;
+static int8_t report_samples[AOA_ARRAY_MAX_REPORT_LENGTH + 1];
+static bd_addr tag_addresses[AOA_MAX_TAGS];
+static volatile uint32_t sink;
+
+/***************************************************************************************************
+ * Benchmarks
+ **************************************************************************************************/
+
+static void bench_get_samples(uint32_t iterations)
+{
+  for (uint32_t n = 0; n < iterations; n++) {
+    aoa_state.array_kernel.copy_samples(&aoa_state.array, iq_report.samples,
+                                        aoa_state.ref_i_samples[0], aoa_state.ref_q_samples[0],
+                                        aoa_state.i_samples, aoa_state.q_samples);
+  }
+  sink += (uint32_t)aoa_state.i_samples[0][0];
+}
+
+static void bench_phase_rotation(uint32_t iterations)
+{
+  float phase_rotation = 0;
+
+  for (uint32_t n = 0; n < iterations; n++) {
+    sl_rtl_aox_calculate_iq_sample_phase_rotation(&aoa_state.libitem,
+                                                  REFERENCE_SAMPL_RATE,
+                                                  aoa_state.ref_i_samples[0],
+                                                  aoa_state.ref_q_samples[0],
+                                                  aoa_state.array.ref_period_samples,
+                                                  &phase_rotation);
+  }
+  sink += (uint32_t)phase_rotation;
+}
+
+static void bench_estimate(uint32_t iterations)
+{
+  aoa_angle_t angle;
+
+  for (uint32_t n = 0; n < iterations; n++) {
+    // A new report for the analysis cache
+    iq_report.event_counter++;
+    aoa_calculate(&aoa_state, &iq_report, &angle);
+  }
+}
+
+static void bench_covariance_update(uint32_t iterations)
+{
+  static uint64_t time_ns = 1000000000u;
+  float slot_rotation = spectrum_slot_rotation(aoa_state.ref_i_samples[0], aoa_state.ref_q_samples[0],
+                                               aoa_state.array.ref_period_samples,
+                                               SAMPLING_RATE / REFERENCE_SAMPL_RATE);
+
+  for (uint32_t n = 0; n < iterations; n++) {
+    time_ns += 20000000u;
+    sink += covariance_update(&aoa_state.covariance, iq_report.channel, aoa_state.i_samples, aoa_state.q_samples,
+                              aoa_state.array.num_snapshots, slot_rotation, time_ns);
+  }
+}
+
+static void bench_covariance_update_q15(uint32_t iterations)
+{
+  static uint64_t time_ns = 1000000000u;
+  const uint32_t ref = aoa_state.array.ref_period_samples;
+  float slot_rotation;
+
+  covariance_samples_q15(iq_report.samples, iq_report.length, aoa_array_report_length(&aoa_state.array),
+                         aoa_state.i_q15, aoa_state.q_q15);
+  slot_rotation = spectrum_slot_rotation_q15(aoa_state.i_q15, aoa_state.q_q15, ref,
+                                             SAMPLING_RATE / REFERENCE_SAMPL_RATE);
+  for (uint32_t n = 0; n < iterations; n++) {
+    time_ns += 20000000u;
+    sink += covariance_update_q15(&aoa_state.covariance, iq_report.channel, &aoa_state.i_q15[ref],
+                                  &aoa_state.q_q15[ref], aoa_state.array.num_snapshots, slot_rotation, time_ns);
+  }
+}
+
+static void bench_make_I_Q(uint32_t iterations)
+{
+  for (uint32_t n = 0; n < iterations; n++) {
+    sink += make_I_Q(iq_report.length, 30.0f)[0];
+  }
+}
+
+static void bench_I_Q_to_CSV(uint32_t iterations)
+{
+  static char buffer[CSV_REPORT_MAX_LEN(AOA_ARRAY_MAX_REPORT_LENGTH)];
+
+  for (uint32_t n = 0; n < iterations; n++) {
+    iq_analytics_invalidate(&aoa_state.analytics);
+    iq_analytics_update(&aoa_state.analytics, &iq_report, OneSwitchRotate, IQ_ANALYTICS_EXACT);
+    sink += I_Q_render_CSV(buffer, &aoa_state.analytics, &iq_report);
+  }
+}
+
+static void bench_tag_lookup_address(uint32_t iterations)
+{
+  for (uint32_t n = 0; n < iterations; n++) {
+    sink += (get_connection_by_address(&tag_addresses[n % AOA_MAX_TAGS]) != NULL);
+  }
+}
+
+static void bench_tag_lookup_handle(uint32_t iterations)
+{
+  for (uint32_t n = 0; n < iterations; n++) {
+    sink += (get_connection_by_handle(n % AOA_MAX_TAGS) != NULL);
+  }
+}
+
+static void bench_payload(uint32_t iterations)
+{
+  aoa_angle_t angle = { 0 };
+  aoa_id_t tag_id;
+  char topic[128];
+  char *payload;
+
+  angle.azimuth = 12.5f;
+  angle.elevation = -3.25f;
+  angle.distance = 1.75f;
+  angle.rssi = -52;
+  angle.channel = 17;
+  for (uint32_t n = 0; n < iterations; n++) {
+    angle.sequence = n;
+    aoa_address_to_id(tag_addresses[n % AOA_MAX_TAGS].addr, 0, tag_id);
+    snprintf(topic, sizeof(topic), "silabs/aoa/angle/%s/%s", "ble-pd-000000000000", tag_id);
+    aoa_angle_to_string(&angle, &payload);
+    sink += (uint8_t)payload[0];
+    free(payload);
+  }
+}
+
+static void bench_stage_stats(uint32_t iterations)
+{
+  static stage_stats_tag_t tag;
+  // The stamp of receipt is taken for the mailbox in any case
+  uint64_t received = stage_stats_now();
+
+  for (uint32_t n = 0; n < iterations; n++) {
+    stage_stats_begin(&tag, received, received);
+    stage_stats_mark(&tag, STAGE_STATS_SAMPLES);
+    stage_stats_mark(&tag, STAGE_STATS_ROTATION);
+    stage_stats_mark(&tag, STAGE_STATS_ESTIMATED);
+    stage_stats_end(&tag, true);
+  }
+  sink += (uint32_t)tag.reports;
+}
+
+static void bench_track_update(uint32_t iterations)
+{
+  static angle_tracker_t tracker;
+  aoa_angle_t angle = { 0 };
+  uint64_t time_ns = 1000000000u;
+
+  angle_tracker_init(&tracker, ANGLE_TRACKER_DEFAULT_MOTION, ANGLE_TRACKER_DEFAULT_NOISE);
+  for (uint32_t n = 0; n < iterations; n++) {
+    // 50 reports/s, a tag moving at 10 deg/s with some estimate noise
+    time_ns += 20000000u;
+    angle.azimuth = 0.2f * (n % 1000) + ((n & 7) - 3.5f) * 0.5f;
+    angle.elevation = 10.0f;
+    sink += angle_tracker_update(&tracker, time_ns, &angle);
+  }
+}
+
+static void bench_track_predict(uint32_t iterations)
+{
+  static angle_tracker_t tracker;
+  aoa_angle_t angle = { 0 };
+
+  angle_tracker_init(&tracker, ANGLE_TRACKER_DEFAULT_MOTION, ANGLE_TRACKER_DEFAULT_NOISE);
+  angle_tracker_update(&tracker, 1000000000u, &angle);
+  for (uint32_t n = 0; n < iterations; n++) {
+    sink += angle_tracker_predict(&tracker, 1000000000u + (n % 50) * 20000000u, &angle);
+  }
+}
+
+/***************************************************************************************************
+ * Harness
+ **************************************************************************************************/
+
+static int compare_double(const void *a, const void *b)
+{
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+static void run(const char *name, bench_fn_t fn)
+{
+  double round_ns[BENCH_ROUNDS];
+  uint32_t iterations = 1;
+  double elapsed;
+  bench_result_t *r;
+
+  if (result_count == BENCH_MAX_RESULTS) {
+    // A row missing from the results would never be compared
+    fprintf(stderr, "More than %d benchmarks, raise BENCH_ARRAY_ROWS or BENCH_OTHER_ROWS\n", BENCH_MAX_RESULTS);
+    exit(EXIT_FAILURE);
+  }
+  // Calibrate: iterations of one round, min_time_s for all rounds
+  for (;;) {
+    double t0 = bench_monotonic_s();
+    fn(iterations);
+    elapsed = bench_monotonic_s() - t0;
+    if ((elapsed >= min_time_s / BENCH_ROUNDS) || (iterations >= (1u << 30))) {
+      break;
+    }
+    iterations = (elapsed > 0) ? (uint32_t)(iterations * (min_time_s / BENCH_ROUNDS / elapsed) * 1.2) + 1
+                 : iterations * 10;
+  }
+  for (int round = 0; round < BENCH_ROUNDS; round++) {
+    double t0 = bench_monotonic_s();
+    fn(iterations);
+    round_ns[round] = (bench_monotonic_s() - t0) * 1e9 / iterations;
+  }
+  qsort(round_ns, BENCH_ROUNDS, sizeof(round_ns[0]), compare_double);
+
+  r = &results[result_count++];
+  snprintf(r->name, sizeof(r->name), "%s", name);
+  r->ns_per_op = round_ns[BENCH_ROUNDS / 2];
+  r->iterations = (uint64_t)iterations * BENCH_ROUNDS;
+  fprintf(stderr, "%-28s %12.1f ns/op %14.0f ops/s\n", r->name, r->ns_per_op, 1e9 / r->ns_per_op);
+}
+
+// Estimator and simulated report for an array type.
+static void setup_array(uint8_t array_type)
+{
+  aoa_array_set_type(&aoa_array_config, array_type);
+  aoa_init(&aoa_state);
+  iq_report.channel = 17;
+  iq_report.rssi = -50;
+  iq_report.event_counter = 0;
+  iq_report.length = aoa_array_report_length(&aoa_array_config);
+  memcpy(report_samples, make_I_Q(iq_report.length, 30.0f), iq_report.length);
+  iq_report.samples = report_samples;
+  bench_get_samples(1);
+}
+
+static void setup_tags(void)
+{
+  init_connection();
+  for (uint32_t t = 0; t < AOA_MAX_TAGS; t++) {
+    for (uint32_t b = 0; b < sizeof(tag_addresses[t].addr); b++) {
+      tag_addresses[t].addr[b] = (uint8_t)(0x10 * t + b);
+    }
+    add_connection(t, &tag_addresses[t], 0);
+  }
+}
+
+static void load_baseline(const char *filename)
+{
+  char *buffer = load_file(filename);
+  cJSON *root, *list, *item, *name, *ns;
+
+  if (buffer == NULL) {
+    fprintf(stderr, "No baseline %s, nothing to compare.\n", filename);
+    return;
+  }
+  root = cJSON_Parse(buffer);
+  list = cJSON_GetObjectItem(root, "benchmarks");
+  for (int i = 0; cJSON_IsArray(list) && (i < cJSON_GetArraySize(list)); i++) {
+    item = cJSON_GetArrayItem(list, i);
+    name = cJSON_GetObjectItem(item, "name");
+    ns = cJSON_GetObjectItem(item, "ns_per_op");
+    if (!cJSON_IsString(name) || !cJSON_IsNumber(ns)) {
+      continue;
+    }
+    for (uint32_t r = 0; r < result_count; r++) {
+      if (strcmp(results[r].name, name->valuestring) == 0) {
+        results[r].baseline_ns_per_op = ns->valuedouble;
+      }
+    }
+  }
+  cJSON_Delete(root);
+  free(buffer);
+}
+
+static const bench_result_t *find_result(const char *prefix, bool cheapest)
+{
+  const bench_result_t *found = NULL;
+
+  for (uint32_t r = 0; r < result_count; r++) {
+    if ((strncmp(results[r].name, prefix, strlen(prefix)) == 0)
+        && ((found == NULL) || (cheapest && (results[r].ns_per_op < found->ns_per_op)))) {
+      found = &results[r];
+    }
+  }
+  return found;
+}
+
+// The stage statistics against the cheapest estimate of a report, true if
+// they are within STAGE_STATS_MAX_OVERHEAD.
+static bool check_stage_stats_overhead(void)
+{
+  const bench_result_t *stats = find_result("stage_stats", false);
+  const bench_result_t *estimate = find_result("estimate/", true);
+  double overhead;
+
+  if ((stats == NULL) || (estimate == NULL)) {
+    return true;
+  }
+  overhead = stats->ns_per_op / estimate->ns_per_op;
+  fprintf(stderr, "stage_stats overhead %.2f %% of %s, at most %.2f %%\n", 100.0 * overhead, estimate->name,
+          100.0 * STAGE_STATS_MAX_OVERHEAD);
+  return overhead <= STAGE_STATS_MAX_OVERHEAD;
+}
+
+// Returns the number of regressions.
+static uint32_t compare_baseline(double tolerance_pct)
+{
+  uint32_t regressions = 0;
+
+  for (uint32_t r = 0; r < result_count; r++) {
+    double change;
+    if (results[r].baseline_ns_per_op <= 0) {
+      continue;
+    }
+    change = 100.0 * (results[r].ns_per_op / results[r].baseline_ns_per_op - 1.0);
+    if (change > tolerance_pct) {
+      fprintf(stderr, "REGRESSION %-28s %+.1f %% (%.1f -> %.1f ns/op)\n", results[r].name,
+              change, results[r].baseline_ns_per_op, results[r].ns_per_op);
+      regressions++;
+    } else if (change < -tolerance_pct) {
+      fprintf(stderr, "improved   %-28s %+.1f %%\n", results[r].name, change);
+    }
+  }
+  return regressions;
+}
+
+static void write_results(const char *filename, double tolerance_pct)
+{
+  FILE *f = fopen(filename, "w");
+
+  if (f == NULL) {
+    fprintf(stderr, "Failed to open %s\n", filename);
+    exit(EXIT_FAILURE);
+  }
+  fprintf(f, "{\n  \"kernels\": \"%s\",\n  \"tolerance_pct\": %.1f,\n  \"benchmarks\": [\n",
+          simd_kernels->name, tolerance_pct);
+  for (uint32_t r = 0; r < result_count; r++) {
+    const bench_result_t *b = &results[r];
+    fprintf(f, "    { \"name\": \"%s\", \"ns_per_op\": %.2f, \"ops_per_s\": %.0f, \"iterations\": %llu",
+            b->name, b->ns_per_op, 1e9 / b->ns_per_op, (unsigned long long)b->iterations);
+    if (b->baseline_ns_per_op > 0) {
+      double change = 100.0 * (b->ns_per_op / b->baseline_ns_per_op - 1.0);
+      fprintf(f, ", \"baseline_ns_per_op\": %.2f, \"change_pct\": %.1f, \"regression\": %s",
+              b->baseline_ns_per_op, change, (change > tolerance_pct) ? "true" : "false");
+    }
+    fprintf(f, " }%s\n", (r + 1 < result_count) ? "," : "");
+  }
+  fprintf(f, "  ]\n}\n");
+  fclose(f);
+}
+
+int main(int argc, char *argv[])
+{
+  static const uint8_t array_types[ARRAY_TYPES] = {
+    ARRAY_TYPE_1x4_ULA, ARRAY_TYPE_3x3_URA, ARRAY_TYPE_4x4_URA
+  };
+  const char *results_file = "bench_results.json";
+  const char *baseline_file = NULL;
+  const char *kernels = NULL;
+  double tolerance_pct = 10.0;
+  uint32_t regressions = 0;
+  char name[48];
+  int opt;
+
+  while ((opt = getopt(argc, argv, "o:b:r:t:k:h")) != -1) {
+    switch (opt) {
+      case 'o':
+        results_file = optarg;
+        break;
+      case 'b':
+        baseline_file = optarg;
+        break;
+      case 'r':
+        tolerance_pct = atof(optarg);
+        break;
+      case 't':
+        min_time_s = atof(optarg);
+        break;
+      case 'k':
+        kernels = optarg;
+        break;
+      default:
+        fprintf(stderr, USAGE, argv[0]);
+        exit(opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+  }
+
+  simd_init();
+  if ((kernels != NULL) && (simd_select(kernels) != SL_STATUS_OK)) {
+    fprintf(stderr, "SIMD kernels '%s' not available on this CPU.\n", kernels);
+    exit(EXIT_FAILURE);
+  }
+  fprintf(stderr, "kernels: %s\n", simd_kernels->name);
+  // The estimator logs every report, keep the console out of the measurement.
+  if (freopen(NULL_DEVICE, "w", stdout) == NULL) {
+    fprintf(stderr, "Failed to silence stdout\n");
+  }
+
+  for (int t = 0; t < ARRAY_TYPES; t++) {
+    const char *array = aoa_array_type_to_string(array_types[t]) + strlen("ARRAY_TYPE_");
+    setup_array(array_types[t]);
+    snprintf(name, sizeof(name), "get_samples/%s", array);
+    run(name, bench_get_samples);
+    snprintf(name, sizeof(name), "phase_rotation/%s", array);
+    run(name, bench_phase_rotation);
+    snprintf(name, sizeof(name), "estimate/%s", array);
+    run(name, bench_estimate);
+    snprintf(name, sizeof(name), "make_I_Q/%s", array);
+    run(name, bench_make_I_Q);
+    aoa_deinit(&aoa_state);
+
+    covariance_window = BENCH_COVARIANCE_WINDOW;
+    covariance_fixed_point = false;
+    setup_array(array_types[t]);
+    snprintf(name, sizeof(name), "covariance/%s", array);
+    run(name, bench_covariance_update);
+    snprintf(name, sizeof(name), "estimate_cov/%s", array);
+    run(name, bench_estimate);
+    aoa_deinit(&aoa_state);
+
+    covariance_fixed_point = true;
+    setup_array(array_types[t]);
+    snprintf(name, sizeof(name), "covariance_q15/%s", array);
+    run(name, bench_covariance_update_q15);
+    snprintf(name, sizeof(name), "estimate_q15/%s", array);
+    run(name, bench_estimate);
+    aoa_deinit(&aoa_state);
+    covariance_window = 0;
+    covariance_fixed_point = COVARIANCE_DEFAULT_FIXED_POINT;
+  }
+
+  // Default geometry for the rest
+  setup_array(ARRAY_TYPE);
+  run("I_Q_to_CSV", bench_I_Q_to_CSV);
+  log_level_set_verbose(0);
+  run("estimate_log/quiet", bench_estimate);
+  log_level_set_verbose(2);
+  run("estimate_log/debug", bench_estimate);
+  log_level_set_verbose(0);
+  aoa_deinit(&aoa_state);
+
+  setup_tags();
+  run("tag_lookup_address", bench_tag_lookup_address);
+  run("tag_lookup_handle", bench_tag_lookup_handle);
+  run("payload", bench_payload);
+  run("stage_stats", bench_stage_stats);
+  run("track/update", bench_track_update);
+  run("track/predict", bench_track_predict);
+  stage_stats_reset();
+
+  if (baseline_file != NULL) {
+    load_baseline(baseline_file);
+    regressions = compare_baseline(tolerance_pct);
+  }
+  write_results(results_file, tolerance_pct);
+  fprintf(stderr, "results: %s, %u regressions\n", results_file, regressions);
+  if (!check_stage_stats_overhead()) {
+    fprintf(stderr, "STAGE STATS OVERHEAD above the limit\n");
+    regressions++;
+  }
+  return (regressions == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
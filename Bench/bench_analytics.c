@@ -0,0 +1,158 @@
+/***************************************************************************//**
+ * @file
+ * @brief Accuracy and speed of the IQ analytics kernels.
+ *
+ * Measures the error of the FAST phase and amplitude kernels against libm
+ * over every possible int8 IQ pair (the bounds quoted in iq_analytics.h) and
+ * the reports/s of a whole-report analysis in both precisions, FAST with
+ * every SIMD kernel variant the CPU supports. -x cross-checks the variants.
+ ******************************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <math.h>
+
+#include "app_config.h"
+#include "aoa.h"
+#include "iq_analytics.h"
+#include "simd_kernels.h"
+#include "bench_util.h"
+
+#define USAGE "\nUsage: %s [-n <reports>] [-k <kernels>] [-x]\n" \
+              "  -x  check that every SIMD kernel variant gives the scalar results\n"
+#define REPORT_VARIANTS 64
+#define REPORT_LENGTH   (2 * (AOA_REF_PERIOD_SAMPLES + AOA_NUM_SNAPSHOTS * AOA_NUM_ARRAY_ELEMENTS))
+#define ALL_PAIRS       (256 * 256)
+
+static int8_t samples[REPORT_VARIANTS][REPORT_LENGTH];
+static aoa_iq_report_t reports[REPORT_VARIANTS];
+static iq_analytics_t analytics;
+static float pair_i[ALL_PAIRS], pair_q[ALL_PAIRS];
+static float fast_phase[ALL_PAIRS], fast_amplitude[ALL_PAIRS];
+
+static void check_error_bounds(void)
+{
+  double max_phase_error = 0, max_amplitude_error = 0;
+  uint32_t k = 0;
+
+  for (int i = -128; i < 128; i++) {
+    for (int q = -128; q < 128; q++) {
+      pair_i[k] = i;
+      pair_q[k] = q;
+      k++;
+    }
+  }
+  iq_analytics_atan2_fast(pair_q, pair_i, fast_phase, ALL_PAIRS);
+  iq_analytics_magnitude_fast(pair_i, pair_q, fast_amplitude, ALL_PAIRS);
+
+  for (k = 0; k < ALL_PAIRS; k++) {
+    double phase = atan2(pair_q[k], pair_i[k]);
+    double amplitude = sqrt(pair_i[k] * pair_i[k] + pair_q[k] * pair_q[k]);
+    double phase_error = fabs(fast_phase[k] - phase);
+    double amplitude_error = (amplitude > 0) ? fabs(fast_amplitude[k] - amplitude) / amplitude
+                             : fabs(fast_amplitude[k]);
+    if (phase_error > max_phase_error) {
+      max_phase_error = phase_error;
+    }
+    if (amplitude_error > max_amplitude_error) {
+      max_amplitude_error = amplitude_error;
+    }
+  }
+  printf("phase error:      %.2e rad max over all int8 pairs\n", max_phase_error);
+  printf("amplitude error:  %.2e relative max over all int8 pairs\n", max_amplitude_error);
+}
+
+static double measure(iq_analytics_mode_t mode, uint32_t report_count)
+{
+  double t0 = bench_monotonic_s();
+
+  for (uint32_t n = 0; n < report_count; n++) {
+    iq_analytics_invalidate(&analytics);
+    iq_analytics_update(&analytics, &reports[n % REPORT_VARIANTS], 0.0f, mode);
+  }
+  return bench_monotonic_s() - t0;
+}
+
+static int cross_check(void)
+{
+  uint32_t failed = 0;
+
+  for (uint32_t v = 0; v < simd_variant_count(); v++) {
+    const simd_kernels_t *variant = simd_variant(v);
+    if (!variant->supported()) {
+      printf("%-8s not supported by this CPU\n", variant->name);
+      continue;
+    }
+    uint32_t mismatches = simd_cross_check(variant);
+    printf("%-8s %s (%u values differ from scalar)\n", variant->name,
+           (mismatches == 0) ? "ok" : "FAILED", mismatches);
+    failed += (mismatches != 0);
+  }
+  return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int main(int argc, char *argv[])
+{
+  uint32_t report_count = 200000;
+  const char *kernels = NULL;
+  double t_exact, t_fast;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "n:k:xh")) != -1) {
+    switch (opt) {
+      case 'n':
+        report_count = atol(optarg);
+        break;
+      case 'k':
+        kernels = optarg;
+        break;
+      case 'x':
+        simd_init();
+        exit(cross_check());
+      default:
+        fprintf(stderr, USAGE, argv[0]);
+        exit(opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+  }
+
+  simd_init();
+  if ((kernels != NULL) && (simd_select(kernels) != SL_STATUS_OK)) {
+    fprintf(stderr, "SIMD kernels '%s' not available on this CPU.\n", kernels);
+    exit(EXIT_FAILURE);
+  }
+  printf("kernels:          %s\n", simd_kernels->name);
+
+  iq_analytics_init(&analytics, AOA_NUM_ARRAY_ELEMENTS, AOA_REF_PERIOD_SAMPLES);
+  srand(1);
+  for (uint32_t r = 0; r < REPORT_VARIANTS; r++) {
+    for (uint32_t i = 0; i < REPORT_LENGTH; i++) {
+      samples[r][i] = (int8_t)(rand() % 256 - 128);
+    }
+    reports[r].channel = r % 40;
+    reports[r].event_counter = r;
+    reports[r].length = REPORT_LENGTH;
+    reports[r].samples = samples[r];
+  }
+
+  check_error_bounds();
+
+  t_exact = measure(IQ_ANALYTICS_EXACT, report_count);
+  printf("reports:          %u of %u IQ pairs\n", report_count, REPORT_LENGTH / 2);
+  printf("exact:            %12.0f reports/s\n", report_count / t_exact);
+  for (uint32_t v = 0; v < simd_variant_count(); v++) {
+    const simd_kernels_t *variant = simd_variant(v);
+    if (!variant->supported() || ((kernels != NULL) && (variant != simd_kernels))) {
+      continue;
+    }
+    const simd_kernels_t *active = simd_kernels;
+    simd_select(variant->name);
+    t_fast = measure(IQ_ANALYTICS_FAST, report_count);
+    simd_select(active->name);
+    printf("fast %-12s %12.0f reports/s  (%.1fx exact)\n", variant->name,
+           report_count / t_fast, t_exact / t_fast);
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,256 @@
+/***************************************************************************//**
+ * @file
+ * @brief Estimates of the tags batched across the SIMD lanes against a report
+ *        at a time, built with 'make bench_batch'.
+ *
+ * For every array type the simulator gives -t tags (64 by default) -n reports
+ * each, every tag from its own random direction (-s degrees of phase noise
+ * per sample), every report on a random data channel. The reports arrive in
+ * rounds, one report of every tag per round, and go through the fixed-point
+ * covariance estimator (covariance.h, window -w) of one estimator per tag:
+ *   report              aoa_calculate() of every report, the SIMD kernels
+ *                       vectorizing within the report
+ *   batch/<G>           aoa_calculate_batch() of G reports of a round at
+ *                       once, G of -g, a tag per lane of the batch kernels
+ * per SIMD variant the CPU has. A row prints the CPU time per report, the
+ * speedup over the report row of the variant, and the reports whose result
+ * or angle differs from it, 0 as the batches give what a report at a time
+ * gives.
+ ******************************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <math.h>
+
+#include "app_config.h"
+#include "aoa.h"
+#include "aoa_array.h"
+#include "covariance.h"
+#include "spectrum.h"
+#include "simd_kernels.h"
+#include "Simulator_I_Q.h"
+#include "bench_util.h"
+
+#define USAGE "\nUsage: %s [-t <tags>] [-n <reports per tag>] [-s <phase noise deg>] [-w <covariance window>]\n" \
+              "          [-g <G>[,<G>...]]\n"
+#define DEFAULT_GROUPS    "8,16"
+#define MAX_CONFIGS       8
+#define ARRAY_TYPES       3
+#define DATA_CHANNELS     37
+#define MAX_ELEVATION     70.0f     // deg, of the URA directions
+#define REPORT_PERIOD_NS  20000000ull
+
+extern float CARRIER_FREQ;
+
+typedef struct {
+  uint8_t channel;
+  int8_t samples[AOA_ARRAY_MAX_REPORT_LENGTH];
+} report_t;
+
+typedef struct {
+  sl_status_t status;
+  aoa_angle_t angle;
+} outcome_t;
+
+static report_t *reports;           // round r of tag t at r * tag_count + t
+static outcome_t *reference;        // of the report row of a variant
+static outcome_t *outcomes;
+static aoa_libitems_t *states;
+static uint32_t tag_count = 64;
+static uint32_t report_count = 200;
+
+static void simulate(bool wraps, uint32_t length, float noise)
+{
+  srand(12345);
+  for (uint32_t t = 0; t < tag_count; t++) {
+    // Away from the row axis, where the ULA has no resolution
+    float azimuth = wraps ? bench_uniform(0, 360.0f) : bench_uniform(10.0f, 170.0f);
+    float elevation = wraps ? bench_uniform(0, MAX_ELEVATION) : 0;
+    for (uint32_t r = 0; r < report_count; r++) {
+      report_t *report = &reports[r * tag_count + t];
+      report->channel = (uint8_t)(rand() % DATA_CHANNELS);
+      CARRIER_FREQ = aoa_channel_frequency(report->channel) / 1e6f;
+      memcpy(report->samples, make_I_Q_direction(length, azimuth, elevation, noise), length);
+    }
+  }
+  CARRIER_FREQ = SPECTRUM_FREQUENCY / 1e6f;
+}
+
+// Reports of every tag round by round, group at once (0 a report at a time);
+// returns the CPU time
+static uint64_t run(uint32_t group, uint32_t length, outcome_t *out)
+{
+  aoa_libitems_t *batch_states[SIMD_BATCH_TAGS];
+  aoa_iq_report_t iq_reports[SIMD_BATCH_TAGS];
+  aoa_iq_report_t *batch_reports[SIMD_BATCH_TAGS];
+  aoa_angle_t angles[SIMD_BATCH_TAGS];
+  sl_status_t results[SIMD_BATCH_TAGS];
+  uint64_t elapsed_ns = 0;
+
+  for (uint32_t t = 0; t < tag_count; t++) {
+    aoa_init(&states[t]);
+  }
+  memset(iq_reports, 0, sizeof(iq_reports));
+  for (uint32_t k = 0; k < SIMD_BATCH_TAGS; k++) {
+    iq_reports[k].rssi = -50;
+    iq_reports[k].length = length;
+    batch_reports[k] = &iq_reports[k];
+  }
+  for (uint32_t r = 0; r < report_count; r++) {
+    const uint32_t size = (group > 0) ? group : 1;
+    for (uint32_t first = 0; first < tag_count; first += size) {
+      uint32_t count = (first + size <= tag_count) ? size : tag_count - first;
+      uint64_t t0;
+      for (uint32_t k = 0; k < count; k++) {
+        const report_t *report = &reports[r * tag_count + first + k];
+        iq_reports[k].channel = report->channel;
+        iq_reports[k].samples = (int8_t *)report->samples;
+        iq_reports[k].event_counter = (uint16_t)r;
+        batch_states[k] = &states[first + k];
+        batch_states[k]->report_time_ns = 1000000000ull + r * REPORT_PERIOD_NS;
+      }
+      t0 = bench_monotonic_ns();
+      if (group == 0) {
+        results[0] = aoa_calculate(batch_states[0], batch_reports[0], &angles[0]);
+      } else {
+        aoa_calculate_batch(batch_states, batch_reports, angles, results, count);
+      }
+      elapsed_ns += bench_monotonic_ns() - t0;
+      for (uint32_t k = 0; k < count; k++) {
+        out[r * tag_count + first + k] = (outcome_t){ results[k], angles[k] };
+      }
+    }
+  }
+  for (uint32_t t = 0; t < tag_count; t++) {
+    aoa_deinit(&states[t]);
+  }
+  return elapsed_ns;
+}
+
+static uint32_t mismatches(const outcome_t *a, const outcome_t *b)
+{
+  uint32_t differ = 0;
+
+  for (uint32_t k = 0; k < tag_count * report_count; k++) {
+    differ += (a[k].status != b[k].status)
+              || ((a[k].status == SL_STATUS_OK)
+                  && ((a[k].angle.azimuth != b[k].angle.azimuth)
+                      || (a[k].angle.elevation != b[k].angle.elevation)));
+  }
+  return differ;
+}
+
+int main(int argc, char *argv[])
+{
+  static const uint8_t array_types[ARRAY_TYPES] = {
+    ARRAY_TYPE_1x4_ULA, ARRAY_TYPE_3x3_URA, ARRAY_TYPE_4x4_URA
+  };
+  uint32_t groups[MAX_CONFIGS], group_count = 0;
+  uint32_t window = 4;
+  float noise = 5.0f;
+  char group_list[64] = DEFAULT_GROUPS;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "t:n:s:w:g:h")) != -1) {
+    switch (opt) {
+      case 't':
+        tag_count = (uint32_t)atol(optarg);
+        break;
+      case 'n':
+        report_count = (uint32_t)atol(optarg);
+        break;
+      case 's':
+        noise = atof(optarg);
+        break;
+      case 'w':
+        window = (uint32_t)atol(optarg);
+        break;
+      case 'g':
+        snprintf(group_list, sizeof(group_list), "%s", optarg);
+        break;
+      default:
+        fprintf(stderr, USAGE, argv[0]);
+        exit(opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+  }
+  if ((tag_count == 0) || (report_count == 0) || (window == 0) || (window > COVARIANCE_MAX_WINDOW)) {
+    fprintf(stderr, USAGE, argv[0]);
+    exit(EXIT_FAILURE);
+  }
+  for (char *s = strtok(group_list, ","); (s != NULL) && (group_count < MAX_CONFIGS); s = strtok(NULL, ",")) {
+    groups[group_count] = (uint32_t)atol(s);
+    if ((groups[group_count] < 2) || (groups[group_count] > SIMD_BATCH_TAGS)) {
+      fprintf(stderr, "Batch of 2..%d reports\n", SIMD_BATCH_TAGS);
+      exit(EXIT_FAILURE);
+    }
+    group_count++;
+  }
+
+  simd_init();
+  reports = malloc((size_t)tag_count * report_count * sizeof(*reports));
+  reference = malloc((size_t)tag_count * report_count * sizeof(*reference));
+  outcomes = malloc((size_t)tag_count * report_count * sizeof(*outcomes));
+  states = malloc(tag_count * sizeof(*states));
+  if ((reports == NULL) || (reference == NULL) || (outcomes == NULL) || (states == NULL)) {
+    fprintf(stderr, "Out of memory, lower -t or -n.\n");
+    exit(EXIT_FAILURE);
+  }
+  // The estimator logs on init, keep the console for the results.
+  if (freopen(NULL_DEVICE, "w", stdout) == NULL) {
+    fprintf(stderr, "Failed to silence stdout\n");
+  }
+  covariance_window = window;
+  covariance_fixed_point = true;
+
+  fprintf(stderr, "%u tags, %u reports each, phase noise %.1f deg, window %u, Q15\n",
+          tag_count, report_count, noise, window);
+  for (int a = 0; a < ARRAY_TYPES; a++) {
+    const spectrum_table_t *tables[SPECTRUM_BANDS];
+    uint32_t length;
+
+    aoa_array_set_type(&aoa_array_config, array_types[a]);
+    length = aoa_array_report_length(&aoa_array_config);
+    // Held across the estimators, built once
+    for (uint32_t b = 0; b < SPECTRUM_BANDS; b++) {
+      tables[b] = spectrum_table_acquire(&aoa_array_config, spectrum_band_frequency(b));
+      if (tables[b] == NULL) {
+        fprintf(stderr, "No steering table.\n");
+        exit(EXIT_FAILURE);
+      }
+    }
+    simulate(tables[0]->azimuth_wraps, length, noise);
+    fprintf(stderr, "\n%s\n", aoa_array_type_to_string(array_types[a]));
+    fprintf(stderr, "%-8s %-12s %10s %10s %10s\n", "kernels", "estimate", "us/report", "speedup", "mismatch");
+    for (uint32_t v = 0; v < simd_variant_count(); v++) {
+      const simd_kernels_t *variant = simd_variant(v);
+      uint64_t single_ns;
+      if (!variant->supported()) {
+        continue;
+      }
+      simd_select(variant->name);
+      single_ns = run(0, length, reference);
+      fprintf(stderr, "%-8s %-12s %10.2f %10.2f %10u\n", variant->name, "report",
+              single_ns / 1000.0 / tag_count / report_count, 1.0, 0u);
+      for (uint32_t g = 0; g < group_count; g++) {
+        char name[32];
+        uint64_t batch_ns = run(groups[g], length, outcomes);
+        snprintf(name, sizeof(name), "batch/%u", groups[g]);
+        fprintf(stderr, "%-8s %-12s %10.2f %10.2f %10u\n", variant->name, name,
+                batch_ns / 1000.0 / tag_count / report_count, (double)single_ns / batch_ns,
+                mismatches(reference, outcomes));
+      }
+    }
+    for (uint32_t b = 0; b < SPECTRUM_BANDS; b++) {
+      spectrum_table_release(tables[b]);
+    }
+  }
+
+  free(reports);
+  free(reference);
+  free(outcomes);
+  free(states);
+  return EXIT_SUCCESS;
+}
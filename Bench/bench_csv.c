@@ -0,0 +1,241 @@
+/***************************************************************************//**
+ * @file
+ * @brief Benchmark of the IQ_Report_data_log.csv rendering.
+ *
+ * Renders random reports with I_Q_render_CSV() (including the analysis of the
+ * report) and with the former per-field printf implementation, checks that both produce the same bytes and prints
+ * the rows/s of each. The printf variant is measured twice: with fprintf to
+ * a buffered FILE (as the locator used to write the log) and with snprintf
+ * into memory (formatting cost only).
+ ******************************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <math.h>
+
+#include "app_config.h"
+#include "aoa.h"
+#include "log2CSV.h"
+#include "bench_util.h"
+
+#define USAGE "\nUsage: %s [-n <reports>]\n"
+#define REPORT_VARIANTS 64
+#define REPORT_LENGTH   (2 * (AOA_REF_PERIOD_SAMPLES + AOA_NUM_SNAPSHOTS * AOA_NUM_ARRAY_ELEMENTS))
+
+extern float OneSwitchRotate;
+
+typedef struct {
+  char *data;
+  size_t len;
+  size_t size;
+} text_buffer_t;
+
+static int8_t samples[REPORT_VARIANTS][REPORT_LENGTH];
+static aoa_iq_report_t reports[REPORT_VARIANTS];
+static iq_analytics_t analytics;
+
+/***************************************************************************************************
+ * Reference implementation, the per-field printf rendering I_Q_to_CSV() used
+ **************************************************************************************************/
+
+// Either f or text is used.
+static void ref_printf(FILE *f, text_buffer_t *text, const char *format, ...)
+{
+  va_list ap;
+
+  va_start(ap, format);
+  if (f != NULL) {
+    vfprintf(f, format, ap);
+  } else {
+    int n = vsnprintf(text->data + text->len, text->size - text->len, format, ap);
+    if (n > 0) {
+      text->len += n;
+    }
+  }
+  va_end(ap);
+}
+
+static void ref_render(FILE *f, text_buffer_t *text, aoa_iq_report_t *iq_report, int len)
+{
+  int8_t *iq_data = iq_report->samples;
+  int8_t *end = iq_data + len;
+  float prevDeg[16] = { 0 };
+  float OwnDeg[16] = { 0 };
+  int N = 1;
+
+  ref_printf(f, text, ";;;;Channel %i, Rssi %i\r\n ", iq_report->channel, iq_report->rssi);
+  while (iq_data < end) {
+    ref_printf(f, text, "%i;", N);
+    N++;
+    for (int b = 0; b < AOA_NUM_ARRAY_ELEMENTS; b++) {
+      // a report may end inside a row, the missing values are 0
+      s8 _i = (iq_data < end) ? *iq_data : 0; iq_data++;
+      ref_printf(f, text, "%i;", _i);
+      s8 _q = (iq_data < end) ? *iq_data : 0; iq_data++;
+      ref_printf(f, text, "%i;", _q);
+
+      float rad = atan2(_q, _i);
+      OwnDeg[b] = rad;
+      float deg = (rad + t_pi) * rad2Dg;
+      ref_printf(f, text, "%.1f;", deg);
+
+      float OwnDiff = restrictRad(prevDeg[b] - rad);
+      ref_printf(f, text, "%.1f;", OwnDiff * rad2Dg);
+      prevDeg[b] = rad;
+
+      float Power = sqrt(_i * _i + _q * _q);
+      ref_printf(f, text, "%.1f;;", Power);
+    }
+    for (int b = 0; b < AOA_NUM_ARRAY_ELEMENTS - 1; b++) {
+      float diff = restrictRad(OwnDeg[b + 1] - OwnDeg[b] - OneSwitchRotate) * rad2Dg;
+      ref_printf(f, text, "%.1f;", diff);
+    }
+    ref_printf(f, text, "\r\n");
+  }
+  ref_printf(f, text, "\r\n\r\n");
+}
+
+/***************************************************************************************************
+ * Checks and measurements
+ **************************************************************************************************/
+
+static uint32_t rows_per_report(int len)
+{
+  return (len + 2 * AOA_NUM_ARRAY_ELEMENTS - 1) / (2 * AOA_NUM_ARRAY_ELEMENTS);
+}
+
+static uint32_t render(char *buffer, aoa_iq_report_t *iq_report)
+{
+  iq_analytics_invalidate(&analytics);
+  iq_analytics_update(&analytics, iq_report, OneSwitchRotate, IQ_ANALYTICS_EXACT);
+  return I_Q_render_CSV(buffer, &analytics, iq_report);
+}
+
+static int compare_report(aoa_iq_report_t *iq_report, int len, char *fast, text_buffer_t *text)
+{
+  aoa_iq_report_t truncated = *iq_report;
+  uint32_t fast_len;
+
+  truncated.length = len;
+  fast_len = render(fast, &truncated);
+  text->len = 0;
+  ref_render(NULL, text, iq_report, len);
+  if ((fast_len != text->len) || (memcmp(fast, text->data, fast_len) != 0)) {
+    fprintf(stderr, "Output differs from printf (channel %u, length %d)\n", iq_report->channel, len);
+    return 1;
+  }
+  return 0;
+}
+
+// Random reports, one report per I/Q pair and a few truncated lengths.
+static int check_output(char *fast, text_buffer_t *text)
+{
+  int errors = 0;
+  int8_t pair[2 * AOA_NUM_ARRAY_ELEMENTS];
+  aoa_iq_report_t iq_report = { 0 };
+
+  for (uint32_t r = 0; r < REPORT_VARIANTS; r++) {
+    errors += compare_report(&reports[r], reports[r].length, fast, text);
+    errors += compare_report(&reports[r], reports[r].length - 1 - (r % 7), fast, text);
+  }
+  iq_report.samples = pair;
+  for (int i = -128; i < 128; i++) {
+    for (int q = -128; q < 128; q++) {
+      for (int n = 0; n < 2 * AOA_NUM_ARRAY_ELEMENTS; n += 2) {
+        pair[n] = (int8_t)i;
+        pair[n + 1] = (int8_t)(q + n);
+      }
+      iq_report.length = sizeof(pair);
+      errors += compare_report(&iq_report, iq_report.length, fast, text);
+    }
+  }
+  return errors;
+}
+
+int main(int argc, char *argv[])
+{
+  uint32_t report_count = 200000;
+  size_t max_len = CSV_REPORT_MAX_LEN(REPORT_LENGTH);
+  char *fast = malloc(max_len);
+  text_buffer_t text = { malloc(max_len), 0, max_len };
+  uint64_t rows = 0;
+  double t0, t_fprintf, t_snprintf, t_fast;
+  uint32_t checksum = 0;
+  FILE *null_file;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "n:h")) != -1) {
+    switch (opt) {
+      case 'n':
+        report_count = atol(optarg);
+        break;
+      default:
+        fprintf(stderr, USAGE, argv[0]);
+        exit(opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+  }
+
+  iq_analytics_init(&analytics, AOA_NUM_ARRAY_ELEMENTS, AOA_REF_PERIOD_SAMPLES);
+  srand(1);
+  for (uint32_t r = 0; r < REPORT_VARIANTS; r++) {
+    for (uint32_t i = 0; i < REPORT_LENGTH; i++) {
+      samples[r][i] = (int8_t)(rand() % 256 - 128);
+    }
+    reports[r].channel = r % 40;
+    reports[r].rssi = -40 - (int8_t)(r % 50);
+    reports[r].event_counter = r;
+    reports[r].length = REPORT_LENGTH;
+    reports[r].samples = samples[r];
+  }
+
+  if (check_output(fast, &text) != 0) {
+    exit(EXIT_FAILURE);
+  }
+  printf("output:       byte-identical to printf\n");
+
+  null_file = fopen(NULL_DEVICE, "wb");
+  if (null_file == NULL) {
+    fprintf(stderr, "Failed to open %s\n", NULL_DEVICE);
+    exit(EXIT_FAILURE);
+  }
+  setvbuf(null_file, NULL, _IOFBF, 1024 * 1024);
+
+  t0 = bench_monotonic_s();
+  for (uint32_t n = 0; n < report_count; n++) {
+    ref_render(null_file, NULL, &reports[n % REPORT_VARIANTS], REPORT_LENGTH);
+  }
+  fflush(null_file);
+  t_fprintf = bench_monotonic_s() - t0;
+
+  t0 = bench_monotonic_s();
+  for (uint32_t n = 0; n < report_count; n++) {
+    text.len = 0;
+    ref_render(NULL, &text, &reports[n % REPORT_VARIANTS], REPORT_LENGTH);
+    checksum += text.len;
+  }
+  t_snprintf = bench_monotonic_s() - t0;
+
+  t0 = bench_monotonic_s();
+  for (uint32_t n = 0; n < report_count; n++) {
+    checksum -= render(fast, &reports[n % REPORT_VARIANTS]);
+  }
+  t_fast = bench_monotonic_s() - t0;
+  fclose(null_file);
+
+  rows = (uint64_t)report_count * rows_per_report(REPORT_LENGTH);
+  printf("reports:      %u, %u rows each\n", report_count, rows_per_report(REPORT_LENGTH));
+  printf("fprintf:      %12.0f rows/s\n", rows / t_fprintf);
+  printf("snprintf:     %12.0f rows/s\n", rows / t_snprintf);
+  printf("I_Q_render:   %12.0f rows/s  (%.1fx fprintf)\n", rows / t_fast, t_fprintf / t_fast);
+  if (checksum != 0) {
+    fprintf(stderr, "Rendered lengths differ\n");
+  }
+
+  free(fast);
+  free(text.data);
+  return EXIT_SUCCESS;
+}
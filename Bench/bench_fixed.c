@@ -0,0 +1,318 @@
+/***************************************************************************//**
+ * @file
+ * @brief Fixed-point against float covariance estimator, built with
+ *        'make bench_fixed'.
+ *
+ * For every array type the simulator gives -n reports of plane waves with -s
+ * degrees of phase noise per sample (make_I_Q_direction()), the direction
+ * random and held for -w reports, the covariance window. Each report goes
+ * through the whole in-tree estimator as in aoa.c, deinterleave, phase
+ * rotation, covariance update and spectrum search, once in float and once in
+ * Q15 (covariance.h).
+ *
+ * Validation: when the window holds the reports of one direction, the
+ * largest difference between the Q15 and the float window mean (covariance
+ * units, trace 1), and the angle between the Q15 and the float estimate
+ * (RMS and max), and the RMS error of each against the true direction. The
+ * bench fails if the Q15 path is off by more than the MAX_* tolerances below
+ * on any array type.
+ *
+ * Throughput: reports/s on one thread, i.e. per core, of the float path and
+ * of the Q15 path with every SIMD variant of this CPU (simd_kernels.h).
+ ******************************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <math.h>
+
+#include "app_config.h"
+#include "aoa.h"
+#include "aoa_array.h"
+#include "covariance.h"
+#include "spectrum.h"
+#include "simd_kernels.h"
+#include "Simulator_I_Q.h"
+#include "bench_util.h"
+
+#define USAGE "\nUsage: %s [-n <reports>] [-s <phase noise deg>] [-w <covariance window>]\n"
+#define ARRAY_TYPES       3
+#define MAX_ELEVATION     70.0f     // deg, of the URA directions
+#define MATRIX_VALUES     (2 * AOA_ARRAY_MAX_ELEMENTS * AOA_ARRAY_MAX_ELEMENTS)
+#define REPORT_PERIOD_NS  20000000ull
+
+// Accepted Q15 deviation from float, at the default noise and window
+#define MAX_MATRIX_DIFF   0.0005f   // covariance units, about 16 Q15 steps
+#define MAX_ANGLE_RMS     1.5       // deg, q15 against float estimate
+#define MAX_ANGLE_DIFF    10.0      // deg, a near tie of two peaks may flip
+#define MAX_ERROR_EXCESS  0.5       // deg, RMS error against the truth above float
+
+extern float REFERENCE_SAMPL_RATE;
+extern float SAMPLING_RATE;
+
+typedef struct {
+  float azimuth;
+  float elevation;
+} direction_t;
+
+// One estimator of a tag, in one arithmetic
+typedef struct {
+  const spectrum_table_t *table;
+  spectrum_search_t search;
+  covariance_t covariance;
+  float ref_i[AOA_ARRAY_MAX_REPORT_LENGTH], ref_q[AOA_ARRAY_MAX_REPORT_LENGTH];
+  float **i_samples, **q_samples;
+  int16_t i_q15[AOA_ARRAY_MAX_REPORT_LENGTH / 2], q_q15[AOA_ARRAY_MAX_REPORT_LENGTH / 2];
+  int16_t matrix_q15[MATRIX_VALUES];
+} estimator_t;
+
+static int8_t *reports;             // report_length values per report
+static direction_t *directions;     // per window of reports
+static uint32_t report_count = 2000;
+static uint32_t window = 4;
+
+static void simulate(const spectrum_table_t *table, uint32_t length, float noise)
+{
+  srand(12345);
+  for (uint32_t r = 0; r < report_count; r++) {
+    direction_t *direction = &directions[r / window];
+    if (r % window == 0) {
+      if (table->azimuth_wraps) {
+        direction->azimuth = bench_uniform(0, 360.0f);
+        direction->elevation = bench_uniform(0, MAX_ELEVATION);
+      } else {
+        // Away from the row axis, where the ULA has no resolution
+        direction->azimuth = bench_uniform(10.0f, 170.0f);
+        direction->elevation = 0;
+      }
+    }
+    memcpy(&reports[(size_t)r * length],
+           make_I_Q_direction(length, direction->azimuth, direction->elevation, noise), length);
+  }
+}
+
+static void estimator_init(estimator_t *estimator, const spectrum_table_t *table, bool fixed_point)
+{
+  const aoa_array_config_t *array = &aoa_array_config;
+
+  memset(estimator, 0, sizeof(*estimator));
+  estimator->table = table;
+  spectrum_search_init(&estimator->search, table, NAN, NAN, spectrum_coarse_stride, spectrum_peaks);
+  covariance_init(&estimator->covariance, table->elements, window, 0, fixed_point);
+  estimator->i_samples = malloc(array->num_snapshots * sizeof(float *));
+  estimator->q_samples = malloc(array->num_snapshots * sizeof(float *));
+  for (uint32_t s = 0; s < array->num_snapshots; s++) {
+    estimator->i_samples[s] = malloc(array->num_array_elements * sizeof(float));
+    estimator->q_samples[s] = malloc(array->num_array_elements * sizeof(float));
+  }
+}
+
+static void estimator_deinit(estimator_t *estimator)
+{
+  for (uint32_t s = 0; s < aoa_array_config.num_snapshots; s++) {
+    free(estimator->i_samples[s]);
+    free(estimator->q_samples[s]);
+  }
+  free(estimator->i_samples);
+  free(estimator->q_samples);
+  covariance_deinit(&estimator->covariance);
+}
+
+// The report through the estimator, as covariance_process_samples() of aoa.c
+static sl_status_t estimate(estimator_t *estimator, const int8_t *samples, uint32_t length, uint64_t time_ns,
+                            float *azimuth, float *elevation)
+{
+  const aoa_array_config_t *array = &aoa_array_config;
+  const uint32_t ref = array->ref_period_samples;
+  const float ratio = SAMPLING_RATE / REFERENCE_SAMPL_RATE;
+  uint32_t count;
+  sl_status_t sc;
+
+  if (estimator->covariance.fixed_point) {
+    covariance_samples_q15(samples, length, length, estimator->i_q15, estimator->q_q15);
+    sc = covariance_update_q15(&estimator->covariance, 0, &estimator->i_q15[ref], &estimator->q_q15[ref],
+                               array->num_snapshots,
+                               spectrum_slot_rotation_q15(estimator->i_q15, estimator->q_q15, ref, ratio), time_ns);
+    if (sc == SL_STATUS_OK) {
+      sc = covariance_get_q15(&estimator->covariance, 0, estimator->matrix_q15, &count);
+    }
+    if (sc == SL_STATUS_OK) {
+      sc = spectrum_estimate_q15(estimator->table, &estimator->search, estimator->matrix_q15, azimuth, elevation);
+    }
+  } else {
+    aoa_array_get_kernel(array).copy_samples(array, samples, estimator->ref_i, estimator->ref_q,
+                                             estimator->i_samples, estimator->q_samples);
+    sc = covariance_update(&estimator->covariance, 0, estimator->i_samples, estimator->q_samples,
+                           array->num_snapshots,
+                           spectrum_slot_rotation(estimator->ref_i, estimator->ref_q, ref, ratio), time_ns);
+    if (sc == SL_STATUS_OK) {
+      sc = spectrum_estimate(estimator->table, &estimator->search,
+                             covariance_get(&estimator->covariance, 0, &count), azimuth, elevation);
+    }
+  }
+  return sc;
+}
+
+// False if the Q15 path is off by more than the tolerances
+static bool validate(const spectrum_table_t *table, uint32_t length)
+{
+  estimator_t fixed, floating;
+  double diff_sum2 = 0, error_sum2[2] = { 0, 0 };
+  float diff_max = 0, matrix_max = 0;
+  uint32_t compared = 0, failed[2] = { 0, 0 };
+  double angle_rms, error_rms[2];
+  bool ok;
+
+  estimator_init(&floating, table, false);
+  estimator_init(&fixed, table, true);
+  for (uint32_t r = 0; r < report_count; r++) {
+    const direction_t *truth = &directions[r / window];
+    uint64_t time_ns = r * REPORT_PERIOD_NS;
+    float azimuth[2], elevation[2];
+    sl_status_t sc[2];
+    const float *sum;
+    uint32_t count;
+
+    sc[0] = estimate(&floating, &reports[(size_t)r * length], length, time_ns, &azimuth[0], &elevation[0]);
+    sc[1] = estimate(&fixed, &reports[(size_t)r * length], length, time_ns, &azimuth[1], &elevation[1]);
+    // A window of one direction only
+    if (r % window != window - 1) {
+      continue;
+    }
+    sum = covariance_get(&floating.covariance, 0, &count);
+    for (uint32_t k = 0; (sum != NULL) && (k < 2 * table->elements * table->elements); k++) {
+      float d = fabsf(sum[k] / count - fixed.matrix_q15[k] / 32767.0f);
+      matrix_max = (d > matrix_max) ? d : matrix_max;
+    }
+    for (int p = 0; p < 2; p++) {
+      if (sc[p] != SL_STATUS_OK) {
+        failed[p]++;
+        continue;
+      }
+      float error = bench_angle_between(azimuth[p], elevation[p], truth->azimuth, truth->elevation);
+      error_sum2[p] += (double)error * error;
+    }
+    if ((sc[0] == SL_STATUS_OK) && (sc[1] == SL_STATUS_OK)) {
+      float d = bench_angle_between(azimuth[0], elevation[0], azimuth[1], elevation[1]);
+      diff_sum2 += (double)d * d;
+      diff_max = (d > diff_max) ? d : diff_max;
+      compared++;
+    }
+  }
+  estimator_deinit(&floating);
+  estimator_deinit(&fixed);
+
+  angle_rms = (compared > 0) ? sqrt(diff_sum2 / compared) : 0.0;
+  printf("covariance max |q15 - float| %.5f\n", matrix_max);
+  printf("angle q15 - float: rms %.3f deg, max %.3f deg over %u windows\n", angle_rms, diff_max, compared);
+  for (int p = 0; p < 2; p++) {
+    uint32_t estimated = report_count / window - failed[p];
+    error_rms[p] = (estimated > 0) ? sqrt(error_sum2[p] / estimated) : 0.0;
+    printf("error against the truth, %-5s: rms %.2f deg, %u failed\n", p ? "q15" : "float", error_rms[p], failed[p]);
+  }
+
+  ok = (matrix_max <= MAX_MATRIX_DIFF) && (angle_rms <= MAX_ANGLE_RMS) && (diff_max <= MAX_ANGLE_DIFF)
+       && (error_rms[1] <= error_rms[0] + MAX_ERROR_EXCESS) && (failed[1] <= failed[0]);
+  if (!ok) {
+    printf("FAILED: q15 beyond the tolerance (covariance %.4f, angle rms %.1f / max %.1f deg, "
+           "error %.1f deg above float)\n", MAX_MATRIX_DIFF, MAX_ANGLE_RMS, MAX_ANGLE_DIFF, MAX_ERROR_EXCESS);
+  }
+  return ok;
+}
+
+static void throughput(const spectrum_table_t *table, uint32_t length, bool fixed_point, const char *kernels)
+{
+  estimator_t estimator;
+  uint64_t t0, elapsed_ns;
+  char name[32];
+
+  estimator_init(&estimator, table, fixed_point);
+  t0 = bench_monotonic_ns();
+  for (uint32_t r = 0; r < report_count; r++) {
+    float azimuth, elevation;
+    estimate(&estimator, &reports[(size_t)r * length], length, r * REPORT_PERIOD_NS, &azimuth, &elevation);
+  }
+  elapsed_ns = bench_monotonic_ns() - t0;
+  estimator_deinit(&estimator);
+
+  snprintf(name, sizeof(name), "%s/%s", fixed_point ? "q15" : "float", kernels);
+  printf("%-16s %12.0f %12.1f\n", name, report_count * 1e9 / elapsed_ns, elapsed_ns / 1000.0 / report_count);
+}
+
+int main(int argc, char *argv[])
+{
+  static const uint8_t array_types[ARRAY_TYPES] = {
+    ARRAY_TYPE_1x4_ULA, ARRAY_TYPE_3x3_URA, ARRAY_TYPE_4x4_URA
+  };
+  const simd_kernels_t *widest;
+  float noise = 5.0f;
+  bool passed = true;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "n:s:w:h")) != -1) {
+    switch (opt) {
+      case 'n':
+        report_count = (uint32_t)atol(optarg);
+        break;
+      case 's':
+        noise = atof(optarg);
+        break;
+      case 'w':
+        window = (uint32_t)atol(optarg);
+        break;
+      default:
+        fprintf(stderr, USAGE, argv[0]);
+        exit(opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+  }
+  if ((window == 0) || (window > COVARIANCE_MAX_WINDOW) || (report_count < window)) {
+    fprintf(stderr, USAGE, argv[0]);
+    exit(EXIT_FAILURE);
+  }
+  report_count -= report_count % window;
+
+  widest = simd_init();
+  reports = malloc((size_t)report_count * AOA_ARRAY_MAX_REPORT_LENGTH);
+  directions = malloc((report_count / window) * sizeof(*directions));
+  if ((reports == NULL) || (directions == NULL)) {
+    fprintf(stderr, "Out of memory, lower -n.\n");
+    exit(EXIT_FAILURE);
+  }
+
+  printf("%u reports, phase noise %.1f deg, window %u, coarse stride %u, %u peaks\n",
+         report_count, noise, window, spectrum_coarse_stride, spectrum_peaks);
+  for (int t = 0; t < ARRAY_TYPES; t++) {
+    const spectrum_table_t *table;
+    uint32_t length;
+
+    aoa_array_set_type(&aoa_array_config, array_types[t]);
+    length = aoa_array_report_length(&aoa_array_config);
+    table = spectrum_table_acquire(&aoa_array_config, SPECTRUM_FREQUENCY);
+    if (table == NULL) {
+      fprintf(stderr, "No steering table.\n");
+      exit(EXIT_FAILURE);
+    }
+    simulate(table, length, noise);
+    printf("\n%s, %u snapshots of %u slots\n", aoa_array_type_to_string(array_types[t]),
+           aoa_array_config.num_snapshots, aoa_array_config.num_array_elements);
+    passed &= validate(table, length);
+
+    printf("%-16s %12s %12s\n", "path", "reports/s", "us/report");
+    throughput(table, length, false, widest->name);
+    for (uint32_t v = 0; v < simd_variant_count(); v++) {
+      const simd_kernels_t *variant = simd_variant(v);
+      if (simd_select(variant->name) != SL_STATUS_OK) {
+        continue;
+      }
+      throughput(table, length, true, variant->name);
+    }
+    simd_select(widest->name);
+    spectrum_table_release(table);
+  }
+
+  free(reports);
+  free(directions);
+  return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,262 @@
+/***************************************************************************//**
+ * @file
+ * @brief Joint estimate over the channels against an estimate per report,
+ *        built with 'make bench_joint'.
+ *
+ * For every array type the simulator gives -n reports of a tag hopping over
+ * the 37 data channels, each report on a random channel at its frequency
+ * (CARRIER_FREQ of the simulator). The direct plane wave (make_I_Q_direction(),
+ * -s degrees of phase noise per sample) adds a reflection from another
+ * direction -r times its amplitude; both start at a random phase, so the
+ * reflection adds with another phase on every report, as a path a few meters
+ * longer does from one channel to the next. The directions are random and
+ * held for -d reports.
+ *
+ * Every report goes through aoa_calculate() of one estimator per
+ * configuration, in float and in Q15 (covariance.h), with a window of -w
+ * reports per channel:
+ *   report              an estimate per report, from the window of its channel
+ *   joint/<K>           covariance_joint_reports K of -j, an estimate every K
+ *                       reports over the windows of the last K channels
+ * A row prints the angles published, the CPU time of aoa_calculate() per
+ * report and per published angle, and the RMS and p95 error of the angles
+ * against the direct path.
+ ******************************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <math.h>
+
+#include "app_config.h"
+#include "aoa.h"
+#include "aoa_array.h"
+#include "covariance.h"
+#include "spectrum.h"
+#include "iq_qa.h"
+#include "simd_kernels.h"
+#include "Simulator_I_Q.h"
+#include "bench_util.h"
+
+#define USAGE "\nUsage: %s [-n <reports>] [-d <reports per direction>] [-s <phase noise deg>]\n" \
+              "          [-r <reflection amplitude>] [-w <covariance window>] [-j <K>[,<K>...]]\n"
+#define DEFAULT_JOINT     "2,4,8"
+#define MAX_CONFIGS       8
+#define ARRAY_TYPES       3
+#define DATA_CHANNELS     37
+#define MAX_ELEVATION     70.0f     // deg, of the URA directions
+#define REPORT_PERIOD_NS  20000000ull
+
+extern float CARRIER_FREQ;
+
+typedef struct {
+  float azimuth;
+  float elevation;
+} direction_t;
+
+typedef struct {
+  uint8_t channel;
+  int8_t samples[AOA_ARRAY_MAX_REPORT_LENGTH];
+} report_t;
+
+static report_t *reports;
+static direction_t *directions;     // of the direct path, per -d reports
+static float *errors;
+static uint32_t report_count = 4000;
+static uint32_t direction_reports = 100;
+
+static void random_direction(direction_t *direction, bool wraps)
+{
+  if (wraps) {
+    direction->azimuth = bench_uniform(0, 360.0f);
+    direction->elevation = bench_uniform(0, MAX_ELEVATION);
+  } else {
+    // Away from the row axis, where the ULA has no resolution
+    direction->azimuth = bench_uniform(10.0f, 170.0f);
+    direction->elevation = 0;
+  }
+}
+
+static void simulate(bool wraps, uint32_t length, float noise, float reflection)
+{
+  direction_t reflected = { 0, 0 };
+  int8_t direct[AOA_ARRAY_MAX_REPORT_LENGTH];
+
+  srand(12345);
+  for (uint32_t r = 0; r < report_count; r++) {
+    report_t *report = &reports[r];
+    const int8_t *path;
+    if (r % direction_reports == 0) {
+      random_direction(&directions[r / direction_reports], wraps);
+      random_direction(&reflected, wraps);
+    }
+    report->channel = (uint8_t)(rand() % DATA_CHANNELS);
+    CARRIER_FREQ = aoa_channel_frequency(report->channel) / 1e6f;
+    memcpy(direct, make_I_Q_direction(length, directions[r / direction_reports].azimuth,
+                                      directions[r / direction_reports].elevation, noise), length);
+    path = make_I_Q_direction(length, reflected.azimuth, reflected.elevation, noise);
+    for (uint32_t k = 0; k < length; k++) {
+      report->samples[k] = (int8_t)lrintf((direct[k] + reflection * path[k]) / (1.0f + reflection));
+    }
+  }
+  CARRIER_FREQ = SPECTRUM_FREQUENCY / 1e6f;
+}
+
+static void run(const char *arithmetic, uint32_t joint, uint32_t length)
+{
+  aoa_libitems_t aoa_state;
+  aoa_iq_report_t iq_report;
+  uint64_t elapsed_ns = 0;
+  double error_sum2 = 0;
+  uint32_t angles = 0;
+  char name[32];
+
+  covariance_joint_reports = joint;
+  aoa_init(&aoa_state);
+  memset(&iq_report, 0, sizeof(iq_report));
+  iq_report.rssi = -50;
+  iq_report.length = length;
+  for (uint32_t r = 0; r < report_count; r++) {
+    const direction_t *truth = &directions[r / direction_reports];
+    aoa_angle_t angle;
+    uint64_t t0;
+    sl_status_t sc;
+    // A new direction, the windows of the last one out
+    if ((r > 0) && (r % direction_reports == 0)) {
+      aoa_deinit(&aoa_state);
+      aoa_init(&aoa_state);
+    }
+    iq_report.channel = reports[r].channel;
+    iq_report.samples = reports[r].samples;
+    iq_report.event_counter = (uint16_t)r;
+    aoa_state.report_time_ns = 1000000000ull + r * REPORT_PERIOD_NS;
+    t0 = bench_monotonic_ns();
+    sc = aoa_calculate(&aoa_state, &iq_report, &angle);
+    elapsed_ns += bench_monotonic_ns() - t0;
+    if (sc != SL_STATUS_OK) {
+      continue;
+    }
+    errors[angles] = bench_angle_between(angle.azimuth, angle.elevation, truth->azimuth, truth->elevation);
+    error_sum2 += (double)errors[angles] * errors[angles];
+    angles++;
+  }
+  aoa_deinit(&aoa_state);
+  qsort(errors, angles, sizeof(float), bench_compare_float);
+
+  if (joint > 1) {
+    snprintf(name, sizeof(name), "%s/joint/%u", arithmetic, joint);
+  } else {
+    snprintf(name, sizeof(name), "%s/report", arithmetic);
+  }
+  fprintf(stderr, "%-16s %8u %10.1f %10.1f %10.2f %10.2f\n", name, angles,
+          elapsed_ns / 1000.0 / report_count, (angles > 0) ? elapsed_ns / 1000.0 / angles : 0.0,
+          (angles > 0) ? sqrt(error_sum2 / angles) : 0.0,
+          (angles > 0) ? errors[(uint32_t)(0.95 * (angles - 1))] : 0.0f);
+}
+
+int main(int argc, char *argv[])
+{
+  static const uint8_t array_types[ARRAY_TYPES] = {
+    ARRAY_TYPE_1x4_ULA, ARRAY_TYPE_3x3_URA, ARRAY_TYPE_4x4_URA
+  };
+  uint32_t joints[MAX_CONFIGS], joint_count = 0;
+  uint32_t window = 4;
+  float noise = 5.0f, reflection = 0.5f;
+  char joint_list[64] = DEFAULT_JOINT;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "n:d:s:r:w:j:h")) != -1) {
+    switch (opt) {
+      case 'n':
+        report_count = (uint32_t)atol(optarg);
+        break;
+      case 'd':
+        direction_reports = (uint32_t)atol(optarg);
+        break;
+      case 's':
+        noise = atof(optarg);
+        break;
+      case 'r':
+        reflection = atof(optarg);
+        break;
+      case 'w':
+        window = (uint32_t)atol(optarg);
+        break;
+      case 'j':
+        snprintf(joint_list, sizeof(joint_list), "%s", optarg);
+        break;
+      default:
+        fprintf(stderr, USAGE, argv[0]);
+        exit(opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+  }
+  if ((report_count == 0) || (direction_reports == 0) || (window == 0) || (window > COVARIANCE_MAX_WINDOW)
+      || (reflection < 0)) {
+    fprintf(stderr, USAGE, argv[0]);
+    exit(EXIT_FAILURE);
+  }
+  joints[joint_count++] = 1;
+  for (char *s = strtok(joint_list, ","); (s != NULL) && (joint_count < MAX_CONFIGS); s = strtok(NULL, ",")) {
+    joints[joint_count] = (uint32_t)atol(s);
+    if ((joints[joint_count] < 2) || (joints[joint_count] > SPECTRUM_MAX_JOINT)) {
+      fprintf(stderr, "Joint reports 2..%d\n", SPECTRUM_MAX_JOINT);
+      exit(EXIT_FAILURE);
+    }
+    joint_count++;
+  }
+
+  simd_init();
+  reports = malloc(report_count * sizeof(*reports));
+  directions = malloc((report_count / direction_reports + 1) * sizeof(*directions));
+  errors = malloc(report_count * sizeof(*errors));
+  if ((reports == NULL) || (directions == NULL) || (errors == NULL)) {
+    fprintf(stderr, "Out of memory, lower -n.\n");
+    exit(EXIT_FAILURE);
+  }
+  // The estimator logs on init, keep the console for the results.
+  if (freopen(NULL_DEVICE, "w", stdout) == NULL) {
+    fprintf(stderr, "Failed to silence stdout\n");
+  }
+  covariance_window = window;
+  // The reflection fades the amplitude the gate checks, the estimator sees
+  // every report
+  iq_qa_config.enabled = false;
+
+  fprintf(stderr, "%u reports, %u per direction, phase noise %.1f deg, reflection %.2f, window %u\n",
+          report_count, direction_reports, noise, reflection, window);
+  for (int t = 0; t < ARRAY_TYPES; t++) {
+    const spectrum_table_t *tables[SPECTRUM_BANDS];
+    uint32_t length;
+
+    aoa_array_set_type(&aoa_array_config, array_types[t]);
+    length = aoa_array_report_length(&aoa_array_config);
+    // Held across the estimators, built once
+    for (uint32_t b = 0; b < SPECTRUM_BANDS; b++) {
+      tables[b] = spectrum_table_acquire(&aoa_array_config, spectrum_band_frequency(b));
+      if (tables[b] == NULL) {
+        fprintf(stderr, "No steering table.\n");
+        exit(EXIT_FAILURE);
+      }
+    }
+    simulate(tables[0]->azimuth_wraps, length, noise, reflection);
+    fprintf(stderr, "\n%s\n", aoa_array_type_to_string(array_types[t]));
+    fprintf(stderr, "%-16s %8s %10s %10s %10s %10s\n",
+            "estimate", "angles", "us/report", "us/angle", "err rms", "err p95");
+    for (int fixed_point = 0; fixed_point < 2; fixed_point++) {
+      covariance_fixed_point = fixed_point;
+      for (uint32_t j = 0; j < joint_count; j++) {
+        run(fixed_point ? "q15" : "float", joints[j], length);
+      }
+    }
+    for (uint32_t b = 0; b < SPECTRUM_BANDS; b++) {
+      spectrum_table_release(tables[b]);
+    }
+  }
+
+  free(reports);
+  free(directions);
+  free(errors);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,212 @@
+/***************************************************************************//**
+ * @file
+ * @brief Accuracy and throughput of the positioning engine, built with
+ *        'make bench_position'.
+ *
+ * Simulates -l locators on the ceiling of a 10 x 10 x 3 m room, facing down,
+ * and -t tags walking at 1 m above the floor. Every round each locator gives
+ * the true angle to each tag plus gaussian noise of -s degrees; the engine
+ * takes the angles and solves all tags. Per SIMD kernel variant of solve3 it
+ * prints the angles/s taken, the tags/s solved and the RMS and p95 distance
+ * between solved and true positions.
+ ******************************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <math.h>
+
+#include "position.h"
+#include "simd_kernels.h"
+#include "bench_util.h"
+
+#define USAGE "\nUsage: %s [-t <tags>] [-l <locators>] [-n <rounds>] [-s <angle noise deg>]\n"
+#define ROOM_SIZE       10.0f
+#define CEILING         3.0f
+#define TAG_HEIGHT      1.0f
+#define WALK_STEP       0.05f     // m per round
+#define RAD_TO_DEG      57.29577951f
+
+typedef struct {
+  float position[3];
+  aoa_id_t id;
+} sim_tag_t;
+
+static sim_tag_t *tags;
+static aoa_angle_t *angles;
+static float *errors;
+static uint32_t error_count;
+static double error_sum2;
+static uint32_t seed = 12345;
+
+static float uniform(void)
+{
+  seed = seed * 1103515245u + 12345u;
+  return (float)((seed >> 8) & 0xFFFFFF) / 16777216.0f;
+}
+
+static float gaussian(void)
+{
+  float u = uniform() + 1e-7f, v = uniform();
+  return sqrtf(-2.0f * logf(u)) * cosf(6.2831853f * v);
+}
+
+// Noisy angle of a tag seen by a locator
+static void simulate_angle(const position_locator_t *locator, const float tag[3], float noise,
+                           aoa_angle_t *angle)
+{
+  float v[3], local[3];
+
+  for (int a = 0; a < 3; a++) {
+    v[a] = tag[a] - locator->coordinate[a];
+  }
+  // Room frame to locator frame, the transpose of the rotation
+  for (int a = 0; a < 3; a++) {
+    local[a] = locator->rotation[0][a] * v[0] + locator->rotation[1][a] * v[1] + locator->rotation[2][a] * v[2];
+  }
+  memset(angle, 0, sizeof(*angle));
+  angle->azimuth = atan2f(local[1], local[0]) * RAD_TO_DEG + noise * gaussian();
+  angle->elevation = atan2f(local[2], sqrtf(local[0] * local[0] + local[1] * local[1])) * RAD_TO_DEG
+                     + noise * gaussian();
+  angle->azimuth_stdev = noise;
+  angle->elevation_stdev = noise;
+  angle->distance = sqrtf(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+}
+
+static void on_position(const char *tag_id, const aoa_position_t *position)
+{
+  const sim_tag_t *tag = &tags[atol(tag_id + strlen("tag-"))];
+  float dx = position->x - tag->position[0];
+  float dy = position->y - tag->position[1];
+  float dz = position->z - tag->position[2];
+  float error = sqrtf(dx * dx + dy * dy + dz * dz);
+
+  errors[error_count++] = error;
+  error_sum2 += (double)error * error;
+}
+
+static void add_locators(position_engine_t *engine, uint32_t locator_count)
+{
+  for (uint32_t l = 0; l < locator_count; l++) {
+    // On a circle around the room center, facing down
+    float phi = 6.2831853f * l / locator_count + 0.785398f;
+    float coordinate[3] = {
+      ROOM_SIZE / 2 + 0.45f * ROOM_SIZE * cosf(phi),
+      ROOM_SIZE / 2 + 0.45f * ROOM_SIZE * sinf(phi),
+      CEILING
+    };
+    float orientation[3] = { 0, 180.0f, 0 };
+    char id[32];
+    snprintf(id, sizeof(id), "locator-%u", l);
+    position_add_locator(engine, id, coordinate, orientation);
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  uint32_t tag_count = 1000, locator_count = 4, rounds = 20;
+  float noise = 2.0f;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "t:l:n:s:h")) != -1) {
+    switch (opt) {
+      case 't':
+        tag_count = (uint32_t)atol(optarg);
+        break;
+      case 'l':
+        locator_count = (uint32_t)atol(optarg);
+        break;
+      case 'n':
+        rounds = (uint32_t)atol(optarg);
+        break;
+      case 's':
+        noise = atof(optarg);
+        break;
+      default:
+        fprintf(stderr, USAGE, argv[0]);
+        exit(opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+  }
+  if ((tag_count == 0) || (locator_count < 2) || (locator_count > POSITION_MAX_LOCATORS) || (rounds == 0)) {
+    fprintf(stderr, USAGE, argv[0]);
+    exit(EXIT_FAILURE);
+  }
+
+  tags = malloc(tag_count * sizeof(*tags));
+  angles = malloc((size_t)tag_count * locator_count * sizeof(*angles));
+  errors = malloc((size_t)tag_count * rounds * sizeof(*errors));
+  if ((tags == NULL) || (angles == NULL) || (errors == NULL)) {
+    fprintf(stderr, "Out of memory, lower -t or -n.\n");
+    exit(EXIT_FAILURE);
+  }
+
+  printf("%u tags, %u locators, %u rounds, angle noise %.1f deg\n", tag_count, locator_count, rounds, noise);
+  printf("%-8s %14s %14s %10s %10s\n", "kernels", "angles/s", "tags/s", "rms m", "p95 m");
+  for (uint32_t v = 0; v < simd_variant_count(); v++) {
+    const simd_kernels_t *variant = simd_variant(v);
+    position_engine_t engine;
+    double add_s = 0, solve_s = 0;
+    uint32_t solved = 0;
+
+    if (!variant->supported()) {
+      continue;
+    }
+    simd_select(variant->name);
+    if (position_init(&engine, tag_count) != SL_STATUS_OK) {
+      fprintf(stderr, "Positioning engine init failed.\n");
+      exit(EXIT_FAILURE);
+    }
+    add_locators(&engine, locator_count);
+    // Same walk for every variant
+    seed = 12345;
+    for (uint32_t t = 0; t < tag_count; t++) {
+      tags[t].position[0] = ROOM_SIZE * uniform();
+      tags[t].position[1] = ROOM_SIZE * uniform();
+      tags[t].position[2] = TAG_HEIGHT;
+      snprintf(tags[t].id, sizeof(tags[t].id), "tag-%u", t);
+    }
+    error_count = 0;
+    error_sum2 = 0;
+
+    for (uint32_t r = 0; r < rounds; r++) {
+      uint64_t now_ns = 1000000000ull + r * 20000000ull;
+      double t0;
+      for (uint32_t l = 0; l < locator_count; l++) {
+        for (uint32_t t = 0; t < tag_count; t++) {
+          simulate_angle(&engine.locators[l], tags[t].position, noise, &angles[l * tag_count + t]);
+        }
+      }
+      // The angles of a round arrive locator by locator
+      t0 = bench_monotonic_s();
+      for (uint32_t l = 0; l < locator_count; l++) {
+        for (uint32_t t = 0; t < tag_count; t++) {
+          position_add_angle(&engine, l, tags[t].id, &angles[l * tag_count + t], now_ns);
+        }
+      }
+      add_s += bench_monotonic_s() - t0;
+      t0 = bench_monotonic_s();
+      solved += position_solve(&engine, now_ns, on_position);
+      solve_s += bench_monotonic_s() - t0;
+      for (uint32_t t = 0; t < tag_count; t++) {
+        for (int a = 0; a < 2; a++) {
+          float p = tags[t].position[a] + WALK_STEP * (2.0f * uniform() - 1.0f);
+          tags[t].position[a] = (p < 0) ? 0 : (p > ROOM_SIZE) ? ROOM_SIZE : p;
+        }
+      }
+    }
+
+    qsort(errors, error_count, sizeof(float), bench_compare_float);
+    printf("%-8s %14.0f %14.0f %10.3f %10.3f\n", variant->name,
+           (double)tag_count * locator_count * rounds / add_s, solved / solve_s,
+           (error_count > 0) ? sqrt(error_sum2 / error_count) : 0.0,
+           (error_count > 0) ? errors[(uint32_t)(0.95 * (error_count - 1))] : 0.0f);
+    position_deinit(&engine);
+  }
+
+  free(tags);
+  free(angles);
+  free(errors);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,253 @@
+/***************************************************************************//**
+ * @file
+ * @brief Accuracy against cost of the spectrum search of the covariance
+ *        estimator, built with 'make bench_spectrum'.
+ *
+ * For every array type the simulator gives -n reports of plane waves from
+ * random directions with -s degrees of phase noise per sample
+ * (make_I_Q_direction()); each direction is the covariance of a window of -w
+ * such reports. Every search then estimates all directions: the full sweep
+ * (stride 1) and the coarse to fine searches of the strides of -c, with 1 and
+ * 2 peaks, without and with the azimuth mask -m (the directions are drawn
+ * outside of it). A row prints the spectrum points and the time per
+ * estimate, the RMS and p95 error, the angle between the estimated and the
+ * true direction, and the share of lost peaks, estimates more than LOST_DEG
+ * off the estimate of the unmasked full sweep (the search took another lobe,
+ * or the mask removed the peak); the rows of the strides are the curve of
+ * accuracy against cost.
+ ******************************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <math.h>
+
+#include "app_config.h"
+#include "aoa.h"
+#include "aoa_array.h"
+#include "covariance.h"
+#include "spectrum.h"
+#include "simd_kernels.h"
+#include "Simulator_I_Q.h"
+#include "bench_util.h"
+
+#define USAGE "\nUsage: %s [-n <directions>] [-s <phase noise deg>] [-w <covariance window>]\n" \
+              "          [-c <stride>[,<stride>...]] [-m <masked azimuth min>:<max>]\n"
+#define DEFAULT_STRIDES   "2,4,8"
+#define MAX_STRIDES       8
+#define LOST_DEG          5.0f
+#define ARRAY_TYPES       3
+#define MAX_ELEVATION     70.0f     // deg, of the URA directions
+
+extern float REFERENCE_SAMPL_RATE;
+extern float SAMPLING_RATE;
+
+typedef struct {
+  float azimuth;
+  float elevation;
+} direction_t;
+
+static direction_t *directions;
+static direction_t *full_sweep;     // estimates of the full sweep, unmasked
+static float *covariances;          // per direction
+static float *errors;
+static uint32_t direction_count = 500;
+
+static bool masked(float azimuth, float mask_min, float mask_max)
+{
+  if (isnan(mask_min) || isnan(mask_max)) {
+    return false;
+  }
+  return (mask_min <= mask_max) ? ((azimuth >= mask_min) && (azimuth <= mask_max))
+         : ((azimuth >= mask_min) || (azimuth <= mask_max));
+}
+
+// Directions outside of the mask and the covariance of each
+static void simulate(const spectrum_table_t *table, uint32_t window, float noise, float mask_min, float mask_max)
+{
+  const aoa_array_config_t *array = &aoa_array_config;
+  aoa_array_kernel_t kernel = aoa_array_get_kernel(array);
+  uint32_t floats = 2 * table->elements * table->elements;
+  uint32_t length = aoa_array_report_length(array);
+  float ref_i[AOA_ARRAY_MAX_REPORT_LENGTH], ref_q[AOA_ARRAY_MAX_REPORT_LENGTH];
+  float **i_samples = malloc(array->num_snapshots * sizeof(float *));
+  float **q_samples = malloc(array->num_snapshots * sizeof(float *));
+
+  for (uint32_t s = 0; s < array->num_snapshots; s++) {
+    i_samples[s] = malloc(array->num_array_elements * sizeof(float));
+    q_samples[s] = malloc(array->num_array_elements * sizeof(float));
+  }
+  srand(12345);
+  for (uint32_t d = 0; d < direction_count; d++) {
+    direction_t *direction = &directions[d];
+    covariance_t covariance;
+    uint32_t reports;
+
+    do {
+      if (table->azimuth_wraps) {
+        direction->azimuth = bench_uniform(0, 360.0f);
+        direction->elevation = bench_uniform(0, MAX_ELEVATION);
+      } else {
+        // Away from the row axis, where the ULA has no resolution
+        direction->azimuth = bench_uniform(10.0f, 170.0f);
+        direction->elevation = 0;
+      }
+    } while (masked(direction->azimuth, mask_min, mask_max));
+
+    covariance_init(&covariance, table->elements, window, 0, false);
+    for (uint32_t r = 0; r < window; r++) {
+      const int8_t *samples = make_I_Q_direction(length, direction->azimuth, direction->elevation, noise);
+      kernel.copy_samples(array, samples, ref_i, ref_q, i_samples, q_samples);
+      covariance_update(&covariance, 0, i_samples, q_samples, array->num_snapshots,
+                        spectrum_slot_rotation(ref_i, ref_q, array->ref_period_samples,
+                                               SAMPLING_RATE / REFERENCE_SAMPL_RATE),
+                        1000000000ull + r * 20000000ull);
+    }
+    memcpy(&covariances[(size_t)d * floats], covariance_get(&covariance, 0, &reports), floats * sizeof(float));
+    covariance_deinit(&covariance);
+  }
+  for (uint32_t s = 0; s < array->num_snapshots; s++) {
+    free(i_samples[s]);
+    free(q_samples[s]);
+  }
+  free(i_samples);
+  free(q_samples);
+}
+
+static void run(const spectrum_table_t *table, uint32_t stride, uint32_t peaks, float mask_min, float mask_max)
+{
+  uint32_t floats = 2 * table->elements * table->elements;
+  bool reference = (stride == 1) && isnan(mask_min);
+  spectrum_search_t search;
+  uint64_t points = 0, elapsed_ns = 0;
+  double error_sum2 = 0;
+  uint32_t estimated = 0, lost = 0;
+  char name[32];
+
+  spectrum_search_init(&search, table, mask_min, mask_max, stride, peaks);
+  for (uint32_t d = 0; d < direction_count; d++) {
+    float azimuth, elevation, error;
+    uint64_t t0 = bench_monotonic_ns();
+    sl_status_t sc = spectrum_estimate(table, &search, &covariances[(size_t)d * floats], &azimuth, &elevation);
+    elapsed_ns += bench_monotonic_ns() - t0;
+    points += search.points;
+    if (sc != SL_STATUS_OK) {
+      azimuth = elevation = NAN;
+    }
+    if (reference) {
+      full_sweep[d].azimuth = azimuth;
+      full_sweep[d].elevation = elevation;
+    } else if (!(bench_angle_between(azimuth, elevation, full_sweep[d].azimuth, full_sweep[d].elevation) <= LOST_DEG)) {
+      lost++;
+    }
+    if (sc != SL_STATUS_OK) {
+      continue;
+    }
+    error = bench_angle_between(azimuth, elevation, directions[d].azimuth, directions[d].elevation);
+    errors[estimated++] = error;
+    error_sum2 += (double)error * error;
+  }
+  qsort(errors, estimated, sizeof(float), bench_compare_float);
+
+  snprintf(name, sizeof(name), "%s/%u/%u", isnan(mask_min) ? "full" : "masked", stride, peaks);
+  printf("%-16s %8.0f %10.1f %10.2f %10.2f %8.1f\n", name,
+         (double)points / direction_count, (double)elapsed_ns / 1000.0 / direction_count,
+         (estimated > 0) ? sqrt(error_sum2 / estimated) : 0.0,
+         (estimated > 0) ? errors[(uint32_t)(0.95 * (estimated - 1))] : 0.0f,
+         100.0 * lost / direction_count);
+}
+
+int main(int argc, char *argv[])
+{
+  static const uint8_t array_types[ARRAY_TYPES] = {
+    ARRAY_TYPE_1x4_ULA, ARRAY_TYPE_3x3_URA, ARRAY_TYPE_4x4_URA
+  };
+  uint32_t strides[MAX_STRIDES], stride_count = 0;
+  uint32_t window = 1;
+  float noise = 5.0f, mask_min = 120.0f, mask_max = 240.0f;
+  char stride_list[64] = DEFAULT_STRIDES;
+  char *sep;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "n:s:w:c:m:h")) != -1) {
+    switch (opt) {
+      case 'n':
+        direction_count = (uint32_t)atol(optarg);
+        break;
+      case 's':
+        noise = atof(optarg);
+        break;
+      case 'w':
+        window = (uint32_t)atol(optarg);
+        break;
+      case 'c':
+        strncpy(stride_list, optarg, sizeof(stride_list) - 1);
+        break;
+      case 'm':
+        sep = strchr(optarg, ':');
+        if (sep == NULL) {
+          fprintf(stderr, USAGE, argv[0]);
+          exit(EXIT_FAILURE);
+        }
+        *sep = '\0';
+        mask_min = atof(optarg);
+        mask_max = atof(sep + 1);
+        break;
+      default:
+        fprintf(stderr, USAGE, argv[0]);
+        exit(opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+  }
+  if ((direction_count == 0) || (window == 0) || (window > COVARIANCE_MAX_WINDOW)) {
+    fprintf(stderr, USAGE, argv[0]);
+    exit(EXIT_FAILURE);
+  }
+  strides[stride_count++] = 1;
+  for (char *s = strtok(stride_list, ","); (s != NULL) && (stride_count < MAX_STRIDES); s = strtok(NULL, ",")) {
+    strides[stride_count++] = (uint32_t)atol(s);
+  }
+
+  simd_init();
+  directions = malloc(direction_count * sizeof(*directions));
+  full_sweep = malloc(direction_count * sizeof(*full_sweep));
+  covariances = malloc((size_t)direction_count * 2 * AOA_ARRAY_MAX_ELEMENTS * AOA_ARRAY_MAX_ELEMENTS * sizeof(float));
+  errors = malloc(direction_count * sizeof(*errors));
+  if ((directions == NULL) || (full_sweep == NULL) || (covariances == NULL) || (errors == NULL)) {
+    fprintf(stderr, "Out of memory, lower -n.\n");
+    exit(EXIT_FAILURE);
+  }
+
+  printf("%u directions, phase noise %.1f deg, window %u, azimuth mask %.0f..%.0f deg\n",
+         direction_count, noise, window, mask_min, mask_max);
+  for (int t = 0; t < ARRAY_TYPES; t++) {
+    const spectrum_table_t *table;
+
+    aoa_array_set_type(&aoa_array_config, array_types[t]);
+    table = spectrum_table_acquire(&aoa_array_config, SPECTRUM_FREQUENCY);
+    if (table == NULL) {
+      fprintf(stderr, "No steering table.\n");
+      exit(EXIT_FAILURE);
+    }
+    simulate(table, window, noise, mask_min, mask_max);
+    printf("\n%s, grid %u x %u\n", aoa_array_type_to_string(array_types[t]),
+           table->azimuth_steps, table->elevation_steps);
+    printf("%-16s %8s %10s %10s %10s %8s\n",
+           "search", "points", "us", "err rms", "err p95", "lost %");
+    for (int m = 0; m < 2; m++) {
+      for (uint32_t s = 0; s < stride_count; s++) {
+        for (uint32_t peaks = 1; peaks <= ((strides[s] > 1) ? 2 : 1); peaks++) {
+          run(table, strides[s], peaks, m ? mask_min : NAN, m ? mask_max : NAN);
+        }
+      }
+    }
+    spectrum_table_release(table);
+  }
+
+  free(directions);
+  free(full_sweep);
+  free(covariances);
+  free(errors);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,233 @@
+/***************************************************************************//**
+ * @file
+ * @brief CPU per tag and angular error of the estimator modes, with and
+ *        without the angle tracking filter, built with 'make bench_tracker'.
+ *
+ * One simulated tag sweeps back and forth: the phase shift per antenna of the
+ * simulated reports follows a sine of -w degrees over a period of -p seconds,
+ * at -r reports/s. Every report goes through one estimator per configuration:
+ *   reference           REAL_TIME_HIGH_ACCURACY, unfiltered
+ *   <mode>              each mode of -m, unfiltered
+ *   <mode>+track        each mode of -m with the tracking filter (-F), the
+ *                       prediction for reports without an estimate
+ * and the angles of a configuration are compared with the reference angle of
+ * the same report: RMS and p95 azimuth error, and the jitter, the RMS change
+ * of the azimuth from one report to the next. The CPU time is that of
+ * aoa_calculate() and aoa_predict() per report.
+ ******************************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <math.h>
+
+#include "app_config.h"
+#include "aoa.h"
+#include "aoa_array.h"
+#include "simd_kernels.h"
+#include "Simulator_I_Q.h"
+#include "bench_util.h"
+
+#define USAGE "\nUsage: %s [-n <reports>] [-r <reports/s>] [-w <phase shift deg>] [-p <period s>]\n" \
+              "          [-m <mode>[,<mode>...]] [-F <angle motion deg/s^2>[:<noise deg>]] [-a <array type>]\n"
+#define DEFAULT_MODES     "REAL_TIME_FAST_RESPONSE,REAL_TIME_BASIC,ONE_SHOT_FAST_RESPONSE"
+#define REFERENCE_MODE    SL_RTL_AOX_MODE_REAL_TIME_HIGH_ACCURACY
+#define MAX_CONFIGS       16
+
+typedef struct {
+  char name[64];
+  aoa_libitems_t aoa_state;
+  uint64_t cpu_ns;
+  uint32_t angles;
+  uint32_t compared;
+  float *errors;
+  double error_sum2;
+  double jitter_sum2;
+  uint32_t jitter_count;
+  bool has_last;
+  float last_azimuth;
+  // Angle of the report in progress
+  bool valid;
+  aoa_angle_t angle;
+} tracker_config_t;
+
+static tracker_config_t configs[MAX_CONFIGS];
+static uint32_t config_count;
+
+static float azimuth_difference(float a, float b)
+{
+  float d = fmodf(a - b, 360.0f);
+
+  if (d >= 180.0f) {
+    d -= 360.0f;
+  } else if (d < -180.0f) {
+    d += 360.0f;
+  }
+  return d;
+}
+
+static void add_config(enum sl_rtl_aox_mode mode, bool track, float motion, uint32_t reports)
+{
+  tracker_config_t *c;
+
+  if (config_count == MAX_CONFIGS) {
+    fprintf(stderr, "At most %d configurations.\n", MAX_CONFIGS);
+    exit(EXIT_FAILURE);
+  }
+  c = &configs[config_count++];
+  snprintf(c->name, sizeof(c->name), "%s%s", aoa_aox_mode_to_string(mode) + strlen("SL_RTL_AOX_MODE_"),
+           track ? "+track" : "");
+  c->errors = malloc(reports * sizeof(*c->errors));
+  if (c->errors == NULL) {
+    fprintf(stderr, "Out of memory, lower -n.\n");
+    exit(EXIT_FAILURE);
+  }
+  aoa_aox_mode = mode;
+  angle_tracker_motion = track ? motion : 0.0f;
+  aoa_init(&c->aoa_state);
+}
+
+static void run_report(tracker_config_t *c, aoa_iq_report_t *iq_report, uint64_t time_ns)
+{
+  uint64_t t0 = bench_monotonic_ns();
+
+  c->aoa_state.report_time_ns = time_ns;
+  c->valid = (aoa_calculate(&c->aoa_state, iq_report, &c->angle) == SL_STATUS_OK)
+             || (aoa_predict(&c->aoa_state, iq_report, &c->angle) == SL_STATUS_OK);
+  c->cpu_ns += bench_monotonic_ns() - t0;
+  if (!c->valid) {
+    return;
+  }
+  c->angles++;
+  if (c->has_last) {
+    float step = azimuth_difference(c->angle.azimuth, c->last_azimuth);
+    c->jitter_sum2 += step * step;
+    c->jitter_count++;
+  }
+  c->has_last = true;
+  c->last_azimuth = c->angle.azimuth;
+}
+
+static void compare(tracker_config_t *c, const tracker_config_t *reference)
+{
+  float error;
+
+  if (!c->valid || !reference->valid) {
+    return;
+  }
+  error = fabsf(azimuth_difference(c->angle.azimuth, reference->angle.azimuth));
+  c->errors[c->compared++] = error;
+  c->error_sum2 += (double)error * error;
+}
+
+int main(int argc, char *argv[])
+{
+  uint32_t reports = 3000;
+  double rate = 50.0, sweep_deg = 60.0, period_s = 20.0;
+  float motion = ANGLE_TRACKER_DEFAULT_MOTION;
+  char modes[256] = DEFAULT_MODES;
+  static int8_t samples[AOA_ARRAY_MAX_REPORT_LENGTH + 1];
+  aoa_iq_report_t iq_report;
+  uint8_t array_type;
+  char *sep, *name;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "n:r:w:p:m:F:a:h")) != -1) {
+    switch (opt) {
+      case 'n':
+        reports = (uint32_t)atol(optarg);
+        break;
+      case 'r':
+        rate = atof(optarg);
+        break;
+      case 'w':
+        sweep_deg = atof(optarg);
+        break;
+      case 'p':
+        period_s = atof(optarg);
+        break;
+      case 'm':
+        snprintf(modes, sizeof(modes), "%s", optarg);
+        break;
+      case 'F':
+        sep = strchr(optarg, ':');
+        if (sep != NULL) {
+          *sep = '\0';
+          angle_tracker_noise = atof(sep + 1);
+        }
+        motion = atof(optarg);
+        break;
+      case 'a':
+        if (aoa_array_type_from_string(optarg, &array_type) != SL_STATUS_OK) {
+          fprintf(stderr, "Unknown array type '%s'\n", optarg);
+          exit(EXIT_FAILURE);
+        }
+        aoa_array_set_type(&aoa_array_config, array_type);
+        break;
+      default:
+        fprintf(stderr, USAGE, argv[0]);
+        exit(opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+  }
+  if ((reports < 2) || (rate <= 0) || (period_s <= 0) || (motion <= 0)) {
+    fprintf(stderr, USAGE, argv[0]);
+    exit(EXIT_FAILURE);
+  }
+
+  simd_init();
+  // The estimator logs every report, keep the console for the results.
+  if (freopen(NULL_DEVICE, "w", stdout) == NULL) {
+    fprintf(stderr, "Failed to silence stdout\n");
+  }
+
+  add_config(REFERENCE_MODE, false, motion, reports);
+  snprintf(configs[0].name, sizeof(configs[0].name), "reference");
+  for (name = strtok(modes, ","); name != NULL; name = strtok(NULL, ",")) {
+    enum sl_rtl_aox_mode mode;
+    if (aoa_aox_mode_from_string(name, &mode) != SL_STATUS_OK) {
+      fprintf(stderr, "Unknown estimator mode '%s'\n", name);
+      exit(EXIT_FAILURE);
+    }
+    add_config(mode, false, motion, reports);
+    add_config(mode, true, motion, reports);
+  }
+
+  iq_report.channel = 17;
+  iq_report.rssi = -50;
+  iq_report.length = aoa_array_report_length(&aoa_array_config);
+  iq_report.samples = samples;
+  for (uint32_t n = 0; n < reports; n++) {
+    double t = n / rate;
+    uint64_t time_ns = 1000000000ull + (uint64_t)(t * 1e9);
+    float shift = (float)(sweep_deg * sin(2.0 * M_PI * t / period_s));
+
+    memcpy(samples, make_I_Q(iq_report.length, shift), iq_report.length);
+    iq_report.event_counter = (uint16_t)n;
+    for (uint32_t c = 0; c < config_count; c++) {
+      run_report(&configs[c], &iq_report, time_ns);
+    }
+    for (uint32_t c = 1; c < config_count; c++) {
+      compare(&configs[c], &configs[0]);
+    }
+  }
+
+  fprintf(stderr, "%u reports at %.0f/s, %s, sweep +-%.0f deg phase shift over %.0f s, tracking %.0f deg/s^2 %.1f deg\n",
+          reports, rate, aoa_array_type_to_string(aoa_array_config.array_type), sweep_deg, period_s,
+          motion, angle_tracker_noise);
+  fprintf(stderr, "%-40s %10s %8s %10s %10s %10s\n",
+          "configuration", "us/report", "angles%", "rms deg", "p95 deg", "jitter deg");
+  for (uint32_t c = 0; c < config_count; c++) {
+    tracker_config_t *config = &configs[c];
+    qsort(config->errors, config->compared, sizeof(float), bench_compare_float);
+    fprintf(stderr, "%-40s %10.2f %8.1f %10.2f %10.2f %10.2f\n", config->name,
+            config->cpu_ns / 1e3 / reports, 100.0 * config->angles / reports,
+            (config->compared > 0) ? sqrt(config->error_sum2 / config->compared) : 0.0,
+            (config->compared > 0) ? config->errors[(uint32_t)(0.95 * (config->compared - 1))] : 0.0f,
+            (config->jitter_count > 0) ? sqrt(config->jitter_sum2 / config->jitter_count) : 0.0);
+    aoa_deinit(&config->aoa_state);
+    free(config->errors);
+  }
+  return EXIT_SUCCESS;
+}
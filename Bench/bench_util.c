@@ -0,0 +1,51 @@
+/***************************************************************************//**
+ * @file
+ * @brief Helpers shared by the benchmarks: clocks, random directions and
+ *        angle errors.
+ ******************************************************************************/
+
+#include <stdlib.h>
+#include <time.h>
+#include <math.h>
+
+#include "bench_util.h"
+
+/***************************************************************************************************
+ * Public Function Definitions
+ **************************************************************************************************/
+
+double bench_monotonic_s(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+uint64_t bench_monotonic_ns(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+int bench_compare_float(const void *a, const void *b)
+{
+  float x = *(const float *)a, y = *(const float *)b;
+  return (x > y) - (x < y);
+}
+
+float bench_uniform(float min, float max)
+{
+  return min + (max - min) * (rand() / (RAND_MAX + 1.0f));
+}
+
+float bench_angle_between(float azimuth1, float elevation1, float azimuth2, float elevation2)
+{
+  float a1 = azimuth1 * 0.017453292f, e1 = elevation1 * 0.017453292f;
+  float a2 = azimuth2 * 0.017453292f, e2 = elevation2 * 0.017453292f;
+  float c = cosf(e1) * cosf(e2) * cosf(a1 - a2) + sinf(e1) * sinf(e2);
+
+  return acosf((c > 1.0f) ? 1.0f : (c < -1.0f) ? -1.0f : c) * 57.29577951f;
+}
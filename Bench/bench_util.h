@@ -0,0 +1,43 @@
+/***************************************************************************//**
+ * @file
+ * @brief Helpers shared by the benchmarks: clocks, random directions and
+ *        angle errors.
+ ******************************************************************************/
+
+#ifndef BENCH_UTIL_H_
+#define BENCH_UTIL_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef _WIN32
+#define NULL_DEVICE "NUL"
+#else
+#define NULL_DEVICE "/dev/null"
+#endif
+
+/***************************************************************************************************
+ * Function Declarations
+ **************************************************************************************************/
+
+// Monotonic clock, s and ns
+double bench_monotonic_s(void);
+uint64_t bench_monotonic_ns(void);
+
+// qsort() comparison of floats, ascending
+int bench_compare_float(const void *a, const void *b);
+
+// Uniform in [min, max) from rand(), seeded by the caller
+float bench_uniform(float min, float max);
+
+// Angle between two directions, all in deg
+float bench_angle_between(float azimuth1, float elevation1, float azimuth2, float elevation2);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* BENCH_UTIL_H_ */
@@ -0,0 +1,222 @@
+/***************************************************************************//**
+ * @file
+ * @brief Estimator mode governor, trades the accuracy of the tags for CPU
+ *        when the load is above the estimation budget.
+ ******************************************************************************/
+
+#include <string.h>
+
+#include "app_config.h"
+#include "governor.h"
+#include "conn.h"
+#include "log_level.h"
+
+typedef struct {
+  enum sl_rtl_aox_mode mode;
+  uint32_t divisor;             // of the snapshots of a report
+} governor_level_t;
+
+/***************************************************************************************************
+ * Static Variables
+ **************************************************************************************************/
+
+static const governor_level_t levels[GOVERNOR_LEVELS] = {
+  { SL_RTL_AOX_MODE_REAL_TIME_HIGH_ACCURACY, 1 },
+  { SL_RTL_AOX_MODE_REAL_TIME_BASIC, 1 },
+  { SL_RTL_AOX_MODE_REAL_TIME_FAST_RESPONSE, 1 },
+  { SL_RTL_AOX_MODE_REAL_TIME_FAST_RESPONSE, 2 },
+  { SL_RTL_AOX_MODE_REAL_TIME_FAST_RESPONSE, 4 },
+};
+
+static uint64_t period_start_ns;
+static uint64_t period_busy_ns;
+static double load;
+static double level_cost_ns[GOVERNOR_LEVELS];   // per report, moving average over all tags
+static uint64_t level_reports[GOVERNOR_LEVELS];
+static uint64_t level_sum_ns[GOVERNOR_LEVELS];  // of the period
+
+/***************************************************************************************************
+ * Public Variables
+ **************************************************************************************************/
+
+double governor_budget;
+
+/***************************************************************************************************
+ * Static Function Definitions
+ **************************************************************************************************/
+
+static inline double ewma(double average, double value)
+{
+  return (average > 0) ? average + GOVERNOR_EWMA * (value - average) : value;
+}
+
+// Cost of a level over the one above it, the default while either is unknown
+static double level_ratio(uint32_t level)
+{
+  if ((level == 0) || (level >= GOVERNOR_LEVELS)
+      || (level_cost_ns[level] <= 0) || (level_cost_ns[level - 1] <= 0)) {
+    return 1.0 - GOVERNOR_DEFAULT_SAVING;
+  }
+  return level_cost_ns[level] / level_cost_ns[level - 1];
+}
+
+static void set_level(conn_properties_t *conn, uint32_t level)
+{
+  aoa_libitems_t *aoa_state = &conn->aoa_states;
+  uint32_t snapshots = aoa_state->array.num_snapshots / levels[level].divisor;
+
+  conn->governor.hold = GOVERNOR_HOLD_PERIODS;
+  if (aoa_set_estimator(aoa_state, levels[level].mode, (snapshots > 0) ? snapshots : 1) != SL_STATUS_OK) {
+    return;
+  }
+  log_info("Tag %02x:%02x governor level %u -> %u\n", conn->address.addr[1], conn->address.addr[0],
+           conn->governor.level, level);
+  __atomic_store_n(&conn->governor.level, level, __ATOMIC_RELAXED);
+  __atomic_store_n(&conn->governor.switches, conn->governor.switches + 1, __ATOMIC_RELAXED);
+}
+
+// Tags of the largest shares down a level until the expected saving covers
+// the excess load
+static void degrade(conn_properties_t **tags, uint32_t n, double excess)
+{
+  while (excess > 0) {
+    conn_properties_t *heaviest = NULL;
+    for (uint32_t k = 0; k < n; k++) {
+      governor_tag_t *t = &tags[k]->governor;
+      if ((t->hold == 0) && (t->level + 1 < GOVERNOR_LEVELS)
+          && ((heaviest == NULL) || (t->share > heaviest->governor.share))) {
+        heaviest = tags[k];
+      }
+    }
+    if (heaviest == NULL) {
+      return;
+    }
+    excess -= heaviest->governor.share * (1.0 - level_ratio(heaviest->governor.level + 1));
+    set_level(heaviest, heaviest->governor.level + 1);
+  }
+}
+
+// The tag at the cheapest level, the smallest share first, up one if the
+// load stays within the headroom
+static void upgrade(conn_properties_t **tags, uint32_t n)
+{
+  conn_properties_t *cheapest = NULL;
+
+  for (uint32_t k = 0; k < n; k++) {
+    governor_tag_t *t = &tags[k]->governor;
+    if ((t->hold == 0) && (t->level > 0)
+        && ((cheapest == NULL) || (t->level > cheapest->governor.level)
+            || ((t->level == cheapest->governor.level) && (t->share < cheapest->governor.share)))) {
+      cheapest = tags[k];
+    }
+  }
+  if ((cheapest != NULL)
+      && (load + cheapest->governor.share * (1.0 / level_ratio(cheapest->governor.level) - 1.0)
+          < governor_budget * GOVERNOR_UPGRADE_HEADROOM)) {
+    set_level(cheapest, cheapest->governor.level - 1);
+  }
+}
+
+// Load and shares of the period, then the levels
+static void update_levels(uint64_t now)
+{
+  conn_properties_t *tags[AOA_MAX_TAGS];
+  conn_properties_t *conn;
+  double dt = (double)(now - period_start_ns);
+  double value = ewma(load, period_busy_ns / dt);
+  uint32_t n = 0, queued = 0;
+
+  period_start_ns = now;
+  __atomic_store(&load, &value, __ATOMIC_RELAXED);
+  period_busy_ns = 0;
+  for (uint32_t l = 0; l < GOVERNOR_LEVELS; l++) {
+    if (level_reports[l] > 0) {
+      level_cost_ns[l] = ewma(level_cost_ns[l], (double)level_sum_ns[l] / level_reports[l]);
+    }
+    level_reports[l] = 0;
+    level_sum_ns[l] = 0;
+  }
+  for (uint8_t i = 0; ((conn = get_connection_by_index(i)) != NULL) && (n < AOA_MAX_TAGS); i++) {
+    governor_tag_t *t = &conn->governor;
+    t->share = ewma(t->share, t->period_ns / dt);
+    t->period_ns = 0;
+    if (t->hold > 0) {
+      t->hold--;
+    }
+    queued += conn->mailbox.count;
+    tags[n++] = conn;
+  }
+
+  if (load > governor_budget) {
+    degrade(tags, n, load - governor_budget);
+  } else if (queued > GOVERNOR_QUEUE_HIGH) {
+    degrade(tags, n, load * GOVERNOR_QUEUE_SHED);
+  } else if (queued <= GOVERNOR_QUEUE_LOW) {
+    upgrade(tags, n);
+  }
+}
+
+/***************************************************************************************************
+ * Public Function Definitions
+ **************************************************************************************************/
+
+void governor_tag_init(governor_tag_t *tag, aoa_libitems_t *aoa_state)
+{
+  uint32_t level = 1;
+
+  memset(tag, 0, sizeof(*tag));
+  for (uint32_t l = 0; l < GOVERNOR_LEVELS; l++) {
+    if ((levels[l].mode == aoa_state->aox_mode) && (levels[l].divisor == 1)) {
+      level = l;
+      break;
+    }
+  }
+  tag->level = level;
+  if (governor_budget > 0) {
+    aoa_set_estimator(aoa_state, levels[level].mode, aoa_state->array.num_snapshots);
+  }
+}
+
+void governor_account(governor_tag_t *tag, uint64_t now, uint64_t cost_ns)
+{
+  if (governor_budget <= 0) {
+    return;
+  }
+  tag->period_ns += cost_ns;
+  period_busy_ns += cost_ns;
+  level_reports[tag->level]++;
+  level_sum_ns[tag->level] += cost_ns;
+  if (period_start_ns == 0) {
+    period_start_ns = now;
+  } else if (now - period_start_ns >= GOVERNOR_PERIOD_MS * 1000000ull) {
+    update_levels(now);
+  }
+}
+
+enum sl_rtl_aox_mode governor_level_mode(uint32_t level)
+{
+  return levels[(level < GOVERNOR_LEVELS) ? level : GOVERNOR_LEVELS - 1].mode;
+}
+
+uint32_t governor_level_divisor(uint32_t level)
+{
+  return levels[(level < GOVERNOR_LEVELS) ? level : GOVERNOR_LEVELS - 1].divisor;
+}
+
+double governor_load(void)
+{
+  double value;
+
+  __atomic_load(&load, &value, __ATOMIC_RELAXED);
+  return value;
+}
+
+uint32_t governor_tag_level(const governor_tag_t *tag)
+{
+  return __atomic_load_n(&tag->level, __ATOMIC_RELAXED);
+}
+
+uint64_t governor_tag_switches(const governor_tag_t *tag)
+{
+  return __atomic_load_n(&tag->switches, __ATOMIC_RELAXED);
+}
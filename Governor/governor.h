@@ -0,0 +1,103 @@
+/***************************************************************************//**
+ * @file
+ * @brief Estimator mode governor, trades the accuracy of the tags for CPU
+ *        when the load is above the estimation budget.
+ *
+ * Every tag runs at a level of a ladder of estimators from the most accurate
+ * to the cheapest:
+ *   0  REAL_TIME_HIGH_ACCURACY
+ *   1  REAL_TIME_BASIC
+ *   2  REAL_TIME_FAST_RESPONSE
+ *   3  REAL_TIME_FAST_RESPONSE on half the snapshots of a report
+ *   4  REAL_TIME_FAST_RESPONSE on a quarter of the snapshots
+ * and starts at the level of the estimator mode of the build (aoa_aox_mode).
+ * The in-tree covariance estimator has no mode, only the snapshot levels
+ * make it cheaper.
+ *
+ * The estimation time of every report is accounted to its tag
+ * (governor_account()); every GOVERNOR_PERIOD_MS the load, the share of the
+ * event thread spent estimating, and the reports waiting in the mailboxes
+ * are checked:
+ *   above the budget, or more than GOVERNOR_QUEUE_HIGH reports waiting:
+ *       the tags of the largest shares go down a level until the expected
+ *       saving covers the excess
+ *   below GOVERNOR_UPGRADE_HEADROOM of the budget with the one tag up a level
+ *       included, and at most GOVERNOR_QUEUE_LOW reports waiting:
+ *       the tag at the cheapest level goes up one
+ * The expected cost of a level is the measured mean over all tags. Between
+ * the budget and the headroom nothing changes, and a tag stays at least
+ * GOVERNOR_HOLD_PERIODS at a level, so the tags don't flap between two.
+ *
+ * All functions run on the event thread. The level and the switches of a tag
+ * are written with relaxed atomics for the metrics server.
+ ******************************************************************************/
+
+#ifndef GOVERNOR_H_
+#define GOVERNOR_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "aoa.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define GOVERNOR_LEVELS             5
+#define GOVERNOR_PERIOD_MS          250
+#define GOVERNOR_HOLD_PERIODS       4
+#define GOVERNOR_UPGRADE_HEADROOM   0.8       // of the budget, the load after an upgrade
+#define GOVERNOR_QUEUE_HIGH         64        // reports in the mailboxes of all tags
+#define GOVERNOR_QUEUE_LOW          8
+#define GOVERNOR_QUEUE_SHED         0.1       // of the load, shed while the queue is high
+#define GOVERNOR_DEFAULT_SAVING     0.3       // of the cost, a level down not measured yet
+#define GOVERNOR_EWMA               0.3       // weight of the newest period
+
+/***************************************************************************************************
+ * Type Definitions
+ **************************************************************************************************/
+
+typedef struct {
+  uint32_t hold;                // periods before the level may change again
+  uint64_t period_ns;           // estimation time in the period
+  double share;                 // of the event thread, moving average
+  // Exported
+  uint32_t level;
+  uint64_t switches;
+} governor_tag_t;
+
+/***************************************************************************************************
+ * Public variables
+ **************************************************************************************************/
+
+// Share of the event thread for the estimation, 0 keeps every tag at the
+// mode of the build (the default)
+extern double governor_budget;
+
+/***************************************************************************************************
+ * Function Declarations
+ **************************************************************************************************/
+
+// A new tag at the level of aoa_aox_mode, the basic level if the mode is not
+// on the ladder; while the governor is on, the estimator of the tag
+// (aoa_init()) is set to it.
+void governor_tag_init(governor_tag_t *tag, aoa_libitems_t *aoa_state);
+
+// Estimation time of a report of the tag, done at now (stage_stats_now());
+// sets the levels at the end of a period.
+void governor_account(governor_tag_t *tag, uint64_t now, uint64_t cost_ns);
+
+// Estimator mode and snapshot divisor of a level.
+enum sl_rtl_aox_mode governor_level_mode(uint32_t level);
+uint32_t governor_level_divisor(uint32_t level);
+
+// Share of the event thread spent estimating, 0 while not measured.
+double governor_load(void);
+uint32_t governor_tag_level(const governor_tag_t *tag);
+uint64_t governor_tag_switches(const governor_tag_t *tag);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* GOVERNOR_H_ */
@@ -0,0 +1,200 @@
+/***************************************************************************//**
+ * @file
+ * @brief Per-report phase and amplitude analytics of the IQ samples.
+ *
+ * The FAST kernels and the IQ deinterleave are those of simd_kernels.h, in
+ * the variant bound at startup for the CPU.
+ ******************************************************************************/
+
+#include <string.h>
+#include <math.h>
+
+#include "iq_analytics.h"
+#include "aoa.h"
+#include "app_config.h"
+#include "simd_kernels.h"
+
+/***************************************************************************************************
+ * Type Definitions
+ **************************************************************************************************/
+
+#define TWO_PI_F   6.28318531f
+
+/***************************************************************************************************
+ * Static Function Declarations
+ **************************************************************************************************/
+
+static void analyse_exact(iq_analytics_t *a, uint32_t n);
+static void analyse_fast(iq_analytics_t *a, uint32_t n);
+static void derive(iq_analytics_t *a, float switch_rotation, bool exact);
+
+// Remainder over 2xPi with the sign of x, like restrictRad() but in float.
+// The int conversion truncates, truncf() would be a libm call without SSE4.1.
+static inline float wrap_2pi_fast(float x)
+{
+  return x - TWO_PI_F * (float)(int32_t)(x * (1.0f / TWO_PI_F));
+}
+
+// Maps a phase step into [-Pi, Pi].
+static inline float wrap_pi(float x)
+{
+  float turns = x * (1.0f / TWO_PI_F);
+  return x - TWO_PI_F * (float)(int32_t)(turns + ((turns >= 0) ? 0.5f : -0.5f));
+}
+
+/***************************************************************************************************
+ * Public Function Definitions
+ **************************************************************************************************/
+
+void iq_analytics_init(iq_analytics_t *analytics, uint8_t num_elements, uint8_t ref_period_samples)
+{
+  memset(analytics, 0, sizeof(*analytics));
+  if (num_elements > IQ_ANALYTICS_MAX_ELEMENTS) {
+    num_elements = IQ_ANALYTICS_MAX_ELEMENTS;
+  }
+  analytics->num_elements = (num_elements > 0) ? num_elements : 1;
+  analytics->ref_period_samples = ref_period_samples;
+}
+
+const iq_analytics_t *iq_analytics_update(iq_analytics_t *analytics,
+                                          const aoa_iq_report_t *iq_report,
+                                          float switch_rotation,
+                                          iq_analytics_mode_t mode)
+{
+  iq_analytics_t *a = analytics;
+  uint32_t length = iq_report->length;
+  uint32_t n;
+
+  if (a->valid
+      && (a->samples == iq_report->samples)
+      && (a->length == iq_report->length)
+      && (a->event_counter == iq_report->event_counter)
+      && (a->channel == iq_report->channel)
+      && (a->rssi == iq_report->rssi)
+      && (a->switch_rotation == switch_rotation)
+      && (a->mode >= mode)) {
+    return a;
+  }
+
+  if (length > 2 * IQ_ANALYTICS_MAX_PAIRS) {
+    length = 2 * IQ_ANALYTICS_MAX_PAIRS;
+  }
+  a->num_pairs = (length + 1) / 2;
+  a->num_rows = (a->num_pairs + a->num_elements - 1) / a->num_elements;
+  n = a->num_rows * a->num_elements;
+
+  simd_kernels->deinterleave(iq_report->samples, a->i, a->q, length / 2);
+  if (length & 1) {
+    a->i[length / 2] = iq_report->samples[length - 1];
+    a->q[length / 2] = 0;
+  }
+  for (uint32_t k = a->num_pairs; k < IQ_ANALYTICS_BUFFER_SIZE; k++) {
+    a->i[k] = 0;
+    a->q[k] = 0;
+  }
+
+  if (mode == IQ_ANALYTICS_EXACT) {
+    analyse_exact(a, n);
+  } else {
+    analyse_fast(a, n);
+  }
+  derive(a, switch_rotation, mode == IQ_ANALYTICS_EXACT);
+
+  a->valid = true;
+  a->mode = mode;
+  a->samples = iq_report->samples;
+  a->length = iq_report->length;
+  a->event_counter = iq_report->event_counter;
+  a->channel = iq_report->channel;
+  a->rssi = iq_report->rssi;
+  a->switch_rotation = switch_rotation;
+  return a;
+}
+
+void iq_analytics_invalidate(iq_analytics_t *analytics)
+{
+  analytics->valid = false;
+}
+
+void iq_analytics_atan2_fast(const float *y, const float *x, float *out, uint32_t n)
+{
+  simd_kernels->atan2(y, x, out, n);
+}
+
+void iq_analytics_magnitude_fast(const float *i, const float *q, float *out, uint32_t n)
+{
+  simd_kernels->magnitude(i, q, out, n);
+}
+
+/***************************************************************************************************
+ * Static Function Definitions
+ **************************************************************************************************/
+
+static void analyse_exact(iq_analytics_t *a, uint32_t n)
+{
+  for (uint32_t k = 0; k < n; k++) {
+    a->phase[k] = atan2(a->q[k], a->i[k]);
+    a->amplitude[k] = sqrt(a->i[k] * a->i[k] + a->q[k] * a->q[k]);
+  }
+}
+
+static void analyse_fast(iq_analytics_t *a, uint32_t n)
+{
+  iq_analytics_atan2_fast(a->q, a->i, a->phase, n);
+  iq_analytics_magnitude_fast(a->i, a->q, a->amplitude, n);
+}
+
+// The sequential parts, cheap compared to the phase and amplitude. Inlined
+// with elements as a constant for each supported array, see derive().
+static inline __attribute__((always_inline))
+void derive_rows(iq_analytics_t *a, float switch_rotation, bool exact, uint32_t elements)
+{
+  uint32_t n = a->num_rows * elements;
+  uint32_t ref = (a->ref_period_samples < n) ? a->ref_period_samples : n;
+  float *diff = a->element_diff;
+
+  for (uint32_t k = 0; k < n; k++) {
+    float prev = (k >= elements) ? a->phase[k - elements] : 0;
+    a->own_shift[k] = exact ? restrictRad(prev - a->phase[k]) : wrap_2pi_fast(prev - a->phase[k]);
+  }
+
+  for (uint32_t row = 0; row < a->num_rows; row++) {
+    const float *phase = &a->phase[row * elements];
+    for (uint32_t b = 0; b + 1 < elements; b++) {
+      float d = phase[b + 1] - phase[b] - switch_rotation;
+      *diff++ = exact ? restrictRad(d) : wrap_2pi_fast(d);
+    }
+  }
+
+  if (ref > 0) {
+    a->unwrapped[0] = a->phase[0];
+  }
+  for (uint32_t k = 1; k < ref; k++) {
+    a->unwrapped[k] = a->unwrapped[k - 1] + wrap_pi(a->phase[k] - a->phase[k - 1]);
+  }
+  for (uint32_t k = ref; k < n; k++) {
+    if (k < ref + elements) {
+      a->unwrapped[k] = a->phase[k];
+    } else {
+      a->unwrapped[k] = a->unwrapped[k - elements] + wrap_pi(a->phase[k] - a->phase[k - elements]);
+    }
+  }
+}
+
+static void derive(iq_analytics_t *a, float switch_rotation, bool exact)
+{
+  switch (a->num_elements) {
+    case ARRAY_4x4_URA_NUM_ARRAY_ELEMENTS:
+      derive_rows(a, switch_rotation, exact, ARRAY_4x4_URA_NUM_ARRAY_ELEMENTS);
+      break;
+    case ARRAY_3x3_URA_NUM_ARRAY_ELEMENTS:
+      derive_rows(a, switch_rotation, exact, ARRAY_3x3_URA_NUM_ARRAY_ELEMENTS);
+      break;
+    case ARRAY_1x4_ULA_NUM_ARRAY_ELEMENTS:
+      derive_rows(a, switch_rotation, exact, ARRAY_1x4_ULA_NUM_ARRAY_ELEMENTS);
+      break;
+    default:
+      derive_rows(a, switch_rotation, exact, a->num_elements);
+      break;
+  }
+}
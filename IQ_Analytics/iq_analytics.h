@@ -0,0 +1,107 @@
+/***************************************************************************//**
+ * @file
+ * @brief Per-report phase and amplitude analytics of the IQ samples.
+ *
+ * Computes the phase, unwrapped phase, amplitude and the phase differences
+ * between neighbouring antennas for a whole IQ report in one pass. The result
+ * is kept with the tag, so the QA gate, the CSV log and the diagnostics share
+ * one computation per report.
+ *
+ * The report is viewed the way it arrives: consecutive IQ pairs, grouped in
+ * rows of num_elements pairs (the layout of IQ_Report_data_log.csv). The
+ * first ref_period_samples pairs belong to the reference period.
+ *
+ * Two precisions are available:
+ *   IQ_ANALYTICS_EXACT  libm atan2() and sqrt(), bit-identical to the values
+ *                       the CSV log always printed.
+ *   IQ_ANALYTICS_FAST   SIMD kernels of simd_kernels.h, polynomial atan2 and
+ *                       rsqrt with Newton steps, the same result with every
+ *                       instruction set. Measured over every int8 IQ pair
+ *                       (bench_analytics):
+ *                       phase error <= 2.0e-6 rad, amplitude error
+ *                       <= 5.0e-6 relative.
+ ******************************************************************************/
+
+#ifndef IQ_ANALYTICS_H_
+#define IQ_ANALYTICS_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "aoa_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/***************************************************************************************************
+ * Type Definitions
+ **************************************************************************************************/
+
+// A BGAPI IQ report carries at most 255 samples.
+#define IQ_ANALYTICS_MAX_PAIRS       128
+#define IQ_ANALYTICS_MAX_ELEMENTS    16
+// Room for the zero padded last row, a multiple of the SIMD width.
+#define IQ_ANALYTICS_BUFFER_SIZE     (IQ_ANALYTICS_MAX_PAIRS + IQ_ANALYTICS_MAX_ELEMENTS)
+
+typedef enum {
+  IQ_ANALYTICS_FAST  = 0,
+  IQ_ANALYTICS_EXACT = 1
+} iq_analytics_mode_t;
+
+typedef struct {
+  // Configuration
+  uint8_t num_elements;
+  uint8_t ref_period_samples;
+
+  // Identity of the analysed report
+  bool valid;
+  iq_analytics_mode_t mode;
+  const int8_t *samples;
+  uint16_t length;
+  uint16_t event_counter;
+  uint8_t channel;
+  int8_t rssi;
+  float switch_rotation;
+
+  // Results, num_rows * num_elements values, padding pairs are 0
+  uint16_t num_pairs;           // a trailing I without Q counts as a pair with Q = 0
+  uint16_t num_rows;
+  float i[IQ_ANALYTICS_BUFFER_SIZE];
+  float q[IQ_ANALYTICS_BUFFER_SIZE];
+  float phase[IQ_ANALYTICS_BUFFER_SIZE];       // atan2(q, i), rad
+  float amplitude[IQ_ANALYTICS_BUFFER_SIZE];   // sqrt(i * i + q * q)
+  // Reference period: continuous over the samples. Snapshots: continuous per
+  // antenna from one snapshot to the next.
+  float unwrapped[IQ_ANALYTICS_BUFFER_SIZE];
+  // restrictRad(phase of the same element one row before - phase), the
+  // first row uses 0 as the previous phase.
+  float own_shift[IQ_ANALYTICS_BUFFER_SIZE];
+  // num_elements - 1 values per row:
+  // restrictRad(phase[b + 1] - phase[b] - switch_rotation)
+  float element_diff[IQ_ANALYTICS_BUFFER_SIZE];
+} iq_analytics_t;
+
+/***************************************************************************************************
+ * Function Declarations
+ **************************************************************************************************/
+
+void iq_analytics_init(iq_analytics_t *analytics, uint8_t num_elements, uint8_t ref_period_samples);
+
+// Analyses the report unless it already is, at the same or a higher precision.
+const iq_analytics_t *iq_analytics_update(iq_analytics_t *analytics,
+                                          const aoa_iq_report_t *iq_report,
+                                          float switch_rotation,
+                                          iq_analytics_mode_t mode);
+
+// Forgets the last report, e.g. after its sample buffer was reused.
+void iq_analytics_invalidate(iq_analytics_t *analytics);
+
+// The FAST kernels on plain arrays.
+void iq_analytics_atan2_fast(const float *y, const float *x, float *out, uint32_t n);
+void iq_analytics_magnitude_fast(const float *i, const float *q, float *out, uint32_t n);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* IQ_ANALYTICS_H_ */
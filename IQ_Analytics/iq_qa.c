@@ -0,0 +1,163 @@
+/***************************************************************************//**
+ * @file
+ * @brief IQ sample quality gate, run before the estimator.
+ ******************************************************************************/
+
+#include <string.h>
+#include <math.h>
+
+#include "iq_qa.h"
+
+/***************************************************************************************************
+ * Public Variables
+ **************************************************************************************************/
+
+iq_qa_config_t iq_qa_config = IQ_QA_CONFIG_DEFAULT;
+iq_qa_counters_t iq_qa_counters;
+
+/***************************************************************************************************
+ * Static Variables
+ **************************************************************************************************/
+
+static const char *reason_strings[IQ_QA_REASON_COUNT] = {
+  "pass",
+  "truncated",
+  "amplitude",
+  "sndr",
+  "phase_jitter"
+};
+
+/***************************************************************************************************
+ * Public Function Definitions
+ **************************************************************************************************/
+
+iq_qa_reason_t iq_qa_check_length(const aoa_iq_report_t *iq_report, uint32_t expected_length)
+{
+  return (iq_report->length < expected_length) ? IQ_QA_REJECT_LENGTH : IQ_QA_PASS;
+}
+
+iq_qa_reason_t iq_qa_check(const iq_analytics_t *analytics,
+                           const iq_qa_config_t *config,
+                           iq_qa_metrics_t *metrics)
+{
+  iq_qa_metrics(analytics, metrics);
+
+  if (metrics->mean_amplitude < config->min_amplitude) {
+    return IQ_QA_REJECT_AMPLITUDE;
+  }
+  if (analytics->ref_period_samples < 3) {
+    // Too short for a line fit, nothing more to check.
+    return IQ_QA_PASS;
+  }
+  if (metrics->ref_sndr_db < config->min_ref_sndr_db) {
+    return IQ_QA_REJECT_SNDR;
+  }
+  if (metrics->ref_phase_jitter > config->max_phase_jitter) {
+    return IQ_QA_REJECT_PHASE_JITTER;
+  }
+  return IQ_QA_PASS;
+}
+
+void iq_qa_metrics(const iq_analytics_t *analytics, iq_qa_metrics_t *metrics)
+{
+  const iq_analytics_t *a = analytics;
+  uint32_t ref = a->ref_period_samples;
+  float sum = 0;
+  float sx = 0, sy = 0, sxx = 0, sxy = 0;
+  float slope, intercept, denominator;
+  float residual_sq = 0, power = 0, re = 0, im = 0, signal;
+
+  memset(metrics, 0, sizeof(*metrics));
+  if (a->num_pairs == 0) {
+    return;
+  }
+  for (uint32_t k = 0; k < a->num_pairs; k++) {
+    sum += a->amplitude[k];
+  }
+  metrics->mean_amplitude = sum / a->num_pairs;
+
+  if (ref > a->num_pairs) {
+    ref = a->num_pairs;
+  }
+  if (ref < 3) {
+    return;
+  }
+
+  // Least squares line through the unwrapped reference phase
+  for (uint32_t k = 0; k < ref; k++) {
+    sx += k;
+    sy += a->unwrapped[k];
+    sxx += (float)k * k;
+    sxy += k * a->unwrapped[k];
+  }
+  denominator = ref * sxx - sx * sx;
+  slope = (ref * sxy - sx * sy) / denominator;
+  intercept = (sy - slope * sx) / ref;
+
+  for (uint32_t k = 0; k < ref; k++) {
+    float residual = a->unwrapped[k] - (intercept + slope * k);
+    residual_sq += residual * residual;
+    // Sample derotated by the fitted tone
+    re += a->amplitude[k] * cosf(residual);
+    im += a->amplitude[k] * sinf(residual);
+    power += a->amplitude[k] * a->amplitude[k];
+  }
+  re /= ref;
+  im /= ref;
+  power /= ref;
+  signal = re * re + im * im;
+
+  metrics->ref_phase_slope = slope;
+  metrics->ref_phase_jitter = sqrtf(residual_sq / ref);
+  if (signal <= 0) {
+    metrics->ref_sndr_db = -99.0f;
+  } else if (power - signal <= signal * 1e-6f) {
+    // Ideal tone, e.g. simulated samples
+    metrics->ref_sndr_db = 60.0f;
+  } else {
+    metrics->ref_sndr_db = 10.0f * log10f(signal / (power - signal));
+  }
+}
+
+const char *iq_qa_reason_to_string(iq_qa_reason_t reason)
+{
+  if (reason >= IQ_QA_REASON_COUNT) {
+    return "unknown";
+  }
+  return reason_strings[reason];
+}
+
+void iq_qa_count(iq_qa_reason_t reason, uint64_t gate_ns)
+{
+  __atomic_fetch_add(&iq_qa_counters.checked, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&iq_qa_counters.results[reason], 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&iq_qa_counters.gate_ns, gate_ns, __ATOMIC_RELAXED);
+}
+
+void iq_qa_count_estimation(uint64_t estimator_ns)
+{
+  __atomic_fetch_add(&iq_qa_counters.estimated, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&iq_qa_counters.estimator_ns, estimator_ns, __ATOMIC_RELAXED);
+}
+
+void iq_qa_get_counters(iq_qa_counters_t *counters)
+{
+  counters->checked = __atomic_load_n(&iq_qa_counters.checked, __ATOMIC_RELAXED);
+  for (int r = 0; r < IQ_QA_REASON_COUNT; r++) {
+    counters->results[r] = __atomic_load_n(&iq_qa_counters.results[r], __ATOMIC_RELAXED);
+  }
+  counters->gate_ns = __atomic_load_n(&iq_qa_counters.gate_ns, __ATOMIC_RELAXED);
+  counters->estimated = __atomic_load_n(&iq_qa_counters.estimated, __ATOMIC_RELAXED);
+  counters->estimator_ns = __atomic_load_n(&iq_qa_counters.estimator_ns, __ATOMIC_RELAXED);
+}
+
+int64_t iq_qa_saved_ns(const iq_qa_counters_t *counters)
+{
+  uint64_t rejected = counters->checked - counters->results[IQ_QA_PASS];
+
+  if (counters->estimated == 0) {
+    return -(int64_t)counters->gate_ns;
+  }
+  return (int64_t)(rejected * (counters->estimator_ns / counters->estimated))
+         - (int64_t)counters->gate_ns;
+}
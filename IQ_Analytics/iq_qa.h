@@ -0,0 +1,102 @@
+/***************************************************************************//**
+ * @file
+ * @brief IQ sample quality gate, run before the estimator.
+ *
+ * Rejects reports that cannot give a useful angle before they reach
+ * sl_rtl_aox_process(): truncated reports, reports below an amplitude floor,
+ * and reports whose reference period has a low SNDR or a jittery phase. The
+ * metrics come from the shared per-report analysis (iq_analytics.h).
+ *
+ * Reference period metrics: the unwrapped phase of the reference samples is
+ * fitted with a straight line (the CTE tone). The RMS of the residual is the
+ * phase jitter. With the samples derotated by the fit, the power of their
+ * mean is the signal, the remaining power the noise and distortion.
+ ******************************************************************************/
+
+#ifndef IQ_QA_H_
+#define IQ_QA_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "aoa_types.h"
+#include "iq_analytics.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/***************************************************************************************************
+ * Type Definitions
+ **************************************************************************************************/
+
+typedef enum {
+  IQ_QA_PASS = 0,
+  IQ_QA_REJECT_LENGTH,          // fewer IQ samples than the array configuration needs
+  IQ_QA_REJECT_AMPLITUDE,       // mean amplitude below the floor
+  IQ_QA_REJECT_SNDR,            // reference period SNDR too low
+  IQ_QA_REJECT_PHASE_JITTER,    // reference period phase jitter too large
+  IQ_QA_REASON_COUNT
+} iq_qa_reason_t;
+
+typedef struct {
+  bool enabled;
+  float min_amplitude;          // ADC counts
+  float min_ref_sndr_db;
+  float max_phase_jitter;       // rad RMS
+} iq_qa_config_t;
+
+#define IQ_QA_CONFIG_DEFAULT    { true, 4.0f, 3.0f, 0.5f }
+
+typedef struct {
+  float mean_amplitude;
+  float ref_sndr_db;
+  float ref_phase_jitter;
+  float ref_phase_slope;        // rad per reference sample
+} iq_qa_metrics_t;
+
+// Updated with atomic adds, may be read from any thread.
+typedef struct {
+  uint64_t checked;
+  uint64_t results[IQ_QA_REASON_COUNT];    // reports per outcome, [IQ_QA_PASS] passed
+  uint64_t gate_ns;             // time spent in the gate
+  uint64_t estimated;           // passed reports that went through the estimator
+  uint64_t estimator_ns;        // time spent in the estimator for them
+} iq_qa_counters_t;
+
+/***************************************************************************************************
+ * Public variables
+ **************************************************************************************************/
+
+extern iq_qa_config_t iq_qa_config;
+extern iq_qa_counters_t iq_qa_counters;
+
+/***************************************************************************************************
+ * Function Declarations
+ **************************************************************************************************/
+
+// The cheap check first, before the report is analysed. expected_length is
+// the number of IQ samples (I and Q each count) of a complete report.
+iq_qa_reason_t iq_qa_check_length(const aoa_iq_report_t *iq_report, uint32_t expected_length);
+// Checks an analysed report against the thresholds, fills metrics.
+iq_qa_reason_t iq_qa_check(const iq_analytics_t *analytics,
+                           const iq_qa_config_t *config,
+                           iq_qa_metrics_t *metrics);
+
+// Metrics only, without any threshold.
+void iq_qa_metrics(const iq_analytics_t *analytics, iq_qa_metrics_t *metrics);
+
+const char *iq_qa_reason_to_string(iq_qa_reason_t reason);
+
+void iq_qa_count(iq_qa_reason_t reason, uint64_t gate_ns);
+void iq_qa_count_estimation(uint64_t estimator_ns);
+// Copy of the counters.
+void iq_qa_get_counters(iq_qa_counters_t *counters);
+// Estimator time not spent thanks to the rejected reports, based on the
+// average estimator time, minus the time of the gate itself.
+int64_t iq_qa_saved_ns(const iq_qa_counters_t *counters);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* IQ_QA_H_ */
@@ -0,0 +1,464 @@
+/***************************************************************************//**
+ * @file
+ * @brief Binary, append-only capture of IQ reports.
+ *
+ * The writer appends records to a large in-memory buffer and hands it to the
+ * C library with a single fwrite once it is full, so the cost per report is a
+ * memcpy. If the log writer thread is running, each record is copied into its
+ * ring instead and the file is written off the event thread. The reader maps
+ * the whole file and hands out pointers into it.
+ ******************************************************************************/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#ifdef _WIN32
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "iq_capture.h"
+#include "app_config.h"
+#include "aoa_array.h"
+#include "aoa.h"
+
+extern float SAMPLING_RATE;
+extern float CTE_FREQ;
+extern float REFERENCE_SAMPL_RATE;
+
+/***************************************************************************************************
+ * Static Function Declarations
+ **************************************************************************************************/
+
+static sl_status_t writer_append(iq_capture_writer_t *writer, const void *data, size_t len);
+static sl_status_t writer_append_record(iq_capture_writer_t *writer,
+                                        const void *head, size_t head_len,
+                                        const void *data, size_t data_len,
+                                        size_t length);
+static sl_status_t writer_write_index(iq_capture_writer_t *writer);
+static sl_status_t writer_append_async(iq_capture_writer_t *writer,
+                                       const void *head, size_t head_len,
+                                       const void *data, size_t data_len,
+                                       size_t length);
+
+/***************************************************************************************************
+ * Public Function Definitions
+ **************************************************************************************************/
+
+uint64_t iq_capture_time_us(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return (uint64_t)ts.tv_sec * 1000000u + (uint64_t)ts.tv_nsec / 1000u;
+}
+
+void iq_capture_fill_header(iq_capture_header_t *header)
+{
+  const aoa_array_config_t *array = &aoa_array_config;
+  uint8_t pattern_length = array->switching_pattern_length;
+
+  memset(header, 0, sizeof(*header));
+  header->magic = IQ_CAPTURE_MAGIC;
+  header->version = IQ_CAPTURE_VERSION;
+  header->header_size = sizeof(*header);
+  header->array_type = array->array_type;
+  header->num_array_elements = array->num_array_elements;
+  header->num_snapshots = array->num_snapshots;
+  header->ref_period_samples = array->ref_period_samples;
+  if (pattern_length > IQ_CAPTURE_MAX_ELEMENTS) {
+    pattern_length = IQ_CAPTURE_MAX_ELEMENTS;
+  }
+  memcpy(header->switching_pattern, array->switching_pattern, pattern_length);
+  header->switching_pattern_length = pattern_length;
+  header->aox_mode = aoa_aox_mode;
+  header->cte_slot_duration = CTE_SLOT_DURATION;
+  header->index_interval = IQ_CAPTURE_INDEX_INTERVAL;
+  header->ref_sampling_rate_us = REFERENCE_SAMPL_RATE;
+  header->sampling_rate_us = SAMPLING_RATE;
+  header->cte_freq_khz = CTE_FREQ;
+  header->start_time_us = iq_capture_time_us();
+}
+
+sl_status_t iq_capture_open(iq_capture_writer_t *writer, const char *filename)
+{
+  iq_capture_header_t header;
+
+  memset(writer, 0, sizeof(*writer));
+  writer->stream = LOG_STREAM_INVALID;
+  if (log_writer_running()) {
+    writer->stream = log_writer_open(filename);
+    if (writer->stream == LOG_STREAM_INVALID) {
+      return SL_STATUS_FAIL;
+    }
+    writer->async = true;
+    iq_capture_fill_header(&header);
+    if (writer_append_async(writer, &header, sizeof(header), NULL, 0, sizeof(header)) != SL_STATUS_OK) {
+      log_writer_close(writer->stream);
+      writer->stream = LOG_STREAM_INVALID;
+      writer->async = false;
+      return SL_STATUS_FULL;
+    }
+    return SL_STATUS_OK;
+  }
+
+  writer->buffer = malloc(IQ_CAPTURE_WRITE_BUFFER_SIZE);
+  if (writer->buffer == NULL) {
+    return SL_STATUS_ALLOCATION_FAILED;
+  }
+  writer->file = fopen(filename, "wb");
+  if (writer->file == NULL) {
+    free(writer->buffer);
+    writer->buffer = NULL;
+    return SL_STATUS_FAIL;
+  }
+  // We do our own buffering.
+  setvbuf(writer->file, NULL, _IONBF, 0);
+
+  iq_capture_fill_header(&header);
+  return writer_append(writer, &header, sizeof(header));
+}
+
+bool iq_capture_is_open(const iq_capture_writer_t *writer)
+{
+  return writer->async || (writer->file != NULL);
+}
+
+sl_status_t iq_capture_write(iq_capture_writer_t *writer,
+                             const bd_addr *address,
+                             uint8_t address_type,
+                             uint64_t timestamp_us,
+                             const aoa_iq_report_t *iq_report)
+{
+  iq_capture_report_t record;
+  uint32_t length;
+  uint64_t offset;
+  sl_status_t sc;
+
+  if (!iq_capture_is_open(writer)) {
+    return SL_STATUS_FAIL;
+  }
+
+  length = IQ_CAPTURE_ALIGN(sizeof(record) + iq_report->length);
+
+  memset(&record, 0, sizeof(record));
+  record.length = length;
+  record.type = IQ_CAPTURE_RECORD_REPORT;
+  record.address_type = address_type;
+  record.event_counter = iq_report->event_counter;
+  record.timestamp_us = timestamp_us;
+  memcpy(record.address, address->addr, sizeof(record.address));
+  record.channel = iq_report->channel;
+  record.rssi = iq_report->rssi;
+  record.num_samples = (uint16_t)iq_report->length;
+
+  // The record goes in whole or not at all, the index and the count only
+  // cover records that were appended.
+  if (writer->async) {
+    offset = writer->offset;
+    sc = writer_append_async(writer, &record, sizeof(record), iq_report->samples, iq_report->length, length);
+  } else {
+    offset = writer->offset + writer->used;
+    sc = writer_append_record(writer, &record, sizeof(record), iq_report->samples, iq_report->length, length);
+  }
+  if (sc != SL_STATUS_OK) {
+    return sc;
+  }
+  if (writer->index_count == 0) {
+    writer->index_first_timestamp_us = timestamp_us;
+  }
+  writer->index_offsets[writer->index_count++] = offset;
+  writer->report_count++;
+  if (writer->index_count == IQ_CAPTURE_INDEX_INTERVAL) {
+    sc = writer_write_index(writer);
+  }
+  return sc;
+}
+
+sl_status_t iq_capture_flush(iq_capture_writer_t *writer)
+{
+  if (writer->async) {
+    // The writer thread flushes on its own.
+    return SL_STATUS_OK;
+  }
+  if (writer->file == NULL) {
+    return SL_STATUS_FAIL;
+  }
+  if (writer->used > 0) {
+    size_t written = fwrite(writer->buffer, 1, writer->used, writer->file);
+    // Keep the offsets in line with the file, the rest stays for the next flush.
+    writer->offset += written;
+    writer->used -= written;
+    if (writer->used > 0) {
+      memmove(writer->buffer, writer->buffer + written, writer->used);
+      return SL_STATUS_FAIL;
+    }
+  }
+  return SL_STATUS_OK;
+}
+
+sl_status_t iq_capture_close(iq_capture_writer_t *writer)
+{
+  iq_capture_trailer_t trailer;
+  sl_status_t sc = SL_STATUS_OK;
+
+  if (!iq_capture_is_open(writer)) {
+    return SL_STATUS_FAIL;
+  }
+  if (writer->index_count > 0) {
+    sc = writer_write_index(writer);
+  }
+  trailer.magic = IQ_CAPTURE_TRAILER_MAGIC;
+  trailer.report_count = writer->report_count;
+  trailer.last_index_offset = writer->prev_index_offset;
+  if (writer->async) {
+    // A dropped index only costs random access, the trailer is still valid.
+    sc = writer_append_async(writer, &trailer, sizeof(trailer), NULL, 0, sizeof(trailer));
+    log_writer_close(writer->stream);
+    writer->stream = LOG_STREAM_INVALID;
+    writer->async = false;
+    return sc;
+  }
+  if (sc == SL_STATUS_OK) {
+    sc = writer_append(writer, &trailer, sizeof(trailer));
+  }
+  if (sc == SL_STATUS_OK) {
+    sc = iq_capture_flush(writer);
+  }
+  fclose(writer->file);
+  writer->file = NULL;
+  free(writer->buffer);
+  writer->buffer = NULL;
+  return sc;
+}
+
+sl_status_t iq_capture_reader_open(iq_capture_reader_t *reader, const char *filename)
+{
+  const iq_capture_trailer_t *trailer;
+  struct stat st;
+  void *base;
+
+  memset(reader, 0, sizeof(*reader));
+  if ((stat(filename, &st) != 0) || ((size_t)st.st_size < sizeof(iq_capture_header_t))) {
+    return SL_STATUS_FAIL;
+  }
+
+#ifdef _WIN32
+  FILE *f = fopen(filename, "rb");
+  if (f == NULL) {
+    return SL_STATUS_FAIL;
+  }
+  base = malloc(st.st_size);
+  if ((base == NULL) || (fread(base, 1, st.st_size, f) != (size_t)st.st_size)) {
+    free(base);
+    fclose(f);
+    return SL_STATUS_FAIL;
+  }
+  fclose(f);
+#else
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0) {
+    return SL_STATUS_FAIL;
+  }
+  base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) {
+    return SL_STATUS_FAIL;
+  }
+  // Records are consumed front to back.
+  madvise(base, st.st_size, MADV_SEQUENTIAL);
+#endif
+
+  reader->base = base;
+  reader->size = st.st_size;
+  reader->header = (const iq_capture_header_t *)reader->base;
+  if ((reader->header->magic != IQ_CAPTURE_MAGIC)
+      || (reader->header->version != IQ_CAPTURE_VERSION)) {
+    iq_capture_reader_close(reader);
+    return SL_STATUS_FAIL;
+  }
+  reader->offset = reader->header->header_size;
+
+  trailer = (const iq_capture_trailer_t *)(reader->base + reader->size - sizeof(*trailer));
+  if ((reader->size >= reader->offset + sizeof(*trailer))
+      && (trailer->magic == IQ_CAPTURE_TRAILER_MAGIC)) {
+    reader->trailer = trailer;
+  }
+  return SL_STATUS_OK;
+}
+
+void iq_capture_reader_close(iq_capture_reader_t *reader)
+{
+  if (reader->base != NULL) {
+#ifdef _WIN32
+    free((void *)reader->base);
+#else
+    munmap((void *)reader->base, reader->size);
+#endif
+  }
+  memset(reader, 0, sizeof(*reader));
+}
+
+const iq_capture_report_t *iq_capture_reader_next(iq_capture_reader_t *reader)
+{
+  const iq_capture_report_t *record;
+
+  for (;;) {
+    // A record header must fit, otherwise we are at the trailer or at a torn write.
+    if (reader->offset + sizeof(iq_capture_report_t) > reader->size) {
+      return NULL;
+    }
+    record = (const iq_capture_report_t *)(reader->base + reader->offset);
+    if ((record->length < sizeof(iq_capture_index_t))
+        || (reader->offset + record->length > reader->size)) {
+      return NULL;
+    }
+    reader->offset += record->length;
+    if (record->type == IQ_CAPTURE_RECORD_REPORT) {
+      return record;
+    }
+    if (record->type != IQ_CAPTURE_RECORD_INDEX) {
+      return NULL;
+    }
+  }
+}
+
+const iq_capture_index_t *iq_capture_reader_index(const iq_capture_reader_t *reader, uint64_t offset)
+{
+  const iq_capture_index_t *index;
+
+  if ((offset == 0) || (offset + sizeof(*index) > reader->size)) {
+    return NULL;
+  }
+  index = (const iq_capture_index_t *)(reader->base + offset);
+  if ((index->type != IQ_CAPTURE_RECORD_INDEX)
+      || (offset + index->length > reader->size)) {
+    return NULL;
+  }
+  return index;
+}
+
+const iq_capture_report_t *iq_capture_reader_report(const iq_capture_reader_t *reader, uint64_t offset)
+{
+  const iq_capture_report_t *record;
+
+  if (offset + sizeof(*record) > reader->size) {
+    return NULL;
+  }
+  record = (const iq_capture_report_t *)(reader->base + offset);
+  if ((record->type != IQ_CAPTURE_RECORD_REPORT)
+      || (offset + record->length > reader->size)) {
+    return NULL;
+  }
+  return record;
+}
+
+void iq_capture_to_iq_report(const iq_capture_report_t *record, aoa_iq_report_t *iq_report)
+{
+  iq_report->channel = record->channel;
+  iq_report->rssi = record->rssi;
+  iq_report->event_counter = record->event_counter;
+  iq_report->length = record->num_samples;
+  // The estimator never writes the samples, the cast only drops the const.
+  iq_report->samples = (int8_t *)(record + 1);
+}
+
+/***************************************************************************************************
+ * Static Function Definitions
+ **************************************************************************************************/
+
+static sl_status_t writer_append(iq_capture_writer_t *writer, const void *data, size_t len)
+{
+  sl_status_t sc;
+
+  if (writer->used + len > IQ_CAPTURE_WRITE_BUFFER_SIZE) {
+    sc = iq_capture_flush(writer);
+    if (sc != SL_STATUS_OK) {
+      return sc;
+    }
+  }
+  memcpy(writer->buffer + writer->used, data, len);
+  writer->used += len;
+  return SL_STATUS_OK;
+}
+
+static sl_status_t writer_write_index(iq_capture_writer_t *writer)
+{
+  iq_capture_index_t index;
+  uint64_t offset = writer->offset + writer->used;
+  size_t offsets_len = writer->index_count * sizeof(writer->index_offsets[0]);
+  sl_status_t sc;
+
+  memset(&index, 0, sizeof(index));
+  index.length = sizeof(index) + offsets_len;
+  index.type = IQ_CAPTURE_RECORD_INDEX;
+  index.prev_index_offset = writer->prev_index_offset;
+  index.first_timestamp_us = writer->index_first_timestamp_us;
+  index.count = writer->index_count;
+
+  if (writer->async) {
+    sc = writer_append_async(writer, &index, sizeof(index), writer->index_offsets, offsets_len, index.length);
+    // Keep the chain pointing at an index that was really written.
+    if (sc == SL_STATUS_OK) {
+      writer->prev_index_offset = offset;
+    }
+    writer->index_count = 0;
+    return sc;
+  }
+
+  sc = writer_append_record(writer, &index, sizeof(index), writer->index_offsets, offsets_len, index.length);
+  if (sc == SL_STATUS_OK) {
+    writer->prev_index_offset = offset;
+  }
+  writer->index_count = 0;
+  return sc;
+}
+
+// Copies a whole record into the buffer, or nothing if the flush to make room fails.
+static sl_status_t writer_append_record(iq_capture_writer_t *writer,
+                                        const void *head, size_t head_len,
+                                        const void *data, size_t data_len,
+                                        size_t length)
+{
+  sl_status_t sc;
+
+  if (writer->used + length > IQ_CAPTURE_WRITE_BUFFER_SIZE) {
+    sc = iq_capture_flush(writer);
+    if (sc != SL_STATUS_OK) {
+      return sc;
+    }
+  }
+  memcpy(writer->buffer + writer->used, head, head_len);
+  if (data_len > 0) {
+    memcpy(writer->buffer + writer->used + head_len, data, data_len);
+  }
+  memset(writer->buffer + writer->used + head_len + data_len, 0, length - head_len - data_len);
+  writer->used += length;
+  return SL_STATUS_OK;
+}
+
+// Copies a whole record into the log writer ring, or nothing if it does not fit.
+static sl_status_t writer_append_async(iq_capture_writer_t *writer,
+                                       const void *head, size_t head_len,
+                                       const void *data, size_t data_len,
+                                       size_t length)
+{
+  uint8_t *p = log_writer_reserve(writer->stream, length);
+
+  if (p == NULL) {
+    return SL_STATUS_FULL;
+  }
+  memcpy(p, head, head_len);
+  if (data_len > 0) {
+    memcpy(p + head_len, data, data_len);
+  }
+  memset(p + head_len + data_len, 0, length - head_len - data_len);
+  log_writer_commit(length);
+  writer->offset += length;
+  return SL_STATUS_OK;
+}
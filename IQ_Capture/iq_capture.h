@@ -0,0 +1,161 @@
+/***************************************************************************//**
+ * @file
+ * @brief Binary, append-only capture of IQ reports.
+ *
+ * File layout (all fields little-endian):
+ *
+ *   iq_capture_header_t                     fixed size, array configuration
+ *   record, record, ...                     length-prefixed, 8 byte aligned
+ *   iq_capture_trailer_t                    only present after a clean close
+ *
+ * A record is either a report (iq_capture_report_t followed by the raw int8
+ * IQ samples) or an index (iq_capture_index_t followed by the file offsets of
+ * the reports written since the previous index). Index records are chained
+ * backwards through prev_index_offset, the trailer points at the last one.
+ * A file without trailer (crashed writer) is still readable sequentially.
+ ******************************************************************************/
+
+#ifndef IQ_CAPTURE_H_
+#define IQ_CAPTURE_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stddef.h>
+#include "sl_bt_api.h"
+#include "aoa_types.h"
+#include "log_writer.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/***************************************************************************************************
+ * Type Definitions
+ **************************************************************************************************/
+
+#define IQ_CAPTURE_MAGIC              0x51494F41u  // "AOIQ"
+#define IQ_CAPTURE_TRAILER_MAGIC      0x444E4551u  // "QEND"
+#define IQ_CAPTURE_VERSION            2
+#define IQ_CAPTURE_MAX_ELEMENTS       16
+// Number of report records covered by one index record.
+#define IQ_CAPTURE_INDEX_INTERVAL     256
+// Size of the writer side buffer, flushed with a single fwrite.
+#define IQ_CAPTURE_WRITE_BUFFER_SIZE  (1024 * 1024)
+
+#define IQ_CAPTURE_RECORD_REPORT      1
+#define IQ_CAPTURE_RECORD_INDEX       2
+
+// Records always start on an 8 byte boundary.
+#define IQ_CAPTURE_ALIGN(x)           (((x) + 7u) & ~7u)
+
+typedef struct {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t header_size;
+  uint8_t  array_type;
+  uint8_t  num_array_elements;
+  uint8_t  num_snapshots;
+  uint8_t  ref_period_samples;
+  uint8_t  switching_pattern[IQ_CAPTURE_MAX_ELEMENTS];
+  uint8_t  aox_mode;
+  uint8_t  cte_slot_duration;
+  uint16_t index_interval;
+  float    ref_sampling_rate_us;
+  float    sampling_rate_us;
+  float    cte_freq_khz;
+  uint32_t reserved0;
+  uint64_t start_time_us;           // wall clock at capture start, us since epoch
+  uint8_t  switching_pattern_length;  // entries of switching_pattern, since version 2
+  uint8_t  reserved[7];
+} iq_capture_header_t;
+
+typedef struct {
+  uint32_t length;                  // whole record incl. padding
+  uint8_t  type;                    // IQ_CAPTURE_RECORD_REPORT
+  uint8_t  address_type;
+  uint16_t event_counter;
+  uint64_t timestamp_us;            // wall clock, us since epoch
+  uint8_t  address[6];
+  uint8_t  channel;
+  int8_t   rssi;
+  uint16_t num_samples;             // number of int8 values following
+  uint16_t reserved;
+  uint32_t reserved2;
+} iq_capture_report_t;
+
+typedef struct {
+  uint32_t length;                  // whole record incl. offsets
+  uint8_t  type;                    // IQ_CAPTURE_RECORD_INDEX
+  uint8_t  reserved[3];
+  uint64_t prev_index_offset;       // 0 for the first index
+  uint64_t first_timestamp_us;
+  uint32_t count;                   // number of offsets following
+  uint32_t reserved2;
+} iq_capture_index_t;
+
+typedef struct {
+  uint32_t magic;                   // IQ_CAPTURE_TRAILER_MAGIC
+  uint32_t report_count;
+  uint64_t last_index_offset;
+} iq_capture_trailer_t;
+
+typedef struct {
+  FILE *file;
+  bool async;                       // records go through the log writer thread
+  log_stream_t stream;              // only valid if async
+  uint8_t *buffer;
+  size_t used;
+  uint64_t offset;                  // file offset of buffer[0]
+  uint64_t prev_index_offset;
+  uint64_t index_first_timestamp_us;
+  uint64_t index_offsets[IQ_CAPTURE_INDEX_INTERVAL];
+  uint32_t index_count;
+  uint32_t report_count;
+} iq_capture_writer_t;
+
+typedef struct {
+  const uint8_t *base;
+  size_t size;
+  size_t offset;                    // next record to be read
+  const iq_capture_header_t *header;
+  const iq_capture_trailer_t *trailer;  // NULL if the writer did not close cleanly
+} iq_capture_reader_t;
+
+/***************************************************************************************************
+ * Function Declarations
+ **************************************************************************************************/
+
+// Returns the wall clock in microseconds since epoch.
+uint64_t iq_capture_time_us(void);
+
+// Fills a header from the current array configuration.
+void iq_capture_fill_header(iq_capture_header_t *header);
+
+// Uses the log writer thread if it is running, a report that does not fit
+// into its ring is dropped as a whole and iq_capture_write returns SL_STATUS_FULL.
+sl_status_t iq_capture_open(iq_capture_writer_t *writer, const char *filename);
+bool iq_capture_is_open(const iq_capture_writer_t *writer);
+sl_status_t iq_capture_write(iq_capture_writer_t *writer,
+                             const bd_addr *address,
+                             uint8_t address_type,
+                             uint64_t timestamp_us,
+                             const aoa_iq_report_t *iq_report);
+sl_status_t iq_capture_flush(iq_capture_writer_t *writer);
+sl_status_t iq_capture_close(iq_capture_writer_t *writer);
+
+sl_status_t iq_capture_reader_open(iq_capture_reader_t *reader, const char *filename);
+void iq_capture_reader_close(iq_capture_reader_t *reader);
+// Returns the next report record or NULL at the end of the capture.
+const iq_capture_report_t *iq_capture_reader_next(iq_capture_reader_t *reader);
+// Returns the index record at the given offset or NULL if there is none.
+const iq_capture_index_t *iq_capture_reader_index(const iq_capture_reader_t *reader, uint64_t offset);
+// Returns the report record at the given offset or NULL if there is none.
+const iq_capture_report_t *iq_capture_reader_report(const iq_capture_reader_t *reader, uint64_t offset);
+// Points an IQ report at the samples of a mapped record.
+void iq_capture_to_iq_report(const iq_capture_report_t *record, aoa_iq_report_t *iq_report);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* IQ_CAPTURE_H_ */
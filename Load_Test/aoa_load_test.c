@@ -0,0 +1,654 @@
+/***************************************************************************//**
+ * @file
+ * @brief Load test of the locator host, built with 'make loadtest'.
+ *
+ * Linked with the locator sources instead of main.c. A generator thread plays
+ * the NCP: it builds Silabs CTE IQ report events for N tags on an open-loop
+ * schedule of R events/s in total and queues them in a bounded ring, the size
+ * of the host receive buffer (-q). A full ring drops the event. The main
+ * thread takes the events from the ring and passes them to app_bt_on_event(),
+ * so the real whitelist, tag table, mailboxes, admission control, estimator,
+ * CSV log and publish path run; the ring occupancy is the backlog the
+ * mailboxes and the admission control see. The MQTT client calls are
+ * redirected to a sink that counts the messages and takes the latency from
+ * the scheduled time of the event of the report. Reports superseded in the
+ * tag mailboxes are counted as coalesced.
+ *
+ * The rate is ramped by -s per step of -d seconds, starting at -r, until the
+ * p99 latency exceeds -p ms or more than -x percent of the events are
+ * dropped. The capacity is the last step within both limits. With the
+ * estimator governor on (-G), the level column is the mean estimator level of
+ * the tags at the end of the step (governor.h). -S sets the budget per cycle
+ * of the mailbox scheduler (scheduler.h); the reports/s served per tag of the
+ * last step are printed at the end.
+ *
+ * The stages are timed by wrapping their functions at link time (see
+ * LOADTEST_WRAP in the makefile), on the event thread:
+ *   simulate   make_I_Q()
+ *   estimate   aoa_calculate()
+ *   csv        I_Q_to_CSV()
+ *   publish    aoa_angle_to_string() and mqtt_publish()
+ *   dispatch   the rest of app_bt_on_event(): whitelist, tag table, topic
+ ******************************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/resource.h>
+
+#include "sl_bt_api.h"
+#include "app.h"
+#include "app_config.h"
+#include "aoa.h"
+#include "aoa_array.h"
+#include "aoa_serdes.h"
+#include "aoa_util.h"
+#include "conn.h"
+#include "log2CSV.h"
+#include "log_writer.h"
+#include "mqtt.h"
+#include "simd_kernels.h"
+#include "Simulator_I_Q.h"
+#include "trace.h"
+#include "admission.h"
+#include "governor.h"
+#include "scheduler.h"
+#include "mailbox.h"
+
+#define USAGE "\nUsage: %s [-n <tags>] [-r <start rate>] [-s <rate step>] [-m <max rate>] [-d <step seconds>]\n"   \
+              "          [-p <p99 limit ms>] [-x <drop limit %%>] [-q <queue events>] [-a <array type>] [-l <reports to csv>] [-o <report.csv>]\n" \
+              "          [-T <trace 1 in N reports>[:<trace file>]] [-c <report load %%, 0: admit all>]\n"   \
+              "          [-k <newest reports kept per tag>] [-G <estimation load %%, 0: mode of the build>]\n" \
+              "          [-S <scheduler budget us per cycle, 0: in turn>]\n"                             \
+              "  -r, -m  aggregate IQ report events/s of all tags\n"                                         \
+              "  -s      rate factor from one step to the next\n"
+#define DEFAULT_TAGS          AOA_MAX_TAGS
+#define DEFAULT_RATE          100.0
+#define DEFAULT_RATE_STEP     1.5
+#define DEFAULT_MAX_RATE      1000000.0
+#define DEFAULT_STEP_S        3.0
+#define DEFAULT_P99_MS        50.0
+#define DEFAULT_DROP_PCT      1.0
+#define DEFAULT_QUEUE         256
+#define MAX_STEPS             64
+// The generator sleeps at most this long between batches of events
+#define GENERATOR_TICK_NS     200000
+// Scheduled times kept per tag, by packet counter
+#define SCHEDULED_SLOTS       256
+#define BGAPI_HEADER_BYTES    4
+
+#ifdef _WIN32
+#define NULL_DEVICE "NUL"
+#else
+#define NULL_DEVICE "/dev/null"
+#endif
+
+typedef enum {
+  STAGE_SIMULATE,
+  STAGE_ESTIMATE,
+  STAGE_CSV,
+  STAGE_PUBLISH,
+  STAGE_DISPATCH,
+  STAGE_COUNT
+} stage_t;
+
+typedef struct {
+  uint64_t scheduled_ns;
+  union {
+    sl_bt_msg_t msg;
+    uint8_t raw[sizeof(sl_bt_msg_t) + AOA_ARRAY_MAX_REPORT_LENGTH + 1];
+  } evt;
+} load_event_t;
+
+typedef struct {
+  double rate;
+  uint64_t offered;
+  uint64_t dropped;
+  uint64_t handled;
+  uint64_t published;
+  uint64_t coalesced;
+  double p50_ms, p99_ms, max_ms;
+  double busy_pct;          // event thread busy time of the wall time
+  double process_cpu_pct;   // all threads, 100 is one core
+  double stage_us[STAGE_COUNT];
+  double level;             // mean estimator level of the tags at the end
+  bool pass;
+} step_result_t;
+
+static const char *stage_names[STAGE_COUNT] = {
+  "simulate", "estimate", "csv", "publish", "dispatch"
+};
+
+// Event ring, single producer (generator), single consumer (event thread)
+static load_event_t *ring;
+static uint32_t ring_size;
+static uint32_t ring_head;    // written by the generator
+static uint32_t ring_tail;    // written by the event thread
+
+// Generator parameters of the running step
+static uint32_t tag_count = DEFAULT_TAGS;
+static double step_rate;
+static uint64_t step_start_ns;
+static uint64_t step_end_ns;
+static volatile bool generator_done;
+static uint64_t offered, dropped;
+static int8_t tag_samples[AOA_ARRAY_MAX_REPORT_LENGTH];
+static uint8_t tag_samples_length;
+
+// Event thread accounting, owned by the event thread
+static uint64_t current_scheduled_ns;
+static uint64_t scheduled_ns[AOA_MAX_TAGS][SCHEDULED_SLOTS];
+static uint64_t stage_ns[STAGE_COUNT];
+static uint32_t stage_depth;
+static uint64_t *latencies;
+static uint64_t latency_count, latency_capacity;
+static double served_rate[AOA_MAX_TAGS];    // reports/s taken from the mailbox, last step
+
+/***************************************************************************************************
+ * Helpers
+ **************************************************************************************************/
+
+static uint64_t process_cpu_ns(void)
+{
+  struct rusage usage;
+
+  getrusage(RUSAGE_SELF, &usage);
+  return (uint64_t)(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000000ull
+         + (uint64_t)(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1000ull;
+}
+
+static void sleep_until_ns(uint64_t t_ns)
+{
+  struct timespec ts;
+
+  ts.tv_sec = t_ns / 1000000000ull;
+  ts.tv_nsec = t_ns % 1000000000ull;
+  clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+}
+
+static int compare_u64(const void *a, const void *b)
+{
+  uint64_t x = *(const uint64_t *)a;
+  uint64_t y = *(const uint64_t *)b;
+  return (x > y) - (x < y);
+}
+
+static double percentile_ms(const uint64_t *sorted, uint64_t count, double p)
+{
+  if (count == 0) {
+    return 0;
+  }
+  return sorted[(uint64_t)(p / 100.0 * (count - 1) + 0.5)] / 1e6;
+}
+
+// Only the outermost stage is charged, a wrapped call inside a stage is part of it.
+static inline uint64_t stage_enter(void)
+{
+  stage_depth++;
+  return stage_stats_now();
+}
+
+static inline void stage_leave(stage_t stage, uint64_t t0)
+{
+  if (--stage_depth == 0) {
+    stage_ns[stage] += stage_stats_now() - t0;
+  }
+}
+
+/***************************************************************************************************
+ * Link time wrappers (-Wl,--wrap), called by the locator sources
+ **************************************************************************************************/
+
+s8 *__real_make_I_Q(u8 len, float AOA_shift);
+sl_status_t __real_aoa_calculate(aoa_libitems_t *aoa_state, aoa_iq_report_t *iq_report, aoa_angle_t *angle);
+void __real_I_Q_to_CSV(aoa_iq_report_t *iq_report, int len, conn_properties_t *tag);
+sl_status_t __real_aoa_angle_to_string(aoa_angle_t *angle, char **str);
+
+s8 *__wrap_make_I_Q(u8 len, float AOA_shift)
+{
+  uint64_t t0 = stage_enter();
+  s8 *samples = __real_make_I_Q(len, AOA_shift);
+  stage_leave(STAGE_SIMULATE, t0);
+  return samples;
+}
+
+sl_status_t __wrap_aoa_calculate(aoa_libitems_t *aoa_state, aoa_iq_report_t *iq_report, aoa_angle_t *angle)
+{
+  uint64_t t0 = stage_enter();
+  conn_properties_t *tag;
+
+  // The report may be an older one of the tag, from its mailbox
+  for (uint8_t i = 0; (tag = get_connection_by_index(i)) != NULL; i++) {
+    if (&tag->aoa_states == aoa_state) {
+      current_scheduled_ns = scheduled_ns[tag->address.addr[0] % AOA_MAX_TAGS][iq_report->event_counter % SCHEDULED_SLOTS];
+      break;
+    }
+  }
+  sl_status_t sc = __real_aoa_calculate(aoa_state, iq_report, angle);
+  stage_leave(STAGE_ESTIMATE, t0);
+  return sc;
+}
+
+void __wrap_I_Q_to_CSV(aoa_iq_report_t *iq_report, int len, conn_properties_t *tag)
+{
+  uint64_t t0 = stage_enter();
+  __real_I_Q_to_CSV(iq_report, len, tag);
+  stage_leave(STAGE_CSV, t0);
+}
+
+sl_status_t __wrap_aoa_angle_to_string(aoa_angle_t *angle, char **str)
+{
+  uint64_t t0 = stage_enter();
+  sl_status_t sc = __real_aoa_angle_to_string(angle, str);
+  stage_leave(STAGE_PUBLISH, t0);
+  return sc;
+}
+
+// MQTT sink: no broker, the message is complete when it is handed over.
+mqtt_status_t __wrap_mqtt_init(mqtt_handle_t *handle)
+{
+  (void)handle;
+  return MQTT_SUCCESS;
+}
+
+mqtt_status_t __wrap_mqtt_publish(mqtt_handle_t *handle, const char *topic, const char *payload)
+{
+  uint64_t t0 = stage_enter();
+  volatile size_t length;
+
+  (void)handle;
+  // A broker client copies topic and payload into its send buffer.
+  length = strlen(topic) + strlen(payload);
+  (void)length;
+  if (latency_count < latency_capacity) {
+    latencies[latency_count++] = t0 - current_scheduled_ns;
+  }
+  stage_leave(STAGE_PUBLISH, t0);
+  return MQTT_SUCCESS;
+}
+
+mqtt_status_t __wrap_mqtt_step(mqtt_handle_t *handle)
+{
+  (void)handle;
+  return MQTT_SUCCESS;
+}
+
+mqtt_status_t __wrap_mqtt_deinit(mqtt_handle_t *handle)
+{
+  (void)handle;
+  return MQTT_SUCCESS;
+}
+
+/***************************************************************************************************
+ * Generator, plays the NCP
+ **************************************************************************************************/
+
+// Bytes waiting in the ring, the host receive buffer of the admission control
+static int32_t ring_backlog(void)
+{
+  uint32_t events = __atomic_load_n(&ring_head, __ATOMIC_ACQUIRE) - ring_tail;
+
+  return (int32_t)(events * (BGAPI_HEADER_BYTES + sizeof(struct sl_bt_evt_cte_receiver_silabs_iq_report_s)
+                             + tag_samples_length));
+}
+
+static void build_event(load_event_t *e, uint64_t sequence, uint64_t scheduled_ns)
+{
+  struct sl_bt_evt_cte_receiver_silabs_iq_report_s *r = &e->evt.msg.data.evt_cte_receiver_silabs_iq_report;
+  uint32_t tag = (uint32_t)(sequence % tag_count);
+
+  e->scheduled_ns = scheduled_ns;
+  e->evt.msg.header = sl_bt_evt_cte_receiver_silabs_iq_report_id;
+  r->status = 0;
+  memset(r->address.addr, 0, sizeof(r->address.addr));
+  r->address.addr[0] = (uint8_t)tag;
+  r->address.addr[1] = (uint8_t)(tag >> 8);
+  r->address.addr[5] = 0xAA;
+  r->address_type = 0;
+  r->phy = 1;
+  // Data channels 0..36 in turn, as the tags hop
+  r->channel = (uint8_t)((sequence / tag_count) % 37);
+  r->rssi = -50;
+  r->packet_counter = (uint16_t)(sequence / tag_count);
+  r->samples.len = tag_samples_length;
+  memcpy(r->samples.data, tag_samples, tag_samples_length);
+}
+
+static void *generator_thread(void *arg)
+{
+  uint64_t sequence = 0;
+  double interval_ns = 1e9 / step_rate;
+
+  (void)arg;
+  for (;;) {
+    uint64_t now = stage_stats_now();
+    uint64_t scheduled = step_start_ns + (uint64_t)(sequence * interval_ns);
+
+    if (scheduled >= step_end_ns) {
+      break;
+    }
+    if (scheduled > now) {
+      uint64_t wake = scheduled;
+      if (wake - now > GENERATOR_TICK_NS) {
+        wake = now + GENERATOR_TICK_NS;
+      }
+      sleep_until_ns(wake);
+      continue;
+    }
+    // Every event due by now, the ring decides what is dropped.
+    while ((scheduled <= now) && (scheduled < step_end_ns)) {
+      uint32_t head = ring_head;
+      uint32_t tail = __atomic_load_n(&ring_tail, __ATOMIC_ACQUIRE);
+      if (head - tail < ring_size) {
+        build_event(&ring[head % ring_size], sequence, scheduled);
+        __atomic_store_n(&ring_head, head + 1, __ATOMIC_RELEASE);
+      } else {
+        dropped++;
+      }
+      offered++;
+      sequence++;
+      scheduled = step_start_ns + (uint64_t)(sequence * interval_ns);
+    }
+  }
+  __atomic_store_n(&generator_done, true, __ATOMIC_RELEASE);
+  return NULL;
+}
+
+/***************************************************************************************************
+ * Steps
+ **************************************************************************************************/
+
+static void run_step(double rate, double step_s, step_result_t *result)
+{
+  pthread_t generator;
+  uint64_t busy_ns = 0, handled = 0;
+  uint64_t t0, wall_ns, cpu0, coalesced0 = 0, coalesced = 0;
+  uint64_t served0[AOA_MAX_TAGS] = { 0 };
+  uint32_t levels = 0, tags = 0;
+  conn_properties_t *tag;
+
+  memset(stage_ns, 0, sizeof(stage_ns));
+  latency_count = 0;
+  offered = 0;
+  dropped = 0;
+  generator_done = false;
+  step_rate = rate;
+  step_start_ns = stage_stats_now() + 10000000ull;
+  step_end_ns = step_start_ns + (uint64_t)(step_s * 1e9);
+
+  for (uint8_t i = 0; (tag = get_connection_by_index(i)) != NULL; i++) {
+    coalesced0 += tag->mailbox.coalesced;
+    served0[i] = tag->scheduler.served;
+  }
+  cpu0 = process_cpu_ns();
+  pthread_create(&generator, NULL, generator_thread, NULL);
+  t0 = stage_stats_now();
+  for (;;) {
+    uint32_t tail = ring_tail;
+    uint32_t head = __atomic_load_n(&ring_head, __ATOMIC_ACQUIRE);
+    if (tail == head) {
+      if (__atomic_load_n(&generator_done, __ATOMIC_ACQUIRE)
+          && (__atomic_load_n(&ring_head, __ATOMIC_ACQUIRE) == tail)) {
+        break;
+      }
+      // The main loop of the locator, between the events
+      uint64_t e0 = stage_stats_now();
+      app_process_pending();
+      busy_ns += stage_stats_now() - e0;
+      sleep_until_ns(stage_stats_now() + 50000);
+      continue;
+    }
+    load_event_t *e = &ring[tail % ring_size];
+    struct sl_bt_evt_cte_receiver_silabs_iq_report_s *r = &e->evt.msg.data.evt_cte_receiver_silabs_iq_report;
+    uint64_t e0 = stage_stats_now();
+    current_scheduled_ns = e->scheduled_ns;
+    scheduled_ns[r->address.addr[0] % AOA_MAX_TAGS][r->packet_counter % SCHEDULED_SLOTS] = e->scheduled_ns;
+    app_bt_on_event(&e->evt.msg);
+    app_process_pending();
+    busy_ns += stage_stats_now() - e0;
+    handled++;
+    __atomic_store_n(&ring_tail, tail + 1, __ATOMIC_RELEASE);
+  }
+  wall_ns = stage_stats_now() - t0;
+  pthread_join(generator, NULL);
+  // Reports still in the mailboxes belong to this step, the next one starts clean
+  for (uint8_t i = 0; (tag = get_connection_by_index(i)) != NULL; i++) {
+    coalesced += tag->mailbox.coalesced;
+    served_rate[i] = (tag->scheduler.served - served0[i]) / (wall_ns / 1e9);
+    mailbox_clear(&tag->mailbox);
+    levels += governor_tag_level(&tag->governor);
+    tags++;
+  }
+
+  qsort(latencies, latency_count, sizeof(*latencies), compare_u64);
+  result->rate = rate;
+  result->offered = offered;
+  result->dropped = dropped;
+  result->handled = handled;
+  result->published = latency_count;
+  result->coalesced = coalesced - coalesced0;
+  result->p50_ms = percentile_ms(latencies, latency_count, 50.0);
+  result->p99_ms = percentile_ms(latencies, latency_count, 99.0);
+  result->max_ms = (latency_count > 0) ? latencies[latency_count - 1] / 1e6 : 0;
+  result->busy_pct = 100.0 * busy_ns / wall_ns;
+  result->process_cpu_pct = 100.0 * (process_cpu_ns() - cpu0) / wall_ns;
+  result->level = (tags > 0) ? (double)levels / tags : 0;
+  uint64_t staged_ns = 0;
+  for (int s = 0; s < STAGE_DISPATCH; s++) {
+    staged_ns += stage_ns[s];
+  }
+  stage_ns[STAGE_DISPATCH] = (busy_ns > staged_ns) ? busy_ns - staged_ns : 0;
+  for (int s = 0; s < STAGE_COUNT; s++) {
+    result->stage_us[s] = (handled > 0) ? stage_ns[s] / 1e3 / handled : 0;
+  }
+}
+
+static void print_step(const step_result_t *r)
+{
+  fprintf(stderr, "%10.0f %9llu %6.2f %6.2f %8.1f %8.1f %8.1f %6.1f %6.1f %6.2f  %s\n",
+          r->rate, (unsigned long long)r->offered,
+          (r->offered > 0) ? 100.0 * r->dropped / r->offered : 0.0,
+          (r->offered > 0) ? 100.0 * r->coalesced / r->offered : 0.0,
+          r->p50_ms, r->p99_ms, r->max_ms, r->busy_pct, r->process_cpu_pct, r->level,
+          r->pass ? "ok" : "SLO breached");
+}
+
+static void write_report(const char *filename, const step_result_t *steps, uint32_t count)
+{
+  FILE *f = fopen(filename, "wb");
+
+  if (f == NULL) {
+    fprintf(stderr, "Failed to open %s\n", filename);
+    return;
+  }
+  fprintf(f, "rate;offered;dropped;handled;coalesced;published;p50_ms;p99_ms;max_ms;busy_pct;process_cpu_pct;level");
+  for (int s = 0; s < STAGE_COUNT; s++) {
+    fprintf(f, ";%s_us", stage_names[s]);
+  }
+  fprintf(f, ";slo\r\n");
+  for (uint32_t i = 0; i < count; i++) {
+    const step_result_t *r = &steps[i];
+    fprintf(f, "%.0f;%llu;%llu;%llu;%llu;%llu;%.3f;%.3f;%.3f;%.1f;%.1f;%.2f", r->rate,
+            (unsigned long long)r->offered, (unsigned long long)r->dropped,
+            (unsigned long long)r->handled, (unsigned long long)r->coalesced,
+            (unsigned long long)r->published,
+            r->p50_ms, r->p99_ms, r->max_ms, r->busy_pct, r->process_cpu_pct, r->level);
+    for (int s = 0; s < STAGE_COUNT; s++) {
+      fprintf(f, ";%.2f", r->stage_us[s]);
+    }
+    fprintf(f, ";%s\r\n", r->pass ? "ok" : "breached");
+  }
+  fclose(f);
+}
+
+int main(int argc, char *argv[])
+{
+  double rate = DEFAULT_RATE, rate_step = DEFAULT_RATE_STEP, max_rate = DEFAULT_MAX_RATE;
+  double step_s = DEFAULT_STEP_S, p99_limit_ms = DEFAULT_P99_MS, drop_limit_pct = DEFAULT_DROP_PCT;
+  const char *report_file = NULL;
+  const char *trace_file = TRACE_DEFAULT_FILE;
+  char *sep;
+  step_result_t steps[MAX_STEPS];
+  const step_result_t *capacity = NULL;
+  uint32_t step_count = 0;
+  conn_properties_t *tag;
+  uint8_t array_type;
+  int opt;
+
+  ring_size = DEFAULT_QUEUE;
+  cnt_to_csv = 0;
+  while ((opt = getopt(argc, argv, "n:r:s:m:d:p:x:q:a:l:o:T:c:k:G:S:h")) != -1) {
+    switch (opt) {
+      case 'n':
+        tag_count = (uint32_t)atol(optarg);
+        break;
+      case 'r':
+        rate = atof(optarg);
+        break;
+      case 's':
+        rate_step = atof(optarg);
+        break;
+      case 'm':
+        max_rate = atof(optarg);
+        break;
+      case 'd':
+        step_s = atof(optarg);
+        break;
+      case 'p':
+        p99_limit_ms = atof(optarg);
+        break;
+      case 'x':
+        drop_limit_pct = atof(optarg);
+        break;
+      case 'q':
+        ring_size = (uint32_t)atol(optarg);
+        break;
+      case 'a':
+        if (aoa_array_type_from_string(optarg, &array_type) != SL_STATUS_OK) {
+          fprintf(stderr, "Unknown array type '%s'\n", optarg);
+          exit(EXIT_FAILURE);
+        }
+        aoa_array_set_type(&aoa_array_config, array_type);
+        break;
+      case 'l':
+        cnt_to_csv = (uint32_t)atol(optarg);
+        break;
+      case 'o':
+        report_file = optarg;
+        break;
+      case 'c':
+        admission_target_load = atof(optarg) / 100.0;
+        break;
+      case 'k':
+        mailbox_depth = (uint32_t)atol(optarg);
+        break;
+      case 'G':
+        governor_budget = atof(optarg) / 100.0;
+        break;
+      case 'S':
+        scheduler_budget_ns = (uint64_t)(atof(optarg) * 1000.0);
+        break;
+      case 'T':
+        sep = strchr(optarg, ':');
+        if (sep != NULL) {
+          *sep = '\0';
+          trace_file = sep + 1;
+        }
+        trace_sample_every = (uint32_t)atol(optarg);
+        break;
+      default:
+        fprintf(stderr, USAGE, argv[0]);
+        exit(opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+  }
+  if ((tag_count == 0) || (tag_count > AOA_MAX_TAGS) || (ring_size == 0)
+      || (rate <= 0) || (rate_step <= 1.0) || (step_s <= 0)
+      || (mailbox_depth < 1) || (mailbox_depth > MAILBOX_MAX_DEPTH)) {
+    fprintf(stderr, "Invalid parameters, 1 to %d tags, rate step above 1, 1 to %d reports kept per tag.\n",
+            AOA_MAX_TAGS, MAILBOX_MAX_DEPTH);
+    fprintf(stderr, USAGE, argv[0]);
+    exit(EXIT_FAILURE);
+  }
+
+  // The setup of app_init() without the NCP
+  aoa_whitelist_init();
+  if (log_writer_start() != SL_STATUS_OK) {
+    fprintf(stderr, "Failed to start the log writer, logging disabled\n");
+  }
+  fprintf(stderr, "kernels: %s\n", simd_init()->name);
+  init_connection();
+  admission_set_backlog(ring_backlog);
+
+  tag_samples_length = (uint8_t)aoa_array_report_length(&aoa_array_config);
+  memcpy(tag_samples, __real_make_I_Q(tag_samples_length, 0.0f), tag_samples_length);
+  ring = calloc(ring_size, sizeof(*ring));
+  latency_capacity = (uint64_t)(max_rate * step_s) + ring_size;
+  latencies = malloc(latency_capacity * sizeof(*latencies));
+  if ((ring == NULL) || (latencies == NULL)) {
+    fprintf(stderr, "Out of memory, lower -m or -d.\n");
+    exit(EXIT_FAILURE);
+  }
+
+  // The locator logs every report, keep the console for the report.
+  if (freopen(NULL_DEVICE, "w", stdout) == NULL) {
+    fprintf(stderr, "Failed to silence stdout\n");
+  }
+
+  fprintf(stderr, "%u tags, %s, queue %u events, %u reports kept per tag, SLO p99 <= %.1f ms, drops <= %.2f %%\n",
+          tag_count, aoa_array_type_to_string(aoa_array_config.array_type), ring_size, mailbox_depth,
+          p99_limit_ms, drop_limit_pct);
+  fprintf(stderr, "%10s %9s %6s %6s %8s %8s %8s %6s %6s %6s\n",
+          "events/s", "offered", "drop%", "coal%", "p50 ms", "p99 ms", "max ms", "busy%", "cpu%", "level");
+  while ((step_count < MAX_STEPS) && (rate <= max_rate)) {
+    step_result_t *r = &steps[step_count++];
+    run_step(rate, step_s, r);
+    r->pass = (r->p99_ms <= p99_limit_ms)
+              && ((r->offered == 0) || (100.0 * r->dropped / r->offered <= drop_limit_pct));
+    print_step(r);
+    if (!r->pass) {
+      break;
+    }
+    capacity = r;
+    rate *= rate_step;
+  }
+
+  if (capacity != NULL) {
+    double handled_rate = capacity->rate * capacity->handled / (capacity->offered ? capacity->offered : 1);
+    fprintf(stderr, "\ncapacity: %u tags at %.0f events/s (%.1f per tag), %.0f published/s, p99 %.2f ms\n",
+            tag_count, capacity->rate, capacity->rate / tag_count,
+            capacity->rate * capacity->published / (capacity->offered ? capacity->offered : 1),
+            capacity->p99_ms);
+    fprintf(stderr, "event thread per event, at capacity:\n");
+    for (int s = 0; s < STAGE_COUNT; s++) {
+      double busy_us = 0;
+      for (int t = 0; t < STAGE_COUNT; t++) {
+        busy_us += capacity->stage_us[t];
+      }
+      fprintf(stderr, "  %-9s %9.2f us  %5.1f %%  %5.1f %% of a core\n", stage_names[s],
+              capacity->stage_us[s], (busy_us > 0) ? 100.0 * capacity->stage_us[s] / busy_us : 0.0,
+              capacity->stage_us[s] * handled_rate / 1e4);
+    }
+  } else {
+    fprintf(stderr, "\nSLO breached at the first step, lower -r.\n");
+  }
+  fprintf(stderr, "served/s per tag, last step:");
+  for (uint8_t i = 0; (tag = get_connection_by_index(i)) != NULL; i++) {
+    fprintf(stderr, " %.1f", served_rate[i]);
+  }
+  fprintf(stderr, "\n");
+  if (report_file != NULL) {
+    write_report(report_file, steps, step_count);
+  }
+  if ((trace_sample_every != 0) && (trace_export(trace_file) != SL_STATUS_OK)) {
+    fprintf(stderr, "Failed to write the trace to %s\n", trace_file);
+  }
+
+  log_writer_stop();
+  free(latencies);
+  free(ring);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,79 @@
+/***************************************************************************//**
+ * @file
+ * @brief Fixed-format number rendering for the CSV logs.
+ *
+ * Replacements for the printf conversions used by the CSV logs. They append
+ * to a caller provided buffer, never write a terminating zero and return the
+ * new end of the text. The output is the same as printf's:
+ *   csv_put_int()     "%i"
+ *   csv_put_float1()  "%.1f" of a float argument
+ ******************************************************************************/
+
+#ifndef CSV_FORMAT_H_
+#define CSV_FORMAT_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <math.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+static inline char *csv_put_char(char *p, char c)
+{
+  *p++ = c;
+  return p;
+}
+
+static inline char *csv_put_u64(char *p, uint64_t value)
+{
+  char tmp[20];
+  int n = 0;
+
+  do {
+    tmp[n++] = (char)('0' + value % 10);
+    value /= 10;
+  } while (value != 0);
+  while (n > 0) {
+    *p++ = tmp[--n];
+  }
+  return p;
+}
+
+static inline char *csv_put_int(char *p, int32_t value)
+{
+  if (value < 0) {
+    *p++ = '-';
+    return csv_put_u64(p, 0u - (uint32_t)value);
+  }
+  return csv_put_u64(p, (uint32_t)value);
+}
+
+static inline char *csv_put_float1(char *p, float value)
+{
+  // A float has 24 significant bits, times 10 is exact in a double, so
+  // rint() sees the same value printf rounds and breaks ties the same way.
+  double scaled = rint((double)value * 10.0);
+  uint64_t q;
+
+  if (!(fabs(scaled) < 1e15)) {
+    // nan, inf and values too large for the fast path
+    return p + sprintf(p, "%.1f", value);
+  }
+  q = (uint64_t)fabs(scaled);
+  // printf keeps the sign of values that round to zero, "-0.0"
+  if (signbit(value)) {
+    *p++ = '-';
+  }
+  p = csv_put_u64(p, q / 10);
+  *p++ = '.';
+  *p++ = (char)('0' + q % 10);
+  return p;
+}
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* CSV_FORMAT_H_ */
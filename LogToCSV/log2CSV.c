@@ -13,45 +13,104 @@
 #include "conn.h"
 #include "app_config.h"
 #include "aoa.h"
+#include "log_writer.h"
+#include "csv_format.h"
 
 
-extern FILE *fCsv;
 extern float OneSwitchRotate;
 
+log_stream_t csv_stream = LOG_STREAM_INVALID;
+log_stream_t sample_stream = LOG_STREAM_INVALID;
+
 u32 DeadCnt = DEAD_START_CNT;
 uint32_t cnt_to_csv = LOG_TO_CSV;
 bool onLog = 0;
 
+/*
+ * Render one analysed report in the IQ_Report_data_log.csv layout into
+ * buffer, at most CSV_REPORT_MAX_LEN(iq_report->length) bytes.
+ * Returns the length of the text. Same output as the former per-field
+ * fprintf, see csv_format.h; the values come from an IQ_ANALYTICS_EXACT analysis
+ */
+uint32_t I_Q_render_CSV(char *buffer, const iq_analytics_t *a, const aoa_iq_report_t *iq_report)
+{
+	uint32_t elements = a->num_elements;
+	const float *diff = a->element_diff;
+	char *p = buffer;
+
+	memcpy(p, ";;;;Channel ", 12); p += 12;
+	p = csv_put_int(p, iq_report->channel);
+	memcpy(p, ", Rssi ", 7); p += 7;
+	p = csv_put_int(p, iq_report->rssi);
+	memcpy(p, "\r\n ", 3); p += 3;
+
+	for (uint32_t row = 0; row < a->num_rows; row++)
+	{
+		p = csv_put_int(p, row + 1);
+		p = csv_put_char(p, ';');
+		for (uint32_t b = 0; b < elements; b++)
+		{
+			uint32_t k = row * elements + b;
+
+			p = csv_put_int(p, (int)a->i[k]);
+			p = csv_put_char(p, ';');
+			p = csv_put_int(p, (int)a->q[k]);
+			p = csv_put_char(p, ';');
+
+			float deg = (a->phase[k]+ t_pi)* rad2Dg;
+			p = csv_put_float1(p, deg);
+			p = csv_put_char(p, ';');
+			p = csv_put_float1(p, a->own_shift[k]* rad2Dg);
+			p = csv_put_char(p, ';');
+			p = csv_put_float1(p, a->amplitude[k]);
+			p = csv_put_char(p, ';');
+			p = csv_put_char(p, ';');
+		}
+		for (uint32_t b = 0; b + 1 < elements; b++)
+		{
+			p = csv_put_float1(p, *diff++ * rad2Dg);
+			p = csv_put_char(p, ';');
+		}
+		memcpy(p, "\r\n", 2); p += 2;
+	}
+
+	memcpy(p, "\r\n\r\n", 4); p += 4;
+	return (uint32_t)(p - buffer);
+}
+
 void I_Q_to_CSV(aoa_iq_report_t *iq_report, int len, conn_properties_t *tag)
 {
+	log_line_t line;
+
 	if (DeadCnt) DeadCnt--;
 
 	if ((cnt_to_csv == 0) || (DeadCnt!= 0)) return;
 
 
-	cnt_to_csv--;
+	if (cnt_to_csv != LOG_TO_CSV_CONTINUOUS)
+		cnt_to_csv--;
 	if (cnt_to_csv == 0) {
-		if (fCsv != NULL)
-			fclose(fCsv);
 		onLog = 0;
 	}
 	else onLog = 1;
 
-	int8_t* iq_data = iq_report->samples;
-
-	if (fCsv == NULL) {
-		fCsv = fopen("Logs/IQ_Report_data_log.csv", "wb");
-		fprintf(fCsv, "N;");
-		for (int r = 0; r < AOA_NUM_ARRAY_ELEMENTS; ++r) {
-			fprintf(fCsv, "i%i;q%i;Degree%i;Own Shft%i;Amplitude%i;;"
-					,r,r,r,r,r);
+	if (csv_stream == LOG_STREAM_INVALID) {
+		csv_stream = log_writer_open("Logs/IQ_Report_data_log.csv");
+		uint8_t elements = tag->aoa_states.array.num_array_elements;
+		if (log_line_begin(&line, csv_stream, 64 + elements * 64)) {
+			log_line_printf(&line, "N;");
+			for (int r = 0; r < elements; ++r) {
+				log_line_printf(&line, "i%i;q%i;Degree%i;Own Shft%i;Amplitude%i;;"
+						,r,r,r,r,r);
+			}
+			for (int r = 0; r < elements-1; ++r) {
+				log_line_printf(&line, "Degr%i-Degr%i;"
+						,r+1,r);
+			}
+
+			log_line_printf(&line, "\r\n\r\n" );
+			log_line_end(&line);
 		}
-		for (int r = 0; r < AOA_NUM_ARRAY_ELEMENTS-1; ++r) {
-			fprintf(fCsv, "Degr%i-Degr%i;"
-					,r+1,r);
-		}
-
-		fprintf(fCsv, "\r\n\r\n" );
 	}
 
 //  sl_rtl_clib_iq_sample_qa_dataset_t *qa_s =&qa_dataset;
@@ -66,56 +125,20 @@ void I_Q_to_CSV(aoa_iq_report_t *iq_report, int len, conn_properties_t *tag)
 //  }
 
 
-	fprintf(fCsv, ";;;;Channel %i, Rssi %i\r\n ", iq_report->channel, iq_report->rssi );
-
-	int8_t *end =   iq_data+len;
-		float prevDeg[16] = {0,0,0,0};
-		float OwnDeg[16] = {0,0,0,0};
-		int  N =1;
-	while (iq_data < end)
-	{
-			fprintf(fCsv, "%i;", N);
-			N++;
-		for (int b = 0; b < AOA_NUM_ARRAY_ELEMENTS; b++)
-		{
-
-			s8 _i = *iq_data;iq_data++;
-			fprintf(fCsv, "%i;", _i);
-			s8 _q = *iq_data;iq_data++;
-			fprintf(fCsv, "%i;", _q);
-
-			float rad = atan2(_q,_i);
-			OwnDeg[b] = rad;
-			float deg = (rad+ t_pi)* rad2Dg;
-			fprintf(fCsv, "%.1f;", deg );
-
-			float OwnDiff = restrictRad(prevDeg[b] - rad);
-//			float diff = (prevDeg[b] - rad)* rad2Dg;
-
-			fprintf(fCsv, "%.1f;", OwnDiff* rad2Dg );
-			prevDeg[b] =   rad ;
-
-			float Power = sqrt(_i*_i + _q*_q);
-			fprintf(fCsv, "%.1f;;", Power);
-
-
-			if (iq_data > end)
-				break;
-		}
-//		extern float tShftsample;
-		for (int b = 0; b < AOA_NUM_ARRAY_ELEMENTS-1; b++)
-		{
-//			float diff = convto360(OwnDeg[b+1]- OwnDeg[b]- 360*tShftsample);
-			float diff = restrictRad(OwnDeg[b+1]- OwnDeg[b]-OneSwitchRotate)*rad2Dg;
-			fprintf(fCsv, "%.1f;", diff );
-		}
-		fprintf(fCsv, "\r\n");
+	// The whole report is rendered into the writer ring and committed once,
+	// if the ring is full the report is dropped (and counted) instead.
+	if (log_line_begin(&line, csv_stream, CSV_REPORT_MAX_LEN(len))) {
+		// Shared with the estimator side, computed once per report
+		const iq_analytics_t *a = iq_analytics_update(&tag->aoa_states.analytics, iq_report,
+				OneSwitchRotate, IQ_ANALYTICS_EXACT);
+		line.len = I_Q_render_CSV(line.data, a, iq_report);
+		log_line_end(&line);
 	}
 
-
-
-	fprintf(fCsv, "\r\n\r\n");
-
+	if (cnt_to_csv == 0) {
+		log_writer_close(csv_stream);
+		csv_stream = LOG_STREAM_INVALID;
+	}
 }
 
 
@@ -11,11 +11,20 @@
 
 #define LOG_TO_CSV                   15
 #define DEAD_START_CNT               30
+// cnt_to_csv value for logging every report (-l -1)
+#define LOG_TO_CSV_CONTINUOUS        0xFFFFFFFFu
 
 #include "conn.h"
+#include "log_writer.h"
+#include "iq_analytics.h"
+
+// Upper bound of the text rendered for one report of len IQ values
+#define CSV_REPORT_MAX_LEN(len)      (256 + (len) * 32 + AOA_ARRAY_MAX_ELEMENTS * 8)
 
 extern void I_Q_to_CSV(aoa_iq_report_t *iq_report, int len, conn_properties_t *tag);
+extern uint32_t I_Q_render_CSV(char *buffer, const iq_analytics_t *a, const aoa_iq_report_t *iq_report);
 
-extern FILE *fCsv;
+extern log_stream_t csv_stream;
+extern log_stream_t sample_stream;
 extern u32 cnt_to_csv;
 #endif /* LOG2CSV_H_ */
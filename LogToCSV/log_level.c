@@ -0,0 +1,47 @@
+/***************************************************************************//**
+ * @file
+ * @brief Leveled console logging of the report path.
+ ******************************************************************************/
+
+#include "log_level.h"
+#include "stage_stats.h"
+
+/***************************************************************************************************
+ * Public Variables
+ **************************************************************************************************/
+
+uint32_t log_level_threshold = LOG_LEVEL_WARNING;
+
+/***************************************************************************************************
+ * Static Function Definitions
+ **************************************************************************************************/
+
+/***************************************************************************************************
+ * Public Function Definitions
+ **************************************************************************************************/
+
+void log_level_set_verbose(uint32_t verbose_level)
+{
+  log_level_threshold = (verbose_level < LOG_LEVEL_DEBUG - LOG_LEVEL_WARNING)
+                        ? LOG_LEVEL_WARNING + verbose_level : LOG_LEVEL_DEBUG;
+}
+
+bool log_limit_pass(log_limit_t *limit)
+{
+  uint64_t now = stage_stats_now();
+
+  if (now - limit->period_start_ns >= LOG_LIMIT_PERIOD_MS * 1000000ull) {
+    if (limit->suppressed > 0) {
+      app_log("(%u similar messages suppressed)\n", limit->suppressed);
+    }
+    limit->period_start_ns = now;
+    limit->printed = 0;
+    limit->suppressed = 0;
+  }
+  if (limit->printed < LOG_LIMIT_BURST) {
+    limit->printed++;
+    return true;
+  }
+  limit->suppressed++;
+  return false;
+}
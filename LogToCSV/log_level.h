@@ -0,0 +1,116 @@
+/***************************************************************************//**
+ * @file
+ * @brief Leveled console logging of the report path.
+ *
+ * A message is printed with app_log() if its level is within the runtime
+ * threshold, LOG_LEVEL_WARNING + verbose level (-v):
+ *   -v 0   errors and warnings
+ *   -v 1   + info, e.g. the angle of every report
+ *   -v 2   + debug, e.g. phase rotation and channel of every report
+ * Levels above LOG_LEVEL_MAX are removed by the preprocessor, arguments
+ * included; 'make release' builds with LOG_LEVEL_MAX=LOG_LEVEL_INFO.
+ *
+ * Warnings are rate limited per call site: at most LOG_LIMIT_BURST in
+ * LOG_LIMIT_PERIOD_MS, the number suppressed is printed with the next one.
+ * The limit state is per thread, so the replay workers estimating on their
+ * own threads each have their own limit.
+ ******************************************************************************/
+
+#ifndef LOG_LEVEL_H_
+#define LOG_LEVEL_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "app_log.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LOG_LEVEL_ERROR           0
+#define LOG_LEVEL_WARNING         1
+#define LOG_LEVEL_INFO            2
+#define LOG_LEVEL_DEBUG           3
+
+#ifndef LOG_LEVEL_MAX
+#define LOG_LEVEL_MAX             LOG_LEVEL_DEBUG
+#endif
+
+#define LOG_LIMIT_BURST           10
+#define LOG_LIMIT_PERIOD_MS       1000
+
+/***************************************************************************************************
+ * Type Definitions
+ **************************************************************************************************/
+
+typedef struct {
+  uint64_t period_start_ns;
+  uint32_t printed;
+  uint32_t suppressed;
+} log_limit_t;
+
+/***************************************************************************************************
+ * Public variables
+ **************************************************************************************************/
+
+// Highest level printed, set with log_level_set_verbose()
+extern uint32_t log_level_threshold;
+
+/***************************************************************************************************
+ * Function Declarations
+ **************************************************************************************************/
+
+void log_level_set_verbose(uint32_t verbose_level);
+
+// True if the message of this call site may be printed, prints the number
+// of messages suppressed before it.
+bool log_limit_pass(log_limit_t *limit);
+
+static inline bool log_level_enabled(uint32_t level)
+{
+  return level <= log_level_threshold;
+}
+
+#define log_at(level, ...)                                    \
+  do {                                                        \
+    if (log_level_enabled(level)) {                           \
+      app_log(__VA_ARGS__);                                   \
+    }                                                         \
+  } while (0)
+
+// Removed levels stay type checked, but no code or string is emitted
+#define log_none(...)                                         \
+  do {                                                        \
+    if (0) {                                                  \
+      app_log(__VA_ARGS__);                                   \
+    }                                                         \
+  } while (0)
+
+#define log_error(...)          log_at(LOG_LEVEL_ERROR, __VA_ARGS__)
+
+#if LOG_LEVEL_MAX >= LOG_LEVEL_INFO
+#define log_info(...)           log_at(LOG_LEVEL_INFO, __VA_ARGS__)
+#else
+#define log_info(...)           log_none(__VA_ARGS__)
+#endif
+
+#if LOG_LEVEL_MAX >= LOG_LEVEL_DEBUG
+#define log_debug(...)          log_at(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#else
+#define log_debug(...)          log_none(__VA_ARGS__)
+#endif
+
+#define log_warning(...)                                      \
+  do {                                                        \
+    static __thread log_limit_t log_limit_;                   \
+    if (log_level_enabled(LOG_LEVEL_WARNING)                  \
+        && log_limit_pass(&log_limit_)) {                     \
+      app_log(__VA_ARGS__);                                   \
+    }                                                         \
+  } while (0)
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* LOG_LEVEL_H_ */
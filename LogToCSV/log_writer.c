@@ -0,0 +1,390 @@
+/***************************************************************************//**
+ * @file
+ * @brief Asynchronous log file writer.
+ *
+ * Ring layout: messages are 8 byte aligned, each starts with a
+ * log_message_t header. A message never wraps; if it does not fit before the
+ * end of the ring, a padding message fills the gap and it starts at offset 0.
+ * head is only written by the producer, tail only by the writer thread.
+ ******************************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "log_writer.h"
+
+#define RING_MASK          (LOG_WRITER_RING_SIZE - 1u)
+#define ALIGN8(x)          (((x) + 7u) & ~7u)
+#define IDLE_SLEEP_NS      2000000
+
+typedef enum {
+  LOG_CMD_PAD = 0,
+  LOG_CMD_DATA,
+  LOG_CMD_OPEN,
+  LOG_CMD_CLOSE
+} log_cmd_t;
+
+typedef struct {
+  uint32_t len;             // payload length
+  uint16_t stream;
+  uint8_t cmd;
+  uint8_t reserved;
+} log_message_t;
+
+typedef struct {
+  FILE *file;
+  char *buffer;
+} log_file_t;
+
+/***************************************************************************************************
+ * Static Variables
+ **************************************************************************************************/
+
+static uint8_t *ring;
+static uint64_t head;                 // producer position
+static uint64_t tail;                 // writer thread position
+static volatile int running;
+static pthread_t writer_thread;
+
+// Producer side state
+static bool stream_used[LOG_WRITER_MAX_STREAMS];
+static uint64_t reserved_head;        // head after a pending padding message
+static log_message_t *reserved_message;
+
+// Writer thread side state
+static log_file_t files[LOG_WRITER_MAX_STREAMS];
+
+// Statistics, updated with relaxed atomics so they can be read from any thread
+static log_writer_stats_t stats;
+
+/***************************************************************************************************
+ * Static Function Declarations
+ **************************************************************************************************/
+
+static void *writer_main(void *arg);
+static void process_message(const log_message_t *message);
+static void flush_files(void);
+static log_message_t *reserve_message(log_cmd_t cmd, log_stream_t stream, uint32_t len);
+static sl_status_t send_control(log_cmd_t cmd, log_stream_t stream, const void *data, uint32_t len);
+
+/***************************************************************************************************
+ * Public Function Definitions
+ **************************************************************************************************/
+
+sl_status_t log_writer_start(void)
+{
+  if (running) {
+    return SL_STATUS_OK;
+  }
+  ring = malloc(LOG_WRITER_RING_SIZE);
+  if (ring == NULL) {
+    return SL_STATUS_ALLOCATION_FAILED;
+  }
+  head = 0;
+  tail = 0;
+  memset(&stats, 0, sizeof(stats));
+  __atomic_store_n(&running, 1, __ATOMIC_RELEASE);
+  if (pthread_create(&writer_thread, NULL, writer_main, NULL) != 0) {
+    running = 0;
+    free(ring);
+    ring = NULL;
+    return SL_STATUS_FAIL;
+  }
+  return SL_STATUS_OK;
+}
+
+void log_writer_stop(void)
+{
+  if (!running) {
+    return;
+  }
+  for (log_stream_t s = 0; s < LOG_WRITER_MAX_STREAMS; s++) {
+    if (stream_used[s]) {
+      log_writer_close(s);
+    }
+  }
+  // The writer thread drains the ring before it exits.
+  __atomic_store_n(&running, 0, __ATOMIC_RELEASE);
+  pthread_join(writer_thread, NULL);
+  free(ring);
+  ring = NULL;
+}
+
+bool log_writer_running(void)
+{
+  return __atomic_load_n(&running, __ATOMIC_ACQUIRE) != 0;
+}
+
+log_stream_t log_writer_open(const char *filename)
+{
+  log_stream_t stream;
+
+  if (!running) {
+    return LOG_STREAM_INVALID;
+  }
+  for (stream = 0; stream < LOG_WRITER_MAX_STREAMS; stream++) {
+    if (!stream_used[stream]) {
+      break;
+    }
+  }
+  if (stream == LOG_WRITER_MAX_STREAMS) {
+    return LOG_STREAM_INVALID;
+  }
+  if (send_control(LOG_CMD_OPEN, stream, filename, strlen(filename) + 1) != SL_STATUS_OK) {
+    return LOG_STREAM_INVALID;
+  }
+  stream_used[stream] = true;
+  return stream;
+}
+
+void log_writer_close(log_stream_t stream)
+{
+  if (!running || (stream < 0) || (stream >= LOG_WRITER_MAX_STREAMS) || !stream_used[stream]) {
+    return;
+  }
+  send_control(LOG_CMD_CLOSE, stream, NULL, 0);
+  stream_used[stream] = false;
+}
+
+void *log_writer_reserve(log_stream_t stream, uint32_t len)
+{
+  log_message_t *message;
+
+  if (!running || (stream < 0) || (stream >= LOG_WRITER_MAX_STREAMS) || !stream_used[stream]) {
+    return NULL;
+  }
+  message = reserve_message(LOG_CMD_DATA, stream, len);
+  if (message == NULL) {
+    __atomic_fetch_add(&stats.messages_dropped, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&stats.bytes_dropped, len, __ATOMIC_RELAXED);
+    return NULL;
+  }
+  return message + 1;
+}
+
+void log_writer_commit(uint32_t len)
+{
+  uint64_t new_head;
+  uint32_t used;
+
+  if (reserved_message == NULL) {
+    return;
+  }
+  reserved_message->len = len;
+  new_head = reserved_head + sizeof(log_message_t) + ALIGN8(len);
+  reserved_message = NULL;
+  __atomic_store_n(&head, new_head, __ATOMIC_RELEASE);
+
+  used = (uint32_t)(new_head - __atomic_load_n(&tail, __ATOMIC_ACQUIRE));
+  __atomic_store_n(&stats.ring_used, used, __ATOMIC_RELAXED);
+  if (used > stats.ring_high_water) {
+    __atomic_store_n(&stats.ring_high_water, used, __ATOMIC_RELAXED);
+  }
+}
+
+sl_status_t log_writer_write(log_stream_t stream, const void *data, uint32_t len)
+{
+  void *p = log_writer_reserve(stream, len);
+
+  if (p == NULL) {
+    return SL_STATUS_FULL;
+  }
+  memcpy(p, data, len);
+  log_writer_commit(len);
+  return SL_STATUS_OK;
+}
+
+bool log_line_begin(log_line_t *line, log_stream_t stream, uint32_t max_len)
+{
+  line->data = log_writer_reserve(stream, max_len);
+  line->len = 0;
+  line->size = (line->data != NULL) ? max_len : 0;
+  return line->data != NULL;
+}
+
+void log_line_printf(log_line_t *line, const char *format, ...)
+{
+  va_list args;
+  int n;
+
+  if ((line->data == NULL) || (line->len + 1 >= line->size)) {
+    return;
+  }
+  va_start(args, format);
+  n = vsnprintf(line->data + line->len, line->size - line->len, format, args);
+  va_end(args);
+  if (n > 0) {
+    line->len += ((uint32_t)n < line->size - line->len) ? (uint32_t)n : line->size - line->len - 1;
+  }
+}
+
+void log_line_end(log_line_t *line)
+{
+  if (line->data != NULL) {
+    log_writer_commit(line->len);
+    line->data = NULL;
+  }
+}
+
+void log_writer_get_stats(log_writer_stats_t *out)
+{
+  out->messages_written = __atomic_load_n(&stats.messages_written, __ATOMIC_RELAXED);
+  out->bytes_written = __atomic_load_n(&stats.bytes_written, __ATOMIC_RELAXED);
+  out->messages_dropped = __atomic_load_n(&stats.messages_dropped, __ATOMIC_RELAXED);
+  out->bytes_dropped = __atomic_load_n(&stats.bytes_dropped, __ATOMIC_RELAXED);
+  out->write_errors = __atomic_load_n(&stats.write_errors, __ATOMIC_RELAXED);
+  out->ring_used = __atomic_load_n(&stats.ring_used, __ATOMIC_RELAXED);
+  out->ring_high_water = __atomic_load_n(&stats.ring_high_water, __ATOMIC_RELAXED);
+}
+
+/***************************************************************************************************
+ * Static Function Definitions
+ **************************************************************************************************/
+
+static log_message_t *reserve_message(log_cmd_t cmd, log_stream_t stream, uint32_t len)
+{
+  uint64_t h = head;
+  uint64_t t = __atomic_load_n(&tail, __ATOMIC_ACQUIRE);
+  uint32_t total = sizeof(log_message_t) + ALIGN8(len);
+  uint32_t pos = (uint32_t)(h & RING_MASK);
+  uint32_t contiguous = LOG_WRITER_RING_SIZE - pos;
+  uint32_t needed = (total > contiguous) ? (contiguous + total) : total;
+  log_message_t *message;
+
+  if ((len > LOG_WRITER_MAX_MESSAGE) || (LOG_WRITER_RING_SIZE - (h - t) < needed)) {
+    return NULL;
+  }
+  if (total > contiguous) {
+    // Pad to the end of the ring, published together with the message.
+    message = (log_message_t *)(ring + pos);
+    message->len = contiguous - sizeof(log_message_t);
+    message->cmd = LOG_CMD_PAD;
+    h += contiguous;
+    pos = 0;
+  }
+  message = (log_message_t *)(ring + pos);
+  message->stream = (uint16_t)stream;
+  message->cmd = (uint8_t)cmd;
+  message->len = len;
+  reserved_head = h;
+  reserved_message = message;
+  return message;
+}
+
+static sl_status_t send_control(log_cmd_t cmd, log_stream_t stream, const void *data, uint32_t len)
+{
+  log_message_t *message;
+  struct timespec ts = { 0, IDLE_SLEEP_NS };
+
+  // Control messages are rare and must not get lost, wait for room.
+  while ((message = reserve_message(cmd, stream, len)) == NULL) {
+    if (len > LOG_WRITER_MAX_MESSAGE) {
+      return SL_STATUS_FAIL;
+    }
+    nanosleep(&ts, NULL);
+  }
+  if (len > 0) {
+    memcpy(message + 1, data, len);
+  }
+  log_writer_commit(len);
+  return SL_STATUS_OK;
+}
+
+static void *writer_main(void *arg)
+{
+  struct timespec idle = { 0, IDLE_SLEEP_NS };
+  uint32_t idle_ms = 0;
+  bool dirty = false;
+
+  (void)arg;
+  for (;;) {
+    uint64_t h = __atomic_load_n(&head, __ATOMIC_ACQUIRE);
+    uint64_t t = tail;
+
+    if (t == h) {
+      if (!__atomic_load_n(&running, __ATOMIC_ACQUIRE)
+          && (__atomic_load_n(&head, __ATOMIC_ACQUIRE) == t)) {
+        break;
+      }
+      nanosleep(&idle, NULL);
+      idle_ms += IDLE_SLEEP_NS / 1000000;
+      if (dirty && (idle_ms >= LOG_WRITER_FLUSH_INTERVAL_MS)) {
+        flush_files();
+        dirty = false;
+      }
+      continue;
+    }
+
+    // Drain everything published so far, then hand the room back at once.
+    while (t != h) {
+      const log_message_t *message = (const log_message_t *)(ring + (t & RING_MASK));
+      process_message(message);
+      t += sizeof(log_message_t) + ALIGN8(message->len);
+    }
+    __atomic_store_n(&tail, t, __ATOMIC_RELEASE);
+    idle_ms = 0;
+    dirty = true;
+  }
+
+  for (int s = 0; s < LOG_WRITER_MAX_STREAMS; s++) {
+    if (files[s].file != NULL) {
+      fclose(files[s].file);
+      free(files[s].buffer);
+      files[s].file = NULL;
+      files[s].buffer = NULL;
+    }
+  }
+  return NULL;
+}
+
+static void process_message(const log_message_t *message)
+{
+  log_file_t *f = &files[message->stream];
+
+  switch (message->cmd) {
+    case LOG_CMD_OPEN:
+      f->file = fopen((const char *)(message + 1), "wb");
+      if (f->file != NULL) {
+        f->buffer = malloc(LOG_WRITER_FILE_BUFFER_SIZE);
+        setvbuf(f->file, f->buffer, _IOFBF, LOG_WRITER_FILE_BUFFER_SIZE);
+      } else {
+        __atomic_fetch_add(&stats.write_errors, 1, __ATOMIC_RELAXED);
+      }
+      break;
+
+    case LOG_CMD_DATA:
+      if ((f->file == NULL)
+          || (fwrite(message + 1, 1, message->len, f->file) != message->len)) {
+        __atomic_fetch_add(&stats.write_errors, 1, __ATOMIC_RELAXED);
+        break;
+      }
+      __atomic_fetch_add(&stats.messages_written, 1, __ATOMIC_RELAXED);
+      __atomic_fetch_add(&stats.bytes_written, message->len, __ATOMIC_RELAXED);
+      break;
+
+    case LOG_CMD_CLOSE:
+      if (f->file != NULL) {
+        fclose(f->file);
+        free(f->buffer);
+        f->file = NULL;
+        f->buffer = NULL;
+      }
+      break;
+
+    default:
+      break;
+  }
+}
+
+static void flush_files(void)
+{
+  for (int s = 0; s < LOG_WRITER_MAX_STREAMS; s++) {
+    if (files[s].file != NULL) {
+      fflush(files[s].file);
+    }
+  }
+}
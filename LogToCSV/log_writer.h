@@ -0,0 +1,96 @@
+/***************************************************************************//**
+ * @file
+ * @brief Asynchronous log file writer.
+ *
+ * Log output is handed from the event thread to a writer thread through a
+ * lock-free single-producer/single-consumer ring buffer. The writer thread
+ * owns the files, batches the writes through large stdio buffers and is the
+ * only one doing blocking file I/O. When the ring is full, data is dropped
+ * and counted instead of stalling the estimation.
+ *
+ * All producer calls (open, reserve/commit, write, close) must come from the
+ * same thread, i.e. the one running the Bluetooth event handler.
+ ******************************************************************************/
+
+#ifndef LOG_WRITER_H_
+#define LOG_WRITER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "sl_status.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/***************************************************************************************************
+ * Type Definitions
+ **************************************************************************************************/
+
+// Ring buffer size in bytes, must be a power of two.
+#define LOG_WRITER_RING_SIZE          (4u * 1024u * 1024u)
+// Largest single message, bigger ones are dropped.
+#define LOG_WRITER_MAX_MESSAGE        (LOG_WRITER_RING_SIZE / 8u)
+// stdio buffer per open file on the writer thread.
+#define LOG_WRITER_FILE_BUFFER_SIZE   (1024u * 1024u)
+#define LOG_WRITER_MAX_STREAMS        8
+// Idle time after which the writer thread flushes its files.
+#define LOG_WRITER_FLUSH_INTERVAL_MS  500
+
+#define LOG_STREAM_INVALID            (-1)
+
+typedef int log_stream_t;
+
+// A formatted chunk rendered directly into the ring.
+typedef struct {
+  char *data;                   // NULL if the chunk was dropped
+  uint32_t len;
+  uint32_t size;
+} log_line_t;
+
+typedef struct {
+  uint64_t messages_written;
+  uint64_t bytes_written;
+  uint64_t messages_dropped;
+  uint64_t bytes_dropped;
+  uint64_t write_errors;
+  uint32_t ring_used;           // bytes currently queued
+  uint32_t ring_high_water;     // largest ring_used seen
+} log_writer_stats_t;
+
+/***************************************************************************************************
+ * Function Declarations
+ **************************************************************************************************/
+
+sl_status_t log_writer_start(void);
+// Drains the ring, closes all files and stops the writer thread.
+void log_writer_stop(void);
+bool log_writer_running(void);
+
+// Opens (truncates) a file on the writer thread. Returns LOG_STREAM_INVALID on failure.
+log_stream_t log_writer_open(const char *filename);
+void log_writer_close(log_stream_t stream);
+
+// Reserves room for up to len bytes in the ring. Returns NULL (and counts a drop)
+// if the ring is full. The reservation must be finished with log_writer_commit()
+// before the next producer call.
+void *log_writer_reserve(log_stream_t stream, uint32_t len);
+// Publishes the first len bytes of the last reservation, len may be 0.
+void log_writer_commit(uint32_t len);
+// Copies data into the ring, SL_STATUS_FULL if it was dropped.
+sl_status_t log_writer_write(log_stream_t stream, const void *data, uint32_t len);
+
+// Reserves up to max_len bytes for formatted output, false if dropped.
+bool log_line_begin(log_line_t *line, log_stream_t stream, uint32_t max_len);
+// Appends formatted text, silently truncated at the reserved size.
+void log_line_printf(log_line_t *line, const char *format, ...);
+// Commits the text appended so far.
+void log_line_end(log_line_t *line);
+
+void log_writer_get_stats(log_writer_stats_t *stats);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* LOG_WRITER_H_ */
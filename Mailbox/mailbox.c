@@ -0,0 +1,110 @@
+/***************************************************************************//**
+ * @file
+ * @brief Per-tag mailbox of IQ reports, keeping the newest reports of a tag.
+ ******************************************************************************/
+
+#include <string.h>
+
+#include "mailbox.h"
+
+/***************************************************************************************************
+ * Static Variables
+ **************************************************************************************************/
+
+static uint32_t read_ahead;
+
+/***************************************************************************************************
+ * Public Variables
+ **************************************************************************************************/
+
+uint32_t mailbox_depth = MAILBOX_DEFAULT_DEPTH;
+
+/***************************************************************************************************
+ * Static Function Definitions
+ **************************************************************************************************/
+
+static inline void export_add(uint64_t *counter)
+{
+  __atomic_store_n(counter, *counter + 1, __ATOMIC_RELAXED);
+}
+
+static inline uint32_t depth(void)
+{
+  if (mailbox_depth < 1) {
+    return 1;
+  }
+  return (mailbox_depth > MAILBOX_MAX_DEPTH) ? MAILBOX_MAX_DEPTH : mailbox_depth;
+}
+
+/***************************************************************************************************
+ * Public Function Definitions
+ **************************************************************************************************/
+
+void mailbox_init(mailbox_t *mailbox)
+{
+  memset(mailbox, 0, sizeof(*mailbox));
+}
+
+void mailbox_post(mailbox_t *mailbox, const aoa_iq_report_t *report, uint64_t received)
+{
+  mailbox_slot_t *slot;
+
+  export_add(&mailbox->posted);
+  if (mailbox->count >= depth()) {
+    // The oldest report is stale now
+    mailbox->head = (mailbox->head + 1) % MAILBOX_MAX_DEPTH;
+    mailbox->count--;
+    export_add(&mailbox->coalesced);
+  }
+  slot = &mailbox->slots[(mailbox->head + mailbox->count) % MAILBOX_MAX_DEPTH];
+  mailbox->count++;
+
+  slot->received = received;
+  slot->report = *report;
+  if (slot->report.length > sizeof(slot->samples)) {
+    slot->report.length = sizeof(slot->samples);
+  }
+  memcpy(slot->samples, report->samples, slot->report.length);
+  slot->report.samples = slot->samples;
+}
+
+aoa_iq_report_t *mailbox_take(mailbox_t *mailbox, uint64_t *received)
+{
+  mailbox_slot_t *slot;
+
+  if (mailbox->count == 0) {
+    return NULL;
+  }
+  slot = &mailbox->slots[mailbox->head];
+  mailbox->head = (mailbox->head + 1) % MAILBOX_MAX_DEPTH;
+  mailbox->count--;
+  // The tag table entry may have moved since the report was posted
+  slot->report.samples = slot->samples;
+  *received = slot->received;
+  return &slot->report;
+}
+
+aoa_iq_report_t *mailbox_take_latest(mailbox_t *mailbox, uint64_t *received)
+{
+  while (mailbox->count > 1) {
+    mailbox->head = (mailbox->head + 1) % MAILBOX_MAX_DEPTH;
+    mailbox->count--;
+    export_add(&mailbox->coalesced);
+  }
+  return mailbox_take(mailbox, received);
+}
+
+void mailbox_clear(mailbox_t *mailbox)
+{
+  mailbox->head = 0;
+  mailbox->count = 0;
+}
+
+bool mailbox_serve_due(int32_t backlog_bytes)
+{
+  if ((backlog_bytes >= MAILBOX_BACKLOG_BYTES) && (++read_ahead < MAILBOX_READ_AHEAD)) {
+    return false;
+  }
+  read_ahead = 0;
+  return true;
+}
@@ -0,0 +1,103 @@
+/***************************************************************************//**
+ * @file
+ * @brief Per-tag mailbox of IQ reports between the event handler and
+ *        app_on_iq_report(), keeping the newest reports of a tag.
+ *
+ * The event handler only posts a report to the mailbox of its tag, copying
+ * the samples. A full mailbox drops its oldest report, counted as coalesced:
+ * with mailbox_depth N only the newest N reports of a tag wait, older ones
+ * never reach deinterleave or estimation. The default depth of 1 keeps only
+ * the latest report, so a tag held back by its token bucket or the
+ * scheduler budget publishes the angle of its newest report. A deeper
+ * mailbox is served oldest first, every kept report in order, at the cost
+ * of angles up to N reports behind while the host is behind.
+ *
+ * The main loop serves the mailboxes (mailbox_serve_due()) once the host
+ * receive buffer is down to less than one report event, so while the host
+ * is behind the events are read ahead and the stale reports coalesce. At
+ * most MAILBOX_READ_AHEAD events are read before the mailboxes are served
+ * anyway. The age of a report when it is served is the queue stage of the
+ * stage statistics.
+ *
+ * All functions run on the event thread. The exported counters (posted,
+ * coalesced) are written with relaxed atomics for the metrics server.
+ ******************************************************************************/
+
+#ifndef MAILBOX_H_
+#define MAILBOX_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "aoa_types.h"
+#include "aoa_array.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MAILBOX_MAX_DEPTH         32
+#define MAILBOX_DEFAULT_DEPTH     1         // latest wins
+#define MAILBOX_BACKLOG_BYTES     64        // less than one IQ report event
+#define MAILBOX_READ_AHEAD        64        // events read at most between two services
+
+/***************************************************************************************************
+ * Type Definitions
+ **************************************************************************************************/
+
+typedef struct {
+  uint64_t received;
+  aoa_iq_report_t report;
+  int8_t samples[AOA_ARRAY_MAX_REPORT_LENGTH];
+} mailbox_slot_t;
+
+typedef struct {
+  uint32_t head;                // oldest report
+  uint32_t count;
+  mailbox_slot_t slots[MAILBOX_MAX_DEPTH];
+  // Exported
+  uint64_t posted;
+  uint64_t coalesced;           // dropped for a newer report of the tag
+} mailbox_t;
+
+/***************************************************************************************************
+ * Public variables
+ **************************************************************************************************/
+
+// Reports kept per tag, 1 to MAILBOX_MAX_DEPTH
+extern uint32_t mailbox_depth;
+
+/***************************************************************************************************
+ * Function Declarations
+ **************************************************************************************************/
+
+void mailbox_init(mailbox_t *mailbox);
+
+// Copies a report received at received (stage_stats_now()), dropping the
+// oldest one of a full mailbox.
+void mailbox_post(mailbox_t *mailbox, const aoa_iq_report_t *report, uint64_t received);
+
+// The oldest report, removed from the mailbox. It is valid until the next
+// mailbox_post() to the mailbox.
+aoa_iq_report_t *mailbox_take(mailbox_t *mailbox, uint64_t *received);
+
+// The newest report, removed from the mailbox with the older ones, which are
+// counted as coalesced. It is valid until the next mailbox_post().
+aoa_iq_report_t *mailbox_take_latest(mailbox_t *mailbox, uint64_t *received);
+
+// Drops all reports, without counting them.
+void mailbox_clear(mailbox_t *mailbox);
+
+// True if the main loop shall serve the mailboxes now, backlog_bytes is the
+// content of the host receive buffer. Called once per main loop iteration.
+bool mailbox_serve_due(int32_t backlog_bytes);
+
+static inline bool mailbox_empty(const mailbox_t *mailbox)
+{
+  return mailbox->count == 0;
+}
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* MAILBOX_H_ */
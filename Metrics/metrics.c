@@ -0,0 +1,87 @@
+/***************************************************************************//**
+ * @file
+ * @brief Health counters of the locator, exported by the metrics server.
+ ******************************************************************************/
+
+#include <stddef.h>
+
+#include "metrics.h"
+
+/***************************************************************************************************
+ * Static Variables
+ **************************************************************************************************/
+
+static const metrics_counter_info_t counter_info[METRICS_COUNTER_COUNT] = {
+  [METRICS_IQ_REPORTS] = {
+    "iq_reports_total", NULL, "IQ reports passed to the estimator."
+  },
+  [METRICS_ESTIMATES_OK] = {
+    "estimates_total", "result=\"ok\"", "Estimator results per outcome."
+  },
+  [METRICS_ESTIMATES_IN_PROGRESS] = {
+    "estimates_total", "result=\"in_progress\"", "Estimator results per outcome."
+  },
+  [METRICS_ESTIMATES_FAILED] = {
+    "estimates_total", "result=\"error\"", "Estimator results per outcome."
+  },
+  [METRICS_TAGS_ADDED] = {
+    "tags_added_total", NULL, "Tags added to the tag table."
+  },
+  [METRICS_TAGS_REMOVED] = {
+    "tags_removed_total", NULL, "Tags removed from the tag table."
+  },
+  [METRICS_TAG_TABLE_FULL] = {
+    "tag_table_full_total", NULL, "New tags refused because the tag table was full."
+  },
+  [METRICS_PUBLISHED] = {
+    "published_total", NULL, "Angles published to MQTT."
+  },
+  [METRICS_PUBLISH_FAILED] = {
+    "publish_failures_total", NULL, "Angles the MQTT client failed to publish."
+  },
+  [METRICS_TRACK_ACCEPTED] = {
+    "track_updates_total", "result=\"accepted\"", "Estimates given to the angle tracking filter per outcome."
+  },
+  [METRICS_TRACK_GATED] = {
+    "track_updates_total", "result=\"gated\"", "Estimates given to the angle tracking filter per outcome."
+  },
+  [METRICS_TRACK_RESTARTED] = {
+    "track_updates_total", "result=\"restarted\"", "Estimates given to the angle tracking filter per outcome."
+  },
+  [METRICS_TRACK_PREDICTED] = {
+    "track_predictions_total", NULL, "Predicted angles published for reports without an estimate."
+  },
+  [METRICS_POSITION_ANGLES] = {
+    "position_angles_total", "result=\"accepted\"", "Angles received by the positioning engine per outcome."
+  },
+  [METRICS_POSITION_UNKNOWN_LOCATOR] = {
+    "position_angles_total", "result=\"unknown_locator\"", "Angles received by the positioning engine per outcome."
+  },
+  [METRICS_POSITION_TABLE_FULL] = {
+    "position_angles_total", "result=\"table_full\"", "Angles received by the positioning engine per outcome."
+  },
+  [METRICS_POSITION_TAGS_EVICTED] = {
+    "position_tags_evicted_total", NULL, "Stale tags of the positioning engine replaced by new ones."
+  },
+  [METRICS_POSITION_SOLVED] = {
+    "position_solves_total", "result=\"solved\"", "Tag positions solved by the positioning engine per outcome."
+  },
+  [METRICS_POSITION_SINGULAR] = {
+    "position_solves_total", "result=\"singular\"", "Tag positions solved by the positioning engine per outcome."
+  }
+};
+
+/***************************************************************************************************
+ * Public Variables
+ **************************************************************************************************/
+
+uint64_t metrics_counters[METRICS_COUNTER_COUNT];
+
+/***************************************************************************************************
+ * Public Function Definitions
+ **************************************************************************************************/
+
+const metrics_counter_info_t *metrics_counter_info(metrics_counter_t counter)
+{
+  return (counter < METRICS_COUNTER_COUNT) ? &counter_info[counter] : NULL;
+}
@@ -0,0 +1,81 @@
+/***************************************************************************//**
+ * @file
+ * @brief Health counters of the locator, exported by the metrics server.
+ *
+ * The counters are maintained by aoa.c, conn.c, the positioning engine and
+ * the publish path with relaxed atomic adds, and read by the metrics server
+ * thread (metrics_server.h) without any lock. Together with the IQ QA counters,
+ * the log writer statistics and the stage latency histograms they are
+ * rendered in the Prometheus text format.
+ ******************************************************************************/
+
+#ifndef METRICS_H_
+#define METRICS_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/***************************************************************************************************
+ * Type Definitions
+ **************************************************************************************************/
+
+typedef enum {
+  METRICS_IQ_REPORTS = 0,           // reports passed to aoa_calculate()
+  METRICS_ESTIMATES_OK,             // sl_rtl_aox_process() gave an angle
+  METRICS_ESTIMATES_IN_PROGRESS,    // SL_RTL_ERROR_ESTIMATION_IN_PROGRESS, more reports needed
+  METRICS_ESTIMATES_FAILED,         // any other estimator error
+  METRICS_TAGS_ADDED,
+  METRICS_TAGS_REMOVED,
+  METRICS_TAG_TABLE_FULL,           // new tag refused, AOA_MAX_TAGS reached
+  METRICS_PUBLISHED,
+  METRICS_PUBLISH_FAILED,
+  METRICS_TRACK_ACCEPTED,           // estimate taken by the angle tracking filter
+  METRICS_TRACK_GATED,              // estimate gated as an outlier, the prediction published
+  METRICS_TRACK_RESTARTED,          // new track, first estimate or the tag moved
+  METRICS_TRACK_PREDICTED,          // no estimate, the prediction published
+  METRICS_POSITION_ANGLES,          // angle taken by the positioning engine (-P)
+  METRICS_POSITION_UNKNOWN_LOCATOR, // angle of a locator without a pose
+  METRICS_POSITION_TABLE_FULL,      // angle of a new tag refused, max tags reached
+  METRICS_POSITION_TAGS_EVICTED,    // tag without a ray younger than POSITION_RAY_MAX_AGE_S replaced
+  METRICS_POSITION_SOLVED,          // position published
+  METRICS_POSITION_SINGULAR,        // rays too close to parallel, no position
+  METRICS_COUNTER_COUNT
+} metrics_counter_t;
+
+typedef struct {
+  const char *name;                 // metric family, without the prefix
+  const char *label;                // "key=\"value\"" or NULL
+  const char *help;
+} metrics_counter_info_t;
+
+/***************************************************************************************************
+ * Public variables
+ **************************************************************************************************/
+
+extern uint64_t metrics_counters[METRICS_COUNTER_COUNT];
+
+/***************************************************************************************************
+ * Function Declarations
+ **************************************************************************************************/
+
+static inline void metrics_inc(metrics_counter_t counter)
+{
+  __atomic_fetch_add(&metrics_counters[counter], 1, __ATOMIC_RELAXED);
+}
+
+static inline uint64_t metrics_get(metrics_counter_t counter)
+{
+  return __atomic_load_n(&metrics_counters[counter], __ATOMIC_RELAXED);
+}
+
+// Name, label and help of a counter. Counters of one family are adjacent.
+const metrics_counter_info_t *metrics_counter_info(metrics_counter_t counter);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* METRICS_H_ */
@@ -0,0 +1,411 @@
+/***************************************************************************//**
+ * @file
+ * @brief Prometheus text endpoint of the locator, served from its own thread.
+ ******************************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <pthread.h>
+#include <poll.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/time.h>
+#endif
+
+#include "metrics_server.h"
+#include "metrics.h"
+#include "conn.h"
+#include "aoa_util.h"
+#include "iq_qa.h"
+#include "log_writer.h"
+#include "stage_stats.h"
+#include "admission.h"
+#include "governor.h"
+#include "scheduler.h"
+
+/***************************************************************************************************
+ * Type Definitions
+ **************************************************************************************************/
+
+#define UNIX_PREFIX             "unix:"
+#define REQUEST_MAX_LEN         4096
+#define RESPONSE_INITIAL_SIZE   (16u * 1024u)
+#define CLIENT_TIMEOUT_MS       1000
+// The server thread checks for stop at least this often
+#define POLL_INTERVAL_MS        500
+
+typedef struct {
+  char *data;
+  size_t size;
+  size_t len;
+} text_t;
+
+/***************************************************************************************************
+ * Static Variables
+ **************************************************************************************************/
+
+#ifndef _WIN32
+static int listen_fd = -1;
+static pthread_t server_thread;
+static volatile bool server_running;
+static char unix_path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+#endif
+
+static const double quantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+
+/***************************************************************************************************
+ * Rendering
+ **************************************************************************************************/
+
+static void text_printf(text_t *t, const char *format, ...)
+{
+  va_list args;
+  int n;
+
+  va_start(args, format);
+  n = vsnprintf(t->data + ((t->len < t->size) ? t->len : t->size),
+                (t->len < t->size) ? t->size - t->len : 0, format, args);
+  va_end(args);
+  if (n > 0) {
+    t->len += (size_t)n;
+  }
+}
+
+static void text_family(text_t *t, const char *name, const char *type, const char *help)
+{
+  text_printf(t, "# HELP " METRICS_PREFIX "%s %s\n# TYPE " METRICS_PREFIX "%s %s\n", name, help, name, type);
+}
+
+size_t metrics_render(char *buffer, size_t size)
+{
+  text_t t = { buffer, size, 0 };
+  const char *family = NULL;
+  iq_qa_counters_t qa;
+  log_writer_stats_t log;
+  conn_properties_t *tag;
+  aoa_id_t tag_id;
+
+  for (uint32_t c = 0; c < METRICS_COUNTER_COUNT; c++) {
+    const metrics_counter_info_t *info = metrics_counter_info(c);
+    if ((family == NULL) || (strcmp(family, info->name) != 0)) {
+      family = info->name;
+      text_family(&t, info->name, "counter", info->help);
+    }
+    text_printf(&t, METRICS_PREFIX "%s%s%s%s %llu\n", info->name,
+                info->label ? "{" : "", info->label ? info->label : "", info->label ? "}" : "",
+                (unsigned long long)metrics_get(c));
+  }
+
+  text_family(&t, "tags", "gauge", "Tags in the tag table.");
+  text_printf(&t, METRICS_PREFIX "tags %u\n", get_connection_count());
+
+  iq_qa_get_counters(&qa);
+  text_family(&t, "iq_qa_total", "counter", "IQ sample quality gate results per outcome.");
+  for (uint32_t r = 0; r < IQ_QA_REASON_COUNT; r++) {
+    text_printf(&t, METRICS_PREFIX "iq_qa_total{result=\"%s\"} %llu\n",
+                iq_qa_reason_to_string(r), (unsigned long long)qa.results[r]);
+  }
+
+  log_writer_get_stats(&log);
+  text_family(&t, "log_queue_bytes", "gauge", "Bytes queued for the log writer thread.");
+  text_printf(&t, METRICS_PREFIX "log_queue_bytes %u\n", log.ring_used);
+  text_family(&t, "log_queue_high_water_bytes", "gauge", "Most bytes queued for the log writer thread.");
+  text_printf(&t, METRICS_PREFIX "log_queue_high_water_bytes %u\n", log.ring_high_water);
+  text_family(&t, "log_dropped_messages_total", "counter", "Log messages dropped on a full queue.");
+  text_printf(&t, METRICS_PREFIX "log_dropped_messages_total %llu\n", (unsigned long long)log.messages_dropped);
+
+  text_family(&t, "stage_latency_seconds", "summary", "Latency of the report processing stages, of the sampled reports.");
+  for (uint32_t s = 0; s < STAGE_STATS_STAGE_COUNT; s++) {
+    const stage_stats_histogram_t *h = &stage_stats_histograms[s];
+    const char *stage = stage_stats_stage_to_string(s);
+    for (uint32_t q = 0; q < sizeof(quantiles) / sizeof(quantiles[0]); q++) {
+      text_printf(&t, METRICS_PREFIX "stage_latency_seconds{stage=\"%s\",quantile=\"%g\"} %.9f\n",
+                  stage, quantiles[q], stage_stats_percentile(h, 100.0 * quantiles[q]) / 1e9);
+    }
+    text_printf(&t, METRICS_PREFIX "stage_latency_seconds_sum{stage=\"%s\"} %.9f\n", stage,
+                __atomic_load_n(&h->sum_ns, __ATOMIC_RELAXED) / 1e9);
+    text_printf(&t, METRICS_PREFIX "stage_latency_seconds_count{stage=\"%s\"} %llu\n", stage,
+                (unsigned long long)__atomic_load_n(&h->total, __ATOMIC_RELAXED));
+  }
+
+  // The table may change under us when a tag leaves, the values are atomic
+  // and a torn entry is corrected by the next scrape.
+  text_family(&t, "tag_reports_total", "counter", "IQ reports per tag.");
+  for (uint8_t i = 0; (tag = get_connection_by_index(i)) != NULL; i++) {
+    aoa_address_to_id(tag->address.addr, tag->address_type, tag_id);
+    text_printf(&t, METRICS_PREFIX "tag_reports_total{tag=\"%s\"} %llu\n", tag_id,
+                (unsigned long long)__atomic_load_n(&tag->aoa_states.stage_stats.reports, __ATOMIC_RELAXED));
+  }
+  text_family(&t, "tag_published_total", "counter", "Angles published per tag.");
+  for (uint8_t i = 0; (tag = get_connection_by_index(i)) != NULL; i++) {
+    aoa_address_to_id(tag->address.addr, tag->address_type, tag_id);
+    text_printf(&t, METRICS_PREFIX "tag_published_total{tag=\"%s\"} %llu\n", tag_id,
+                (unsigned long long)__atomic_load_n(&tag->aoa_states.stage_stats.published, __ATOMIC_RELAXED));
+  }
+
+  text_family(&t, "admission_capacity", "gauge", "Reports/s the admission control gives all tags, 0 while not measured.");
+  text_printf(&t, METRICS_PREFIX "admission_capacity %.1f\n", admission_capacity());
+  text_family(&t, "tag_admission_rate", "gauge", "Reports/s admitted per tag, 0 while not limited.");
+  for (uint8_t i = 0; (tag = get_connection_by_index(i)) != NULL; i++) {
+    aoa_address_to_id(tag->address.addr, tag->address_type, tag_id);
+    text_printf(&t, METRICS_PREFIX "tag_admission_rate{tag=\"%s\"} %.1f\n", tag_id,
+                admission_tag_rate(&tag->admission));
+  }
+  text_family(&t, "tag_admission_total", "counter", "IQ reports per tag by admission outcome.");
+  for (uint8_t i = 0; (tag = get_connection_by_index(i)) != NULL; i++) {
+    aoa_address_to_id(tag->address.addr, tag->address_type, tag_id);
+    text_printf(&t, METRICS_PREFIX "tag_admission_total{tag=\"%s\",result=\"offered\"} %llu\n", tag_id,
+                (unsigned long long)__atomic_load_n(&tag->admission.offered, __ATOMIC_RELAXED));
+    text_printf(&t, METRICS_PREFIX "tag_admission_total{tag=\"%s\",result=\"admitted\"} %llu\n", tag_id,
+                (unsigned long long)__atomic_load_n(&tag->admission.admitted, __ATOMIC_RELAXED));
+  }
+  text_family(&t, "governor_load", "gauge", "Share of the event thread spent estimating, 0 while not measured.");
+  text_printf(&t, METRICS_PREFIX "governor_load %.3f\n", governor_load());
+  text_family(&t, "tag_estimator_level", "gauge", "Estimator level per tag, 0 high accuracy to 4 fast on a quarter of the snapshots.");
+  for (uint8_t i = 0; (tag = get_connection_by_index(i)) != NULL; i++) {
+    aoa_address_to_id(tag->address.addr, tag->address_type, tag_id);
+    text_printf(&t, METRICS_PREFIX "tag_estimator_level{tag=\"%s\"} %u\n", tag_id,
+                governor_tag_level(&tag->governor));
+  }
+  text_family(&t, "tag_estimator_switches_total", "counter", "Estimator level changes per tag.");
+  for (uint8_t i = 0; (tag = get_connection_by_index(i)) != NULL; i++) {
+    aoa_address_to_id(tag->address.addr, tag->address_type, tag_id);
+    text_printf(&t, METRICS_PREFIX "tag_estimator_switches_total{tag=\"%s\"} %llu\n", tag_id,
+                (unsigned long long)governor_tag_switches(&tag->governor));
+  }
+  text_family(&t, "tag_service_rate", "gauge", "Reports/s taken from the mailbox per tag.");
+  for (uint8_t i = 0; (tag = get_connection_by_index(i)) != NULL; i++) {
+    aoa_address_to_id(tag->address.addr, tag->address_type, tag_id);
+    text_printf(&t, METRICS_PREFIX "tag_service_rate{tag=\"%s\"} %.1f\n", tag_id,
+                scheduler_tag_rate(&tag->scheduler));
+  }
+  text_family(&t, "tag_served_total", "counter", "IQ reports per tag taken from the mailbox.");
+  for (uint8_t i = 0; (tag = get_connection_by_index(i)) != NULL; i++) {
+    aoa_address_to_id(tag->address.addr, tag->address_type, tag_id);
+    text_printf(&t, METRICS_PREFIX "tag_served_total{tag=\"%s\"} %llu\n", tag_id,
+                (unsigned long long)__atomic_load_n(&tag->scheduler.served, __ATOMIC_RELAXED));
+  }
+  text_family(&t, "tag_coalesced_reports_total", "counter", "IQ reports per tag dropped unprocessed for a newer one.");
+  for (uint8_t i = 0; (tag = get_connection_by_index(i)) != NULL; i++) {
+    aoa_address_to_id(tag->address.addr, tag->address_type, tag_id);
+    text_printf(&t, METRICS_PREFIX "tag_coalesced_reports_total{tag=\"%s\"} %llu\n", tag_id,
+                (unsigned long long)__atomic_load_n(&tag->mailbox.coalesced, __ATOMIC_RELAXED));
+  }
+  return t.len;
+}
+
+#ifndef _WIN32
+
+/***************************************************************************************************
+ * Server
+ **************************************************************************************************/
+
+static void write_all(int fd, const char *data, size_t len)
+{
+  while (len > 0) {
+    ssize_t n = write(fd, data, len);
+    if (n <= 0) {
+      return;
+    }
+    data += n;
+    len -= (size_t)n;
+  }
+}
+
+static void serve_client(int fd, char **response, size_t *response_size)
+{
+  char request[REQUEST_MAX_LEN + 1];
+  size_t request_len = 0;
+  struct timeval timeout = { CLIENT_TIMEOUT_MS / 1000, (CLIENT_TIMEOUT_MS % 1000) * 1000 };
+  char header[160];
+  size_t len;
+
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+  // The request line is enough, the rest of the header is not needed
+  while ((request_len < REQUEST_MAX_LEN) && (memchr(request, '\n', request_len) == NULL)) {
+    ssize_t n = read(fd, request + request_len, REQUEST_MAX_LEN - request_len);
+    if (n <= 0) {
+      return;
+    }
+    request_len += (size_t)n;
+  }
+  request[request_len] = '\0';
+
+  if (strncmp(request, "GET ", 4) != 0) {
+    static const char not_allowed[] = "HTTP/1.0 405 Method Not Allowed\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+    write_all(fd, not_allowed, sizeof(not_allowed) - 1);
+    return;
+  }
+
+  len = metrics_render(*response, *response_size);
+  if (len >= *response_size) {
+    char *larger = realloc(*response, len + RESPONSE_INITIAL_SIZE);
+    if (larger == NULL) {
+      return;
+    }
+    *response = larger;
+    *response_size = len + RESPONSE_INITIAL_SIZE;
+    len = metrics_render(*response, *response_size);
+    if (len >= *response_size) {
+      len = *response_size - 1;
+    }
+  }
+  snprintf(header, sizeof(header),
+           "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: %zu\r\nConnection: close\r\n\r\n",
+           len);
+  write_all(fd, header, strlen(header));
+  write_all(fd, *response, len);
+}
+
+static void *server_main(void *arg)
+{
+  size_t response_size = RESPONSE_INITIAL_SIZE;
+  char *response = malloc(response_size);
+  struct pollfd pfd = { listen_fd, POLLIN, 0 };
+
+  (void)arg;
+  while (server_running && (response != NULL)) {
+    if (poll(&pfd, 1, POLL_INTERVAL_MS) <= 0) {
+      continue;
+    }
+    int fd = accept(listen_fd, NULL, NULL);
+    if (fd < 0) {
+      continue;
+    }
+    serve_client(fd, &response, &response_size);
+    close(fd);
+  }
+  free(response);
+  return NULL;
+}
+
+static int bind_unix(const char *path)
+{
+  struct sockaddr_un addr;
+  int fd;
+
+  if (strlen(path) >= sizeof(addr.sun_path)) {
+    return -1;
+  }
+  fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    return -1;
+  }
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, path);
+  // A socket file left behind by a former run
+  unlink(path);
+  if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+    close(fd);
+    return -1;
+  }
+  strcpy(unix_path, path);
+  return fd;
+}
+
+static int bind_tcp(const char *endpoint)
+{
+  char host[256];
+  const char *port = strrchr(endpoint, ':');
+  struct addrinfo hints, *result, *ai;
+  int fd = -1, one = 1;
+
+  if (port == NULL) {
+    snprintf(host, sizeof(host), "%s", METRICS_DEFAULT_ADDRESS);
+    port = endpoint;
+  } else {
+    snprintf(host, sizeof(host), "%.*s", (int)(port - endpoint), endpoint);
+    port++;
+  }
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = AI_PASSIVE;
+  if (getaddrinfo(host, port, &hints, &result) != 0) {
+    return -1;
+  }
+  for (ai = result; ai != NULL; ai = ai->ai_next) {
+    fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+    if (fd < 0) {
+      continue;
+    }
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (bind(fd, ai->ai_addr, ai->ai_addrlen) == 0) {
+      break;
+    }
+    close(fd);
+    fd = -1;
+  }
+  freeaddrinfo(result);
+  return fd;
+}
+
+/***************************************************************************************************
+ * Public Function Definitions
+ **************************************************************************************************/
+
+sl_status_t metrics_server_start(const char *endpoint)
+{
+  if (server_running) {
+    return SL_STATUS_INVALID_STATE;
+  }
+  if (strncmp(endpoint, UNIX_PREFIX, strlen(UNIX_PREFIX)) == 0) {
+    listen_fd = bind_unix(endpoint + strlen(UNIX_PREFIX));
+  } else {
+    listen_fd = bind_tcp(endpoint);
+  }
+  if (listen_fd < 0) {
+    return SL_STATUS_FAIL;
+  }
+  if (listen(listen_fd, 8) != 0) {
+    close(listen_fd);
+    listen_fd = -1;
+    return SL_STATUS_FAIL;
+  }
+  server_running = true;
+  if (pthread_create(&server_thread, NULL, server_main, NULL) != 0) {
+    server_running = false;
+    close(listen_fd);
+    listen_fd = -1;
+    return SL_STATUS_FAIL;
+  }
+  return SL_STATUS_OK;
+}
+
+void metrics_server_stop(void)
+{
+  if (!server_running) {
+    return;
+  }
+  server_running = false;
+  pthread_join(server_thread, NULL);
+  close(listen_fd);
+  listen_fd = -1;
+  if (unix_path[0] != '\0') {
+    unlink(unix_path);
+    unix_path[0] = '\0';
+  }
+}
+
+#else
+
+sl_status_t metrics_server_start(const char *endpoint)
+{
+  (void)endpoint;
+  return SL_STATUS_NOT_SUPPORTED;
+}
+
+void metrics_server_stop(void)
+{
+}
+
+#endif
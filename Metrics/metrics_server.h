@@ -0,0 +1,43 @@
+/***************************************************************************//**
+ * @file
+ * @brief Prometheus text endpoint of the locator, served from its own thread.
+ *
+ * Enabled with the locator option -e <endpoint>:
+ *   [<address>:]<port>   HTTP over TCP, e.g. -e 9464 or -e 127.0.0.1:9464
+ *   unix:<path>          HTTP over a Unix domain socket, e.g. for a sidecar
+ *                        (curl --unix-socket <path> http://localhost/metrics)
+ * Every GET answers with the current metrics in the Prometheus text format
+ * 0.0.4. The server only reads counters that the report path updates with
+ * relaxed atomics, it takes no lock that the report path could wait for.
+ ******************************************************************************/
+
+#ifndef METRICS_SERVER_H_
+#define METRICS_SERVER_H_
+
+#include <stddef.h>
+#include "sl_status.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define METRICS_PREFIX              "aoa_locator_"
+#define METRICS_DEFAULT_ADDRESS     "0.0.0.0"
+
+/***************************************************************************************************
+ * Function Declarations
+ **************************************************************************************************/
+
+// Binds the endpoint and starts the server thread.
+sl_status_t metrics_server_start(const char *endpoint);
+void metrics_server_stop(void);
+
+// Renders all metrics into buffer, returns the length the full text needs
+// (as snprintf); the text is complete if that is below size.
+size_t metrics_render(char *buffer, size_t size);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* METRICS_SERVER_H_ */
@@ -0,0 +1,348 @@
+/***************************************************************************//**
+ * @file
+ * @brief Positioning engine, tag positions from the angles of several
+ *        locators of known pose.
+ ******************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "position.h"
+#include "simd_kernels.h"
+#include "metrics.h"
+
+#define DEG_TO_RAD    0.017453292f
+#define FREE_SLOT     UINT32_MAX
+
+/***************************************************************************************************
+ * Static Function Definitions
+ **************************************************************************************************/
+
+// FNV-1a of a tag id
+static uint32_t hash_id(const char *id)
+{
+  uint32_t hash = 2166136261u;
+
+  while (*id != '\0') {
+    hash = (hash ^ (uint8_t)*id++) * 16777619u;
+  }
+  return hash;
+}
+
+// Time of the newest ray of a tag
+static uint64_t newest_ray(const position_engine_t *engine, const position_tag_t *tag)
+{
+  uint64_t newest = 0;
+
+  for (uint32_t l = 0; l < engine->locator_count; l++) {
+    if (tag->ray_time_ns[l] > newest) {
+      newest = tag->ray_time_ns[l];
+    }
+  }
+  return newest;
+}
+
+// Frees a slot of the table, the entries after it that probed past it are
+// shifted back so no probe sequence breaks.
+static void table_remove(position_engine_t *engine, uint32_t slot)
+{
+  uint32_t next = slot;
+
+  for (;;) {
+    uint32_t home;
+    next = (next + 1) & engine->table_mask;
+    if (engine->table[next] == FREE_SLOT) {
+      break;
+    }
+    home = hash_id(engine->tags[engine->table[next]].id) & engine->table_mask;
+    if (((next - home) & engine->table_mask) >= ((next - slot) & engine->table_mask)) {
+      engine->table[slot] = engine->table[next];
+      slot = next;
+    }
+  }
+  engine->table[slot] = FREE_SLOT;
+}
+
+// Index of a tag without a ray younger than POSITION_RAY_MAX_AGE_S, removed
+// from the table, FREE_SLOT if there is none. A full scan that finds none
+// knows when the oldest tag gets stale and is not repeated before.
+static uint32_t evict_stale(position_engine_t *engine, uint64_t now_ns)
+{
+  uint64_t max_age_ns = (uint64_t)(POSITION_RAY_MAX_AGE_S * 1e9f);
+  uint64_t oldest = UINT64_MAX;
+
+  if (now_ns < engine->evict_after_ns) {
+    return FREE_SLOT;
+  }
+  for (uint32_t n = 0; n < engine->tag_count; n++) {
+    uint32_t index = engine->evict_cursor;
+    position_tag_t *tag = &engine->tags[index];
+    uint64_t newest = newest_ray(engine, tag);
+    engine->evict_cursor = (index + 1) % engine->tag_count;
+    // A marked tag is in the list of position_solve()
+    if (!tag->marked && (now_ns > newest + max_age_ns)) {
+      uint32_t slot = hash_id(tag->id) & engine->table_mask;
+      while (engine->table[slot] != index) {
+        slot = (slot + 1) & engine->table_mask;
+      }
+      table_remove(engine, slot);
+      metrics_inc(METRICS_POSITION_TAGS_EVICTED);
+      return index;
+    }
+    if (newest < oldest) {
+      oldest = newest;
+    }
+  }
+  engine->evict_after_ns = (oldest == UINT64_MAX) ? now_ns : oldest + max_age_ns + 1;
+  return FREE_SLOT;
+}
+
+static position_tag_t *find_tag(position_engine_t *engine, const char *id, uint64_t now_ns, uint32_t *index)
+{
+  uint32_t slot = hash_id(id) & engine->table_mask;
+  position_tag_t *tag;
+
+  for (;;) {
+    if (engine->table[slot] == FREE_SLOT) {
+      if (engine->tag_count < engine->max_tags) {
+        *index = engine->tag_count++;
+      } else {
+        *index = evict_stale(engine, now_ns);
+        if (*index == FREE_SLOT) {
+          return NULL;
+        }
+        // The removal may have shifted the free slot
+        slot = hash_id(id) & engine->table_mask;
+        while (engine->table[slot] != FREE_SLOT) {
+          slot = (slot + 1) & engine->table_mask;
+        }
+      }
+      engine->table[slot] = *index;
+      tag = &engine->tags[*index];
+      memset(tag, 0, sizeof(*tag));
+      strncpy(tag->id, id, sizeof(tag->id) - 1);
+      return tag;
+    }
+    tag = &engine->tags[engine->table[slot]];
+    if (strcmp(tag->id, id) == 0) {
+      *index = engine->table[slot];
+      return tag;
+    }
+    slot = (slot + 1) & engine->table_mask;
+  }
+}
+
+// Rotation about x, then y, then z
+static void set_rotation(position_locator_t *locator)
+{
+  float sx = sinf(locator->orientation[0] * DEG_TO_RAD), cx = cosf(locator->orientation[0] * DEG_TO_RAD);
+  float sy = sinf(locator->orientation[1] * DEG_TO_RAD), cy = cosf(locator->orientation[1] * DEG_TO_RAD);
+  float sz = sinf(locator->orientation[2] * DEG_TO_RAD), cz = cosf(locator->orientation[2] * DEG_TO_RAD);
+
+  locator->rotation[0][0] = cz * cy;
+  locator->rotation[0][1] = cz * sy * sx - sz * cx;
+  locator->rotation[0][2] = cz * sy * cx + sz * sx;
+  locator->rotation[1][0] = sz * cy;
+  locator->rotation[1][1] = sz * sy * sx + cz * cx;
+  locator->rotation[1][2] = sz * sy * cx - cz * sx;
+  locator->rotation[2][0] = -sy;
+  locator->rotation[2][1] = cy * sx;
+  locator->rotation[2][2] = cy * cx;
+}
+
+static void set_ray(const position_locator_t *locator, const aoa_angle_t *angle, float ray[9])
+{
+  const float *p = locator->coordinate;
+  float az = angle->azimuth * DEG_TO_RAD, el = angle->elevation * DEG_TO_RAD;
+  float local[3] = { cosf(el) * cosf(az), cosf(el) * sinf(az), sinf(el) };
+  float d[3], stdev, range, w;
+
+  for (int r = 0; r < 3; r++) {
+    d[r] = locator->rotation[r][0] * local[0] + locator->rotation[r][1] * local[1]
+           + locator->rotation[r][2] * local[2];
+  }
+  stdev = (angle->azimuth_stdev > angle->elevation_stdev) ? angle->azimuth_stdev : angle->elevation_stdev;
+  if (!(stdev > 0)) {
+    stdev = POSITION_DEFAULT_STDEV;
+  }
+  range = (angle->distance > POSITION_MIN_RANGE) ? angle->distance : POSITION_MIN_RANGE;
+  stdev *= DEG_TO_RAD * range;
+  w = 1.0f / (stdev * stdev);
+
+  ray[0] = w * (1.0f - d[0] * d[0]);
+  ray[1] = -w * d[0] * d[1];
+  ray[2] = -w * d[0] * d[2];
+  ray[3] = w * (1.0f - d[1] * d[1]);
+  ray[4] = -w * d[1] * d[2];
+  ray[5] = w * (1.0f - d[2] * d[2]);
+  ray[6] = ray[0] * p[0] + ray[1] * p[1] + ray[2] * p[2];
+  ray[7] = ray[1] * p[0] + ray[3] * p[1] + ray[4] * p[2];
+  ray[8] = ray[2] * p[0] + ray[4] * p[1] + ray[5] * p[2];
+}
+
+// Normal equations of a tag into lane k of the batch, false without two
+// locators.
+static bool gather(position_engine_t *engine, position_tag_t *tag, uint64_t now_ns, uint32_t k)
+{
+  uint64_t max_age_ns = (uint64_t)(POSITION_RAY_MAX_AGE_S * 1e9f);
+  uint32_t count = 0;
+
+  for (uint32_t e = 0; e < 9; e++) {
+    engine->system[e * POSITION_BATCH + k] = 0;
+  }
+  for (uint32_t l = 0; l < engine->locator_count; l++) {
+    if (!(tag->rays & (1u << l))) {
+      continue;
+    }
+    if (now_ns > tag->ray_time_ns[l] + max_age_ns) {
+      tag->rays &= ~(1u << l);
+      continue;
+    }
+    for (uint32_t e = 0; e < 9; e++) {
+      engine->system[e * POSITION_BATCH + k] += tag->ray[l][e];
+    }
+    count++;
+  }
+  return count >= 2;
+}
+
+/***************************************************************************************************
+ * Public Function Definitions
+ **************************************************************************************************/
+
+sl_status_t position_init(position_engine_t *engine, uint32_t max_tags)
+{
+  uint32_t slots = 1;
+
+  memset(engine, 0, sizeof(*engine));
+  if (max_tags == 0) {
+    return SL_STATUS_INVALID_PARAMETER;
+  }
+  // At most half full
+  while (slots < 2 * max_tags) {
+    slots <<= 1;
+  }
+  engine->max_tags = max_tags;
+  engine->table_mask = slots - 1;
+  engine->tags = malloc(max_tags * sizeof(*engine->tags));
+  engine->table = malloc(slots * sizeof(*engine->table));
+  engine->marked = malloc(max_tags * sizeof(*engine->marked));
+  engine->system = malloc(9 * POSITION_BATCH * sizeof(float));
+  engine->solution = malloc(6 * POSITION_BATCH * sizeof(float));
+  if ((engine->tags == NULL) || (engine->table == NULL) || (engine->marked == NULL)
+      || (engine->system == NULL) || (engine->solution == NULL)) {
+    position_deinit(engine);
+    return SL_STATUS_ALLOCATION_FAILED;
+  }
+  memset(engine->table, 0xFF, slots * sizeof(*engine->table));
+  return SL_STATUS_OK;
+}
+
+void position_deinit(position_engine_t *engine)
+{
+  free(engine->tags);
+  free(engine->table);
+  free(engine->marked);
+  free(engine->system);
+  free(engine->solution);
+  memset(engine, 0, sizeof(*engine));
+}
+
+sl_status_t position_add_locator(position_engine_t *engine, const char *id,
+                                 const float coordinate[3], const float orientation[3])
+{
+  position_locator_t *locator;
+
+  if (position_find_locator(engine, id) >= 0) {
+    return SL_STATUS_ALREADY_EXISTS;
+  }
+  if (engine->locator_count == POSITION_MAX_LOCATORS) {
+    return SL_STATUS_FULL;
+  }
+  locator = &engine->locators[engine->locator_count++];
+  memset(locator, 0, sizeof(*locator));
+  strncpy(locator->id, id, sizeof(locator->id) - 1);
+  memcpy(locator->coordinate, coordinate, sizeof(locator->coordinate));
+  memcpy(locator->orientation, orientation, sizeof(locator->orientation));
+  set_rotation(locator);
+  return SL_STATUS_OK;
+}
+
+int32_t position_find_locator(const position_engine_t *engine, const char *id)
+{
+  for (uint32_t l = 0; l < engine->locator_count; l++) {
+    if (strcmp(engine->locators[l].id, id) == 0) {
+      return (int32_t)l;
+    }
+  }
+  return -1;
+}
+
+sl_status_t position_add_angle(position_engine_t *engine, uint32_t locator, const char *tag_id,
+                               const aoa_angle_t *angle, uint64_t time_ns)
+{
+  position_tag_t *tag;
+  uint32_t index;
+
+  if (locator >= engine->locator_count) {
+    return SL_STATUS_INVALID_PARAMETER;
+  }
+  tag = find_tag(engine, tag_id, time_ns, &index);
+  if (tag == NULL) {
+    metrics_inc(METRICS_POSITION_TABLE_FULL);
+    return SL_STATUS_FULL;
+  }
+  metrics_inc(METRICS_POSITION_ANGLES);
+  set_ray(&engine->locators[locator], angle, tag->ray[locator]);
+  tag->ray_time_ns[locator] = time_ns;
+  tag->rays |= 1u << locator;
+  tag->sequence = angle->sequence;
+  if (!tag->marked) {
+    tag->marked = true;
+    engine->marked[engine->marked_count++] = index;
+  }
+  return SL_STATUS_OK;
+}
+
+uint32_t position_solve(position_engine_t *engine, uint64_t now_ns, position_on_position_t on_position)
+{
+  uint32_t batch[POSITION_BATCH];
+  uint32_t solved = 0, m = 0;
+
+  while (m < engine->marked_count) {
+    uint32_t n = 0;
+    // Normal equations of up to POSITION_BATCH tags
+    for (; (m < engine->marked_count) && (n < POSITION_BATCH); m++) {
+      position_tag_t *tag = &engine->tags[engine->marked[m]];
+      tag->marked = false;
+      if (gather(engine, tag, now_ns, n)) {
+        batch[n++] = engine->marked[m];
+      }
+    }
+    simd_kernels->solve3(engine->system, engine->solution, n, POSITION_BATCH);
+    for (uint32_t k = 0; k < n; k++) {
+      const float *x = engine->solution;
+      aoa_position_t position;
+      // A singular system has no variance
+      if (!(x[3 * POSITION_BATCH + k] > 0)) {
+        metrics_inc(METRICS_POSITION_SINGULAR);
+        continue;
+      }
+      position.x = x[0 * POSITION_BATCH + k];
+      position.y = x[1 * POSITION_BATCH + k];
+      position.z = x[2 * POSITION_BATCH + k];
+      position.x_stdev = sqrtf(x[3 * POSITION_BATCH + k]);
+      position.y_stdev = sqrtf(x[4 * POSITION_BATCH + k]);
+      position.z_stdev = sqrtf(x[5 * POSITION_BATCH + k]);
+      position.sequence = engine->tags[batch[k]].sequence;
+      metrics_inc(METRICS_POSITION_SOLVED);
+      if (on_position != NULL) {
+        on_position(engine->tags[batch[k]].id, &position);
+      }
+      solved++;
+    }
+  }
+  engine->marked_count = 0;
+  return solved;
+}
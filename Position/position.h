@@ -0,0 +1,122 @@
+/***************************************************************************//**
+ * @file
+ * @brief Positioning engine, tag positions from the angles of several
+ *        locators of known pose.
+ *
+ * Every angle of a locator is a ray from the locator coordinate: in the
+ * locator frame the direction is (cos el cos az, cos el sin az, sin el), the
+ * orientation rotates it into the room frame about x, then y, then z. The
+ * position of a tag is the point closest to its rays in the least squares
+ * sense, the rays weighted by the inverse variance of their perpendicular
+ * error (angle stdev times distance):
+ *
+ *   sum w (I - d d^T) x = sum w (I - d d^T) p
+ *
+ * Each tag keeps the newest ray of every locator: an angle replaces the ray of
+ * its locator and marks the tag, nothing else is touched. position_solve()
+ * sums the rays of the marked tags, younger than POSITION_RAY_MAX_AGE_S, into
+ * the normal equations and solves up to POSITION_BATCH tags per call of the
+ * solve3 SIMD kernel, one tag per lane. A tag needs rays of two locators at
+ * least; the stdev of a coordinate is the square root of the diagonal of the
+ * inverse normal matrix.
+ *
+ * Tags are found by id in an open addressing table, up to max_tags of them
+ * (position_init()). Once max_tags are known, a new tag takes the place of a
+ * tag whose rays are all older than POSITION_RAY_MAX_AGE_S, so tags come and
+ * go for the life of the engine. The engine is not thread safe, one thread
+ * feeds and solves it.
+ ******************************************************************************/
+
+#ifndef POSITION_H_
+#define POSITION_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "sl_status.h"
+#include "aoa_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define POSITION_MAX_LOCATORS         16
+#define POSITION_DEFAULT_MAX_TAGS     4096
+#define POSITION_BATCH                256       // tags per solve3 call
+#define POSITION_RAY_MAX_AGE_S        0.5f
+#define POSITION_DEFAULT_STDEV        5.0f      // deg, angles without a stdev
+#define POSITION_MIN_RANGE            0.5f      // m, the distance of a ray weight at least
+
+/***************************************************************************************************
+ * Type Definitions
+ **************************************************************************************************/
+
+typedef struct {
+  aoa_id_t id;
+  float coordinate[3];          // m
+  float orientation[3];         // deg, about x, then y, then z
+  float rotation[3][3];         // locator frame to room frame
+} position_locator_t;
+
+typedef struct {
+  aoa_id_t id;
+  bool marked;                  // new rays since the last solve
+  uint32_t rays;                // bit per locator
+  int32_t sequence;             // of the newest angle
+  uint64_t ray_time_ns[POSITION_MAX_LOCATORS];
+  // w (I - d d^T) as a00 a01 a02 a11 a12 a22, and w (I - d d^T) p
+  float ray[POSITION_MAX_LOCATORS][9];
+} position_tag_t;
+
+typedef void (*position_on_position_t)(const char *tag_id, const aoa_position_t *position);
+
+typedef struct {
+  uint32_t locator_count;
+  position_locator_t locators[POSITION_MAX_LOCATORS];
+  // Tags, tag_count used of max_tags
+  uint32_t max_tags;
+  uint32_t tag_count;
+  position_tag_t *tags;
+  uint32_t *table;              // tag index per slot, UINT32_MAX if free
+  uint32_t table_mask;
+  // Full table: next tag checked for a stale one, and the time before which
+  // none can be
+  uint32_t evict_cursor;
+  uint64_t evict_after_ns;
+  // Marked tags in the order of their first new ray
+  uint32_t *marked;
+  uint32_t marked_count;
+  // Normal equations and solutions of a batch, SoA planes of POSITION_BATCH
+  float *system;
+  float *solution;
+} position_engine_t;
+
+/***************************************************************************************************
+ * Function Declarations
+ **************************************************************************************************/
+
+sl_status_t position_init(position_engine_t *engine, uint32_t max_tags);
+void position_deinit(position_engine_t *engine);
+
+// SL_STATUS_FULL beyond POSITION_MAX_LOCATORS, SL_STATUS_ALREADY_EXISTS for
+// an id given before.
+sl_status_t position_add_locator(position_engine_t *engine, const char *id,
+                                 const float coordinate[3], const float orientation[3]);
+
+// Index of a locator, -1 if unknown.
+int32_t position_find_locator(const position_engine_t *engine, const char *id);
+
+// Ray of an angle of the locator at index locator to the tag, received at
+// time_ns. SL_STATUS_FULL if the tag is new, max_tags are known and none of
+// them is stale.
+sl_status_t position_add_angle(position_engine_t *engine, uint32_t locator, const char *tag_id,
+                               const aoa_angle_t *angle, uint64_t time_ns);
+
+// Solves the tags with new rays, on_position gets each position. Returns the
+// number of positions, the tags without two rays wait for more.
+uint32_t position_solve(position_engine_t *engine, uint64_t now_ns, position_on_position_t on_position);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* POSITION_H_ */
@@ -0,0 +1,416 @@
+/***************************************************************************//**
+ * @file
+ * @brief Offline replay of a binary IQ capture through the estimator.
+ *
+ * Maps a capture written with the locator's -w option, rebuilds an
+ * aoa_iq_report_t for every record and runs it through aoa_calculate() with
+ * one estimator context per tag. Tags are independent, so they are spread
+ * over worker threads; reports of one tag stay on one thread and in order.
+ * Prints the throughput and per-report latency percentiles, and optionally
+ * writes the angles to a file. With -F the angle tracking filter runs on the
+ * capture timestamps, and predicts the angle of reports without an estimate.
+ * With -C the in-tree covariance estimator replaces the library one.
+ ******************************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "app_config.h"
+#include "aoa.h"
+#include "iq_capture.h"
+#include "iq_qa.h"
+#include "simd_kernels.h"
+#include "log_level.h"
+
+#define USAGE "\nUsage: %s -i <capture_file> [-o <angles_file>] [-j <threads>] [-r <speed>] [-k <kernels>] [-v <level>]\n" \
+              "          [-M <estimator mode>] [-F <angle motion deg/s^2>[:<noise deg>]]\n"          \
+              "          [-C <covariance window>[:<max age s>[:q15|float]]] [-J <reports>]\n"      \
+              "  -r  pace the reports by their timestamps, 1.0 is real time\n"                    \
+              "  -M  estimator mode, e.g. REAL_TIME_BASIC, default the one of the locator build\n"  \
+              "  -F  angle tracking filter\n"                                                      \
+              "  -C  in-tree estimator on the covariance of the last reports of each channel\n"     \
+              "  -J  in-tree estimator: one joint estimate over the recent channels per reports\n"  \
+              "  -k  SIMD kernel variant (scalar, sse4.1, avx2, avx512, neon), default the widest\n" \
+              "  -v  verbose level of the console output, default none\n"
+#define MAX_THREADS 64
+
+#ifdef _WIN32
+#define NULL_DEVICE "NUL"
+#else
+#define NULL_DEVICE "/dev/null"
+#endif
+
+extern float REFERENCE_SAMPL_RATE;
+
+typedef struct {
+  uint8_t address[6];
+  uint8_t address_type;
+  uint32_t reports;
+  uint32_t thread;
+  aoa_libitems_t aoa_state;
+} replay_tag_t;
+
+typedef struct {
+  const iq_capture_report_t *record;
+  uint32_t tag;
+  sl_status_t status;
+  uint64_t latency_ns;
+  aoa_angle_t angle;
+} replay_item_t;
+
+typedef struct {
+  uint32_t id;
+  pthread_t thread;
+} replay_worker_t;
+
+static iq_capture_reader_t reader;
+static replay_tag_t *tags;
+static uint32_t tag_count;
+static replay_item_t *items;
+static uint32_t item_count;
+static double pacing_speed;   // 0: as fast as possible
+
+static uint32_t find_or_add_tag(const iq_capture_report_t *record)
+{
+  for (uint32_t i = 0; i < tag_count; i++) {
+    if ((memcmp(tags[i].address, record->address, sizeof(record->address)) == 0)
+        && (tags[i].address_type == record->address_type)) {
+      return i;
+    }
+  }
+  tags = realloc(tags, sizeof(*tags) * (tag_count + 1));
+  if (tags == NULL) {
+    fprintf(stderr, "Out of memory.\n");
+    exit(EXIT_FAILURE);
+  }
+  memset(&tags[tag_count], 0, sizeof(*tags));
+  memcpy(tags[tag_count].address, record->address, sizeof(record->address));
+  tags[tag_count].address_type = record->address_type;
+  return tag_count++;
+}
+
+// Greedy balancing: the busiest tag goes to the least loaded thread.
+static void assign_threads(uint32_t threads)
+{
+  uint64_t load[MAX_THREADS] = { 0 };
+  bool *done = calloc(tag_count, sizeof(bool));
+
+  for (uint32_t n = 0; n < tag_count; n++) {
+    uint32_t busiest = 0, target = 0;
+    for (uint32_t i = 0; i < tag_count; i++) {
+      if (!done[i] && (done[busiest] || tags[i].reports > tags[busiest].reports)) {
+        busiest = i;
+      }
+    }
+    for (uint32_t t = 1; t < threads; t++) {
+      if (load[t] < load[target]) {
+        target = t;
+      }
+    }
+    tags[busiest].thread = target;
+    load[target] += tags[busiest].reports;
+    done[busiest] = true;
+  }
+  free(done);
+}
+
+static void *replay_worker(void *arg)
+{
+  replay_worker_t *worker = arg;
+  uint64_t first_timestamp_us = items[0].record->timestamp_us;
+  uint64_t start_ns = stage_stats_now();
+
+  for (uint32_t i = 0; i < item_count; i++) {
+    replay_item_t *item = &items[i];
+    replay_tag_t *tag = &tags[item->tag];
+    aoa_iq_report_t iq_report;
+    uint64_t t0;
+
+    if (tag->thread != worker->id) {
+      continue;
+    }
+    if (pacing_speed > 0) {
+      // The capture stamps are wall clock, a step back of the clock is due at once
+      int64_t offset_us = (int64_t)(item->record->timestamp_us - first_timestamp_us);
+      uint64_t due_ns = start_ns + (uint64_t)(((offset_us > 0) ? offset_us : 0) * 1000.0 / pacing_speed);
+      uint64_t now_ns = stage_stats_now();
+      if (due_ns > now_ns) {
+        struct timespec ts = { (due_ns - now_ns) / 1000000000u, (due_ns - now_ns) % 1000000000u };
+        nanosleep(&ts, NULL);
+      }
+    }
+    iq_capture_to_iq_report(item->record, &iq_report);
+    tag->aoa_state.report_time_ns = item->record->timestamp_us * 1000u;
+    t0 = stage_stats_now();
+    item->status = aoa_calculate(&tag->aoa_state, &iq_report, &item->angle);
+    if (item->status != SL_STATUS_OK) {
+      item->status = aoa_predict(&tag->aoa_state, &iq_report, &item->angle);
+    }
+    item->latency_ns = stage_stats_now() - t0;
+  }
+  return NULL;
+}
+
+static int compare_u64(const void *a, const void *b)
+{
+  uint64_t x = *(const uint64_t *)a;
+  uint64_t y = *(const uint64_t *)b;
+  return (x > y) - (x < y);
+}
+
+static double percentile_us(const uint64_t *sorted, uint32_t count, double p)
+{
+  uint32_t i = (uint32_t)(p / 100.0 * (count - 1) + 0.5);
+  return sorted[i] / 1000.0;
+}
+
+static void write_angles(const char *filename)
+{
+  FILE *f = fopen(filename, "wb");
+
+  if (f == NULL) {
+    fprintf(stderr, "Failed to open %s\n", filename);
+    return;
+  }
+  fprintf(f, "timestamp_us;tag;channel;rssi;event_counter;status;azimuth;elevation;distance\r\n");
+  for (uint32_t i = 0; i < item_count; i++) {
+    const replay_item_t *item = &items[i];
+    const uint8_t *a = item->record->address;
+    fprintf(f, "%llu;%02X:%02X:%02X:%02X:%02X:%02X;%u;%d;%u;",
+            (unsigned long long)item->record->timestamp_us,
+            a[5], a[4], a[3], a[2], a[1], a[0],
+            item->record->channel, item->record->rssi, item->record->event_counter);
+    if (item->status == SL_STATUS_OK) {
+      fprintf(f, "ok;%.1f;%.1f;%.3f\r\n", item->angle.azimuth, item->angle.elevation, item->angle.distance);
+    } else {
+      fprintf(f, "fail;;;\r\n");
+    }
+  }
+  fclose(f);
+}
+
+int main(int argc, char *argv[])
+{
+  const char *capture_file = NULL;
+  const char *angles_file = NULL;
+  uint32_t threads = (uint32_t)sysconf(_SC_NPROCESSORS_ONLN);
+  int32_t verbose_level = -1;
+  replay_worker_t workers[MAX_THREADS];
+  const iq_capture_report_t *record;
+  uint64_t t0, wall_ns;
+  uint64_t *latencies;
+  uint32_t capacity;
+  uint32_t ok = 0;
+  iq_qa_counters_t qa;
+  const char *kernels = NULL;
+  char *sep;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "i:o:j:r:k:M:F:C:J:v:h")) != -1) {
+    switch (opt) {
+      case 'i':
+        capture_file = optarg;
+        break;
+      case 'o':
+        angles_file = optarg;
+        break;
+      case 'j':
+        threads = atol(optarg);
+        break;
+      case 'r':
+        pacing_speed = atof(optarg);
+        break;
+      case 'k':
+        kernels = optarg;
+        break;
+      case 'M':
+        if (aoa_aox_mode_from_string(optarg, &aoa_aox_mode) != SL_STATUS_OK) {
+          fprintf(stderr, "Unknown estimator mode '%s'\n", optarg);
+          exit(EXIT_FAILURE);
+        }
+        break;
+      case 'F':
+        sep = strchr(optarg, ':');
+        if (sep != NULL) {
+          *sep = '\0';
+          angle_tracker_noise = atof(sep + 1);
+        }
+        angle_tracker_motion = atof(optarg);
+        break;
+      case 'C':
+        sep = strchr(optarg, ':');
+        if (sep != NULL) {
+          *sep = '\0';
+          covariance_max_age_s = atof(sep + 1);
+          sep = strchr(sep + 1, ':');
+          if (sep != NULL) {
+            // Arithmetic, the default Q15 on ARM
+            covariance_fixed_point = (strcmp(sep + 1, "q15") == 0);
+            if (!covariance_fixed_point && (strcmp(sep + 1, "float") != 0)) {
+              fprintf(stderr, "Covariance arithmetic q15 or float\n");
+              exit(EXIT_FAILURE);
+            }
+          }
+        }
+        covariance_window = (uint32_t)atol(optarg);
+        if (covariance_window > COVARIANCE_MAX_WINDOW) {
+          fprintf(stderr, "Covariance window above %d reports\n", COVARIANCE_MAX_WINDOW);
+          exit(EXIT_FAILURE);
+        }
+        break;
+      case 'J':
+        covariance_joint_reports = (uint32_t)atol(optarg);
+        if (covariance_joint_reports > SPECTRUM_MAX_JOINT) {
+          fprintf(stderr, "Joint estimate above %d reports\n", SPECTRUM_MAX_JOINT);
+          exit(EXIT_FAILURE);
+        }
+        break;
+      case 'v':
+        verbose_level = atol(optarg);
+        if (verbose_level < 0) {
+          fprintf(stderr, USAGE, argv[0]);
+          exit(EXIT_FAILURE);
+        }
+        log_level_set_verbose((uint32_t)verbose_level);
+        break;
+      default:
+        fprintf(stderr, USAGE, argv[0]);
+        exit(opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+  }
+  if (capture_file == NULL) {
+    fprintf(stderr, USAGE, argv[0]);
+    exit(EXIT_FAILURE);
+  }
+
+  simd_init();
+  if ((kernels != NULL) && (simd_select(kernels) != SL_STATUS_OK)) {
+    fprintf(stderr, "SIMD kernels '%s' not available on this CPU.\n", kernels);
+    exit(EXIT_FAILURE);
+  }
+
+  if (iq_capture_reader_open(&reader, capture_file) != SL_STATUS_OK) {
+    fprintf(stderr, "Failed to open capture %s\n", capture_file);
+    exit(EXIT_FAILURE);
+  }
+  // The estimators take the array geometry of the capture.
+  if ((aoa_array_set_type(&aoa_array_config, reader.header->array_type) != SL_STATUS_OK)
+      || (reader.header->num_array_elements > IQ_CAPTURE_MAX_ELEMENTS)
+      || (reader.header->switching_pattern_length > IQ_CAPTURE_MAX_ELEMENTS)) {
+    fprintf(stderr, "Unsupported array type %u in capture.\n", reader.header->array_type);
+    exit(EXIT_FAILURE);
+  }
+  aoa_array_config.num_array_elements = reader.header->num_array_elements;
+  aoa_array_config.num_snapshots = reader.header->num_snapshots;
+  aoa_array_config.ref_period_samples = reader.header->ref_period_samples;
+  aoa_array_config.switching_pattern_length = reader.header->switching_pattern_length;
+  memcpy(aoa_array_config.switching_pattern, reader.header->switching_pattern,
+         reader.header->switching_pattern_length);
+  if (aoa_array_validate(&aoa_array_config) != SL_STATUS_OK) {
+    fprintf(stderr, "Capture array configuration (%u elements, %u snapshots, switching pattern of %u) "
+            "is not supported.\n", reader.header->num_array_elements, reader.header->num_snapshots,
+            reader.header->switching_pattern_length);
+    exit(EXIT_FAILURE);
+  }
+  REFERENCE_SAMPL_RATE = reader.header->ref_sampling_rate_us;
+
+  // Index the capture and collect the tags.
+  capacity = ((reader.trailer != NULL) && (reader.trailer->report_count > 0))
+             ? reader.trailer->report_count : 1024;
+  items = malloc(sizeof(*items) * capacity);
+  while ((record = iq_capture_reader_next(&reader)) != NULL) {
+    if (item_count == capacity) {
+      capacity *= 2;
+      items = realloc(items, sizeof(*items) * capacity);
+    }
+    if (items == NULL) {
+      fprintf(stderr, "Out of memory.\n");
+      exit(EXIT_FAILURE);
+    }
+    memset(&items[item_count], 0, sizeof(*items));
+    items[item_count].record = record;
+    items[item_count].tag = find_or_add_tag(record);
+    tags[items[item_count].tag].reports++;
+    item_count++;
+  }
+  if (item_count == 0) {
+    fprintf(stderr, "No reports in %s\n", capture_file);
+    exit(EXIT_FAILURE);
+  }
+
+  if (threads < 1) {
+    threads = 1;
+  }
+  if (threads > MAX_THREADS) {
+    threads = MAX_THREADS;
+  }
+  if (threads > tag_count) {
+    threads = tag_count;
+  }
+  assign_threads(threads);
+
+  if (verbose_level < 0) {
+    if (freopen(NULL_DEVICE, "w", stdout) == NULL) {
+      fprintf(stderr, "Failed to silence stdout\n");
+    }
+  }
+  for (uint32_t i = 0; i < tag_count; i++) {
+    aoa_init(&tags[i].aoa_state);
+  }
+
+  t0 = stage_stats_now();
+  for (uint32_t t = 0; t < threads; t++) {
+    workers[t].id = t;
+    pthread_create(&workers[t].thread, NULL, replay_worker, &workers[t]);
+  }
+  for (uint32_t t = 0; t < threads; t++) {
+    pthread_join(workers[t].thread, NULL);
+  }
+  wall_ns = stage_stats_now() - t0;
+
+  latencies = malloc(sizeof(*latencies) * item_count);
+  for (uint32_t i = 0; i < item_count; i++) {
+    latencies[i] = items[i].latency_ns;
+    ok += (items[i].status == SL_STATUS_OK);
+  }
+  qsort(latencies, item_count, sizeof(*latencies), compare_u64);
+
+  fprintf(stderr, "reports:      %u (%u angles, %u without angle)\n", item_count, ok, item_count - ok);
+  fprintf(stderr, "tags:         %u on %u threads\n", tag_count, threads);
+  fprintf(stderr, "kernels:      %s\n", simd_kernels->name);
+  fprintf(stderr, "wall time:    %.3f s\n", wall_ns / 1e9);
+  fprintf(stderr, "throughput:   %.0f reports/s\n", item_count / (wall_ns / 1e9));
+  fprintf(stderr, "latency (us): p50 %.1f  p90 %.1f  p99 %.1f  p99.9 %.1f  max %.1f\n",
+          percentile_us(latencies, item_count, 50.0),
+          percentile_us(latencies, item_count, 90.0),
+          percentile_us(latencies, item_count, 99.0),
+          percentile_us(latencies, item_count, 99.9),
+          latencies[item_count - 1] / 1000.0);
+  iq_qa_get_counters(&qa);
+  fprintf(stderr, "IQ sample QA: %llu passed, rejected: truncated %llu, amplitude %llu, sndr %llu, phase jitter %llu\n",
+          (unsigned long long)qa.results[IQ_QA_PASS],
+          (unsigned long long)qa.results[IQ_QA_REJECT_LENGTH],
+          (unsigned long long)qa.results[IQ_QA_REJECT_AMPLITUDE],
+          (unsigned long long)qa.results[IQ_QA_REJECT_SNDR],
+          (unsigned long long)qa.results[IQ_QA_REJECT_PHASE_JITTER]);
+  fprintf(stderr, "              gate %.1f ms, estimator time saved %.1f ms\n",
+          qa.gate_ns / 1e6, iq_qa_saved_ns(&qa) / 1e6);
+
+  if (angles_file != NULL) {
+    write_angles(angles_file);
+  }
+
+  for (uint32_t i = 0; i < tag_count; i++) {
+    aoa_deinit(&tags[i].aoa_state);
+  }
+  free(latencies);
+  free(items);
+  free(tags);
+  iq_capture_reader_close(&reader);
+  return EXIT_SUCCESS;
+}
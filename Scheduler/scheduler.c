@@ -0,0 +1,147 @@
+/***************************************************************************//**
+ * @file
+ * @brief Report scheduler, serves the tag mailboxes by the motion of the tags
+ *        and the age of their last angle within a CPU budget per cycle.
+ ******************************************************************************/
+
+#include <string.h>
+#include <math.h>
+
+#include "app_config.h"
+#include "scheduler.h"
+#include "conn.h"
+
+/***************************************************************************************************
+ * Static Variables
+ **************************************************************************************************/
+
+static uint64_t period_start_ns;
+
+/***************************************************************************************************
+ * Public Variables
+ **************************************************************************************************/
+
+uint64_t scheduler_budget_ns;
+
+/***************************************************************************************************
+ * Static Function Definitions
+ **************************************************************************************************/
+
+static inline double ewma(double average, double value)
+{
+  return (average > 0) ? average + SCHEDULER_EWMA * (value - average) : value;
+}
+
+// Angle between two directions, deg
+static double angle_between(double azimuth1, double elevation1, double azimuth2, double elevation2)
+{
+  const double rad = M_PI / 180.0;
+  double c = cos(elevation1 * rad) * cos(elevation2 * rad) * cos((azimuth1 - azimuth2) * rad)
+             + sin(elevation1 * rad) * sin(elevation2 * rad);
+
+  return acos((c > 1.0) ? 1.0 : (c < -1.0) ? -1.0 : c) / rad;
+}
+
+// Served reports/s of the period of all tags
+static void update_rates(uint64_t now)
+{
+  conn_properties_t *conn;
+  double dt = (now - period_start_ns) / 1e9;
+
+  period_start_ns = now;
+  for (uint8_t i = 0; (conn = get_connection_by_index(i)) != NULL; i++) {
+    scheduler_tag_t *t = &conn->scheduler;
+    double rate = ewma(t->rate, t->period_served / dt);
+    __atomic_store(&t->rate, &rate, __ATOMIC_RELAXED);
+    t->period_served = 0;
+  }
+}
+
+/***************************************************************************************************
+ * Public Function Definitions
+ **************************************************************************************************/
+
+void scheduler_tag_init(scheduler_tag_t *tag)
+{
+  memset(tag, 0, sizeof(*tag));
+}
+
+void scheduler_published(scheduler_tag_t *tag, const aoa_libitems_t *aoa_state, const aoa_angle_t *angle,
+                         uint64_t now)
+{
+  const angle_tracker_t *tracker = &aoa_state->tracker;
+
+  tag->published_ns = now;
+  if (angle_tracker_enabled(tracker) && tracker->valid) {
+    // The azimuth rate shrinks towards the zenith
+    tag->motion = hypot(tracker->azimuth.rate * cos(tracker->elevation.angle * M_PI / 180.0),
+                        tracker->elevation.rate);
+    return;
+  }
+  if ((tag->window_ns != 0) && (now - tag->window_ns < SCHEDULER_MOTION_WINDOW_MS * 1000000ull)) {
+    return;
+  }
+  if (tag->window_ns != 0) {
+    tag->motion = ewma(tag->motion, angle_between(tag->azimuth, tag->elevation, angle->azimuth, angle->elevation)
+                                    / ((now - tag->window_ns) / 1e9));
+  }
+  tag->azimuth = angle->azimuth;
+  tag->elevation = angle->elevation;
+  tag->window_ns = now;
+}
+
+void scheduler_served(scheduler_tag_t *tag, uint64_t now)
+{
+  (void)now;
+  __atomic_store_n(&tag->served, tag->served + 1, __ATOMIC_RELAXED);
+  tag->period_served++;
+}
+
+void scheduler_cycle(uint64_t now)
+{
+  // Every cycle, so the rate of a tag not served decays towards 0
+  if (period_start_ns == 0) {
+    period_start_ns = now;
+  } else if (now - period_start_ns >= SCHEDULER_PERIOD_MS * 1000000ull) {
+    update_rates(now);
+  }
+}
+
+uint32_t scheduler_order(uint8_t *order, uint64_t now)
+{
+  double priority[AOA_MAX_TAGS];
+  conn_properties_t *conn;
+  uint32_t n = 0;
+
+  for (uint8_t i = 0; ((conn = get_connection_by_index(i)) != NULL) && (n < AOA_MAX_TAGS); i++) {
+    if (mailbox_empty(&conn->mailbox)) {
+      continue;
+    }
+    // Insertion sort by priority, a handful of tags
+    double p = scheduler_priority(&conn->scheduler, now);
+    uint32_t k = n++;
+    while ((k > 0) && (priority[k - 1] < p)) {
+      priority[k] = priority[k - 1];
+      order[k] = order[k - 1];
+      k--;
+    }
+    priority[k] = p;
+    order[k] = i;
+  }
+  return n;
+}
+
+double scheduler_priority(const scheduler_tag_t *tag, uint64_t now)
+{
+  double motion = (tag->motion > SCHEDULER_MIN_MOTION) ? tag->motion : SCHEDULER_MIN_MOTION;
+
+  return motion * (now - tag->published_ns) / 1e9;
+}
+
+double scheduler_tag_rate(const scheduler_tag_t *tag)
+{
+  double rate;
+
+  __atomic_load(&tag->rate, &rate, __ATOMIC_RELAXED);
+  return rate;
+}
@@ -0,0 +1,97 @@
+/***************************************************************************//**
+ * @file
+ * @brief Report scheduler, serves the tag mailboxes by the motion of the tags
+ *        and the age of their last angle within a CPU budget per cycle.
+ *
+ * Without a budget the main loop serves the mailboxes in turn, the oldest
+ * report of every tag with a token, until they are empty. With a budget
+ * (scheduler_budget_ns) a cycle of app_process_pending() serves the tags in
+ * rounds, the oldest report of every ready tag once per round, by priority:
+ *   priority = max(motion, SCHEDULER_MIN_MOTION) * age
+ * the angle in deg the tag may have moved since its last published angle.
+ * The cycle ends once the budget is spent, so the tags at the end of the
+ * order wait for the next cycle, where newer reports of theirs may supersede
+ * the waiting ones (see mailbox.h). A stationary tag ages at
+ * SCHEDULER_MIN_MOTION and is served once its age makes up for it; a tag
+ * without an angle yet comes first.
+ *
+ * The motion is the angular rate of the track of the tag if the tracking
+ * filter is on (angle_tracker.h), otherwise the angle between the published
+ * angles SCHEDULER_MOTION_WINDOW_MS apart over their time, a moving average,
+ * so the noise of single estimates counts less.
+ *
+ * The reports/s served per tag are set every SCHEDULER_PERIOD_MS, also
+ * when no tag is served, so the rate of a starved tag falls. All
+ * functions run on the event thread. The exported figures of a tag (rate,
+ * served) are written with relaxed atomics for the metrics server.
+ ******************************************************************************/
+
+#ifndef SCHEDULER_H_
+#define SCHEDULER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "aoa.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SCHEDULER_PERIOD_MS         500
+#define SCHEDULER_MOTION_WINDOW_MS  500
+#define SCHEDULER_MIN_MOTION        2.0       // deg/s, a stationary tag
+#define SCHEDULER_EWMA              0.3       // weight of the newest period or motion
+
+/***************************************************************************************************
+ * Type Definitions
+ **************************************************************************************************/
+
+typedef struct {
+  float azimuth;                // published angle at the start of the motion window
+  float elevation;
+  uint64_t window_ns;           // 0 before the first angle
+  double motion;                // deg/s, moving average
+  uint64_t published_ns;        // of the last angle, 0 before the first
+  uint32_t period_served;
+  // Exported
+  double rate;                  // reports/s served, moving average
+  uint64_t served;
+} scheduler_tag_t;
+
+/***************************************************************************************************
+ * Public variables
+ **************************************************************************************************/
+
+// Event thread time of a cycle of app_process_pending(), 0 serves every
+// report in turn (the default)
+extern uint64_t scheduler_budget_ns;
+
+/***************************************************************************************************
+ * Function Declarations
+ **************************************************************************************************/
+
+void scheduler_tag_init(scheduler_tag_t *tag);
+
+// An angle of the tag published at now (stage_stats_now()).
+void scheduler_published(scheduler_tag_t *tag, const aoa_libitems_t *aoa_state, const aoa_angle_t *angle,
+                         uint64_t now);
+
+// A report of the tag taken from its mailbox at now.
+void scheduler_served(scheduler_tag_t *tag, uint64_t now);
+
+// A cycle of app_process_pending() at now, served or not; sets the service
+// rates of all tags at the end of a period.
+void scheduler_cycle(uint64_t now);
+
+// Indexes of the tag table (get_connection_by_index()) of the tags with
+// reports waiting, by priority at now, highest first; returns their count.
+uint32_t scheduler_order(uint8_t *order, uint64_t now);
+
+double scheduler_priority(const scheduler_tag_t *tag, uint64_t now);
+double scheduler_tag_rate(const scheduler_tag_t *tag);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* SCHEDULER_H_ */
@@ -0,0 +1,649 @@
+/***************************************************************************//**
+ * @file
+ * @brief Numeric kernels with a variant per instruction set, bound at startup.
+ ******************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__arm__) && defined(__linux__)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+
+#include "simd_kernels.h"
+
+/***************************************************************************************************
+ * Type Definitions
+ **************************************************************************************************/
+
+// atan(x) on [0, 1], odd minimax polynomial in x (Abramowitz/Stegun 4.4.49 form)
+#define ATAN_C1    0.99997726f
+#define ATAN_C3   -0.33262347f
+#define ATAN_C5    0.19354346f
+#define ATAN_C7   -0.11643287f
+#define ATAN_C9    0.05265332f
+#define ATAN_C11  -0.01172120f
+
+// sin(x) and cos(x) on [-Pi/4, Pi/4] (Cephes sinf/cosf)
+#define SIN_C1    -1.6666654611e-1f
+#define SIN_C3     8.3321608736e-3f
+#define SIN_C5    -1.9515295891e-4f
+#define COS_C2     4.166664568298827e-2f
+#define COS_C4    -1.388731625493765e-3f
+#define COS_C6     2.443315711809948e-5f
+
+// Pi/2 in three parts for the range reduction (Cody-Waite), the products
+// with the quadrant number are exact for the first two.
+#define PIO2_1_F   1.5703125f
+#define PIO2_2_F   4.837512969970703125e-4f
+#define PIO2_3_F   7.549790126404332e-8f
+
+#define PI_F           3.14159265f
+#define PI_2_F         1.57079633f
+#define TWO_OVER_PI_F  0.63661977f
+
+// rsqrt estimate from the exponent bits
+#define RSQRT_MAGIC    0x5F375A86
+
+// Q15: rounding of a product, and the shift of the partial sums y = R a of
+// power_q15 to keep a^H y in 32 bits
+#define Q15_ROUND           (1 << 14)
+#define Q15_POWER_Y_SHIFT   3
+
+#define CROSS_CHECK_PAIRS   (256 * 256)
+#define CROSS_CHECK_POINTS  1021
+#define CROSS_CHECK_TAGS    13        // lanes of a batch, not a vector multiple
+#define CROSS_CHECK_VALUES  (8 + 6 * SIMD_Q15_MAX_ELEMENTS)   // IQ pairs of a batch report
+
+/***************************************************************************************************
+ * Static Function Definitions
+ **************************************************************************************************/
+
+static inline uint32_t float_bits(float f)
+{
+  uint32_t u;
+  memcpy(&u, &f, sizeof(u));
+  return u;
+}
+
+static inline float bits_float(uint32_t u)
+{
+  float f;
+  memcpy(&f, &u, sizeof(f));
+  return f;
+}
+
+// The element functions, the vector loops of every variant do the same.
+static inline float atan2_one(float y, float x)
+{
+  float ay = bits_float(float_bits(y) & 0x7FFFFFFFu);
+  float ax = bits_float(float_bits(x) & 0x7FFFFFFFu);
+  bool y_larger = ay > ax;
+  float mn = y_larger ? ax : ay;
+  float mx = y_larger ? ay : ax;
+  // atan2(0, 0) is 0
+  float t = mn / ((mx == 0) ? 1.0f : mx);
+  float s = t * t;
+  float r = ATAN_C11;
+  r = r * s + ATAN_C9;
+  r = r * s + ATAN_C7;
+  r = r * s + ATAN_C5;
+  r = r * s + ATAN_C3;
+  r = r * s + ATAN_C1;
+  r = r * t;
+  r = y_larger ? PI_2_F - r : r;
+  r = (x < 0) ? PI_F - r : r;
+  return bits_float(float_bits(r) ^ (float_bits(y) & 0x80000000u));
+}
+
+static inline float magnitude_one(float i, float q)
+{
+  float s = i * i + q * q;
+  // Refined by two Newton steps. For s == 0 the estimate stays finite and s * y is 0.
+  float y = bits_float((uint32_t)(RSQRT_MAGIC - ((int32_t)float_bits(s) >> 1)));
+  y = y * (1.5f - 0.5f * s * y * y);
+  y = y * (1.5f - 0.5f * s * y * y);
+  return s * y;
+}
+
+static inline void sincos_one(float x, float *sin_x, float *cos_x)
+{
+  float t = x * TWO_OVER_PI_F;
+  int32_t quadrant = (int32_t)(t + ((t >= 0) ? 0.5f : -0.5f));
+  float kf = (float)quadrant;
+  float r = ((x - kf * PIO2_1_F) - kf * PIO2_2_F) - kf * PIO2_3_F;
+  float z = r * r;
+  float sin_r = r + r * z * ((SIN_C5 * z + SIN_C3) * z + SIN_C1);
+  float cos_r = 1.0f - 0.5f * z + z * z * ((COS_C6 * z + COS_C4) * z + COS_C2);
+  bool swap = (quadrant & 1) != 0;
+  float s = swap ? cos_r : sin_r;
+  float c = swap ? sin_r : cos_r;
+  *sin_x = ((quadrant & 2) != 0) ? bits_float(float_bits(s) ^ 0x80000000u) : s;
+  *cos_x = (((quadrant + 1) & 2) != 0) ? bits_float(float_bits(c) ^ 0x80000000u) : c;
+}
+
+// Planes e of the system k, see simd_kernels_t.solve3
+static inline void solve3_one(const float *a, float *x, uint32_t k, uint32_t stride)
+{
+  float a00 = a[0 * stride + k], a01 = a[1 * stride + k], a02 = a[2 * stride + k];
+  float a11 = a[3 * stride + k], a12 = a[4 * stride + k], a22 = a[5 * stride + k];
+  float b0 = a[6 * stride + k], b1 = a[7 * stride + k], b2 = a[8 * stride + k];
+  float c00 = a11 * a22 - a12 * a12;
+  float c01 = a02 * a12 - a01 * a22;
+  float c02 = a01 * a12 - a02 * a11;
+  float c11 = a00 * a22 - a02 * a02;
+  float c12 = a01 * a02 - a00 * a12;
+  float c22 = a00 * a11 - a01 * a01;
+  float det = a00 * c00 + a01 * c01 + a02 * c02;
+  float trace = a00 + a11 + a22;
+  float inv = (det <= SIMD_SOLVE3_MIN_DET * trace * trace * trace) ? 0.0f : 1.0f / det;
+
+  x[0 * stride + k] = (c00 * b0 + c01 * b1 + c02 * b2) * inv;
+  x[1 * stride + k] = (c01 * b0 + c11 * b1 + c12 * b2) * inv;
+  x[2 * stride + k] = (c02 * b0 + c12 * b1 + c22 * b2) * inv;
+  x[3 * stride + k] = c00 * inv;
+  x[4 * stride + k] = c11 * inv;
+  x[5 * stride + k] = c22 * inv;
+}
+
+static inline void rotate_q15_one(int16_t *i, int16_t *q, int32_t rot_re, int32_t rot_im)
+{
+  int32_t vi = *i, vq = *q;
+
+  *i = (int16_t)((vi * rot_re - vq * rot_im + Q15_ROUND) >> 15);
+  *q = (int16_t)((vi * rot_im + vq * rot_re + Q15_ROUND) >> 15);
+}
+
+static inline void outer_q15_one(int32_t xr_re, int32_t xr_im, int32_t xc_re, int32_t xc_im,
+                                 int32_t *acc_re, int32_t *acc_im)
+{
+  *acc_re += (xr_re * xc_re + xr_im * xc_im) >> 15;
+  *acc_im += (xr_im * xc_re - xr_re * xc_im) >> 15;
+}
+
+// a: the steering vector of the point, n real parts then n imaginary parts
+static inline int32_t power_q15_one(const int16_t *covariance, const int16_t *a, uint32_t n)
+{
+  const int16_t *r_re = covariance;
+  const int16_t *r_im = covariance + n * n;
+  int32_t power = 0;
+
+  for (uint32_t r = 0; r + 1 < n; r++) {
+    int32_t y_re = 0, y_im = 0;
+    for (uint32_t c = r + 1; c < n; c++) {
+      int32_t rr = r_re[r * n + c], ri = r_im[r * n + c];
+      y_re += (rr * a[c] - ri * a[n + c]) >> 15;
+      y_im += (rr * a[n + c] + ri * a[c]) >> 15;
+    }
+    y_re >>= Q15_POWER_Y_SHIFT;
+    y_im >>= Q15_POWER_Y_SHIFT;
+    power += (a[r] * y_re + a[n + r] * y_im) >> (15 - Q15_POWER_Y_SHIFT);
+  }
+  return power;
+}
+
+// The same of the lane t of covariance planes, see simd_kernels_t.power_batch_q15
+static inline int32_t power_batch_q15_one(const int16_t *covariance, const int16_t *a, uint32_t n, uint32_t t)
+{
+  const int16_t *r_re = covariance;
+  const int16_t *r_im = covariance + n * n * SIMD_BATCH_TAGS;
+  int32_t power = 0;
+
+  for (uint32_t r = 0; r + 1 < n; r++) {
+    int32_t y_re = 0, y_im = 0;
+    for (uint32_t c = r + 1; c < n; c++) {
+      int32_t rr = r_re[(r * n + c) * SIMD_BATCH_TAGS + t], ri = r_im[(r * n + c) * SIMD_BATCH_TAGS + t];
+      y_re += (rr * a[c] - ri * a[n + c]) >> 15;
+      y_im += (rr * a[n + c] + ri * a[c]) >> 15;
+    }
+    y_re >>= Q15_POWER_Y_SHIFT;
+    y_im >>= Q15_POWER_Y_SHIFT;
+    power += (a[r] * y_re + a[n + r] * y_im) >> (15 - Q15_POWER_Y_SHIFT);
+  }
+  return power;
+}
+
+static bool supported_always(void)
+{
+  return true;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+static bool supported_sse41(void)
+{
+  return __builtin_cpu_supports("sse4.1");
+}
+
+static bool supported_avx2(void)
+{
+  return __builtin_cpu_supports("avx2");
+}
+
+static bool supported_avx512(void)
+{
+  return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw");
+}
+#elif defined(__aarch64__)
+#define supported_neon    supported_always
+#elif defined(__arm__)
+static bool supported_neon(void)
+{
+#if defined(__linux__)
+  return (getauxval(AT_HWCAP) & HWCAP_NEON) != 0;
+#else
+  return false;
+#endif
+}
+#endif
+
+/***************************************************************************************************
+ * Variants
+ **************************************************************************************************/
+
+#define SIMD_LANES        1
+#define SIMD_SUFFIX       scalar
+#define SIMD_NAME         "scalar"
+#define SIMD_SUPPORTED    supported_always
+#include "simd_kernels_impl.h"
+#undef SIMD_LANES
+#undef SIMD_SUFFIX
+#undef SIMD_NAME
+#undef SIMD_SUPPORTED
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#pragma GCC push_options
+#pragma GCC target("sse4.1")
+#define SIMD_LANES        4
+#define SIMD_SUFFIX       sse41
+#define SIMD_NAME         "sse4.1"
+#define SIMD_SUPPORTED    supported_sse41
+#include "simd_kernels_impl.h"
+#undef SIMD_LANES
+#undef SIMD_SUFFIX
+#undef SIMD_NAME
+#undef SIMD_SUPPORTED
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#define SIMD_LANES        8
+#define SIMD_SUFFIX       avx2
+#define SIMD_NAME         "avx2"
+#define SIMD_SUPPORTED    supported_avx2
+#include "simd_kernels_impl.h"
+#undef SIMD_LANES
+#undef SIMD_SUFFIX
+#undef SIMD_NAME
+#undef SIMD_SUPPORTED
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx512f,avx512bw")
+#define SIMD_LANES        16
+#define SIMD_SUFFIX       avx512
+#define SIMD_NAME         "avx512"
+#define SIMD_SUPPORTED    supported_avx512
+#include "simd_kernels_impl.h"
+#undef SIMD_LANES
+#undef SIMD_SUFFIX
+#undef SIMD_NAME
+#undef SIMD_SUPPORTED
+#pragma GCC pop_options
+
+static const simd_kernels_t *variants[] = {
+  &kernels_scalar, &kernels_sse41, &kernels_avx2, &kernels_avx512
+};
+
+#elif defined(__aarch64__) || defined(__arm__)
+
+#if defined(__arm__)
+#pragma GCC push_options
+#pragma GCC target("fpu=neon")
+#endif
+#define SIMD_LANES        4
+#define SIMD_SUFFIX       neon
+#define SIMD_NAME         "neon"
+#define SIMD_SUPPORTED    supported_neon
+#include "simd_kernels_impl.h"
+#undef SIMD_LANES
+#undef SIMD_SUFFIX
+#undef SIMD_NAME
+#undef SIMD_SUPPORTED
+#if defined(__arm__)
+#pragma GCC pop_options
+#endif
+
+static const simd_kernels_t *variants[] = {
+  &kernels_scalar, &kernels_neon
+};
+
+#else
+
+static const simd_kernels_t *variants[] = {
+  &kernels_scalar
+};
+
+#endif
+
+#define VARIANT_COUNT    (sizeof(variants) / sizeof(variants[0]))
+
+// The batch kernels of variant against scalar: reports of CROSS_CHECK_TAGS
+// lanes out of the n int8 IQ pairs, the phasors (n each) and the steering
+// table of cross_check_q15(), every lane on its own covariance and table
+// points
+static uint32_t cross_check_batch(const simd_kernels_t *reference, const simd_kernels_t *variant,
+                                  const int8_t *samples, const int16_t *rot, const int16_t *covariance,
+                                  const int16_t *steering, const uint32_t *points, uint32_t n)
+{
+  static const uint32_t sizes[] = { 4, 9, SIMD_Q15_MAX_ELEMENTS };
+  const uint32_t plane = CROSS_CHECK_VALUES * SIMD_BATCH_TAGS;
+  const uint32_t matrix = SIMD_Q15_MAX_ELEMENTS * SIMD_Q15_MAX_ELEMENTS * SIMD_BATCH_TAGS;
+  const uint32_t phasors = SIMD_Q15_MAX_ELEMENTS * SIMD_BATCH_TAGS;
+  const uint32_t count = CROSS_CHECK_POINTS / 8;
+  const int8_t *reports[SIMD_BATCH_TAGS];
+  const int16_t *tables[SIMD_BATCH_TAGS];
+  int16_t *rot_planes = malloc(2 * phasors * sizeof(int16_t));
+  int16_t *covariances = malloc(2 * matrix * sizeof(int16_t));
+  int16_t *iq[2] = { malloc(2 * plane * sizeof(int16_t)), malloc(2 * plane * sizeof(int16_t)) };
+  int32_t *acc[2] = { malloc(2 * matrix * sizeof(int32_t)), malloc(2 * matrix * sizeof(int32_t)) };
+  int32_t *power[2] = { malloc(count * SIMD_BATCH_TAGS * sizeof(int32_t)),
+                        malloc(count * SIMD_BATCH_TAGS * sizeof(int32_t)) };
+  uint32_t mismatches = 0;
+
+  for (uint32_t t = 0; t < SIMD_BATCH_TAGS; t++) {
+    reports[t] = samples + t * 4099 * 2;
+    // Every other lane a point further on, within the 64 points of the table
+    tables[t] = steering + (t % 2) * 2 * SIMD_Q15_MAX_ELEMENTS;
+  }
+  for (uint32_t k = 0; k < phasors; k++) {
+    rot_planes[k] = rot[k * 37];
+    rot_planes[phasors + k] = rot[n + k * 37];
+  }
+  for (uint32_t k = 0; k < 2 * matrix; k++) {
+    covariances[k] = covariance[k % (2 * SIMD_Q15_MAX_ELEMENTS * SIMD_Q15_MAX_ELEMENTS)] + (int16_t)(k % 7);
+  }
+
+  for (uint32_t z = 0; z < sizeof(sizes) / sizeof(sizes[0]); z++) {
+    const uint32_t elements = sizes[z];
+    for (int r = 0; r < 2; r++) {
+      const simd_kernels_t *kernels = (r == 0) ? reference : variant;
+      uint32_t points_used[CROSS_CHECK_POINTS / 8];
+      memset(iq[r], 0, 2 * plane * sizeof(int16_t));
+      memset(acc[r], 0, 2 * matrix * sizeof(int32_t));
+      kernels->deinterleave_batch_q15(reports, iq[r], iq[r] + plane, CROSS_CHECK_VALUES, CROSS_CHECK_TAGS);
+      kernels->rotate_batch_q15(iq[r], iq[r] + plane, rot_planes, rot_planes + phasors, CROSS_CHECK_VALUES, elements,
+                                CROSS_CHECK_TAGS);
+      // Every snapshot of elements values
+      for (uint32_t k = 0; (k + 1) * elements <= CROSS_CHECK_VALUES; k++) {
+        const uint32_t offset = k * elements * SIMD_BATCH_TAGS;
+        kernels->outer_batch_q15(iq[r] + offset, iq[r] + plane + offset, acc[r],
+                                 acc[r] + elements * elements * SIMD_BATCH_TAGS, elements, CROSS_CHECK_TAGS);
+      }
+      for (uint32_t k = 0; k < count; k++) {
+        points_used[k] = points[k] % 63;
+      }
+      kernels->power_batch_q15(covariances, tables, points_used, power[r], elements, count, CROSS_CHECK_TAGS);
+    }
+    for (uint32_t k = 0; k < 2 * plane; k++) {
+      mismatches += (iq[0][k] != iq[1][k]);
+    }
+    for (uint32_t k = 0; k < 2 * elements * elements * SIMD_BATCH_TAGS; k++) {
+      mismatches += (acc[0][k] != acc[1][k]);
+    }
+    for (uint32_t k = 0; k < count; k++) {
+      for (uint32_t t = 0; t < CROSS_CHECK_TAGS; t++) {
+        mismatches += (power[0][k * SIMD_BATCH_TAGS + t] != power[1][k * SIMD_BATCH_TAGS + t]);
+      }
+    }
+  }
+
+  for (int r = 0; r < 2; r++) {
+    free(iq[r]);
+    free(acc[r]);
+    free(power[r]);
+  }
+  free(rot_planes);
+  free(covariances);
+  return mismatches;
+}
+
+// The Q15 kernels of variant against scalar: all int8 IQ pairs rotated by a
+// phase sweep, their outer products and the power of random points of a
+// random steering table, see simd_cross_check()
+static uint32_t cross_check_q15(const simd_kernels_t *reference, const simd_kernels_t *variant,
+                                const int8_t *samples, const float *phase, uint32_t n)
+{
+  static const uint32_t sizes[] = { 4, 9, SIMD_Q15_MAX_ELEMENTS };
+  const uint32_t table_points = 64;
+  const uint32_t matrix = SIMD_Q15_MAX_ELEMENTS * SIMD_Q15_MAX_ELEMENTS;
+  int16_t *rot = malloc(2 * n * sizeof(int16_t));
+  int16_t *iq[2] = { malloc(2 * n * sizeof(int16_t)), malloc(2 * n * sizeof(int16_t)) };
+  int32_t *acc[2] = { malloc(2 * matrix * sizeof(int32_t)), malloc(2 * matrix * sizeof(int32_t)) };
+  int16_t *covariance = malloc(2 * matrix * sizeof(int16_t));
+  int16_t *steering = malloc(table_points * 2 * SIMD_Q15_MAX_ELEMENTS * sizeof(int16_t));
+  uint32_t *points = malloc(CROSS_CHECK_POINTS * sizeof(uint32_t));
+  int32_t *power[2] = { malloc(CROSS_CHECK_POINTS * sizeof(int32_t)), malloc(CROSS_CHECK_POINTS * sizeof(int32_t)) };
+  uint32_t seed = 7;
+  uint32_t mismatches = 0;
+
+  for (uint32_t k = 0; k < n; k++) {
+    float sin_x, cos_x;
+    sincos_one(phase[k], &sin_x, &cos_x);
+    rot[k] = (int16_t)(32767.0f * cos_x);
+    rot[n + k] = (int16_t)(32767.0f * sin_x);
+  }
+  for (uint32_t p = 0; p < table_points; p++) {
+    int16_t *a = steering + p * 2 * SIMD_Q15_MAX_ELEMENTS;
+    for (uint32_t c = 0; c < SIMD_Q15_MAX_ELEMENTS; c++) {
+      float sin_x, cos_x;
+      seed = seed * 1103515245u + 12345u;
+      // 0..2 Pi
+      sincos_one((float)((seed >> 8) & 0xFFFF) / 10430.378f, &sin_x, &cos_x);
+      a[c] = (int16_t)(32767.0f * cos_x);
+      a[SIMD_Q15_MAX_ELEMENTS + c] = (int16_t)(32767.0f * sin_x);
+    }
+  }
+  // Entries within 1 / 16, the covariance of 16 slots stays within trace 1
+  for (uint32_t k = 0; k < 2 * matrix; k++) {
+    seed = seed * 1103515245u + 12345u;
+    covariance[k] = (int16_t)((int32_t)((seed >> 8) & 0xFFF) - 2048);
+  }
+  for (uint32_t k = 0; k < CROSS_CHECK_POINTS; k++) {
+    seed = seed * 1103515245u + 12345u;
+    points[k] = (seed >> 8) % table_points;
+  }
+
+  for (int r = 0; r < 2; r++) {
+    const simd_kernels_t *kernels = (r == 0) ? reference : variant;
+    kernels->deinterleave_q15(samples, iq[r], iq[r] + n, n);
+    kernels->rotate_q15(iq[r], iq[r] + n, rot, rot + n, n);
+  }
+  for (uint32_t k = 0; k < 2 * n; k++) {
+    mismatches += (iq[0][k] != iq[1][k]);
+  }
+
+  for (uint32_t z = 0; z < sizeof(sizes) / sizeof(sizes[0]); z++) {
+    const uint32_t elements = sizes[z];
+    for (int r = 0; r < 2; r++) {
+      const simd_kernels_t *kernels = (r == 0) ? reference : variant;
+      memset(acc[r], 0, 2 * matrix * sizeof(int32_t));
+      // Snapshots of the rotated samples, every 97th
+      for (uint32_t k = 0; k + elements <= n; k += 97 * elements) {
+        kernels->outer_q15(iq[0] + k, iq[0] + n + k, acc[r], acc[r] + matrix, elements);
+      }
+      // The steering table of SIMD_Q15_MAX_ELEMENTS slots read as one of
+      // elements slots
+      kernels->power_q15(covariance, steering, points, power[r], elements, CROSS_CHECK_POINTS);
+    }
+    for (uint32_t k = 0; k < 2 * matrix; k++) {
+      mismatches += (acc[0][k] != acc[1][k]);
+    }
+    for (uint32_t k = 0; k < CROSS_CHECK_POINTS; k++) {
+      mismatches += (power[0][k] != power[1][k]);
+    }
+  }
+
+  mismatches += cross_check_batch(reference, variant, samples, rot, covariance, steering, points, n);
+
+  for (int r = 0; r < 2; r++) {
+    free(iq[r]);
+    free(acc[r]);
+    free(power[r]);
+  }
+  free(rot);
+  free(covariance);
+  free(steering);
+  free(points);
+  return mismatches;
+}
+
+/***************************************************************************************************
+ * Public Variables
+ **************************************************************************************************/
+
+const simd_kernels_t *simd_kernels = &kernels_scalar;
+
+/***************************************************************************************************
+ * Public Function Definitions
+ **************************************************************************************************/
+
+const simd_kernels_t *simd_init(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_cpu_init();
+#endif
+  // Widest first
+  for (uint32_t v = VARIANT_COUNT; v-- > 0; ) {
+    if (variants[v]->supported()) {
+      simd_kernels = variants[v];
+      break;
+    }
+  }
+  return simd_kernels;
+}
+
+sl_status_t simd_select(const char *name)
+{
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_cpu_init();
+#endif
+  for (uint32_t v = 0; v < VARIANT_COUNT; v++) {
+    if (strcmp(variants[v]->name, name) == 0) {
+      if (!variants[v]->supported()) {
+        return SL_STATUS_NOT_SUPPORTED;
+      }
+      simd_kernels = variants[v];
+      return SL_STATUS_OK;
+    }
+  }
+  return SL_STATUS_NOT_FOUND;
+}
+
+uint32_t simd_variant_count(void)
+{
+  return VARIANT_COUNT;
+}
+
+const simd_kernels_t *simd_variant(uint32_t index)
+{
+  return (index < VARIANT_COUNT) ? variants[index] : NULL;
+}
+
+uint32_t simd_cross_check(const simd_kernels_t *variant)
+{
+  const simd_kernels_t *reference = &kernels_scalar;
+  // Not a multiple of any vector width, the tails are checked as well
+  const uint32_t n = CROSS_CHECK_PAIRS - 3;
+  int8_t *samples = malloc(2 * CROSS_CHECK_PAIRS);
+  int8_t *synthesized[2] = { malloc(2 * CROSS_CHECK_PAIRS), malloc(2 * CROSS_CHECK_PAIRS) };
+  float *phase = malloc(CROSS_CHECK_PAIRS * sizeof(float));
+  float *amplitude = malloc(CROSS_CHECK_PAIRS * sizeof(float));
+  float *out[2][4];
+  // Systems of 3 rays with random directions, stride not a vector multiple
+  const uint32_t systems = 1021, stride = 1024;
+  float *system = malloc(9 * stride * sizeof(float));
+  float *solution[2] = { malloc(6 * stride * sizeof(float)), malloc(6 * stride * sizeof(float)) };
+  uint32_t seed = 1;
+  uint32_t mismatches = 0;
+
+  for (int r = 0; r < 2; r++) {
+    for (int o = 0; o < 4; o++) {
+      out[r][o] = malloc(CROSS_CHECK_PAIRS * sizeof(float));
+    }
+  }
+
+  // Every int8 IQ pair, and a phase sweep over the range restrictRad() gives
+  for (uint32_t k = 0; k < CROSS_CHECK_PAIRS; k++) {
+    samples[2 * k] = (int8_t)(k >> 8);
+    samples[2 * k + 1] = (int8_t)k;
+    phase[k] = -12.5663706f + 25.1327412f * k / CROSS_CHECK_PAIRS;
+    amplitude[k] = 127.0f - (k % 97);
+  }
+
+  memset(system, 0, 9 * stride * sizeof(float));
+  for (uint32_t k = 0; k < systems; k++) {
+    // Some systems of parallel rays, singular
+    uint32_t rays = (k % 17 == 0) ? 1 : 3;
+    for (uint32_t r = 0; r < rays; r++) {
+      float d[3], p[3], m[6];
+      for (int e = 0; e < 3; e++) {
+        seed = seed * 1103515245u + 12345u;
+        d[e] = (float)((seed >> 8) & 0xFFFF) / 32768.0f - 1.0f;
+        p[e] = d[e] * 7.0f + (float)e;
+      }
+      float norm = 1.0f / (d[0] * d[0] + d[1] * d[1] + d[2] * d[2] + 1e-3f);
+      m[0] = 1.0f - d[0] * d[0] * norm;
+      m[1] = -d[0] * d[1] * norm;
+      m[2] = -d[0] * d[2] * norm;
+      m[3] = 1.0f - d[1] * d[1] * norm;
+      m[4] = -d[1] * d[2] * norm;
+      m[5] = 1.0f - d[2] * d[2] * norm;
+      for (int e = 0; e < 6; e++) {
+        system[e * stride + k] += m[e];
+      }
+      system[6 * stride + k] += m[0] * p[0] + m[1] * p[1] + m[2] * p[2];
+      system[7 * stride + k] += m[1] * p[0] + m[3] * p[1] + m[4] * p[2];
+      system[8 * stride + k] += m[2] * p[0] + m[4] * p[1] + m[5] * p[2];
+    }
+  }
+
+  for (int r = 0; r < 2; r++) {
+    const simd_kernels_t *kernels = (r == 0) ? reference : variant;
+    kernels->solve3(system, solution[r], systems, stride);
+    kernels->deinterleave(samples, out[r][0], out[r][1], n);
+    kernels->atan2(out[r][1], out[r][0], out[r][2], n);
+    kernels->magnitude(out[r][0], out[r][1], out[r][3], n);
+    // Odd length, the last phase gives an I only
+    kernels->synthesize(phase, amplitude, synthesized[r], 2 * n - 1);
+  }
+
+  for (int o = 0; o < 4; o++) {
+    for (uint32_t k = 0; k < n; k++) {
+      mismatches += (float_bits(out[0][o][k]) != float_bits(out[1][o][k]));
+    }
+  }
+  for (uint32_t k = 0; k < 2 * n - 1; k++) {
+    mismatches += (synthesized[0][k] != synthesized[1][k]);
+  }
+  for (uint32_t e = 0; e < 6; e++) {
+    for (uint32_t k = 0; k < systems; k++) {
+      mismatches += (float_bits(solution[0][e * stride + k]) != float_bits(solution[1][e * stride + k]));
+    }
+  }
+  mismatches += cross_check_q15(reference, variant, samples, phase, n);
+
+  for (int r = 0; r < 2; r++) {
+    for (int o = 0; o < 4; o++) {
+      free(out[r][o]);
+    }
+    free(synthesized[r]);
+    free(solution[r]);
+  }
+  free(system);
+  free(samples);
+  free(phase);
+  free(amplitude);
+  return mismatches;
+}
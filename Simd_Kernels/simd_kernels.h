@@ -0,0 +1,150 @@
+/***************************************************************************//**
+ * @file
+ * @brief Numeric kernels with a variant per instruction set, bound at startup.
+ *
+ * The makefile builds one generic binary per DEVICE, without -march. The hot
+ * kernels are therefore compiled several times, once per instruction set,
+ * and simd_init() binds simd_kernels to the widest variant the CPU has:
+ *
+ *   x64      scalar, sse4.1 (4 lanes), avx2 (8 lanes), avx512 (16 lanes)
+ *   cortexa  scalar, neon (4 lanes)
+ *
+ * Every variant gives bit-identical results to the scalar one: the same
+ * float operations in the same order, no contraction into FMA (the makefile
+ * builds with -std=c99, i.e. -ffp-contract=off). simd_cross_check() verifies
+ * that on the running CPU.
+ *
+ * The kernels:
+ *   deinterleave  int8 IQ pairs into float I and Q arrays
+ *   atan2         polynomial atan2, phase error <= 2.0e-6 rad (bench_analytics)
+ *   magnitude     sqrt(i * i + q * q) by rsqrt with two Newton steps,
+ *                 error <= 5.0e-6 relative
+ *   synthesize    int8 IQ pairs amplitude * (cos, sin)(phase) for the
+ *                 simulator, error <= 1 LSB against libm
+ *   solve3        symmetric 3x3 systems A x = b, one per lane, by cofactors,
+ *                 the position solver of many tags at once (position.h)
+ *
+ * and the Q15 kernels of the fixed-point covariance estimator (covariance.h,
+ * spectrum.h), integer only, for the ARM gateways:
+ *   deinterleave_q15  int8 IQ pairs into int16 I and Q arrays, sample << 7
+ *   rotate_q15        complex product with a Q15 phasor per sample, rounded
+ *   outer_q15         adds the Q15 outer product x x^H to an int32 matrix
+ *   power_q15         Bartlett power of points of a Q15 steering table, one
+ *                     point per lane
+ * Every intermediate fits in 32 bits for the ranges documented per kernel,
+ * the shifts are arithmetic (gcc).
+ *
+ * The batch kernels do the same for the reports of up to SIMD_BATCH_TAGS
+ * tags at once, one tag per lane: a report of a 1x4 ULA has 4 slots per
+ * snapshot, too few to fill 8 or 16 lanes with one report. The values are
+ * laid out as structure of arrays across the tags, value k of the tag of
+ * lane t at [k * SIMD_BATCH_TAGS + t]. The last vector of a batch is
+ * computed whole, the lanes past tags on what the planes hold there (zeros
+ * from deinterleave_batch_q15, a steering vector of zeros in
+ * power_batch_q15), so the planes are SIMD_BATCH_TAGS wide and initialized
+ * and their values past tags undefined. Every lane below tags gives exactly
+ * what the kernel of one report gives.
+ *   deinterleave_batch_q15  int8 IQ pairs of every tag into the planes
+ *   rotate_batch_q15        rotate_q15 with the phasors of the lane
+ *   outer_batch_q15         outer_q15 of the snapshot of every lane
+ *   power_batch_q15         power_q15 of the covariance of every lane, the
+ *                           steering table of its lane
+ ******************************************************************************/
+
+#ifndef SIMD_KERNELS_H_
+#define SIMD_KERNELS_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "sl_status.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SIMD_SOLVE3_MIN_DET    1e-6f
+#define SIMD_Q15_MAX_ELEMENTS  16
+#define SIMD_BATCH_TAGS        16
+
+/***************************************************************************************************
+ * Type Definitions
+ **************************************************************************************************/
+
+typedef struct {
+  const char *name;
+  bool (*supported)(void);
+  // n IQ pairs from samples into i and q.
+  void (*deinterleave)(const int8_t *samples, float *i, float *q, uint32_t n);
+  void (*atan2)(const float *y, const float *x, float *out, uint32_t n);
+  void (*magnitude)(const float *i, const float *q, float *out, uint32_t n);
+  // n IQ values (I and Q each count, n may be odd) from n / 2 rounded up phases.
+  void (*synthesize)(const float *phase, const float *amplitude, int8_t *samples, uint32_t n);
+  // n systems, a holds 9 planes of stride floats: a00 a01 a02 a11 a12 a22 b0
+  // b1 b2. x gets 6 planes: the solution and the diagonal of A^-1. Systems
+  // with det(A) <= SIMD_SOLVE3_MIN_DET * trace(A)^3 are singular, all 0.
+  void (*solve3)(const float *a, float *x, uint32_t n, uint32_t stride);
+  // n IQ pairs from samples into i and q, |i + jq| <= 22989.
+  void (*deinterleave_q15)(const int8_t *samples, int16_t *i, int16_t *q, uint32_t n);
+  // n samples times the phasors rot (|rot| <= 1 in Q15), in place, the
+  // products rounded to Q15: |i + jq| stays within 22989.
+  void (*rotate_q15)(int16_t *i, int16_t *q, const int16_t *rot_re, const int16_t *rot_im, uint32_t n);
+  // acc += (x x^H) >> 15 over the whole n x n matrix, the real plane acc_re
+  // and the imaginary plane acc_im row major, |x| <= 22989.
+  void (*outer_q15)(const int16_t *re, const int16_t *im, int32_t *acc_re, int32_t *acc_im, uint32_t n);
+  // Re(a^H R a) without the diagonal, over the upper triangle, of count
+  // points: the points[k]-th steering vector of n Q15 real parts then n
+  // imaginary parts (|a_n| <= 1), R the Q15 real then imaginary plane of an
+  // n x n covariance of trace <= 1, n <= SIMD_Q15_MAX_ELEMENTS. The power is
+  // in Q15.
+  void (*power_q15)(const int16_t *covariance, const int16_t *steering, const uint32_t *points, int32_t *power,
+                    uint32_t n, uint32_t count);
+  // n IQ pairs of the reports samples[t] of tags lanes into the planes i
+  // and q, sample << 7.
+  void (*deinterleave_batch_q15)(const int8_t *const *samples, int16_t *i, int16_t *q, uint32_t n, uint32_t tags);
+  // n values of every lane times the phasors of the lane in place, value k
+  // by phasor k % period (the slot of a snapshot), as rotate_q15.
+  void (*rotate_batch_q15)(int16_t *i, int16_t *q, const int16_t *rot_re, const int16_t *rot_im, uint32_t n,
+                           uint32_t period, uint32_t tags);
+  // outer_q15 of the n values of every lane into its n x n planes acc_re
+  // and acc_im.
+  void (*outer_batch_q15)(const int16_t *re, const int16_t *im, int32_t *acc_re, int32_t *acc_im, uint32_t n,
+                          uint32_t tags);
+  // power_q15 of the covariance planes of every lane (the n x n real then
+  // the n x n imaginary values), steering[t] the Q15 table of lane t; the
+  // power of points[k] of lane t at power[k * SIMD_BATCH_TAGS + t].
+  void (*power_batch_q15)(const int16_t *covariance, const int16_t *const *steering, const uint32_t *points,
+                          int32_t *power, uint32_t n, uint32_t count, uint32_t tags);
+} simd_kernels_t;
+
+/***************************************************************************************************
+ * Public variables
+ **************************************************************************************************/
+
+// Active variant, the scalar one until simd_init().
+extern const simd_kernels_t *simd_kernels;
+
+/***************************************************************************************************
+ * Function Declarations
+ **************************************************************************************************/
+
+// Binds the widest supported variant. Call once, before the worker threads.
+const simd_kernels_t *simd_init(void);
+
+// Binds a variant by name, SL_STATUS_NOT_FOUND if it is not compiled in,
+// SL_STATUS_NOT_SUPPORTED if the CPU lacks it.
+sl_status_t simd_select(const char *name);
+
+// Every variant compiled into this binary, index 0 is scalar.
+uint32_t simd_variant_count(void);
+const simd_kernels_t *simd_variant(uint32_t index);
+
+// Runs every kernel of variant and of the scalar variant over all int8 IQ
+// pairs, a phase sweep, random 3x3 systems and random Q15 covariances and
+// steering vectors, returns the number of differing output values.
+uint32_t simd_cross_check(const simd_kernels_t *variant);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* SIMD_KERNELS_H_ */
@@ -0,0 +1,522 @@
+/***************************************************************************//**
+ * @file
+ * @brief Kernel bodies, instantiated once per variant by simd_kernels.c.
+ *
+ * No include guard. Before each inclusion simd_kernels.c defines SIMD_LANES
+ * (1 for scalar, otherwise the vector width in floats) and SIMD_SUFFIX, and
+ * selects the instruction set with #pragma GCC target. The vector loops are
+ * written with GCC vector extensions and mirror the scalar element functions
+ * of simd_kernels.c operation by operation, the tails use those directly.
+ ******************************************************************************/
+
+#define SIMD_CONCAT_(name, suffix)    name ## _ ## suffix
+#define SIMD_CONCAT(name, suffix)     SIMD_CONCAT_(name, suffix)
+#define SIMD_FN(name)                 SIMD_CONCAT(name, SIMD_SUFFIX)
+
+#if SIMD_LANES > 1
+
+#define VF    SIMD_FN(vf)
+#define VI    SIMD_FN(vi)
+#define VB    SIMD_FN(vb)
+#define VS    SIMD_FN(vs)
+
+typedef float VF __attribute__((vector_size(SIMD_LANES * sizeof(float))));
+typedef int32_t VI __attribute__((vector_size(SIMD_LANES * sizeof(int32_t))));
+typedef int8_t VB __attribute__((vector_size(SIMD_LANES * sizeof(int8_t))));
+typedef int16_t VS __attribute__((vector_size(SIMD_LANES * sizeof(int16_t))));
+
+#if SIMD_LANES == 4
+#define SIMD_EVEN    { 0, 2, 4, 6 }
+#define SIMD_ODD     { 1, 3, 5, 7 }
+#elif SIMD_LANES == 8
+#define SIMD_EVEN    { 0, 2, 4, 6, 8, 10, 12, 14 }
+#define SIMD_ODD     { 1, 3, 5, 7, 9, 11, 13, 15 }
+#elif SIMD_LANES == 16
+#define SIMD_EVEN    { 0, 2, 4, 6, 8, 10, 12, 14, 16, 18, 20, 22, 24, 26, 28, 30 }
+#define SIMD_ODD     { 1, 3, 5, 7, 9, 11, 13, 15, 17, 19, 21, 23, 25, 27, 29, 31 }
+#endif
+
+// Macros rather than functions, vector arguments would change the ABI.
+#define V_LOAD(v, p)              memcpy(&(v), (p), sizeof(v))
+#define V_STORE(p, v)             memcpy((p), &(v), sizeof(v))
+#define V_SELECT(mask, a, b)      ((VF)(((mask) & (VI)(a)) | (~(mask) & (VI)(b))))
+
+#endif // SIMD_LANES > 1
+
+static void SIMD_FN(deinterleave)(const int8_t *samples, float *i, float *q, uint32_t n)
+{
+  uint32_t k = 0;
+
+#if SIMD_LANES > 1
+  const VI even = SIMD_EVEN;
+  const VI odd = SIMD_ODD;
+
+  for (; k + SIMD_LANES <= n; k += SIMD_LANES) {
+    VB lo, hi;
+    V_LOAD(lo, &samples[2 * k]);
+    V_LOAD(hi, &samples[2 * k + SIMD_LANES]);
+    VF flo = __builtin_convertvector(lo, VF);
+    VF fhi = __builtin_convertvector(hi, VF);
+    VF vi = __builtin_shuffle(flo, fhi, even);
+    VF vq = __builtin_shuffle(flo, fhi, odd);
+    V_STORE(&i[k], vi);
+    V_STORE(&q[k], vq);
+  }
+#endif
+  for (; k < n; k++) {
+    i[k] = samples[2 * k];
+    q[k] = samples[2 * k + 1];
+  }
+}
+
+static void SIMD_FN(atan2)(const float *y, const float *x, float *out, uint32_t n)
+{
+  uint32_t k = 0;
+
+#if SIMD_LANES > 1
+  const VI abs_mask = (VI){ 0 } + 0x7FFFFFFF;
+  const VI sign_mask = (VI){ 0 } + (int32_t)0x80000000;
+  const VF zero = { 0 };
+
+  for (; k + SIMD_LANES <= n; k += SIMD_LANES) {
+    VF vy, vx;
+    V_LOAD(vy, &y[k]);
+    V_LOAD(vx, &x[k]);
+    VF ay = (VF)((VI)vy & abs_mask);
+    VF ax = (VF)((VI)vx & abs_mask);
+    VI y_larger = ay > ax;
+    VF mn = V_SELECT(y_larger, ax, ay);
+    VF mx = V_SELECT(y_larger, ay, ax);
+    VF t = mn / V_SELECT(mx == zero, zero + 1.0f, mx);
+    VF s = t * t;
+    VF r = zero + ATAN_C11;
+    r = r * s + ATAN_C9;
+    r = r * s + ATAN_C7;
+    r = r * s + ATAN_C5;
+    r = r * s + ATAN_C3;
+    r = r * s + ATAN_C1;
+    r = r * t;
+    r = V_SELECT(y_larger, PI_2_F - r, r);
+    r = V_SELECT(vx < zero, PI_F - r, r);
+    r = (VF)((VI)r ^ ((VI)vy & sign_mask));
+    V_STORE(&out[k], r);
+  }
+#endif
+  for (; k < n; k++) {
+    out[k] = atan2_one(y[k], x[k]);
+  }
+}
+
+static void SIMD_FN(magnitude)(const float *i, const float *q, float *out, uint32_t n)
+{
+  uint32_t k = 0;
+
+#if SIMD_LANES > 1
+  for (; k + SIMD_LANES <= n; k += SIMD_LANES) {
+    VF vi, vq;
+    V_LOAD(vi, &i[k]);
+    V_LOAD(vq, &q[k]);
+    VF s = vi * vi + vq * vq;
+    VF y = (VF)(RSQRT_MAGIC - ((VI)s >> 1));
+    y = y * (1.5f - 0.5f * s * y * y);
+    y = y * (1.5f - 0.5f * s * y * y);
+    y = s * y;
+    V_STORE(&out[k], y);
+  }
+#endif
+  for (; k < n; k++) {
+    out[k] = magnitude_one(i[k], q[k]);
+  }
+}
+
+static void SIMD_FN(synthesize)(const float *phase, const float *amplitude, int8_t *samples, uint32_t n)
+{
+  uint32_t k = 0;
+
+#if SIMD_LANES > 1
+  const VI sign_mask = (VI){ 0 } + (int32_t)0x80000000;
+  const VF zero = { 0 };
+
+  for (; 2 * (k + SIMD_LANES) <= n; k += SIMD_LANES) {
+    VF x, amp;
+    V_LOAD(x, &phase[k]);
+    V_LOAD(amp, &amplitude[k]);
+    // Quadrant and remainder in [-Pi/4, Pi/4]
+    VF t = x * TWO_OVER_PI_F;
+    VI quadrant = __builtin_convertvector(t + V_SELECT(t >= zero, zero + 0.5f, zero - 0.5f), VI);
+    VF kf = __builtin_convertvector(quadrant, VF);
+    VF r = ((x - kf * PIO2_1_F) - kf * PIO2_2_F) - kf * PIO2_3_F;
+    VF z = r * r;
+    VF sin_r = r + r * z * ((SIN_C5 * z + SIN_C3) * z + SIN_C1);
+    VF cos_r = 1.0f - 0.5f * z + z * z * ((COS_C6 * z + COS_C4) * z + COS_C2);
+    VI swap = (quadrant & 1) != 0;
+    VF sin_x = V_SELECT(swap, cos_r, sin_r);
+    VF cos_x = V_SELECT(swap, sin_r, cos_r);
+    sin_x = (VF)((VI)sin_x ^ (((quadrant & 2) != 0) & sign_mask));
+    cos_x = (VF)((VI)cos_x ^ ((((quadrant + 1) & 2) != 0) & sign_mask));
+    VI vi = __builtin_convertvector(amp * cos_x, VI);
+    VI vq = __builtin_convertvector(amp * sin_x, VI);
+    for (uint32_t l = 0; l < SIMD_LANES; l++) {
+      samples[2 * (k + l)] = (int8_t)vi[l];
+      samples[2 * (k + l) + 1] = (int8_t)vq[l];
+    }
+  }
+#endif
+  for (; 2 * k < n; k++) {
+    float sin_x, cos_x;
+    sincos_one(phase[k], &sin_x, &cos_x);
+    samples[2 * k] = (int8_t)(int32_t)(amplitude[k] * cos_x);
+    if (2 * k + 1 < n) {
+      samples[2 * k + 1] = (int8_t)(int32_t)(amplitude[k] * sin_x);
+    }
+  }
+}
+
+static void SIMD_FN(solve3)(const float *a, float *x, uint32_t n, uint32_t stride)
+{
+  uint32_t k = 0;
+
+#if SIMD_LANES > 1
+  const VF zero = { 0 };
+
+  for (; k + SIMD_LANES <= n; k += SIMD_LANES) {
+    VF a00, a01, a02, a11, a12, a22, b0, b1, b2;
+    V_LOAD(a00, &a[0 * stride + k]);
+    V_LOAD(a01, &a[1 * stride + k]);
+    V_LOAD(a02, &a[2 * stride + k]);
+    V_LOAD(a11, &a[3 * stride + k]);
+    V_LOAD(a12, &a[4 * stride + k]);
+    V_LOAD(a22, &a[5 * stride + k]);
+    V_LOAD(b0, &a[6 * stride + k]);
+    V_LOAD(b1, &a[7 * stride + k]);
+    V_LOAD(b2, &a[8 * stride + k]);
+    VF c00 = a11 * a22 - a12 * a12;
+    VF c01 = a02 * a12 - a01 * a22;
+    VF c02 = a01 * a12 - a02 * a11;
+    VF c11 = a00 * a22 - a02 * a02;
+    VF c12 = a01 * a02 - a00 * a12;
+    VF c22 = a00 * a11 - a01 * a01;
+    VF det = a00 * c00 + a01 * c01 + a02 * c02;
+    VF trace = a00 + a11 + a22;
+    VI singular = det <= SIMD_SOLVE3_MIN_DET * trace * trace * trace;
+    VF inv = V_SELECT(singular, zero, 1.0f / V_SELECT(singular, zero + 1.0f, det));
+    VF x0 = (c00 * b0 + c01 * b1 + c02 * b2) * inv;
+    VF x1 = (c01 * b0 + c11 * b1 + c12 * b2) * inv;
+    VF x2 = (c02 * b0 + c12 * b1 + c22 * b2) * inv;
+    VF v0 = c00 * inv;
+    VF v1 = c11 * inv;
+    VF v2 = c22 * inv;
+    V_STORE(&x[0 * stride + k], x0);
+    V_STORE(&x[1 * stride + k], x1);
+    V_STORE(&x[2 * stride + k], x2);
+    V_STORE(&x[3 * stride + k], v0);
+    V_STORE(&x[4 * stride + k], v1);
+    V_STORE(&x[5 * stride + k], v2);
+  }
+#endif
+  for (; k < n; k++) {
+    solve3_one(a, x, k, stride);
+  }
+}
+
+static void SIMD_FN(deinterleave_q15)(const int8_t *samples, int16_t *i, int16_t *q, uint32_t n)
+{
+  uint32_t k = 0;
+
+#if SIMD_LANES > 1
+  const VI even = SIMD_EVEN;
+  const VI odd = SIMD_ODD;
+
+  for (; k + SIMD_LANES <= n; k += SIMD_LANES) {
+    VB lo, hi;
+    V_LOAD(lo, &samples[2 * k]);
+    V_LOAD(hi, &samples[2 * k + SIMD_LANES]);
+    VI ilo = __builtin_convertvector(lo, VI);
+    VI ihi = __builtin_convertvector(hi, VI);
+    VS vi = __builtin_convertvector(__builtin_shuffle(ilo, ihi, even) * 128, VS);
+    VS vq = __builtin_convertvector(__builtin_shuffle(ilo, ihi, odd) * 128, VS);
+    V_STORE(&i[k], vi);
+    V_STORE(&q[k], vq);
+  }
+#endif
+  for (; k < n; k++) {
+    i[k] = (int16_t)(samples[2 * k] * 128);
+    q[k] = (int16_t)(samples[2 * k + 1] * 128);
+  }
+}
+
+static void SIMD_FN(rotate_q15)(int16_t *i, int16_t *q, const int16_t *rot_re, const int16_t *rot_im, uint32_t n)
+{
+  uint32_t k = 0;
+
+#if SIMD_LANES > 1
+  for (; k + SIMD_LANES <= n; k += SIMD_LANES) {
+    VS si, sq, sr, sm;
+    V_LOAD(si, &i[k]);
+    V_LOAD(sq, &q[k]);
+    V_LOAD(sr, &rot_re[k]);
+    V_LOAD(sm, &rot_im[k]);
+    VI vi = __builtin_convertvector(si, VI);
+    VI vq = __builtin_convertvector(sq, VI);
+    VI rr = __builtin_convertvector(sr, VI);
+    VI ri = __builtin_convertvector(sm, VI);
+    si = __builtin_convertvector((vi * rr - vq * ri + Q15_ROUND) >> 15, VS);
+    sq = __builtin_convertvector((vi * ri + vq * rr + Q15_ROUND) >> 15, VS);
+    V_STORE(&i[k], si);
+    V_STORE(&q[k], sq);
+  }
+#endif
+  for (; k < n; k++) {
+    rotate_q15_one(&i[k], &q[k], rot_re[k], rot_im[k]);
+  }
+}
+
+static void SIMD_FN(outer_q15)(const int16_t *re, const int16_t *im, int32_t *acc_re, int32_t *acc_im, uint32_t n)
+{
+  for (uint32_t r = 0; r < n; r++) {
+    const int32_t xr_re = re[r], xr_im = im[r];
+    int32_t *row_re = acc_re + r * n;
+    int32_t *row_im = acc_im + r * n;
+    uint32_t c = 0;
+
+#if SIMD_LANES > 1
+    for (; c + SIMD_LANES <= n; c += SIMD_LANES) {
+      VS sre, sim;
+      VI ar, ai;
+      V_LOAD(sre, &re[c]);
+      V_LOAD(sim, &im[c]);
+      V_LOAD(ar, &row_re[c]);
+      V_LOAD(ai, &row_im[c]);
+      VI xc_re = __builtin_convertvector(sre, VI);
+      VI xc_im = __builtin_convertvector(sim, VI);
+      ar += (xr_re * xc_re + xr_im * xc_im) >> 15;
+      ai += (xr_im * xc_re - xr_re * xc_im) >> 15;
+      V_STORE(&row_re[c], ar);
+      V_STORE(&row_im[c], ai);
+    }
+#endif
+    for (; c < n; c++) {
+      outer_q15_one(xr_re, xr_im, re[c], im[c], &row_re[c], &row_im[c]);
+    }
+  }
+}
+
+static void SIMD_FN(power_q15)(const int16_t *covariance, const int16_t *steering, const uint32_t *points,
+                               int32_t *power, uint32_t n, uint32_t count)
+{
+  uint32_t k = 0;
+
+#if SIMD_LANES > 1
+  const int16_t *r_re = covariance;
+  const int16_t *r_im = covariance + n * n;
+
+  for (; k + SIMD_LANES <= count; k += SIMD_LANES) {
+    // The steering vectors of the lanes, gathered element by element
+    VI a_re[SIMD_Q15_MAX_ELEMENTS], a_im[SIMD_Q15_MAX_ELEMENTS];
+    VI p = { 0 };
+    for (uint32_t l = 0; l < SIMD_LANES; l++) {
+      const int16_t *a = steering + (size_t)points[k + l] * 2 * n;
+      for (uint32_t c = 0; c < n; c++) {
+        a_re[c][l] = a[c];
+        a_im[c][l] = a[n + c];
+      }
+    }
+    for (uint32_t r = 0; r + 1 < n; r++) {
+      VI y_re = { 0 }, y_im = { 0 };
+      for (uint32_t c = r + 1; c < n; c++) {
+        const int32_t rr = r_re[r * n + c], ri = r_im[r * n + c];
+        y_re += (rr * a_re[c] - ri * a_im[c]) >> 15;
+        y_im += (rr * a_im[c] + ri * a_re[c]) >> 15;
+      }
+      y_re >>= Q15_POWER_Y_SHIFT;
+      y_im >>= Q15_POWER_Y_SHIFT;
+      p += (a_re[r] * y_re + a_im[r] * y_im) >> (15 - Q15_POWER_Y_SHIFT);
+    }
+    V_STORE(&power[k], p);
+  }
+#endif
+  for (; k < count; k++) {
+    power[k] = power_q15_one(covariance, steering + (size_t)points[k] * 2 * n, n);
+  }
+}
+
+static void SIMD_FN(deinterleave_batch_q15)(const int8_t *const *samples, int16_t *i, int16_t *q, uint32_t n,
+                                            uint32_t tags)
+{
+  for (uint32_t k = 0; k < n; k++) {
+    int16_t *row_i = i + k * SIMD_BATCH_TAGS;
+    int16_t *row_q = q + k * SIMD_BATCH_TAGS;
+    uint32_t t = 0;
+
+#if SIMD_LANES > 1
+    for (; t < tags; t += SIMD_LANES) {
+      // One pair of every report, gathered, zeros past the last
+      VI vi = { 0 }, vq = { 0 };
+      for (uint32_t l = 0; (l < SIMD_LANES) && (t + l < tags); l++) {
+        vi[l] = samples[t + l][2 * k];
+        vq[l] = samples[t + l][2 * k + 1];
+      }
+      VS si = __builtin_convertvector(vi * 128, VS);
+      VS sq = __builtin_convertvector(vq * 128, VS);
+      V_STORE(&row_i[t], si);
+      V_STORE(&row_q[t], sq);
+    }
+#endif
+    for (; t < tags; t++) {
+      row_i[t] = (int16_t)(samples[t][2 * k] * 128);
+      row_q[t] = (int16_t)(samples[t][2 * k + 1] * 128);
+    }
+  }
+}
+
+static void SIMD_FN(rotate_batch_q15)(int16_t *i, int16_t *q, const int16_t *rot_re, const int16_t *rot_im,
+                                      uint32_t n, uint32_t period, uint32_t tags)
+{
+  for (uint32_t k = 0; k < n; k++) {
+    int16_t *row_i = i + k * SIMD_BATCH_TAGS;
+    int16_t *row_q = q + k * SIMD_BATCH_TAGS;
+    const int16_t *row_re = rot_re + (k % period) * SIMD_BATCH_TAGS;
+    const int16_t *row_im = rot_im + (k % period) * SIMD_BATCH_TAGS;
+    uint32_t t = 0;
+
+#if SIMD_LANES > 1
+    for (; t < tags; t += SIMD_LANES) {
+      VS si, sq, sr, sm;
+      V_LOAD(si, &row_i[t]);
+      V_LOAD(sq, &row_q[t]);
+      V_LOAD(sr, &row_re[t]);
+      V_LOAD(sm, &row_im[t]);
+      VI vi = __builtin_convertvector(si, VI);
+      VI vq = __builtin_convertvector(sq, VI);
+      VI rr = __builtin_convertvector(sr, VI);
+      VI ri = __builtin_convertvector(sm, VI);
+      si = __builtin_convertvector((vi * rr - vq * ri + Q15_ROUND) >> 15, VS);
+      sq = __builtin_convertvector((vi * ri + vq * rr + Q15_ROUND) >> 15, VS);
+      V_STORE(&row_i[t], si);
+      V_STORE(&row_q[t], sq);
+    }
+#endif
+    for (; t < tags; t++) {
+      rotate_q15_one(&row_i[t], &row_q[t], row_re[t], row_im[t]);
+    }
+  }
+}
+
+static void SIMD_FN(outer_batch_q15)(const int16_t *re, const int16_t *im, int32_t *acc_re, int32_t *acc_im,
+                                     uint32_t n, uint32_t tags)
+{
+  for (uint32_t r = 0; r < n; r++) {
+    for (uint32_t c = 0; c < n; c++) {
+      const int16_t *xr_re = re + r * SIMD_BATCH_TAGS, *xr_im = im + r * SIMD_BATCH_TAGS;
+      const int16_t *xc_re = re + c * SIMD_BATCH_TAGS, *xc_im = im + c * SIMD_BATCH_TAGS;
+      int32_t *cell_re = acc_re + (r * n + c) * SIMD_BATCH_TAGS;
+      int32_t *cell_im = acc_im + (r * n + c) * SIMD_BATCH_TAGS;
+      uint32_t t = 0;
+
+#if SIMD_LANES > 1
+      for (; t < tags; t += SIMD_LANES) {
+        VS s0, s1, s2, s3;
+        VI ar, ai;
+        V_LOAD(s0, &xr_re[t]);
+        V_LOAD(s1, &xr_im[t]);
+        V_LOAD(s2, &xc_re[t]);
+        V_LOAD(s3, &xc_im[t]);
+        V_LOAD(ar, &cell_re[t]);
+        V_LOAD(ai, &cell_im[t]);
+        VI vr_re = __builtin_convertvector(s0, VI);
+        VI vr_im = __builtin_convertvector(s1, VI);
+        VI vc_re = __builtin_convertvector(s2, VI);
+        VI vc_im = __builtin_convertvector(s3, VI);
+        ar += (vr_re * vc_re + vr_im * vc_im) >> 15;
+        ai += (vr_im * vc_re - vr_re * vc_im) >> 15;
+        V_STORE(&cell_re[t], ar);
+        V_STORE(&cell_im[t], ai);
+      }
+#endif
+      for (; t < tags; t++) {
+        outer_q15_one(xr_re[t], xr_im[t], xc_re[t], xc_im[t], &cell_re[t], &cell_im[t]);
+      }
+    }
+  }
+}
+
+static void SIMD_FN(power_batch_q15)(const int16_t *covariance, const int16_t *const *steering,
+                                     const uint32_t *points, int32_t *power, uint32_t n, uint32_t count,
+                                     uint32_t tags)
+{
+  for (uint32_t k = 0; k < count; k++) {
+    const size_t offset = (size_t)points[k] * 2 * n;
+    int32_t *row = power + k * SIMD_BATCH_TAGS;
+    uint32_t t = 0;
+
+#if SIMD_LANES > 1
+    const int16_t *r_re = covariance;
+    const int16_t *r_im = covariance + n * n * SIMD_BATCH_TAGS;
+
+    for (; t < tags; t += SIMD_LANES) {
+      // The steering vector of the point in the table of every lane, zeros
+      // past the last
+      VI a_re[SIMD_Q15_MAX_ELEMENTS], a_im[SIMD_Q15_MAX_ELEMENTS];
+      VI p = { 0 };
+      for (uint32_t c = 0; c < n; c++) {
+        a_re[c] = p;
+        a_im[c] = p;
+      }
+      for (uint32_t l = 0; (l < SIMD_LANES) && (t + l < tags); l++) {
+        const int16_t *a = steering[t + l] + offset;
+        for (uint32_t c = 0; c < n; c++) {
+          a_re[c][l] = a[c];
+          a_im[c][l] = a[n + c];
+        }
+      }
+      for (uint32_t r = 0; r + 1 < n; r++) {
+        VI y_re = { 0 }, y_im = { 0 };
+        for (uint32_t c = r + 1; c < n; c++) {
+          VS sr, si;
+          V_LOAD(sr, &r_re[(r * n + c) * SIMD_BATCH_TAGS + t]);
+          V_LOAD(si, &r_im[(r * n + c) * SIMD_BATCH_TAGS + t]);
+          VI rr = __builtin_convertvector(sr, VI);
+          VI ri = __builtin_convertvector(si, VI);
+          y_re += (rr * a_re[c] - ri * a_im[c]) >> 15;
+          y_im += (rr * a_im[c] + ri * a_re[c]) >> 15;
+        }
+        y_re >>= Q15_POWER_Y_SHIFT;
+        y_im >>= Q15_POWER_Y_SHIFT;
+        p += (a_re[r] * y_re + a_im[r] * y_im) >> (15 - Q15_POWER_Y_SHIFT);
+      }
+      V_STORE(&row[t], p);
+    }
+#endif
+    for (; t < tags; t++) {
+      row[t] = power_batch_q15_one(covariance, steering[t] + offset, n, t);
+    }
+  }
+}
+
+static const simd_kernels_t SIMD_FN(kernels) = {
+  SIMD_NAME,
+  SIMD_SUPPORTED,
+  SIMD_FN(deinterleave),
+  SIMD_FN(atan2),
+  SIMD_FN(magnitude),
+  SIMD_FN(synthesize),
+  SIMD_FN(solve3),
+  SIMD_FN(deinterleave_q15),
+  SIMD_FN(rotate_q15),
+  SIMD_FN(outer_q15),
+  SIMD_FN(power_q15),
+  SIMD_FN(deinterleave_batch_q15),
+  SIMD_FN(rotate_batch_q15),
+  SIMD_FN(outer_batch_q15),
+  SIMD_FN(power_batch_q15)
+};
+
+#undef SIMD_EVEN
+#undef SIMD_ODD
+#undef VF
+#undef VI
+#undef VB
+#undef VS
+#undef V_LOAD
+#undef V_STORE
+#undef V_SELECT
@@ -10,6 +10,8 @@
 #include "aoa.h"
 #include "app_log.h"
 #include "app_config.h"
+#include "aoa_array.h"
+#include "simd_kernels.h"
 #include "time.h"
 #include <stdlib.h>     /* srand, rand */
 
@@ -20,15 +22,20 @@ float SAMPLING_RATE = 2.0;  //us
 float CTE_FREQ = 250.0;		//kHz
 extern float REFERENCE_SAMPL_RATE; // 1us
 float StartAngle = 90;	//degree,   first I Q data
+float CARRIER_FREQ = 2440.0;	//MHz, plane wave of make_I_Q_direction()
  //==========================
 
 
 float tShftsample; // koeff freq vs 2us
 float OneSwitchRotate;// Rotate per each switch path
 s8 Simul_IQ_DATA[DUMP]; // array simulation I Q data
+// Angle and amplitude of each I Q pair, turned into samples by the SIMD kernel
+static float Simul_phase[DUMP / 2];
+static float Simul_amplitude[DUMP / 2];
 
 
 #define toRad(x) x/rad2Dg
+#define SPEED_OF_LIGHT 299.792458	// m/us
 
 /*
  * get angle next sample in reference period
@@ -76,6 +83,30 @@ static inline float GetNoise(float min, float max)
 
 	return 1.0f;  // noise is out
 }
+/*
+ * Snapshots of the simulation, one antenna switch per IQ pair.
+ * Fills the angles of the pairs from pair to pairs.
+ * Inlined with the number of elements as a constant for each array type,
+ * see make_I_Q()
+ */
+static inline __attribute__((always_inline)) void simulate_snapshots(uint32_t pair, uint32_t pairs,
+		float currAnglRad, float aoa_shft_rad, uint32_t elements) {
+
+	float firstAnglRad = currAnglRad;
+	while (pair < pairs) {
+		for (uint32_t d = 0; (d < elements) && (pair < pairs); d++) {
+			Simul_phase[pair] = currAnglRad;
+			Simul_amplitude[pair] = 127*GetNoise(0.6,1.0);
+			pair++;
+			currAnglRad = findAnglShiftperSample(currAnglRad, aoa_shft_rad);
+		}
+	// ================ Set angle on first path of antenna ========
+		//
+		float fSwAnglePerOneSnapshot = elements * OneSwitchRotate;
+			firstAnglRad = restrictRad(firstAnglRad + fSwAnglePerOneSnapshot );
+			currAnglRad = firstAnglRad;
+	}
+}
 /*
  * Create array simulation of I & Q data
  * vs given length  and AOA shift (in degree)
@@ -87,49 +118,103 @@ s8* make_I_Q(u8 len, float AOA_shift) {
 	 calcOneSwitchRotate();
 	srand (time(NULL));
 	float aoa_shft_rad = toRad(AOA_shift);
-float rndNoise;
-	s8 *psimData = Simul_IQ_DATA;
-	s8 * end = psimData+len;
+	uint32_t pairs = (len + 1) / 2;
+	uint32_t pair = 0;
 
 //change next if need
 	StartAngle = (rand() % 360);
 	float currAnglRad = toRad(StartAngle);
 
-	float firstAnglRad =currAnglRad;
 //=========Ref period ===================
-		for (int t = 0; t < AOA_REF_PERIOD_SAMPLES; t++) {
-
-
-			rndNoise = GetNoise(0.7,1.0);
-			*psimData = cos(currAnglRad) * 127*rndNoise; // i
-			psimData++;
-
-			rndNoise =  GetNoise(0.7,1.0);
-			*psimData = sin(currAnglRad) * 127*rndNoise; // q
-			psimData++;
+		for (int t = 0; (t < aoa_array_config.ref_period_samples) && (pair < pairs); t++) {
+			Simul_phase[pair] = currAnglRad;
+			Simul_amplitude[pair] = 127*GetNoise(0.7,1.0);
+			pair++;
 			currAnglRad = Reference_sampling(currAnglRad);
 		}
 
-			firstAnglRad =currAnglRad;
 	// ============= Snapshots ==========================
-	while (psimData<end) {
-		for (int d = 0; d < AOA_NUM_ARRAY_ELEMENTS; d++) {
-			rndNoise =  GetNoise(0.6,1.0);
-			*psimData = cos(currAnglRad) * 127*rndNoise;
-			psimData++;
-			rndNoise =  GetNoise(0.6,1.0);
-			*psimData = sin(currAnglRad) * 127*rndNoise;
-			psimData++;
-			currAnglRad = findAnglShiftperSample(currAnglRad, aoa_shft_rad);
-		}
-	// ================ Set angle on first path of antenna ========
-		//
-		float fSwAnglePerOneSnapshot = AOA_NUM_ARRAY_ELEMENTS * OneSwitchRotate;
-			firstAnglRad = restrictRad(firstAnglRad + fSwAnglePerOneSnapshot );
-			currAnglRad = firstAnglRad;
+	switch (aoa_array_config.num_array_elements) {
+	case ARRAY_4x4_URA_NUM_ARRAY_ELEMENTS:
+		simulate_snapshots(pair, pairs, currAnglRad, aoa_shft_rad, ARRAY_4x4_URA_NUM_ARRAY_ELEMENTS);
+		break;
+	case ARRAY_3x3_URA_NUM_ARRAY_ELEMENTS:
+		simulate_snapshots(pair, pairs, currAnglRad, aoa_shft_rad, ARRAY_3x3_URA_NUM_ARRAY_ELEMENTS);
+		break;
+	case ARRAY_1x4_ULA_NUM_ARRAY_ELEMENTS:
+		simulate_snapshots(pair, pairs, currAnglRad, aoa_shft_rad, ARRAY_1x4_ULA_NUM_ARRAY_ELEMENTS);
+		break;
+	default:
+		simulate_snapshots(pair, pairs, currAnglRad, aoa_shft_rad, aoa_array_config.num_array_elements);
+		break;
 	}
 
+	// cos and sin of all pairs at once
+	simd_kernels->synthesize(Simul_phase, Simul_amplitude, Simul_IQ_DATA, len);
+
 	return Simul_IQ_DATA;
 
 }
 
+/*
+ * Gaussian noise, Box-Muller on rand()
+ */
+static float GetGaussNoise(float stdev)
+{
+	float u = (rand() + 1.0f) / (RAND_MAX + 2.0f);
+	float v = rand() / (RAND_MAX + 1.0f);
+
+	return stdev * sqrtf(-2.0f * logf(u)) * cosf(fullRad * v);
+}
+/*
+ * Create array simulation of I & Q data of a plane wave
+ * vs given length, azimuth and elevation (in degree):
+ * the phase of each antenna is shifted by its position
+ * along the direction (aoa_array_slot_position()).
+ * The random generator is not seeded, srand() by the caller
+ */
+s8* make_I_Q_direction(u8 len, float azimuth, float elevation, float phase_noise) {
+
+	calcOneSwitchRotate();
+	float az = toRad(azimuth);
+	float el = toRad(elevation);
+	float ux = cosf(el) * cosf(az);
+	float uy = cosf(el) * sinf(az);
+	float waveNum = fullRad * CARRIER_FREQ / SPEED_OF_LIGHT;	// rad/m
+	float noise = toRad(phase_noise);
+	uint32_t elements = aoa_array_config.num_array_elements;
+	float slotShift[AOA_ARRAY_MAX_ELEMENTS];
+	uint32_t pairs = (len + 1) / 2;
+	uint32_t pair = 0;
+
+	for (uint32_t d = 0; d < elements; d++) {
+		float x, y;
+		aoa_array_slot_position(&aoa_array_config, d, &x, &y);
+		slotShift[d] = waveNum * (x * ux + y * uy);
+	}
+	float currAnglRad = toRad((float)(rand() % 360));
+
+//=========Ref period ===================
+	for (int t = 0; (t < aoa_array_config.ref_period_samples) && (pair < pairs); t++) {
+		Simul_phase[pair] = restrictRad(currAnglRad + GetGaussNoise(noise));
+		Simul_amplitude[pair] = 127;
+		pair++;
+		currAnglRad = Reference_sampling(currAnglRad);
+	}
+
+	// ============= Snapshots ==========================
+	float firstAnglRad = currAnglRad;
+	while (pair < pairs) {
+		for (uint32_t d = 0; (d < elements) && (pair < pairs); d++) {
+			Simul_phase[pair] = restrictRad(firstAnglRad - d * OneSwitchRotate - slotShift[d]
+					+ GetGaussNoise(noise));
+			Simul_amplitude[pair] = 127;
+			pair++;
+		}
+		firstAnglRad = restrictRad(firstAnglRad - elements * OneSwitchRotate);
+	}
+
+	simd_kernels->synthesize(Simul_phase, Simul_amplitude, Simul_IQ_DATA, len);
+
+	return Simul_IQ_DATA;
+}
@@ -16,6 +16,9 @@
 #include <stdint.h>
 
 extern s8* make_I_Q(u8 len, float AOA_shift);
+// Plane wave from azimuth and elevation (degree) on the elements of
+// aoa_array_config, gaussian phase noise of phase_noise degree per sample
+extern s8* make_I_Q_direction(u8 len, float azimuth, float elevation, float phase_noise);
 
 
 
@@ -0,0 +1,407 @@
+/***************************************************************************//**
+ * @file
+ * @brief Spatial covariance of a tag per channel, accumulated over a sliding
+ *        window of reports.
+ ******************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "covariance.h"
+#include "aoa_array.h"
+#include "simd_kernels.h"
+
+#define Q15_ONE           32767
+#define MAX_SAMPLES       (AOA_ARRAY_MAX_REPORT_LENGTH / 2)
+
+/***************************************************************************************************
+ * Public Variables
+ **************************************************************************************************/
+
+uint32_t covariance_window;
+float covariance_max_age_s = COVARIANCE_DEFAULT_MAX_AGE_S;
+bool covariance_fixed_point = COVARIANCE_DEFAULT_FIXED_POINT;
+uint32_t covariance_joint_reports;
+
+/***************************************************************************************************
+ * Static Function Definitions
+ **************************************************************************************************/
+
+static inline uint32_t matrix_floats(const covariance_t *covariance)
+{
+  return 2 * covariance->elements * covariance->elements;
+}
+
+static inline size_t window_offset(const covariance_t *covariance, uint32_t index)
+{
+  return (size_t)(index % covariance->window) * matrix_floats(covariance);
+}
+
+static inline float *window_matrix(const covariance_t *covariance, const covariance_channel_t *channel,
+                                   uint32_t index)
+{
+  return channel->reports + window_offset(covariance, index);
+}
+
+static void drop_oldest(const covariance_t *covariance, covariance_channel_t *channel)
+{
+  if (covariance->fixed_point) {
+    const int16_t *oldest = channel->reports_q15 + window_offset(covariance, channel->head);
+    for (uint32_t k = 0; k < matrix_floats(covariance); k++) {
+      channel->sum_q15[k] -= oldest[k];
+    }
+  } else {
+    const float *oldest = window_matrix(covariance, channel, channel->head);
+    for (uint32_t k = 0; k < matrix_floats(covariance); k++) {
+      channel->sum[k] -= oldest[k];
+    }
+  }
+  channel->head = (channel->head + 1) % covariance->window;
+  channel->count--;
+}
+
+// Out of the window: the oldest report, and every report too old
+static void make_room(const covariance_t *covariance, covariance_channel_t *channel, uint64_t time_ns)
+{
+  while ((channel->count > 0) && (time_ns > channel->time_ns[channel->head] + covariance->max_age_ns)) {
+    drop_oldest(covariance, channel);
+  }
+  if (channel->count == covariance->window) {
+    drop_oldest(covariance, channel);
+  }
+}
+
+// in * scale / 2^32, saturated to int16
+static void scale_q15(const int32_t *in, int16_t *out, uint32_t count, int64_t scale)
+{
+  for (uint32_t k = 0; k < count; k++) {
+    int64_t v = ((int64_t)in[k] * scale) >> 32;
+    out[k] = (int16_t)((v > Q15_ONE) ? Q15_ONE : (v < -Q15_ONE) ? -Q15_ONE : v);
+  }
+}
+
+// Phasor of slot s the s-th power of the step of slot_rotation, n slots
+static void slot_phasors_q15(float slot_rotation, uint32_t n, int16_t *rot_re, int16_t *rot_im)
+{
+  const int32_t step_re = (int32_t)lrintf(Q15_ONE * cosf(slot_rotation));
+  const int32_t step_im = (int32_t)lrintf(-Q15_ONE * sinf(slot_rotation));
+
+  rot_re[0] = Q15_ONE;
+  rot_im[0] = 0;
+  for (uint32_t s = 1; s < n; s++) {
+    rot_re[s] = (int16_t)((rot_re[s - 1] * step_re - rot_im[s - 1] * step_im + (1 << 14)) >> 15);
+    rot_im[s] = (int16_t)((rot_re[s - 1] * step_im + rot_im[s - 1] * step_re + (1 << 14)) >> 15);
+  }
+}
+
+// Fixed point: the report of the summed outer products acc into the window
+// of a channel, scaled to a trace of 1.0
+static sl_status_t add_report_q15(covariance_t *covariance, uint8_t channel_index, const int32_t *acc,
+                                  uint64_t time_ns)
+{
+  const uint32_t n = covariance->elements;
+  covariance_channel_t *channel = &covariance->channels[channel_index];
+  int16_t *matrix;
+  int64_t trace = 0;
+
+  if (channel->reports_q15 == NULL) {
+    channel->reports_q15 = calloc(covariance->window, matrix_floats(covariance) * sizeof(int16_t));
+    channel->sum_q15 = calloc(1, matrix_floats(covariance) * sizeof(int32_t));
+    if ((channel->reports_q15 == NULL) || (channel->sum_q15 == NULL)) {
+      free(channel->reports_q15);
+      free(channel->sum_q15);
+      channel->reports_q15 = NULL;
+      channel->sum_q15 = NULL;
+      return SL_STATUS_ALLOCATION_FAILED;
+    }
+  }
+  make_room(covariance, channel, time_ns);
+
+  for (uint32_t r = 0; r < n; r++) {
+    trace += acc[r * n + r];
+  }
+  matrix = channel->reports_q15 + window_offset(covariance, channel->head + channel->count);
+  scale_q15(acc, matrix, matrix_floats(covariance), (trace > 0) ? ((int64_t)Q15_ONE << 32) / trace : 0);
+
+  channel->time_ns[(channel->head + channel->count) % covariance->window] = time_ns;
+  channel->count++;
+  for (uint32_t k = 0; k < matrix_floats(covariance); k++) {
+    channel->sum_q15[k] += matrix[k];
+  }
+  return SL_STATUS_OK;
+}
+
+static void resum(const covariance_t *covariance, covariance_channel_t *channel)
+{
+  memset(channel->sum, 0, matrix_floats(covariance) * sizeof(float));
+  for (uint32_t r = 0; r < channel->count; r++) {
+    const float *matrix = window_matrix(covariance, channel, channel->head + r);
+    for (uint32_t k = 0; k < matrix_floats(covariance); k++) {
+      channel->sum[k] += matrix[k];
+    }
+  }
+  channel->updates = 0;
+}
+
+/***************************************************************************************************
+ * Public Function Definitions
+ **************************************************************************************************/
+
+sl_status_t covariance_init(covariance_t *covariance, uint32_t elements, uint32_t window, float max_age_s,
+                            bool fixed_point)
+{
+  memset(covariance, 0, sizeof(*covariance));
+  if ((elements == 0) || (elements > AOA_ARRAY_MAX_ELEMENTS) || (window > COVARIANCE_MAX_WINDOW)) {
+    return SL_STATUS_INVALID_PARAMETER;
+  }
+  covariance->elements = elements;
+  covariance->window = window;
+  covariance->max_age_ns = (uint64_t)(((max_age_s > 0) ? max_age_s : COVARIANCE_DEFAULT_MAX_AGE_S) * 1e9);
+  covariance->fixed_point = fixed_point;
+  return SL_STATUS_OK;
+}
+
+void covariance_deinit(covariance_t *covariance)
+{
+  for (uint32_t c = 0; c < COVARIANCE_CHANNELS; c++) {
+    free(covariance->channels[c].reports);
+    free(covariance->channels[c].sum);
+    free(covariance->channels[c].reports_q15);
+    free(covariance->channels[c].sum_q15);
+  }
+  memset(covariance, 0, sizeof(*covariance));
+}
+
+sl_status_t covariance_update(covariance_t *covariance, uint8_t channel_index, float **i_samples, float **q_samples,
+                              uint32_t snapshots, float slot_rotation, uint64_t time_ns)
+{
+  const uint32_t n = covariance->elements;
+  covariance_channel_t *channel;
+  float rot_re[AOA_ARRAY_MAX_ELEMENTS], rot_im[AOA_ARRAY_MAX_ELEMENTS];
+  float x_re[AOA_ARRAY_MAX_ELEMENTS], x_im[AOA_ARRAY_MAX_ELEMENTS];
+  float *re, *im, trace = 0;
+
+  if (!covariance_enabled(covariance) || covariance->fixed_point
+      || (channel_index >= COVARIANCE_CHANNELS) || (snapshots == 0)) {
+    return SL_STATUS_INVALID_PARAMETER;
+  }
+  channel = &covariance->channels[channel_index];
+  if (channel->reports == NULL) {
+    channel->reports = calloc(covariance->window, matrix_floats(covariance) * sizeof(float));
+    channel->sum = calloc(1, matrix_floats(covariance) * sizeof(float));
+    if ((channel->reports == NULL) || (channel->sum == NULL)) {
+      free(channel->reports);
+      free(channel->sum);
+      channel->reports = NULL;
+      channel->sum = NULL;
+      return SL_STATUS_ALLOCATION_FAILED;
+    }
+  }
+
+  make_room(covariance, channel, time_ns);
+
+  for (uint32_t s = 0; s < n; s++) {
+    rot_re[s] = cosf(s * slot_rotation);
+    rot_im[s] = -sinf(s * slot_rotation);
+  }
+  re = window_matrix(covariance, channel, channel->head + channel->count);
+  im = re + n * n;
+  memset(re, 0, matrix_floats(covariance) * sizeof(float));
+  for (uint32_t snapshot = 0; snapshot < snapshots; snapshot++) {
+    for (uint32_t s = 0; s < n; s++) {
+      float i = i_samples[snapshot][s], q = q_samples[snapshot][s];
+      x_re[s] = i * rot_re[s] - q * rot_im[s];
+      x_im[s] = i * rot_im[s] + q * rot_re[s];
+    }
+    // Upper triangle of x x^H
+    for (uint32_t r = 0; r < n; r++) {
+      for (uint32_t c = r; c < n; c++) {
+        re[r * n + c] += x_re[r] * x_re[c] + x_im[r] * x_im[c];
+        im[r * n + c] += x_im[r] * x_re[c] - x_re[r] * x_im[c];
+      }
+    }
+  }
+  for (uint32_t r = 0; r < n; r++) {
+    trace += re[r * n + r];
+  }
+  trace = (trace > 0) ? 1.0f / trace : 0.0f;
+  for (uint32_t r = 0; r < n; r++) {
+    im[r * n + r] = 0;
+    for (uint32_t c = r; c < n; c++) {
+      re[r * n + c] *= trace;
+      im[r * n + c] *= trace;
+      re[c * n + r] = re[r * n + c];
+      im[c * n + r] = -im[r * n + c];
+    }
+  }
+
+  channel->time_ns[(channel->head + channel->count) % covariance->window] = time_ns;
+  channel->count++;
+  if (++channel->updates >= COVARIANCE_RESUM_REPORTS) {
+    resum(covariance, channel);
+  } else {
+    for (uint32_t k = 0; k < matrix_floats(covariance); k++) {
+      channel->sum[k] += re[k];
+    }
+  }
+  return SL_STATUS_OK;
+}
+
+const float *covariance_get(const covariance_t *covariance, uint8_t channel_index, uint32_t *reports)
+{
+  const covariance_channel_t *channel;
+
+  if (channel_index >= COVARIANCE_CHANNELS) {
+    return NULL;
+  }
+  channel = &covariance->channels[channel_index];
+  if (channel->count == 0) {
+    return NULL;
+  }
+  *reports = channel->count;
+  return channel->sum;
+}
+
+uint32_t covariance_recent_channels(const covariance_t *covariance, uint64_t time_ns, uint8_t *channels,
+                                    uint32_t max)
+{
+  uint64_t last[COVARIANCE_CHANNELS];
+  uint8_t recent[COVARIANCE_CHANNELS];
+  uint32_t found = 0;
+
+  for (uint32_t c = 0; c < COVARIANCE_CHANNELS; c++) {
+    const covariance_channel_t *channel = &covariance->channels[c];
+    if (channel->count == 0) {
+      continue;
+    }
+    last[found] = channel->time_ns[(channel->head + channel->count - 1) % covariance->window];
+    if (time_ns <= last[found] + covariance->max_age_ns) {
+      recent[found++] = (uint8_t)c;
+    }
+  }
+  // The newest one after another
+  for (uint32_t k = 0; (k < max) && (k < found); k++) {
+    uint32_t newest = k;
+    for (uint32_t j = k + 1; j < found; j++) {
+      if (last[j] > last[newest]) {
+        newest = j;
+      }
+    }
+    channels[k] = recent[newest];
+    last[newest] = last[k];
+    recent[newest] = recent[k];
+  }
+  return (found < max) ? found : max;
+}
+
+void covariance_samples_q15(const int8_t *samples, uint32_t length, uint32_t report_length,
+                            int16_t *i_samples, int16_t *q_samples)
+{
+  uint32_t pairs = ((length < report_length) ? length : report_length) / 2;
+
+  simd_kernels->deinterleave_q15(samples, i_samples, q_samples, pairs);
+  if (pairs < report_length / 2) {
+    // A short report, an odd last value alone is dropped
+    memset(&i_samples[pairs], 0, (report_length / 2 - pairs) * sizeof(int16_t));
+    memset(&q_samples[pairs], 0, (report_length / 2 - pairs) * sizeof(int16_t));
+  }
+}
+
+sl_status_t covariance_update_q15(covariance_t *covariance, uint8_t channel_index, const int16_t *i_samples,
+                                  const int16_t *q_samples, uint32_t snapshots, float slot_rotation,
+                                  uint64_t time_ns)
+{
+  const uint32_t n = covariance->elements;
+  const uint32_t samples = snapshots * n;
+  int16_t rot_re[MAX_SAMPLES], rot_im[MAX_SAMPLES];
+  int16_t x_re[MAX_SAMPLES], x_im[MAX_SAMPLES];
+  int32_t acc[2 * AOA_ARRAY_MAX_ELEMENTS * AOA_ARRAY_MAX_ELEMENTS];
+
+  if (!covariance_enabled(covariance) || !covariance->fixed_point
+      || (channel_index >= COVARIANCE_CHANNELS) || (snapshots == 0) || (samples > MAX_SAMPLES)) {
+    return SL_STATUS_INVALID_PARAMETER;
+  }
+
+  // Phasors of the slots repeated per snapshot
+  slot_phasors_q15(slot_rotation, n, rot_re, rot_im);
+  for (uint32_t k = n; k < samples; k++) {
+    rot_re[k] = rot_re[k - n];
+    rot_im[k] = rot_im[k - n];
+  }
+  memcpy(x_re, i_samples, samples * sizeof(int16_t));
+  memcpy(x_im, q_samples, samples * sizeof(int16_t));
+  simd_kernels->rotate_q15(x_re, x_im, rot_re, rot_im, samples);
+
+  memset(acc, 0, matrix_floats(covariance) * sizeof(int32_t));
+  for (uint32_t snapshot = 0; snapshot < snapshots; snapshot++) {
+    simd_kernels->outer_q15(&x_re[snapshot * n], &x_im[snapshot * n], acc, acc + n * n, n);
+  }
+  return add_report_q15(covariance, channel_index, acc, time_ns);
+}
+
+sl_status_t covariance_update_batch_q15(covariance_t *const *covariances, const uint8_t *channels,
+                                        int16_t *i_samples, int16_t *q_samples, uint32_t snapshots,
+                                        const float *slot_rotations, const uint64_t *time_ns,
+                                        sl_status_t *results, uint32_t tags)
+{
+  const uint32_t n = (tags > 0) ? covariances[0]->elements : 0;
+  const uint32_t plane = n * n * SIMD_BATCH_TAGS;
+  int16_t rot_re[AOA_ARRAY_MAX_ELEMENTS * SIMD_BATCH_TAGS], rot_im[AOA_ARRAY_MAX_ELEMENTS * SIMD_BATCH_TAGS];
+  int16_t re[AOA_ARRAY_MAX_ELEMENTS], im[AOA_ARRAY_MAX_ELEMENTS];
+  int32_t acc[2 * AOA_ARRAY_MAX_ELEMENTS * AOA_ARRAY_MAX_ELEMENTS * SIMD_BATCH_TAGS];
+  int32_t matrix[2 * AOA_ARRAY_MAX_ELEMENTS * AOA_ARRAY_MAX_ELEMENTS];
+
+  if ((tags == 0) || (tags > SIMD_BATCH_TAGS) || (snapshots == 0) || (snapshots * n > MAX_SAMPLES)) {
+    return SL_STATUS_INVALID_PARAMETER;
+  }
+  for (uint32_t t = 0; t < tags; t++) {
+    if (!covariance_enabled(covariances[t]) || !covariances[t]->fixed_point || (covariances[t]->elements != n)
+        || (channels[t] >= COVARIANCE_CHANNELS)) {
+      return SL_STATUS_INVALID_PARAMETER;
+    }
+  }
+
+  // The lanes past the tags rotated by zeros
+  memset(rot_re, 0, sizeof(rot_re));
+  memset(rot_im, 0, sizeof(rot_im));
+  for (uint32_t t = 0; t < tags; t++) {
+    slot_phasors_q15(slot_rotations[t], n, re, im);
+    for (uint32_t s = 0; s < n; s++) {
+      rot_re[s * SIMD_BATCH_TAGS + t] = re[s];
+      rot_im[s * SIMD_BATCH_TAGS + t] = im[s];
+    }
+  }
+  simd_kernels->rotate_batch_q15(i_samples, q_samples, rot_re, rot_im, snapshots * n, n, tags);
+
+  memset(acc, 0, 2 * plane * sizeof(int32_t));
+  for (uint32_t snapshot = 0; snapshot < snapshots; snapshot++) {
+    const size_t offset = (size_t)snapshot * n * SIMD_BATCH_TAGS;
+    simd_kernels->outer_batch_q15(&i_samples[offset], &q_samples[offset], acc, acc + plane, n, tags);
+  }
+  for (uint32_t t = 0; t < tags; t++) {
+    for (uint32_t k = 0; k < n * n; k++) {
+      matrix[k] = acc[k * SIMD_BATCH_TAGS + t];
+      matrix[n * n + k] = acc[plane + k * SIMD_BATCH_TAGS + t];
+    }
+    results[t] = add_report_q15(covariances[t], channels[t], matrix, time_ns[t]);
+  }
+  return SL_STATUS_OK;
+}
+
+sl_status_t covariance_get_q15(const covariance_t *covariance, uint8_t channel_index, int16_t *matrix,
+                               uint32_t *reports)
+{
+  const covariance_channel_t *channel;
+
+  if (channel_index >= COVARIANCE_CHANNELS) {
+    return SL_STATUS_INVALID_PARAMETER;
+  }
+  channel = &covariance->channels[channel_index];
+  if ((channel->count == 0) || (channel->sum_q15 == NULL)) {
+    return SL_STATUS_EMPTY;
+  }
+  *reports = channel->count;
+  scale_q15(channel->sum_q15, matrix, matrix_floats(covariance), ((int64_t)1 << 32) / channel->count);
+  return SL_STATUS_OK;
+}
@@ -0,0 +1,161 @@
+/***************************************************************************//**
+ * @file
+ * @brief Spatial covariance of a tag per channel, accumulated over a sliding
+ *        window of reports.
+ *
+ * A report of S snapshots of N antenna slots gives the N x N covariance
+ * (1/S) sum x x^H of its snapshot vectors x, the samples of slot n rotated
+ * back by n times the phase rotation per slot, i.e. the frequency offset of
+ * the tag. Each report matrix is normalized to a trace of 1, so every report
+ * weighs the same whatever its RSSI.
+ *
+ * Each channel keeps the matrices of its last window reports, younger than
+ * max_age, and their sum: a report adds its matrix and subtracts the one it
+ * replaces, the sum is recomputed from the window every
+ * COVARIANCE_RESUM_REPORTS reports against the float drift. The estimator
+ * reads the sum (spectrum.h) instead of the snapshots of every report.
+ *
+ * Matrices are stored as an N x N real plane followed by an N x N imaginary
+ * plane, row major, the whole Hermitian matrix. The window of a channel is
+ * allocated on its first report.
+ *
+ * Fixed point (covariance_fixed_point, the default on ARM): the int8 samples
+ * go through the Q15 kernels of simd_kernels.h instead of float and libm.
+ * The samples are scaled by 128, rotated by Q15 phasors and their outer
+ * products summed in int32; a report matrix is scaled to a trace of 32767
+ * (1.0 in Q15) and stored as int16. The window sum is exact in int32, it is
+ * never recomputed; covariance_get_q15() gives its mean in Q15 for
+ * spectrum_estimate_q15(). bench_fixed compares both paths on simulator
+ * data.
+ *
+ * Frequency diversity (covariance_joint_reports > 1): the estimator gives an
+ * angle every covariance_joint_reports reports of a tag, from the windows of
+ * the channels updated last (covariance_recent_channels()) in one joint
+ * search (spectrum_estimate_joint()); the reports between only update their
+ * window. bench_joint compares it with an estimate per report.
+ *
+ * Batches (covariance_update_batch_q15()): a 1x4 ULA fills 4 lanes with one
+ * report, so the reports of several tags are updated at once, one tag per
+ * lane, in the same arithmetic; bench_batch compares it with a report at a
+ * time.
+ ******************************************************************************/
+
+#ifndef COVARIANCE_H_
+#define COVARIANCE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "sl_status.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define COVARIANCE_CHANNELS           40
+#define COVARIANCE_MAX_WINDOW         32
+#define COVARIANCE_DEFAULT_MAX_AGE_S  5.0f
+#define COVARIANCE_RESUM_REPORTS      64
+
+#if defined(__arm__) || defined(__aarch64__)
+#define COVARIANCE_DEFAULT_FIXED_POINT  true
+#else
+#define COVARIANCE_DEFAULT_FIXED_POINT  false
+#endif
+
+/***************************************************************************************************
+ * Type Definitions
+ **************************************************************************************************/
+
+typedef struct {
+  uint32_t head;                // oldest report
+  uint32_t count;
+  uint32_t updates;             // since the last recomputed sum
+  uint64_t time_ns[COVARIANCE_MAX_WINDOW];
+  float *reports;               // window matrices
+  float *sum;
+  int16_t *reports_q15;         // fixed point: window matrices
+  int32_t *sum_q15;
+} covariance_channel_t;
+
+typedef struct {
+  uint32_t elements;            // N, antenna slots per snapshot
+  uint32_t window;              // reports per channel, 0 when disabled
+  uint64_t max_age_ns;
+  bool fixed_point;             // Q15 reports, covariance_update_q15()
+  covariance_channel_t channels[COVARIANCE_CHANNELS];
+} covariance_t;
+
+/***************************************************************************************************
+ * Public variables
+ **************************************************************************************************/
+
+// Window of the accumulators initialized from now on, 0 disables the
+// in-tree estimator (the default)
+extern uint32_t covariance_window;
+extern float covariance_max_age_s;
+extern bool covariance_fixed_point;
+// Reports per joint estimate over the recent channels, 0 or 1 estimates every
+// report on its channel alone
+extern uint32_t covariance_joint_reports;
+
+/***************************************************************************************************
+ * Function Declarations
+ **************************************************************************************************/
+
+sl_status_t covariance_init(covariance_t *covariance, uint32_t elements, uint32_t window, float max_age_s,
+                            bool fixed_point);
+void covariance_deinit(covariance_t *covariance);
+
+static inline bool covariance_enabled(const covariance_t *covariance)
+{
+  return covariance->window > 0;
+}
+
+// Adds a report of snapshots rows of elements samples received at time_ns,
+// the samples of slot n rotated by -n * slot_rotation (rad).
+sl_status_t covariance_update(covariance_t *covariance, uint8_t channel, float **i_samples, float **q_samples,
+                              uint32_t snapshots, float slot_rotation, uint64_t time_ns);
+
+// Window sum of a channel and its number of reports, NULL if it has none.
+const float *covariance_get(const covariance_t *covariance, uint8_t channel, uint32_t *reports);
+
+// Up to max channels with a report younger than the max age at time_ns, the
+// last updated first, and their number.
+uint32_t covariance_recent_channels(const covariance_t *covariance, uint64_t time_ns, uint8_t *channels,
+                                    uint32_t max);
+
+// Fixed point: deinterleaves the int8 IQ pairs of a report, length values,
+// into i and q, zero up to the report_length of the geometry (values).
+void covariance_samples_q15(const int8_t *samples, uint32_t length, uint32_t report_length,
+                            int16_t *i_samples, int16_t *q_samples);
+
+// Fixed point: adds a report of snapshots rows of elements samples, the rows
+// one after another in i_samples and q_samples (covariance_samples_q15()
+// after the reference period), the samples of slot n rotated by
+// -n * slot_rotation (rad).
+sl_status_t covariance_update_q15(covariance_t *covariance, uint8_t channel, const int16_t *i_samples,
+                                  const int16_t *q_samples, uint32_t snapshots, float slot_rotation,
+                                  uint64_t time_ns);
+
+// Fixed point: covariance_update_q15() of the reports of up to
+// SIMD_BATCH_TAGS tags at once, one tag per lane of the batch kernels of
+// simd_kernels.h. The samples of every tag in the planes of the batch layout
+// (deinterleave_batch_q15(), from the first snapshot on), rotated in place;
+// tag t with covariances[t], channels[t], slot_rotations[t] and time_ns[t],
+// its result in results[t]. The covariances of one geometry, else
+// SL_STATUS_INVALID_PARAMETER and no report added.
+sl_status_t covariance_update_batch_q15(covariance_t *const *covariances, const uint8_t *channels,
+                                        int16_t *i_samples, int16_t *q_samples, uint32_t snapshots,
+                                        const float *slot_rotations, const uint64_t *time_ns,
+                                        sl_status_t *results, uint32_t tags);
+
+// Fixed point: mean of the window of a channel in Q15 into matrix (2 N x N
+// values) and its number of reports, SL_STATUS_EMPTY if it has none.
+sl_status_t covariance_get_q15(const covariance_t *covariance, uint8_t channel, int16_t *matrix,
+                               uint32_t *reports);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* COVARIANCE_H_ */
@@ -0,0 +1,734 @@
+/***************************************************************************//**
+ * @file
+ * @brief Angle of arrival from a spatial covariance, Bartlett beamformer over
+ *        a grid of directions.
+ ******************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+
+#include "spectrum.h"
+#include "simd_kernels.h"
+
+#define SPEED_OF_LIGHT    299792458.0f
+#define DEG_TO_RAD        0.017453292f
+#define Q15_ONE           32767.0f
+#define BATCH_POINTS      64        // points evaluated per call of the power kernel
+#define MATRIX_VALUES     (2 * AOA_ARRAY_MAX_ELEMENTS * AOA_ARRAY_MAX_ELEMENTS)
+
+typedef struct {
+  uint32_t a, e;
+  float power;
+} peak_t;
+
+// Lobes kept by the coarse pass and its lowest power
+typedef struct {
+  peak_t peaks[SPECTRUM_MAX_PEAKS];
+  uint32_t count;
+  float min_power;
+} coarse_t;
+
+// Covariances of the spectrum, each with the steering table of its channel
+typedef struct {
+  const spectrum_table_t *tables[SPECTRUM_MAX_JOINT];
+  const void *covariances[SPECTRUM_MAX_JOINT];
+  float weights[SPECTRUM_MAX_JOINT];
+  uint32_t count;
+} sources_t;
+
+// Powers of count points (index e * azimuth_steps + a), summed over the
+// sources
+typedef void (*powers_fn)(const sources_t *sources, const uint32_t *points, float *power, uint32_t count);
+
+/***************************************************************************************************
+ * Public Variables
+ **************************************************************************************************/
+
+uint32_t spectrum_coarse_stride = SPECTRUM_DEFAULT_COARSE_STRIDE;
+uint32_t spectrum_peaks = SPECTRUM_DEFAULT_PEAKS;
+
+/***************************************************************************************************
+ * Static Variables
+ **************************************************************************************************/
+
+static pthread_mutex_t tables_lock = PTHREAD_MUTEX_INITIALIZER;
+static spectrum_table_t tables[SPECTRUM_MAX_TABLES];
+
+/***************************************************************************************************
+ * Static Function Definitions
+ **************************************************************************************************/
+
+static bool same_geometry(const aoa_array_config_t *a, const aoa_array_config_t *b)
+{
+  return (a->num_array_elements == b->num_array_elements)
+         && (a->array_columns == b->array_columns)
+         && (a->element_spacing == b->element_spacing)
+         && (a->switching_pattern_length == b->switching_pattern_length)
+         && (memcmp(a->switching_pattern, b->switching_pattern, a->switching_pattern_length) == 0);
+}
+
+static sl_status_t build_table(spectrum_table_t *table, const aoa_array_config_t *array, float frequency)
+{
+  const float k = 2.0f * (float)M_PI * frequency / SPEED_OF_LIGHT;
+  uint32_t columns = (array->array_columns > 0) ? array->array_columns : array->num_array_elements;
+  float x[AOA_ARRAY_MAX_ELEMENTS], y[AOA_ARRAY_MAX_ELEMENTS];
+
+  memset(table, 0, sizeof(*table));
+  table->array = *array;
+  table->frequency = frequency;
+  table->elements = array->num_array_elements;
+  if (columns >= table->elements) {
+    // One row: the azimuth from the row axis, both sides alike
+    table->azimuth_step = SPECTRUM_ULA_AZIMUTH_STEP;
+    table->azimuth_steps = (uint32_t)(180.0f / SPECTRUM_ULA_AZIMUTH_STEP) + 1;
+    table->elevation_steps = 1;
+  } else {
+    table->azimuth_step = SPECTRUM_AZIMUTH_STEP;
+    table->azimuth_steps = (uint32_t)(360.0f / SPECTRUM_AZIMUTH_STEP);
+    table->elevation_step = SPECTRUM_ELEVATION_STEP;
+    table->elevation_steps = (uint32_t)(90.0f / SPECTRUM_ELEVATION_STEP) + 1;
+    table->azimuth_wraps = true;
+  }
+  table->steering = malloc((size_t)table->azimuth_steps * table->elevation_steps
+                           * 2 * table->elements * sizeof(float));
+  table->steering_q15 = malloc((size_t)table->azimuth_steps * table->elevation_steps
+                               * 2 * table->elements * sizeof(int16_t));
+  if ((table->steering == NULL) || (table->steering_q15 == NULL)) {
+    free(table->steering);
+    free(table->steering_q15);
+    table->steering = NULL;
+    table->steering_q15 = NULL;
+    return SL_STATUS_ALLOCATION_FAILED;
+  }
+
+  for (uint32_t s = 0; s < table->elements; s++) {
+    aoa_array_slot_position(array, s, &x[s], &y[s]);
+  }
+  for (uint32_t e = 0; e < table->elevation_steps; e++) {
+    float el = e * table->elevation_step * DEG_TO_RAD;
+    for (uint32_t a = 0; a < table->azimuth_steps; a++) {
+      float az = a * table->azimuth_step * DEG_TO_RAD;
+      float ux = cosf(el) * cosf(az), uy = cosf(el) * sinf(az);
+      size_t offset = (size_t)(e * table->azimuth_steps + a) * 2 * table->elements;
+      float *steering = table->steering + offset;
+      int16_t *steering_q15 = table->steering_q15 + offset;
+      for (uint32_t s = 0; s < table->elements; s++) {
+        float phase = -k * (x[s] * ux + y[s] * uy);
+        steering[s] = cosf(phase);
+        steering[table->elements + s] = sinf(phase);
+        steering_q15[s] = (int16_t)lrintf(Q15_ONE * steering[s]);
+        steering_q15[table->elements + s] = (int16_t)lrintf(Q15_ONE * steering[table->elements + s]);
+      }
+    }
+  }
+  return SL_STATUS_OK;
+}
+
+// Re(a^H R a) without the diagonal, over the upper triangle
+static float point_power(const spectrum_table_t *table, const float *covariance, uint32_t point)
+{
+  const uint32_t n = table->elements;
+  const float *a_re = table->steering + (size_t)point * 2 * n;
+  const float *a_im = a_re + n;
+  const float *r_re = covariance;
+  const float *r_im = covariance + n * n;
+  float power = 0;
+
+  for (uint32_t r = 0; r + 1 < n; r++) {
+    float y_re = 0, y_im = 0;
+    for (uint32_t c = r + 1; c < n; c++) {
+      y_re += r_re[r * n + c] * a_re[c] - r_im[r * n + c] * a_im[c];
+      y_im += r_re[r * n + c] * a_im[c] + r_im[r * n + c] * a_re[c];
+    }
+    power += a_re[r] * y_re + a_im[r] * y_im;
+  }
+  return power;
+}
+
+static void powers_float(const sources_t *sources, const uint32_t *points, float *power, uint32_t count)
+{
+  for (uint32_t k = 0; k < count; k++) {
+    power[k] = 0;
+    for (uint32_t s = 0; s < sources->count; s++) {
+      power[k] += sources->weights[s] * point_power(sources->tables[s], sources->covariances[s], points[k]);
+    }
+  }
+}
+
+static void powers_q15(const sources_t *sources, const uint32_t *points, float *power, uint32_t count)
+{
+  int32_t fixed[BATCH_POINTS];
+
+  for (uint32_t s = 0; s < sources->count; s++) {
+    simd_kernels->power_q15(sources->covariances[s], sources->tables[s]->steering_q15, points, fixed,
+                            sources->tables[s]->elements, count);
+    for (uint32_t k = 0; k < count; k++) {
+      power[k] = ((s > 0) ? power[k] : 0) + sources->weights[s] * fixed[k];
+    }
+  }
+}
+
+static inline uint32_t point_index(const spectrum_table_t *table, uint32_t a, uint32_t e)
+{
+  return e * table->azimuth_steps + a;
+}
+
+static inline bool allowed(const spectrum_search_t *search, uint32_t a)
+{
+  return (search->allowed[a / 32] >> (a % 32)) & 1u;
+}
+
+// Azimuth step a moved by delta, false off the grid or disabled
+static bool azimuth_step(const spectrum_table_t *table, const spectrum_search_t *search,
+                         uint32_t a, int32_t delta, uint32_t *moved)
+{
+  int32_t m = (int32_t)a + delta;
+
+  if (table->azimuth_wraps) {
+    m = (m + (int32_t)table->azimuth_steps) % (int32_t)table->azimuth_steps;
+  } else if ((m < 0) || (m >= (int32_t)table->azimuth_steps)) {
+    return false;
+  }
+  *moved = (uint32_t)m;
+  return allowed(search, *moved);
+}
+
+static uint32_t azimuth_distance(const spectrum_table_t *table, uint32_t a, uint32_t b)
+{
+  uint32_t d = (a > b) ? a - b : b - a;
+
+  if (table->azimuth_wraps && (d > table->azimuth_steps / 2)) {
+    d = table->azimuth_steps - d;
+  }
+  return d;
+}
+
+// Keeps the best point of up to search->peaks lobes, a point within a coarse
+// step of a kept one is on its lobe
+static void keep_peak(const spectrum_table_t *table, const spectrum_search_t *search,
+                      peak_t *peaks, uint32_t *count, uint32_t a, uint32_t e, float power)
+{
+  uint32_t worst = 0;
+
+  for (uint32_t k = 0; k < *count; k++) {
+    uint32_t de = (peaks[k].e > e) ? peaks[k].e - e : e - peaks[k].e;
+    if ((azimuth_distance(table, peaks[k].a, a) <= search->coarse_stride)
+        && (de <= search->coarse_elevation_stride)) {
+      if (power > peaks[k].power) {
+        peaks[k] = (peak_t){ a, e, power };
+      }
+      return;
+    }
+    if (peaks[k].power < peaks[worst].power) {
+      worst = k;
+    }
+  }
+  if (*count < search->peaks) {
+    peaks[(*count)++] = (peak_t){ a, e, power };
+  } else if (power > peaks[worst].power) {
+    peaks[worst] = (peak_t){ a, e, power };
+  }
+}
+
+// Offset of the vertex of the parabola through three powers, -0.5..0.5
+static float vertex(float before, float peak, float after)
+{
+  float curvature = before - 2.0f * peak + after;
+
+  if (!(curvature < 0)) {
+    return 0;
+  }
+  return 0.5f * (before - after) / curvature;
+}
+
+// Moves a peak to the best of its neighbours on the full grid until none is
+// better, the neighbours evaluated at once
+static void climb(const spectrum_table_t *table, spectrum_search_t *search, powers_fn powers,
+                  const sources_t *sources, peak_t *peak)
+{
+  for (uint32_t step = 0; step < 2 * (search->coarse_stride + search->coarse_elevation_stride); step++) {
+    peak_t best = *peak;
+    uint32_t points[8];
+    float power[8];
+    uint32_t count = 0;
+    for (int32_t de = -1; de <= 1; de++) {
+      int32_t e = (int32_t)peak->e + de;
+      if ((e < 0) || (e >= (int32_t)table->elevation_steps)) {
+        continue;
+      }
+      for (int32_t da = -1; da <= 1; da++) {
+        uint32_t a;
+        if (((da == 0) && (de == 0)) || !azimuth_step(table, search, peak->a, da, &a)) {
+          continue;
+        }
+        points[count++] = point_index(table, a, (uint32_t)e);
+      }
+    }
+    powers(sources, points, power, count);
+    search->points += count;
+    for (uint32_t k = 0; k < count; k++) {
+      if (power[k] > best.power) {
+        best = (peak_t){ points[k] % table->azimuth_steps, points[k] / table->azimuth_steps, power[k] };
+      }
+    }
+    if ((best.a == peak->a) && (best.e == peak->e)) {
+      return;
+    }
+    *peak = best;
+  }
+}
+
+// Power at the points before and after the peak, parabola vertex offset
+static float refine(spectrum_search_t *search, powers_fn powers, const sources_t *sources,
+                    const peak_t *peak, uint32_t before, uint32_t after)
+{
+  uint32_t points[2] = { before, after };
+  float power[2];
+
+  powers(sources, points, power, 2);
+  search->points += 2;
+  return vertex(power[0], peak->power, power[1]);
+}
+
+// Next batch of up to BATCH_POINTS points of the coarse pass from *cursor on
+// (a point index, 0 at the start), the first azimuth of an enabled range
+// always in; 0 past the last
+static uint32_t coarse_points(const spectrum_table_t *table, const spectrum_search_t *search, uint32_t *cursor,
+                              uint32_t *points)
+{
+  uint32_t batch = 0;
+
+  while (batch < BATCH_POINTS) {
+    uint32_t a = *cursor % table->azimuth_steps, e = *cursor / table->azimuth_steps;
+    if (e >= table->elevation_steps) {
+      break;
+    }
+    *cursor = (a + 1 < table->azimuth_steps) ? *cursor + 1
+              : point_index(table, 0, e + search->coarse_elevation_stride);
+    if (!allowed(search, a)
+        || ((a % search->coarse_stride != 0) && (a > 0) && allowed(search, a - 1))) {
+      continue;
+    }
+    points[batch++] = point_index(table, a, e);
+  }
+  return batch;
+}
+
+// Powers of a batch of coarse points into the lobes kept
+static void coarse_keep(const spectrum_table_t *table, spectrum_search_t *search, coarse_t *coarse,
+                        const uint32_t *points, const float *power, uint32_t batch)
+{
+  search->points += batch;
+  for (uint32_t k = 0; k < batch; k++) {
+    if (power[k] < coarse->min_power) {
+      coarse->min_power = power[k];
+    }
+    keep_peak(table, search, coarse->peaks, &coarse->count, points[k] % table->azimuth_steps,
+              points[k] / table->azimuth_steps, power[k]);
+  }
+}
+
+// The search after the coarse pass: each lobe to its maximum on the full
+// grid, the best refined
+static sl_status_t finish(spectrum_search_t *search, powers_fn powers, const sources_t *sources,
+                          coarse_t *coarse, float *azimuth, float *elevation)
+{
+  const spectrum_table_t *table = sources->tables[0];
+  peak_t *peaks = coarse->peaks;
+  peak_t best;
+  uint32_t before, after;
+  float da = 0, de = 0;
+
+  if (coarse->count == 0) {
+    return SL_STATUS_FAIL;
+  }
+  best = peaks[0];
+  for (uint32_t k = 0; k < coarse->count; k++) {
+    if (search->coarse_stride > 1) {
+      climb(table, search, powers, sources, &peaks[k]);
+    }
+    if (peaks[k].power > best.power) {
+      best = peaks[k];
+    }
+  }
+  if (!(best.power > coarse->min_power)) {
+    return SL_STATUS_FAIL;
+  }
+
+  if (azimuth_step(table, search, best.a, -1, &before) && azimuth_step(table, search, best.a, 1, &after)) {
+    da = refine(search, powers, sources, &best,
+                point_index(table, before, best.e), point_index(table, after, best.e));
+  }
+  if ((best.e > 0) && (best.e + 1 < table->elevation_steps)) {
+    de = refine(search, powers, sources, &best,
+                point_index(table, best.a, best.e - 1), point_index(table, best.a, best.e + 1));
+  }
+
+  *azimuth = (best.a + da) * table->azimuth_step;
+  if (table->azimuth_wraps) {
+    *azimuth = fmodf(*azimuth + 360.0f, 360.0f);
+  }
+  *elevation = (best.e + de) * table->elevation_step;
+  return SL_STATUS_OK;
+}
+
+// The search over the powers of one arithmetic, on the grid of the first
+// table
+static sl_status_t estimate(spectrum_search_t *search, powers_fn powers, const sources_t *sources,
+                            float *azimuth, float *elevation)
+{
+  const spectrum_table_t *table = sources->tables[0];
+  coarse_t coarse = { .count = 0, .min_power = INFINITY };
+  uint32_t points[BATCH_POINTS];
+  float power[BATCH_POINTS];
+  uint32_t cursor = 0, batch;
+
+  search->points = 0;
+  while ((batch = coarse_points(table, search, &cursor, points)) > 0) {
+    powers(sources, points, power, batch);
+    coarse_keep(table, search, &coarse, points, power, batch);
+  }
+  return finish(search, powers, sources, &coarse, azimuth, elevation);
+}
+
+// Tags of a batch estimate searched together: the grid and the coarse pass
+// of tag b the same as of tag a
+static bool same_search(const spectrum_table_t *a, const spectrum_search_t *search_a,
+                        const spectrum_table_t *b, const spectrum_search_t *search_b)
+{
+  return (a->elements == b->elements)
+         && (a->azimuth_steps == b->azimuth_steps)
+         && (a->elevation_steps == b->elevation_steps)
+         && (search_a->coarse_stride == search_b->coarse_stride)
+         && (search_a->coarse_elevation_stride == search_b->coarse_elevation_stride)
+         && (memcmp(search_a->allowed, search_b->allowed, sizeof(search_a->allowed)) == 0);
+}
+
+// Coarse pass of up to SIMD_BATCH_TAGS tags at once, the tag of each lane
+// with its covariance and table, then each tag on its own
+static void estimate_lanes(const spectrum_table_t *const *tables, spectrum_search_t *const *searches,
+                           const int16_t *const *covariances, const uint32_t *lanes, uint32_t count,
+                           float *azimuth, float *elevation, sl_status_t *results)
+{
+  const spectrum_table_t *table = tables[lanes[0]];
+  const uint32_t n = table->elements;
+  const uint32_t plane = n * n * SIMD_BATCH_TAGS;
+  int16_t planes[MATRIX_VALUES * SIMD_BATCH_TAGS];
+  const int16_t *steering[SIMD_BATCH_TAGS];
+  coarse_t coarse[SIMD_BATCH_TAGS];
+  uint32_t points[BATCH_POINTS];
+  int32_t fixed[BATCH_POINTS * SIMD_BATCH_TAGS];
+  float power[BATCH_POINTS];
+  uint32_t cursor = 0, batch;
+
+  // The lanes past the tags of zeros
+  memset(planes, 0, 2 * plane * sizeof(int16_t));
+  for (uint32_t t = 0; t < count; t++) {
+    const int16_t *covariance = covariances[lanes[t]];
+    for (uint32_t k = 0; k < n * n; k++) {
+      planes[k * SIMD_BATCH_TAGS + t] = covariance[k];
+      planes[plane + k * SIMD_BATCH_TAGS + t] = covariance[n * n + k];
+    }
+    steering[t] = tables[lanes[t]]->steering_q15;
+    coarse[t] = (coarse_t){ .count = 0, .min_power = INFINITY };
+    searches[lanes[t]]->points = 0;
+  }
+
+  while ((batch = coarse_points(table, searches[lanes[0]], &cursor, points)) > 0) {
+    simd_kernels->power_batch_q15(planes, steering, points, fixed, n, batch, count);
+    for (uint32_t t = 0; t < count; t++) {
+      // As powers_q15() of the tag alone
+      for (uint32_t k = 0; k < batch; k++) {
+        power[k] = (float)fixed[k * SIMD_BATCH_TAGS + t];
+      }
+      coarse_keep(tables[lanes[t]], searches[lanes[t]], &coarse[t], points, power, batch);
+    }
+  }
+
+  for (uint32_t t = 0; t < count; t++) {
+    const uint32_t s = lanes[t];
+    sources_t sources = { .tables = { tables[s] }, .covariances = { covariances[s] }, .weights = { 1.0f }, .count = 1 };
+    results[s] = finish(searches[s], powers_q15, &sources, &coarse[t], &azimuth[s], &elevation[s]);
+  }
+}
+
+// The tables of a joint estimate on one grid
+static sl_status_t joint_check(const spectrum_table_t *const *tables, const void *const *covariances,
+                               uint32_t count)
+{
+  if ((count == 0) || (count > SPECTRUM_MAX_JOINT)) {
+    return SL_STATUS_INVALID_PARAMETER;
+  }
+  for (uint32_t s = 0; s < count; s++) {
+    if ((tables[s]->elements != tables[0]->elements)
+        || (tables[s]->azimuth_steps != tables[0]->azimuth_steps)
+        || (tables[s]->elevation_steps != tables[0]->elevation_steps)
+        || (covariances[s] == NULL)) {
+      return SL_STATUS_INVALID_PARAMETER;
+    }
+  }
+  return SL_STATUS_OK;
+}
+
+// Source of a table, a new one if none has it yet
+static uint32_t table_source(sources_t *sources, const spectrum_table_t *table, bool *added)
+{
+  uint32_t m = 0;
+
+  while ((m < sources->count) && (sources->tables[m] != table)) {
+    m++;
+  }
+  *added = (m == sources->count);
+  if (*added) {
+    sources->tables[sources->count++] = table;
+  }
+  return m;
+}
+
+// The power is linear in the covariance: the covariances of one table are
+// summed, weighted, and their spectrum evaluated once
+static void merge_float(sources_t *sources, const spectrum_table_t *const *tables, const float *const *covariances,
+                        const float *weights, uint32_t count, float (*merged)[MATRIX_VALUES])
+{
+  const uint32_t values = 2 * tables[0]->elements * tables[0]->elements;
+
+  sources->count = 0;
+  for (uint32_t s = 0; s < count; s++) {
+    float weight = (weights != NULL) ? weights[s] : 1.0f;
+    bool added;
+    uint32_t m = table_source(sources, tables[s], &added);
+    for (uint32_t k = 0; k < values; k++) {
+      merged[m][k] = (added ? 0 : merged[m][k]) + weight * covariances[s][k];
+    }
+    sources->covariances[m] = merged[m];
+    sources->weights[m] = 1.0f;
+  }
+}
+
+// The same for the Q15 means: their mean, weighed by the covariances in it
+static void merge_q15(sources_t *sources, const spectrum_table_t *const *tables, const int16_t *const *covariances,
+                      uint32_t count, int16_t (*merged)[MATRIX_VALUES])
+{
+  const uint32_t values = 2 * tables[0]->elements * tables[0]->elements;
+  int32_t sum[MATRIX_VALUES];
+
+  sources->count = 0;
+  for (uint32_t s = 0; s < count; s++) {
+    bool added;
+    uint32_t m = table_source(sources, tables[s], &added);
+    sources->weights[m] = added ? 1.0f : sources->weights[m] + 1.0f;
+  }
+  for (uint32_t m = 0; m < sources->count; m++) {
+    int32_t n = (int32_t)sources->weights[m];
+    memset(sum, 0, values * sizeof(int32_t));
+    for (uint32_t s = 0; s < count; s++) {
+      if (tables[s] != sources->tables[m]) {
+        continue;
+      }
+      for (uint32_t k = 0; k < values; k++) {
+        sum[k] += covariances[s][k];
+      }
+    }
+    for (uint32_t k = 0; k < values; k++) {
+      merged[m][k] = (int16_t)((sum[k] + ((sum[k] < 0) ? -n / 2 : n / 2)) / n);
+    }
+    sources->covariances[m] = merged[m];
+  }
+}
+
+/***************************************************************************************************
+ * Public Function Definitions
+ **************************************************************************************************/
+
+uint32_t spectrum_band(float frequency)
+{
+  float band = floorf((frequency - SPECTRUM_BAND_LOW) / SPECTRUM_BAND_WIDTH);
+
+  return (band < 0) ? 0 : (band >= SPECTRUM_BANDS) ? SPECTRUM_BANDS - 1 : (uint32_t)band;
+}
+
+float spectrum_band_frequency(uint32_t band)
+{
+  return SPECTRUM_BAND_LOW + (band + 0.5f) * SPECTRUM_BAND_WIDTH;
+}
+
+const spectrum_table_t *spectrum_table_acquire(const aoa_array_config_t *array, float frequency)
+{
+  spectrum_table_t *table = NULL;
+
+  if ((array->num_array_elements < 2) || (array->num_array_elements > AOA_ARRAY_MAX_ELEMENTS)) {
+    return NULL;
+  }
+  pthread_mutex_lock(&tables_lock);
+  for (uint32_t t = 0; t < SPECTRUM_MAX_TABLES; t++) {
+    if ((tables[t].refs > 0) && (tables[t].frequency == frequency) && same_geometry(&tables[t].array, array)) {
+      table = &tables[t];
+      break;
+    }
+  }
+  if (table == NULL) {
+    for (uint32_t t = 0; t < SPECTRUM_MAX_TABLES; t++) {
+      if (tables[t].refs == 0) {
+        if (build_table(&tables[t], array, frequency) == SL_STATUS_OK) {
+          table = &tables[t];
+        }
+        break;
+      }
+    }
+  }
+  if (table != NULL) {
+    table->refs++;
+  }
+  pthread_mutex_unlock(&tables_lock);
+  return table;
+}
+
+void spectrum_table_release(const spectrum_table_t *table)
+{
+  spectrum_table_t *t = (spectrum_table_t *)table;
+
+  if (t == NULL) {
+    return;
+  }
+  pthread_mutex_lock(&tables_lock);
+  if ((t->refs > 0) && (--t->refs == 0)) {
+    free(t->steering);
+    free(t->steering_q15);
+    t->steering = NULL;
+    t->steering_q15 = NULL;
+  }
+  pthread_mutex_unlock(&tables_lock);
+}
+
+sl_status_t spectrum_search_init(spectrum_search_t *search, const spectrum_table_t *table,
+                                 float azimuth_min, float azimuth_max, uint32_t coarse_stride, uint32_t peaks)
+{
+  bool masked = !isnan(azimuth_min) && !isnan(azimuth_max);
+  uint32_t left = 0;
+
+  memset(search, 0, sizeof(*search));
+  search->coarse_stride = (coarse_stride > 0) ? coarse_stride : 1;
+  search->coarse_elevation_stride = (search->coarse_stride + 1) / 2;
+  search->peaks = (peaks == 0) ? 1 : (peaks > SPECTRUM_MAX_PEAKS) ? SPECTRUM_MAX_PEAKS : peaks;
+  for (uint32_t a = 0; (a < table->azimuth_steps) && (a < SPECTRUM_MAX_AZIMUTH_STEPS); a++) {
+    float azimuth = a * table->azimuth_step;
+    bool disabled = false;
+    if (masked) {
+      disabled = (azimuth_min <= azimuth_max) ? ((azimuth >= azimuth_min) && (azimuth <= azimuth_max))
+                 : ((azimuth >= azimuth_min) || (azimuth <= azimuth_max));
+    }
+    if (!disabled) {
+      search->allowed[a / 32] |= 1u << (a % 32);
+      left++;
+    }
+  }
+  if (left == 0) {
+    memset(search->allowed, 0xFF, sizeof(search->allowed));
+    return SL_STATUS_INVALID_PARAMETER;
+  }
+  return SL_STATUS_OK;
+}
+
+float spectrum_slot_rotation(const float *ref_i_samples, const float *ref_q_samples, uint32_t samples, float ratio)
+{
+  float re = 0, im = 0;
+
+  // Mean of ref[k + 1] conj(ref[k])
+  for (uint32_t k = 0; k + 1 < samples; k++) {
+    re += ref_i_samples[k + 1] * ref_i_samples[k] + ref_q_samples[k + 1] * ref_q_samples[k];
+    im += ref_q_samples[k + 1] * ref_i_samples[k] - ref_i_samples[k + 1] * ref_q_samples[k];
+  }
+  return atan2f(im, re) * ratio;
+}
+
+float spectrum_slot_rotation_q15(const int16_t *ref_i_samples, const int16_t *ref_q_samples, uint32_t samples,
+                                 float ratio)
+{
+  int64_t re = 0, im = 0;
+
+  for (uint32_t k = 0; k + 1 < samples; k++) {
+    re += (int32_t)ref_i_samples[k + 1] * ref_i_samples[k] + (int32_t)ref_q_samples[k + 1] * ref_q_samples[k];
+    im += (int32_t)ref_q_samples[k + 1] * ref_i_samples[k] - (int32_t)ref_i_samples[k + 1] * ref_q_samples[k];
+  }
+  return atan2f((float)im, (float)re) * ratio;
+}
+
+sl_status_t spectrum_estimate(const spectrum_table_t *table, spectrum_search_t *search,
+                              const float *covariance, float *azimuth, float *elevation)
+{
+  sources_t sources = { .tables = { table }, .covariances = { covariance }, .weights = { 1.0f }, .count = 1 };
+
+  return estimate(search, powers_float, &sources, azimuth, elevation);
+}
+
+sl_status_t spectrum_estimate_q15(const spectrum_table_t *table, spectrum_search_t *search,
+                                  const int16_t *covariance, float *azimuth, float *elevation)
+{
+  sources_t sources = { .tables = { table }, .covariances = { covariance }, .weights = { 1.0f }, .count = 1 };
+
+  return estimate(search, powers_q15, &sources, azimuth, elevation);
+}
+
+void spectrum_estimate_batch_q15(const spectrum_table_t *const *tables, spectrum_search_t *const *searches,
+                                 const int16_t *const *covariances, uint32_t count, float *azimuth,
+                                 float *elevation, sl_status_t *results)
+{
+  uint32_t lanes[SIMD_BATCH_TAGS];
+
+  if (count == 0) {
+    return;
+  }
+  bool done[count];
+  memset(done, 0, count * sizeof(bool));
+  for (uint32_t first = 0; first < count; first++) {
+    uint32_t lane_count = 0;
+    if (done[first]) {
+      continue;
+    }
+    // The tags of the search of the first left, up to a lane each
+    for (uint32_t s = first; (s < count) && (lane_count < SIMD_BATCH_TAGS); s++) {
+      if (!done[s] && same_search(tables[first], searches[first], tables[s], searches[s])) {
+        lanes[lane_count++] = s;
+        done[s] = true;
+      }
+    }
+    if (lane_count == 1) {
+      results[first] = spectrum_estimate_q15(tables[first], searches[first], covariances[first],
+                                             &azimuth[first], &elevation[first]);
+    } else {
+      estimate_lanes(tables, searches, covariances, lanes, lane_count, azimuth, elevation, results);
+    }
+  }
+}
+
+sl_status_t spectrum_estimate_joint(const spectrum_table_t *const *tables, spectrum_search_t *search,
+                                    const float *const *covariances, const float *weights, uint32_t count,
+                                    float *azimuth, float *elevation)
+{
+  float merged[SPECTRUM_MAX_JOINT][MATRIX_VALUES];
+  sources_t sources;
+  sl_status_t sc = joint_check(tables, (const void *const *)covariances, count);
+
+  if (sc != SL_STATUS_OK) {
+    return sc;
+  }
+  merge_float(&sources, tables, covariances, weights, count, merged);
+  return estimate(search, powers_float, &sources, azimuth, elevation);
+}
+
+sl_status_t spectrum_estimate_joint_q15(const spectrum_table_t *const *tables, spectrum_search_t *search,
+                                        const int16_t *const *covariances, uint32_t count,
+                                        float *azimuth, float *elevation)
+{
+  int16_t merged[SPECTRUM_MAX_JOINT][MATRIX_VALUES];
+  sources_t sources;
+  sl_status_t sc = joint_check(tables, (const void *const *)covariances, count);
+
+  if (sc != SL_STATUS_OK) {
+    return sc;
+  }
+  merge_q15(&sources, tables, covariances, count, merged);
+  return estimate(search, powers_q15, &sources, azimuth, elevation);
+}
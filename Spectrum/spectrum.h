@@ -0,0 +1,170 @@
+/***************************************************************************//**
+ * @file
+ * @brief Angle of arrival from a spatial covariance, Bartlett beamformer over
+ *        a grid of directions.
+ *
+ * The steering vector of a direction u = (cos el cos az, cos el sin az,
+ * sin el) holds exp(-j 2 pi / lambda (p . u)) per antenna slot, p the position
+ * of the element of the slot (aoa_array_slot_position()). The power of a
+ * direction is Re(a^H R a) of the window sum R of covariance.h; the diagonal
+ * is the same for every direction and left out. The angle is the peak of the
+ * grid, refined by a parabola through its neighbours in azimuth and in
+ * elevation.
+ *
+ * The peak is searched coarse to fine (spectrum_search_t): a pass over every
+ * coarse_stride-th azimuth and every (coarse_stride + 1) / 2-th elevation of
+ * the grid keeps the best points of up to peaks different lobes, each climbs
+ * the full grid to its local maximum, the best maximum wins. A stride of 1
+ * sweeps the whole grid. The azimuth mask of the locator (aoa_azimuth_min,
+ * aoa_azimuth_max, the azimuths between them are disabled) removes the
+ * disabled azimuths from the grid before the search.
+ *
+ * Grid: the arrays of one row give the azimuth 0..180 deg in
+ * SPECTRUM_ULA_AZIMUTH_STEP steps at elevation 0, the others the azimuth
+ * 0..360 deg in SPECTRUM_AZIMUTH_STEP steps times the elevation 0..90 deg in
+ * SPECTRUM_ELEVATION_STEP steps. The steering table of a geometry is computed
+ * once per frequency and shared by the estimators of all tags
+ * (spectrum_table_acquire()). The locator keeps one per band of
+ * SPECTRUM_BAND_WIDTH (spectrum_band()), a report is estimated with the table
+ * of the band of its channel; a table per channel would cost ten times the
+ * memory for a wavelength error below 0.5 %.
+ *
+ * Frequency diversity (spectrum_estimate_joint()): the multipath of a tag
+ * adds with another phase on every channel, so the spectra of the
+ * covariances of several channels, each with the table of its band, are
+ * summed and searched once. The direct path adds up, the reflections
+ * average out. The power is linear in the covariance, so the covariances of
+ * one band are summed first: a point costs one power per band of the
+ * channels, at most SPECTRUM_BANDS, instead of one per covariance.
+ *
+ * The points are evaluated in batches, so the fixed-point estimator
+ * (spectrum_estimate_q15(), the Q15 covariance of covariance_get_q15())
+ * computes one point per lane of the power_q15 kernel of simd_kernels.h on
+ * the Q15 copy of the steering table. The search is the same for both.
+ * spectrum_estimate_batch_q15() evaluates the coarse pass of several tags at
+ * once instead, a tag per lane of the power_batch_q15 kernel: the coarse
+ * pass is most of the points of a search, and the points of a 1x4 ULA have
+ * too few slots to fill the lanes of one power.
+ ******************************************************************************/
+
+#ifndef SPECTRUM_H_
+#define SPECTRUM_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "sl_status.h"
+#include "aoa_array.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SPECTRUM_FREQUENCY            2440e6f   // Hz, center of the band
+#define SPECTRUM_BAND_LOW             2400e6f   // Hz
+#define SPECTRUM_BAND_WIDTH           20e6f     // Hz, of a steering table
+#define SPECTRUM_BANDS                4
+#define SPECTRUM_AZIMUTH_STEP         2.0f      // deg
+#define SPECTRUM_ELEVATION_STEP       5.0f      // deg
+#define SPECTRUM_ULA_AZIMUTH_STEP     1.0f      // deg
+#define SPECTRUM_MAX_TABLES           (4 * SPECTRUM_BANDS)  // geometries times bands in use at once
+#define SPECTRUM_MAX_AZIMUTH_STEPS    360
+#define SPECTRUM_MAX_PEAKS            4
+#define SPECTRUM_MAX_JOINT            8         // covariances of a joint estimate
+#define SPECTRUM_DEFAULT_COARSE_STRIDE  4
+#define SPECTRUM_DEFAULT_PEAKS        2
+
+/***************************************************************************************************
+ * Type Definitions
+ **************************************************************************************************/
+
+typedef struct {
+  aoa_array_config_t array;     // geometry of the table
+  float frequency;              // Hz
+  uint32_t refs;
+  uint32_t elements;
+  uint32_t azimuth_steps;
+  uint32_t elevation_steps;
+  float azimuth_step;           // deg
+  float elevation_step;         // deg
+  bool azimuth_wraps;           // the last azimuth neighbours the first
+  // Steering vectors, per point elements real parts then elements imaginary
+  // parts, point e * azimuth_steps + a
+  float *steering;
+  int16_t *steering_q15;        // the same in Q15
+} spectrum_table_t;
+
+typedef struct {
+  uint32_t coarse_stride;       // azimuth steps of the coarse pass, 1 for all
+  uint32_t coarse_elevation_stride;
+  uint32_t peaks;               // lobes refined
+  uint32_t allowed[(SPECTRUM_MAX_AZIMUTH_STEPS + 31) / 32];   // bit per azimuth step
+  uint32_t points;              // spectrum points of the last estimate
+} spectrum_search_t;
+
+/***************************************************************************************************
+ * Public variables
+ **************************************************************************************************/
+
+// Search of the estimators initialized from now on
+extern uint32_t spectrum_coarse_stride;
+extern uint32_t spectrum_peaks;
+
+/***************************************************************************************************
+ * Function Declarations
+ **************************************************************************************************/
+
+// Band of a frequency (Hz), the bands on either end extended, and the
+// frequency of its steering table.
+uint32_t spectrum_band(float frequency);
+float spectrum_band_frequency(uint32_t band);
+
+// Steering table of a geometry at a frequency (Hz), NULL if out of memory or
+// of tables.
+const spectrum_table_t *spectrum_table_acquire(const aoa_array_config_t *array, float frequency);
+void spectrum_table_release(const spectrum_table_t *table);
+
+// Search of a table with the azimuths between azimuth_min and azimuth_max
+// (deg, wrapping past 360 if min > max) disabled, none if either is NaN.
+// SL_STATUS_INVALID_PARAMETER if no azimuth is left, the search then keeps
+// them all.
+sl_status_t spectrum_search_init(spectrum_search_t *search, const spectrum_table_t *table,
+                                 float azimuth_min, float azimuth_max, uint32_t coarse_stride, uint32_t peaks);
+
+// Phase rotation (rad) per antenna slot of the tag from the reference
+// period, ratio the slot over the reference sample period.
+float spectrum_slot_rotation(const float *ref_i_samples, const float *ref_q_samples, uint32_t samples, float ratio);
+float spectrum_slot_rotation_q15(const int16_t *ref_i_samples, const int16_t *ref_q_samples, uint32_t samples,
+                                 float ratio);
+
+// Direction (deg) of the peak of a covariance of table->elements,
+// SL_STATUS_FAIL if the spectrum is flat.
+sl_status_t spectrum_estimate(const spectrum_table_t *table, spectrum_search_t *search,
+                              const float *covariance, float *azimuth, float *elevation);
+sl_status_t spectrum_estimate_q15(const spectrum_table_t *table, spectrum_search_t *search,
+                                  const int16_t *covariance, float *azimuth, float *elevation);
+
+// spectrum_estimate_q15() of count tags, tag k with tables[k], searches[k]
+// and covariances[k], its direction in azimuth[k] and elevation[k] and its
+// result in results[k]. The coarse passes of the tags of one grid and search
+// run SIMD_BATCH_TAGS at once on the power_batch_q15 kernel, the rest of
+// each search alone; the directions are those of a tag at a time.
+void spectrum_estimate_batch_q15(const spectrum_table_t *const *tables, spectrum_search_t *const *searches,
+                                 const int16_t *const *covariances, uint32_t count, float *azimuth,
+                                 float *elevation, sl_status_t *results);
+
+// Direction (deg) of the peak of the sum of the spectra of count covariances,
+// covariances[k] with tables[k] and weights[k] (1 if weights is NULL); the Q15
+// means weigh the same. The tables share one grid, else
+// SL_STATUS_INVALID_PARAMETER, as for 0 or more than SPECTRUM_MAX_JOINT.
+sl_status_t spectrum_estimate_joint(const spectrum_table_t *const *tables, spectrum_search_t *search,
+                                    const float *const *covariances, const float *weights, uint32_t count,
+                                    float *azimuth, float *elevation);
+sl_status_t spectrum_estimate_joint_q15(const spectrum_table_t *const *tables, spectrum_search_t *search,
+                                        const int16_t *const *covariances, uint32_t count,
+                                        float *azimuth, float *elevation);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* SPECTRUM_H_ */
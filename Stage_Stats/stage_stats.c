@@ -0,0 +1,198 @@
+/***************************************************************************//**
+ * @file
+ * @brief Per-stage latency histograms and per-tag counters of the report path.
+ ******************************************************************************/
+
+#include <string.h>
+
+#include "stage_stats.h"
+
+/***************************************************************************************************
+ * Type Definitions
+ **************************************************************************************************/
+
+#define HALF_SUB_BUCKETS    (1u << (STAGE_STATS_SUB_BITS - 1))
+
+typedef struct {
+  stage_stats_point_t from;
+  stage_stats_point_t to;
+} stage_span_t;
+
+/***************************************************************************************************
+ * Static Variables
+ **************************************************************************************************/
+
+static const stage_span_t stage_spans[STAGE_STATS_STAGE_COUNT] = {
+  [STAGE_STATS_STAGE_QUEUE] = { STAGE_STATS_RECEIVED, STAGE_STATS_DEQUEUED },
+  [STAGE_STATS_STAGE_SAMPLES] = { STAGE_STATS_DEQUEUED, STAGE_STATS_SAMPLES },
+  [STAGE_STATS_STAGE_ROTATION] = { STAGE_STATS_SAMPLES, STAGE_STATS_ROTATION },
+  [STAGE_STATS_STAGE_ESTIMATE] = { STAGE_STATS_ROTATION, STAGE_STATS_ESTIMATED },
+  [STAGE_STATS_STAGE_PUBLISH] = { STAGE_STATS_ESTIMATED, STAGE_STATS_PUBLISHED },
+  [STAGE_STATS_STAGE_TOTAL] = { STAGE_STATS_RECEIVED, STAGE_STATS_PUBLISHED }
+};
+
+static const char *stage_names[STAGE_STATS_STAGE_COUNT] = {
+  [STAGE_STATS_STAGE_QUEUE] = "queue",
+  [STAGE_STATS_STAGE_SAMPLES] = "samples",
+  [STAGE_STATS_STAGE_ROTATION] = "rotation",
+  [STAGE_STATS_STAGE_ESTIMATE] = "estimate",
+  [STAGE_STATS_STAGE_PUBLISH] = "publish",
+  [STAGE_STATS_STAGE_TOTAL] = "total"
+};
+
+/***************************************************************************************************
+ * Public Variables
+ **************************************************************************************************/
+
+stage_stats_histogram_t stage_stats_histograms[STAGE_STATS_STAGE_COUNT];
+uint32_t stage_stats_sample_every = STAGE_STATS_DEFAULT_SAMPLE_EVERY;
+__thread uint32_t stage_stats_countdown;
+
+/***************************************************************************************************
+ * Static Function Definitions
+ **************************************************************************************************/
+
+// Exact below 2^SUB_BITS, then HALF_SUB_BUCKETS buckets per power of two.
+static inline uint32_t bucket_index(uint64_t ns)
+{
+  uint32_t magnitude;
+
+  if (ns < (1u << STAGE_STATS_SUB_BITS)) {
+    return (uint32_t)ns;
+  }
+  if (ns >= (1ull << STAGE_STATS_MAX_BITS)) {
+    return STAGE_STATS_BUCKETS - 1;
+  }
+  magnitude = (uint32_t)(63 - __builtin_clzll(ns)) - (STAGE_STATS_SUB_BITS - 1);
+  return (magnitude * HALF_SUB_BUCKETS) + (uint32_t)(ns >> magnitude);
+}
+
+// Middle of the values of a bucket.
+static uint64_t bucket_value(uint32_t index)
+{
+  uint32_t magnitude;
+
+  if (index < (1u << STAGE_STATS_SUB_BITS)) {
+    return index;
+  }
+  magnitude = index / HALF_SUB_BUCKETS - 1;
+  return ((uint64_t)(index - magnitude * HALF_SUB_BUCKETS) << magnitude) + ((1ull << magnitude) >> 1);
+}
+
+// The histograms and the tag counters have a single writer, a plain load and
+// an atomic store keep them readable from other threads without a locked add.
+static inline void counter_add(uint64_t *counter, uint64_t value)
+{
+  __atomic_store_n(counter, *counter + value, __ATOMIC_RELAXED);
+}
+
+static inline void counter_max(uint64_t *max, uint64_t value)
+{
+  if (value > *max) {
+    __atomic_store_n(max, value, __ATOMIC_RELAXED);
+  }
+}
+
+/***************************************************************************************************
+ * Public Function Definitions
+ **************************************************************************************************/
+
+void stage_stats_end(stage_stats_tag_t *tag, bool published)
+{
+  if (tag->stamp[STAGE_STATS_RECEIVED] == 0) {
+    return;
+  }
+  if (published) {
+    stage_stats_mark(tag, STAGE_STATS_PUBLISHED);
+    counter_add(&tag->published, 1);
+  }
+  counter_add(&tag->reports, 1);
+  if (!tag->sampled) {
+    tag->stamp[STAGE_STATS_RECEIVED] = 0;
+    return;
+  }
+
+  for (uint32_t s = 0; s < STAGE_STATS_STAGE_COUNT; s++) {
+    uint64_t from = tag->stamp[stage_spans[s].from];
+    uint64_t to = tag->stamp[stage_spans[s].to];
+    uint64_t ns;
+    stage_stats_histogram_t *h = &stage_stats_histograms[s];
+
+    if ((from == 0) || (to < from)) {
+      continue;
+    }
+    ns = to - from;
+    counter_add(&h->counts[bucket_index(ns)], 1);
+    counter_add(&h->total, 1);
+    counter_add(&h->sum_ns, ns);
+    counter_max(&h->max_ns, ns);
+
+    counter_add(&tag->count[s], 1);
+    counter_add(&tag->sum_ns[s], ns);
+    counter_max(&tag->max_ns[s], ns);
+  }
+  tag->stamp[STAGE_STATS_RECEIVED] = 0;
+  tag->sampled = false;
+}
+
+const char *stage_stats_stage_to_string(stage_stats_stage_t stage)
+{
+  return (stage < STAGE_STATS_STAGE_COUNT) ? stage_names[stage] : "unknown";
+}
+
+uint64_t stage_stats_percentile(const stage_stats_histogram_t *histogram, double p)
+{
+  uint64_t total = __atomic_load_n(&histogram->total, __ATOMIC_RELAXED);
+  uint64_t rank, seen = 0;
+
+  if (total == 0) {
+    return 0;
+  }
+  rank = (uint64_t)(p / 100.0 * total + 0.5);
+  if (rank == 0) {
+    rank = 1;
+  }
+  for (uint32_t b = 0; b < STAGE_STATS_BUCKETS; b++) {
+    seen += __atomic_load_n(&histogram->counts[b], __ATOMIC_RELAXED);
+    if (seen >= rank) {
+      return bucket_value(b);
+    }
+  }
+  // The buckets were updated after total was read
+  return __atomic_load_n(&histogram->max_ns, __ATOMIC_RELAXED);
+}
+
+void stage_stats_dump(FILE *f)
+{
+  fprintf(f, "stage latency (us)    count        mean      p50      p90      p99    p99.9      max\n");
+  for (uint32_t s = 0; s < STAGE_STATS_STAGE_COUNT; s++) {
+    const stage_stats_histogram_t *h = &stage_stats_histograms[s];
+    uint64_t total = __atomic_load_n(&h->total, __ATOMIC_RELAXED);
+    uint64_t sum_ns = __atomic_load_n(&h->sum_ns, __ATOMIC_RELAXED);
+
+    fprintf(f, "  %-16s %10llu %9.1f %8.1f %8.1f %8.1f %8.1f %8.1f\n", stage_names[s],
+            (unsigned long long)total, (total > 0) ? sum_ns / 1e3 / total : 0.0,
+            stage_stats_percentile(h, 50.0) / 1e3, stage_stats_percentile(h, 90.0) / 1e3,
+            stage_stats_percentile(h, 99.0) / 1e3, stage_stats_percentile(h, 99.9) / 1e3,
+            __atomic_load_n(&h->max_ns, __ATOMIC_RELAXED) / 1e3);
+  }
+}
+
+void stage_stats_dump_tag(FILE *f, const char *id, const stage_stats_tag_t *tag)
+{
+  fprintf(f, "  %s: %llu reports, %llu published, mean/max us:", id,
+          (unsigned long long)__atomic_load_n(&tag->reports, __ATOMIC_RELAXED),
+          (unsigned long long)__atomic_load_n(&tag->published, __ATOMIC_RELAXED));
+  for (uint32_t s = 0; s < STAGE_STATS_STAGE_COUNT; s++) {
+    uint64_t count = __atomic_load_n(&tag->count[s], __ATOMIC_RELAXED);
+    uint64_t sum_ns = __atomic_load_n(&tag->sum_ns[s], __ATOMIC_RELAXED);
+    fprintf(f, " %s %.1f/%.1f", stage_names[s], (count > 0) ? sum_ns / 1e3 / count : 0.0,
+            __atomic_load_n(&tag->max_ns[s], __ATOMIC_RELAXED) / 1e3);
+  }
+  fprintf(f, "\n");
+}
+
+void stage_stats_reset(void)
+{
+  memset(stage_stats_histograms, 0, sizeof(stage_stats_histograms));
+}
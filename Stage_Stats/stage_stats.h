@@ -0,0 +1,163 @@
+/***************************************************************************//**
+ * @file
+ * @brief Per-stage latency histograms and per-tag counters of the report path.
+ *
+ * Every IQ report is stamped at six points:
+ *   received    the event reached app_bt_on_event()
+ *   dequeued    its processing started, after the wait in the tag's mailbox
+ *   samples     get_samples() copied the report into the estimator buffers
+ *   rotation    the reference period phase rotation is set
+ *   estimated   sl_rtl_aox_process() returned
+ *   published   mqtt_publish() returned
+ * The intervals between them are the stages below. Each stage has a global
+ * HDR histogram: exact up to 2^STAGE_STATS_SUB_BITS ns, above that
+ * 2^(STAGE_STATS_SUB_BITS - 1) linear sub-buckets per power of two, i.e. a
+ * relative error under 1.6 %, up to 2^STAGE_STATS_MAX_BITS ns (68 s);
+ * larger values go to the last bucket. Each tag has the count, sum
+ * and maximum per stage.
+ *
+ * Only one report in stage_stats_sample_every (per thread) is stamped and
+ * recorded, the histograms and the stage counters of the tags are of these;
+ * the reports and published counters of the tags count every report. A
+ * stamp is one clock_gettime(CLOCK_MONOTONIC), a report not sampled costs a
+ * test per point. stage_stats_end() of all tags runs on one thread, the event
+ * thread, so the histograms and the tag counters are updated with plain
+ * loads and relaxed atomic stores, readable by the metrics server, nothing
+ * blocks. 'make bench' has the cost per report (stage_stats) and fails if it
+ * is above STAGE_STATS_MAX_OVERHEAD of the cheapest estimate/<array>.
+ ******************************************************************************/
+
+#ifndef STAGE_STATS_H_
+#define STAGE_STATS_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <time.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define STAGE_STATS_SUB_BITS      7
+#define STAGE_STATS_MAX_BITS      36
+#define STAGE_STATS_BUCKETS       ((STAGE_STATS_MAX_BITS - STAGE_STATS_SUB_BITS + 2) << (STAGE_STATS_SUB_BITS - 1))
+#define STAGE_STATS_DEFAULT_SAMPLE_EVERY  64
+#define STAGE_STATS_MAX_OVERHEAD  0.01      // of the estimate of a report
+
+/***************************************************************************************************
+ * Type Definitions
+ **************************************************************************************************/
+
+typedef enum {
+  STAGE_STATS_RECEIVED = 0,
+  STAGE_STATS_DEQUEUED,
+  STAGE_STATS_SAMPLES,
+  STAGE_STATS_ROTATION,
+  STAGE_STATS_ESTIMATED,
+  STAGE_STATS_PUBLISHED,
+  STAGE_STATS_POINT_COUNT
+} stage_stats_point_t;
+
+typedef enum {
+  STAGE_STATS_STAGE_QUEUE = 0,      // received -> dequeued: age of the report when it is processed
+  STAGE_STATS_STAGE_SAMPLES,        // dequeued -> samples: dispatch, tag lookup, QA gate, sample copy
+  STAGE_STATS_STAGE_ROTATION,       // samples -> rotation
+  STAGE_STATS_STAGE_ESTIMATE,       // rotation -> estimated
+  STAGE_STATS_STAGE_PUBLISH,        // estimated -> published: distance, payload, MQTT
+  STAGE_STATS_STAGE_TOTAL,          // received -> published
+  STAGE_STATS_STAGE_COUNT
+} stage_stats_stage_t;
+
+typedef struct {
+  uint64_t counts[STAGE_STATS_BUCKETS];
+  uint64_t total;
+  uint64_t sum_ns;
+  uint64_t max_ns;
+} stage_stats_histogram_t;
+
+// Per tag, in aoa_libitems_t. Written by the thread processing the tag only.
+typedef struct {
+  // Stamps of the report in progress, 0 where the point was not reached;
+  // received is set for every report, the others if it is sampled
+  uint64_t stamp[STAGE_STATS_POINT_COUNT];
+  bool sampled;
+  uint64_t reports;
+  uint64_t published;
+  uint64_t count[STAGE_STATS_STAGE_COUNT];
+  uint64_t sum_ns[STAGE_STATS_STAGE_COUNT];
+  uint64_t max_ns[STAGE_STATS_STAGE_COUNT];
+} stage_stats_tag_t;
+
+/***************************************************************************************************
+ * Public variables
+ **************************************************************************************************/
+
+extern stage_stats_histogram_t stage_stats_histograms[STAGE_STATS_STAGE_COUNT];
+
+// Reports per sampled report, 1 samples every report
+extern uint32_t stage_stats_sample_every;
+// Reports of the thread until the next sampled one
+extern __thread uint32_t stage_stats_countdown;
+
+/***************************************************************************************************
+ * Function Declarations
+ **************************************************************************************************/
+
+static inline uint64_t stage_stats_now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+// Starts the report of a tag, received is the stamp taken on receipt and
+// dequeued the one taken when its processing started.
+static inline void stage_stats_begin(stage_stats_tag_t *tag, uint64_t received, uint64_t dequeued)
+{
+  tag->stamp[STAGE_STATS_RECEIVED] = received;
+  tag->sampled = (stage_stats_countdown == 0);
+  if (!tag->sampled) {
+    stage_stats_countdown--;
+    return;
+  }
+  stage_stats_countdown = stage_stats_sample_every - 1;
+  tag->stamp[STAGE_STATS_DEQUEUED] = dequeued;
+  tag->stamp[STAGE_STATS_SAMPLES] = 0;
+  tag->stamp[STAGE_STATS_ROTATION] = 0;
+  tag->stamp[STAGE_STATS_ESTIMATED] = 0;
+  tag->stamp[STAGE_STATS_PUBLISHED] = 0;
+}
+
+// No-op outside a sampled report started by stage_stats_begin(), e.g. in a
+// replay.
+static inline void stage_stats_mark(stage_stats_tag_t *tag, stage_stats_point_t point)
+{
+  if (tag->sampled) {
+    tag->stamp[point] = stage_stats_now();
+  }
+}
+
+// Counts the report, and records the stages of a sampled one between stamped
+// points into the histograms and the tag counters. published tells if it was
+// sent.
+void stage_stats_end(stage_stats_tag_t *tag, bool published);
+
+const char *stage_stats_stage_to_string(stage_stats_stage_t stage);
+
+// Value in ns at percentile p (0..100) of a histogram, 0 if it is empty.
+uint64_t stage_stats_percentile(const stage_stats_histogram_t *histogram, double p);
+
+// Writes the percentiles of every stage histogram.
+void stage_stats_dump(FILE *f);
+// Writes the counters of one tag, id is the tag name printed.
+void stage_stats_dump_tag(FILE *f, const char *id, const stage_stats_tag_t *tag);
+
+void stage_stats_reset(void);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* STAGE_STATS_H_ */
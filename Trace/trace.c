@@ -0,0 +1,213 @@
+/***************************************************************************//**
+ * @file
+ * @brief Sampled tracing of single IQ reports, exported as Chrome trace JSON.
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "trace.h"
+
+/***************************************************************************************************
+ * Type Definitions
+ **************************************************************************************************/
+
+typedef struct {
+  uint64_t begin;
+  uint64_t end;
+  uint8_t address[6];
+  uint8_t span;
+  uint8_t channel;
+  uint16_t event_counter;
+} trace_event_t;
+
+// Single writer, the thread that owns it. head counts all spans written,
+// the ring holds the last TRACE_RING_EVENTS of them.
+typedef struct {
+  uint64_t head;
+  uint32_t thread;
+  trace_event_t events[TRACE_RING_EVENTS];
+} trace_ring_t;
+
+/***************************************************************************************************
+ * Static Variables
+ **************************************************************************************************/
+
+static const char *span_names[TRACE_SPAN_COUNT] = {
+  [TRACE_SPAN_REPORT] = "report",
+  [TRACE_SPAN_QUEUE] = "queue",
+  [TRACE_SPAN_QA] = "qa",
+  [TRACE_SPAN_DEINTERLEAVE] = "deinterleave",
+  [TRACE_SPAN_ROTATION] = "rotation",
+  [TRACE_SPAN_ESTIMATE] = "estimate",
+  [TRACE_SPAN_DISTANCE] = "distance",
+  [TRACE_SPAN_SERIALIZE] = "serialize",
+  [TRACE_SPAN_PUBLISH] = "publish"
+};
+
+static trace_ring_t *rings[TRACE_MAX_THREADS];
+static uint32_t ring_count;
+
+static __thread trace_ring_t *ring;
+static __thread bool ring_failed;
+static __thread uint32_t countdown;
+
+/***************************************************************************************************
+ * Public Variables
+ **************************************************************************************************/
+
+uint32_t trace_sample_every;
+__thread trace_report_t trace_current;
+
+/***************************************************************************************************
+ * Static Function Definitions
+ **************************************************************************************************/
+
+// The ring of the calling thread, registered on its first traced span.
+static trace_ring_t *get_ring(void)
+{
+  uint32_t index;
+
+  if ((ring != NULL) || ring_failed) {
+    return ring;
+  }
+  index = __atomic_fetch_add(&ring_count, 1, __ATOMIC_RELAXED);
+  if (index < TRACE_MAX_THREADS) {
+    ring = calloc(1, sizeof(trace_ring_t));
+  }
+  if (ring == NULL) {
+    ring_failed = true;
+    return NULL;
+  }
+  ring->thread = index + 1;
+  __atomic_store_n(&rings[index], ring, __ATOMIC_RELEASE);
+  return ring;
+}
+
+static void write_event(FILE *f, int pid, uint32_t thread, const trace_event_t *e)
+{
+  fprintf(f, ",\n{\"name\":\"%s\",\"cat\":\"aoa\",\"ph\":\"X\",\"pid\":%d,\"tid\":%u,"
+          "\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"tag\":\"%02X:%02X:%02X:%02X:%02X:%02X\","
+          "\"event_counter\":%u,\"channel\":%u}}",
+          trace_span_to_string((trace_span_t)e->span), pid, thread,
+          e->begin / 1e3, (e->end - e->begin) / 1e3,
+          e->address[5], e->address[4], e->address[3], e->address[2], e->address[1], e->address[0],
+          e->event_counter, e->channel);
+}
+
+// Copies the spans of one ring, skipping those the owner overwrote meanwhile.
+static uint32_t copy_ring(const trace_ring_t *r, trace_event_t *copy)
+{
+  uint64_t head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+  uint64_t first = (head > TRACE_RING_EVENTS) ? head - TRACE_RING_EVENTS : 0;
+  uint64_t valid;
+  uint32_t n = 0;
+
+  for (uint64_t i = first; i < head; i++) {
+    copy[i - first] = r->events[i & (TRACE_RING_EVENTS - 1)];
+  }
+  // The owner may be writing span number head now, which reuses the slot of
+  // head - TRACE_RING_EVENTS
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  valid = __atomic_load_n(&r->head, __ATOMIC_RELAXED);
+  valid = (valid >= TRACE_RING_EVENTS) ? valid - TRACE_RING_EVENTS + 1 : 0;
+  for (uint64_t i = first; i < head; i++) {
+    if (i >= valid) {
+      copy[n++] = copy[i - first];
+    }
+  }
+  return n;
+}
+
+/***************************************************************************************************
+ * Public Function Definitions
+ **************************************************************************************************/
+
+void trace_report_begin(uint64_t received, const uint8_t address[6],
+                        uint16_t event_counter, uint8_t channel)
+{
+  TRACE_PROBE3(report_begin, event_counter, channel, received);
+  trace_current.active = false;
+  if (trace_sample_every == 0) {
+    return;
+  }
+  if (countdown > 0) {
+    countdown--;
+    return;
+  }
+  countdown = trace_sample_every - 1;
+  memcpy(trace_current.address, address, sizeof(trace_current.address));
+  trace_current.event_counter = event_counter;
+  trace_current.channel = channel;
+  trace_current.received = received;
+  trace_current.active = true;
+}
+
+void trace_record(trace_span_t span, uint64_t begin, uint64_t end)
+{
+  trace_ring_t *r = get_ring();
+  trace_event_t *e;
+
+  if (r == NULL) {
+    return;
+  }
+  e = &r->events[r->head & (TRACE_RING_EVENTS - 1)];
+  e->begin = begin;
+  e->end = end;
+  memcpy(e->address, trace_current.address, sizeof(e->address));
+  e->span = (uint8_t)span;
+  e->channel = trace_current.channel;
+  e->event_counter = trace_current.event_counter;
+  __atomic_store_n(&r->head, r->head + 1, __ATOMIC_RELEASE);
+}
+
+const char *trace_span_to_string(trace_span_t span)
+{
+  return (span < TRACE_SPAN_COUNT) ? span_names[span] : "unknown";
+}
+
+sl_status_t trace_export(const char *filename)
+{
+  uint32_t count = __atomic_load_n(&ring_count, __ATOMIC_RELAXED);
+  trace_event_t *copy;
+  int pid = (int)getpid();
+  FILE *f;
+
+  copy = malloc(TRACE_RING_EVENTS * sizeof(trace_event_t));
+  if (copy == NULL) {
+    return SL_STATUS_ALLOCATION_FAILED;
+  }
+  f = fopen(filename, "w");
+  if (f == NULL) {
+    free(copy);
+    return SL_STATUS_FAIL;
+  }
+  if (count > TRACE_MAX_THREADS) {
+    count = TRACE_MAX_THREADS;
+  }
+
+  // Timestamps are CLOCK_MONOTONIC in us, the clock perf records with
+  fprintf(f, "{\"displayTimeUnit\":\"ns\",\"otherData\":{\"clock\":\"CLOCK_MONOTONIC\"},\n"
+          "\"traceEvents\":[\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"aoa_locator\"}}",
+          pid);
+  for (uint32_t t = 0; t < count; t++) {
+    const trace_ring_t *r = __atomic_load_n(&rings[t], __ATOMIC_ACQUIRE);
+    uint32_t n;
+
+    if (r == NULL) {
+      continue;
+    }
+    fprintf(f, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%u,\"args\":{\"name\":\"thread %u\"}}",
+            pid, r->thread, r->thread);
+    n = copy_ring(r, copy);
+    for (uint32_t i = 0; i < n; i++) {
+      write_event(f, pid, r->thread, &copy[i]);
+    }
+  }
+  fprintf(f, "\n]}\n");
+
+  free(copy);
+  return (fclose(f) == 0) ? SL_STATUS_OK : SL_STATUS_FAIL;
+}
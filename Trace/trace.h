@@ -0,0 +1,135 @@
+/***************************************************************************//**
+ * @file
+ * @brief Sampled tracing of single IQ reports, exported as Chrome trace JSON.
+ *
+ * One report in trace_sample_every (0 off) is followed from receipt to
+ * publish: trace_report_begin() picks it on the thread that handles the
+ * report, the spans below are recorded with their begin and end time and
+ * the tag, event_counter and channel of the report into a ring buffer of
+ * that thread. Reports that are not sampled cost one thread local test per
+ * span. trace_export() writes the last TRACE_RING_EVENTS spans of every
+ * thread in the Chrome trace event format, for chrome://tracing or
+ * ui.perfetto.dev.
+ *
+ * Built with AOA_TRACE_USDT (make TRACE_USDT=1, needs <sys/sdt.h>) every
+ * report, sampled or not, also fires the USDT probes aoa_locator:report_begin,
+ * report_end, span_begin and span_end, e.g. for
+ *   perf probe -x exe/aoa_locator sdt_aoa_locator:span_begin
+ *   perf record -e sdt_aoa_locator:* -p <pid>
+ * A probe is a nop until it is attached.
+ ******************************************************************************/
+
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include "sl_status.h"
+
+#ifdef AOA_TRACE_USDT
+#include <sys/sdt.h>
+#define TRACE_PROBE1(name, a)                   DTRACE_PROBE1(aoa_locator, name, a)
+#define TRACE_PROBE3(name, a, b, c)             DTRACE_PROBE3(aoa_locator, name, a, b, c)
+#else
+#define TRACE_PROBE1(name, a)
+#define TRACE_PROBE3(name, a, b, c)
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TRACE_RING_EVENTS         4096      // spans kept per thread, power of two
+#define TRACE_MAX_THREADS         16
+#define TRACE_DEFAULT_FILE        "aoa_trace.json"
+
+/***************************************************************************************************
+ * Type Definitions
+ **************************************************************************************************/
+
+typedef enum {
+  TRACE_SPAN_REPORT = 0,        // receipt in app_bt_on_event() to the end of app_on_iq_report()
+  TRACE_SPAN_QUEUE,             // receipt to the start of processing, the wait in the tag's mailbox
+  TRACE_SPAN_QA,                // in-tree IQ sample quality gate
+  TRACE_SPAN_DEINTERLEAVE,      // get_samples()
+  TRACE_SPAN_ROTATION,          // reference period phase rotation, calculate and set
+  TRACE_SPAN_ESTIMATE,          // sl_rtl_aox_process()
+  TRACE_SPAN_DISTANCE,          // RSSI to distance and its filter
+  TRACE_SPAN_SERIALIZE,         // MQTT topic and angle payload
+  TRACE_SPAN_PUBLISH,           // mqtt_publish()
+  TRACE_SPAN_COUNT
+} trace_span_t;
+
+// The report followed on this thread
+typedef struct {
+  bool active;
+  uint8_t address[6];
+  uint8_t channel;
+  uint16_t event_counter;
+  uint64_t received;
+} trace_report_t;
+
+/***************************************************************************************************
+ * Public variables
+ **************************************************************************************************/
+
+// One report in this many is traced, 0 disables tracing
+extern uint32_t trace_sample_every;
+
+extern __thread trace_report_t trace_current;
+
+/***************************************************************************************************
+ * Function Declarations
+ **************************************************************************************************/
+
+static inline uint64_t trace_now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+// Records a span of the current report, called by the inline functions below.
+void trace_record(trace_span_t span, uint64_t begin, uint64_t end);
+
+// Decides if the report that arrived at received (trace_now()) is traced.
+void trace_report_begin(uint64_t received, const uint8_t address[6],
+                        uint16_t event_counter, uint8_t channel);
+
+// Records the report span and ends the report.
+static inline void trace_report_end(void)
+{
+  TRACE_PROBE1(report_end, 0);
+  if (trace_current.active) {
+    trace_record(TRACE_SPAN_REPORT, trace_current.received, trace_now());
+    trace_current.active = false;
+  }
+}
+
+// Returns the begin time for trace_span_end(), 0 if the report is not traced.
+static inline uint64_t trace_span_begin(trace_span_t span)
+{
+  TRACE_PROBE1(span_begin, span);
+  return trace_current.active ? trace_now() : 0;
+}
+
+static inline void trace_span_end(trace_span_t span, uint64_t begin)
+{
+  TRACE_PROBE1(span_end, span);
+  if (begin != 0) {
+    trace_record(span, begin, trace_now());
+  }
+}
+
+const char *trace_span_to_string(trace_span_t span);
+
+// Writes the spans of all threads to filename, in the Chrome trace event format.
+sl_status_t trace_export(const char *filename);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* TRACE_H_ */
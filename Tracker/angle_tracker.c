@@ -0,0 +1,158 @@
+/***************************************************************************//**
+ * @file
+ * @brief Angle tracking filter of a tag, a constant velocity Kalman filter on
+ *        azimuth and elevation with motion gating.
+ ******************************************************************************/
+
+#include <string.h>
+#include <math.h>
+
+#include "angle_tracker.h"
+
+/***************************************************************************************************
+ * Public Variables
+ **************************************************************************************************/
+
+float angle_tracker_motion;
+float angle_tracker_noise = ANGLE_TRACKER_DEFAULT_NOISE;
+
+/***************************************************************************************************
+ * Static Function Definitions
+ **************************************************************************************************/
+
+// Azimuth difference in -180..180
+static inline float wrap_deg(float deg)
+{
+  if ((deg >= 180.0f) || (deg < -180.0f)) {
+    deg -= 360.0f * floorf((deg + 180.0f) / 360.0f);
+  }
+  return deg;
+}
+
+static void axis_start(angle_tracker_axis_t *axis, float angle, float noise)
+{
+  axis->angle = angle;
+  axis->rate = 0;
+  axis->p00 = noise * noise;
+  axis->p01 = 0;
+  axis->p11 = ANGLE_TRACKER_INITIAL_RATE * ANGLE_TRACKER_INITIAL_RATE;
+}
+
+// Time update with a white acceleration of variance q over dt.
+static void axis_predict(const angle_tracker_axis_t *axis, float dt, float q, angle_tracker_axis_t *out)
+{
+  float dt2 = dt * dt;
+
+  out->angle = axis->angle + axis->rate * dt;
+  out->rate = axis->rate;
+  out->p00 = axis->p00 + dt * (2.0f * axis->p01 + dt * axis->p11) + q * dt2 * dt2 * 0.25f;
+  out->p01 = axis->p01 + dt * axis->p11 + q * dt2 * dt * 0.5f;
+  out->p11 = axis->p11 + q * dt2;
+}
+
+static void axis_correct(angle_tracker_axis_t *axis, float innovation, float s)
+{
+  float k0 = axis->p00 / s;
+  float k1 = axis->p01 / s;
+
+  axis->angle += k0 * innovation;
+  axis->rate += k1 * innovation;
+  axis->p11 -= k1 * axis->p01;
+  axis->p01 -= k0 * axis->p01;
+  axis->p00 -= k0 * axis->p00;
+}
+
+static void restart(angle_tracker_t *tracker, uint64_t time_ns, aoa_angle_t *angle)
+{
+  axis_start(&tracker->azimuth, angle->azimuth, tracker->noise);
+  axis_start(&tracker->elevation, angle->elevation, tracker->noise);
+  tracker->valid = true;
+  tracker->time_ns = time_ns;
+  tracker->misses = 0;
+  angle->azimuth_stdev = tracker->noise;
+  angle->elevation_stdev = tracker->noise;
+}
+
+static inline float seconds_since(const angle_tracker_t *tracker, uint64_t time_ns)
+{
+  return (time_ns > tracker->time_ns) ? (time_ns - tracker->time_ns) / 1e9f : 0.0f;
+}
+
+/***************************************************************************************************
+ * Public Function Definitions
+ **************************************************************************************************/
+
+void angle_tracker_init(angle_tracker_t *tracker, float motion, float noise)
+{
+  memset(tracker, 0, sizeof(*tracker));
+  tracker->motion = motion;
+  tracker->noise = (noise > 0) ? noise : ANGLE_TRACKER_DEFAULT_NOISE;
+}
+
+angle_tracker_result_t angle_tracker_update(angle_tracker_t *tracker, uint64_t time_ns, aoa_angle_t *angle)
+{
+  angle_tracker_axis_t azimuth, elevation;
+  float dt, q, r, s_azimuth, s_elevation, nu_azimuth, nu_elevation;
+
+  dt = seconds_since(tracker, time_ns);
+  if (!tracker->valid || (dt > ANGLE_TRACKER_LOST_S)) {
+    restart(tracker, time_ns, angle);
+    return ANGLE_TRACKER_RESTARTED;
+  }
+
+  q = tracker->motion * tracker->motion;
+  r = tracker->noise * tracker->noise;
+  axis_predict(&tracker->azimuth, dt, q, &azimuth);
+  axis_predict(&tracker->elevation, dt, q, &elevation);
+  azimuth.angle = wrap_deg(azimuth.angle);
+  nu_azimuth = wrap_deg(angle->azimuth - azimuth.angle);
+  nu_elevation = angle->elevation - elevation.angle;
+  s_azimuth = azimuth.p00 + r;
+  s_elevation = elevation.p00 + r;
+
+  if ((nu_azimuth * nu_azimuth / s_azimuth + nu_elevation * nu_elevation / s_elevation) > ANGLE_TRACKER_GATE) {
+    if (++tracker->misses > ANGLE_TRACKER_MAX_MISSES) {
+      restart(tracker, time_ns, angle);
+      return ANGLE_TRACKER_RESTARTED;
+    }
+    // The track stays where it was, the outlier is replaced by the prediction
+    angle->azimuth = azimuth.angle;
+    angle->elevation = elevation.angle;
+    angle->azimuth_stdev = sqrtf(azimuth.p00);
+    angle->elevation_stdev = sqrtf(elevation.p00);
+    return ANGLE_TRACKER_GATED;
+  }
+
+  axis_correct(&azimuth, nu_azimuth, s_azimuth);
+  axis_correct(&elevation, nu_elevation, s_elevation);
+  azimuth.angle = wrap_deg(azimuth.angle);
+  tracker->azimuth = azimuth;
+  tracker->elevation = elevation;
+  tracker->time_ns = time_ns;
+  tracker->misses = 0;
+
+  angle->azimuth = azimuth.angle;
+  angle->elevation = elevation.angle;
+  angle->azimuth_stdev = sqrtf(azimuth.p00);
+  angle->elevation_stdev = sqrtf(elevation.p00);
+  return ANGLE_TRACKER_ACCEPTED;
+}
+
+bool angle_tracker_predict(const angle_tracker_t *tracker, uint64_t time_ns, aoa_angle_t *angle)
+{
+  angle_tracker_axis_t azimuth, elevation;
+  float dt, q;
+
+  dt = seconds_since(tracker, time_ns);
+  if (!tracker->valid || (dt > ANGLE_TRACKER_COAST_S)) {
+    return false;
+  }
+  q = tracker->motion * tracker->motion;
+  axis_predict(&tracker->azimuth, dt, q, &azimuth);
+  axis_predict(&tracker->elevation, dt, q, &elevation);
+  angle->azimuth = wrap_deg(azimuth.angle);
+  angle->elevation = elevation.angle;
+  angle->azimuth_stdev = sqrtf(azimuth.p00);
+  angle->elevation_stdev = sqrtf(elevation.p00);
+  return true;
+}
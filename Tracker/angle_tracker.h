@@ -0,0 +1,101 @@
+/***************************************************************************//**
+ * @file
+ * @brief Angle tracking filter of a tag, a constant velocity Kalman filter on
+ *        azimuth and elevation with motion gating.
+ *
+ * Each axis has the state angle and rate. Between two reports the state is
+ * predicted with the rate; the process noise is a white acceleration of
+ * stdev motion (deg/s^2), the measurement noise a stdev of noise (deg). The
+ * steady state is an alpha-beta filter whose gains follow the report rate.
+ *
+ * Motion gating: a report whose normalized innovation over both axes exceeds
+ * ANGLE_TRACKER_GATE (chi-square, 2 degrees of freedom, 99.9 %) does not
+ * move the track, the prediction is given instead. After more than
+ * ANGLE_TRACKER_MAX_MISSES gated reports in a row the tag has really moved
+ * and the track restarts at the report, as it does after ANGLE_TRACKER_LOST_S
+ * without a report.
+ *
+ * angle_tracker_predict() gives the angle at any time up to
+ * ANGLE_TRACKER_COAST_S after the last report, e.g. for a report the
+ * estimator gave no angle for.
+ ******************************************************************************/
+
+#ifndef ANGLE_TRACKER_H_
+#define ANGLE_TRACKER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "aoa_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ANGLE_TRACKER_DEFAULT_MOTION  90.0f     // deg/s^2, a walking tag at a few meters
+#define ANGLE_TRACKER_DEFAULT_NOISE   4.0f      // deg, stdev of a fast response estimate
+#define ANGLE_TRACKER_INITIAL_RATE    45.0f     // deg/s, stdev of the rate of a new track
+#define ANGLE_TRACKER_GATE            13.8f
+#define ANGLE_TRACKER_MAX_MISSES      3
+#define ANGLE_TRACKER_LOST_S          2.0f
+#define ANGLE_TRACKER_COAST_S         1.0f
+
+/***************************************************************************************************
+ * Type Definitions
+ **************************************************************************************************/
+
+typedef struct {
+  float angle;                  // deg
+  float rate;                   // deg/s
+  float p00, p01, p11;          // covariance of angle and rate
+} angle_tracker_axis_t;
+
+typedef struct {
+  // Configuration, motion 0 disables the filter
+  float motion;
+  float noise;
+  // Track
+  bool valid;
+  uint64_t time_ns;             // of the last update
+  uint32_t misses;
+  angle_tracker_axis_t azimuth;
+  angle_tracker_axis_t elevation;
+} angle_tracker_t;
+
+typedef enum {
+  ANGLE_TRACKER_ACCEPTED = 0,   // the report updated the track
+  ANGLE_TRACKER_GATED,          // an outlier, the prediction is given
+  ANGLE_TRACKER_RESTARTED       // a new track starts at the report
+} angle_tracker_result_t;
+
+/***************************************************************************************************
+ * Public variables
+ **************************************************************************************************/
+
+// Configuration of the trackers initialized from now on, motion 0 disables them
+extern float angle_tracker_motion;
+extern float angle_tracker_noise;
+
+/***************************************************************************************************
+ * Function Declarations
+ **************************************************************************************************/
+
+void angle_tracker_init(angle_tracker_t *tracker, float motion, float noise);
+
+static inline bool angle_tracker_enabled(const angle_tracker_t *tracker)
+{
+  return tracker->motion > 0;
+}
+
+// Filters the azimuth and elevation of an estimate of a report at time_ns
+// in place, the stdev fields are set to those of the track.
+angle_tracker_result_t angle_tracker_update(angle_tracker_t *tracker, uint64_t time_ns, aoa_angle_t *angle);
+
+// Azimuth, elevation and their stdev at time_ns, false without a track or
+// beyond ANGLE_TRACKER_COAST_S.
+bool angle_tracker_predict(const angle_tracker_t *tracker, uint64_t time_ns, aoa_angle_t *angle);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* ANGLE_TRACKER_H_ */
@@ -34,30 +34,39 @@
 // standard library headers
 #include <stdint.h>
 #include <string.h>
+#include <strings.h>
 #include <stdio.h>
 #include <stdbool.h>
 #include <unistd.h>
 #include <stdlib.h>
 #include <math.h>
+#include <time.h>
 
 #include "aoa.h"
 #include "app_log.h"
+#include "log_level.h"
 #include "app_config.h"
+#include "log_writer.h"
+#include "iq_qa.h"
+#include "metrics.h"
+#include "trace.h"
+#include "simd_kernels.h"
+
+// Upper bound of the Sample.csv text for one report
+#define SAMPLE_LOG_MAX_LEN(array)   (256 + aoa_array_report_length(array) * 8)
+// Quality flags of a report as text, parse_qa_res()
+#define QA_RES_LENGTH               32
 
 /***************************************************************************************************
  * Public Variables
  **************************************************************************************************/
 float aoa_azimuth_min = AOA_AZIMUTH_MASK_MIN_DEFAULT;
 float aoa_azimuth_max = AOA_AZIMUTH_MASK_MAX_DEFAULT;
+enum sl_rtl_aox_mode aoa_aox_mode = AOX_MODE;
 
 /***************************************************************************************************
  * Static Variables
  **************************************************************************************************/
-static float **ref_i_samples;
-static float **ref_q_samples;
-static float **i_samples;
-static float **q_samples;
-
 sl_rtl_clib_iq_sample_qa_dataset_t qa_dataset;
   sl_rtl_clib_iq_sample_qa_antenna_data_t qa_antenna;
 /***************************************************************************************************
@@ -65,14 +74,20 @@ sl_rtl_clib_iq_sample_qa_dataset_t qa_dataset;
  **************************************************************************************************/
 
 static enum sl_rtl_error_code aox_process_samples(aoa_libitems_t *aoa_state, aoa_iq_report_t *iq_report, float *azimuth, float *elevation, uint32_t *qa_result);
-static float calc_frequency_from_channel(uint8_t channel);
 static uint32_t allocate_2D_float_buffer(float*** buf, uint32_t rows, uint32_t cols);
-static void get_samples(aoa_iq_report_t *iq_report,float fr);
+static void free_2D_float_buffer(float** buf, uint32_t rows);
+static void get_samples(aoa_libitems_t *aoa_state, aoa_iq_report_t *iq_report,float fr);
+static iq_qa_reason_t quality_gate(aoa_libitems_t *aoa_state, aoa_iq_report_t *iq_report);
+static uint64_t report_time_ns(aoa_libitems_t *aoa_state);
+static void create_estimator(aoa_libitems_t *aoa_state);
+static enum sl_rtl_error_code covariance_process_samples(aoa_libitems_t *aoa_state, aoa_iq_report_t *iq_report, float fr, float *azimuth, float *elevation);
+static sl_status_t covariance_estimate_joint(aoa_libitems_t *aoa_state, float *azimuth, float *elevation, uint32_t *reports);
+static sl_status_t report_result(aoa_libitems_t *aoa_state, aoa_iq_report_t *iq_report, aoa_angle_t *angle, enum sl_rtl_error_code ret, uint32_t quality_result);
+static bool batch_eligible(aoa_libitems_t *aoa_state, aoa_iq_report_t *iq_report);
+static bool same_batch(aoa_libitems_t *a, aoa_libitems_t *b);
+static void calculate_lanes(aoa_libitems_t *const *aoa_states, aoa_iq_report_t *const *iq_reports, aoa_angle_t *angles, sl_status_t *results, const uint32_t *lanes, uint32_t count);
 
 
-const char ARR_TYP_STRNG[3][19]={"ARRAY_TYPE_4x4_URA",
-		"ARRAY_TYPE_3x3_URA",
-		"ARRAY_TYPE_1x4_ULA"};
 const char Strng_Mode[12][64] = {
 		 "SL_RTL_AOX_MODE_ONE_SHOT_BASIC", ///< Medium filtering, medium response. Returns 2D angle, requires 10 rounds. Most suitable for single shot measurement.
 		  "SL_RTL_AOX_MODE_ONE_SHOT_BASIC_LIGHTWEIGHT", ///< Medium filtering, medium response, low CPU cost & low elevation resolution. 2D angle, req. 10 rounds. Most suitable for single shot measurement.
@@ -89,35 +104,48 @@ const char Strng_Mode[12][64] = {
 /***************************************************************************************************
  * Public Function Definitions
  **************************************************************************************************/
-void aoa_init_buffers(void)
-{
-  allocate_2D_float_buffer(&ref_i_samples, AOA_NUM_SNAPSHOTS, AOA_NUM_ARRAY_ELEMENTS);
-  allocate_2D_float_buffer(&ref_q_samples, AOA_NUM_SNAPSHOTS, AOA_NUM_ARRAY_ELEMENTS);
-
-  allocate_2D_float_buffer(&i_samples, AOA_NUM_SNAPSHOTS, AOA_NUM_ARRAY_ELEMENTS);
-  allocate_2D_float_buffer(&q_samples, AOA_NUM_SNAPSHOTS, AOA_NUM_ARRAY_ELEMENTS);
-}
-
 void aoa_init(aoa_libitems_t *aoa_state)
 {
   app_log("AoA library init...\n");
-  // Initialize AoX library
-  sl_rtl_aox_init(&aoa_state->libitem);
-  // Set the number of snapshots - how many times the antennas are scanned during one measurement
-  sl_rtl_aox_set_num_snapshots(&aoa_state->libitem, AOA_NUM_SNAPSHOTS);
-  // Set the antenna array type
-  sl_rtl_aox_set_array_type(&aoa_state->libitem, AOX_ARRAY_TYPE);
-  // Select mode (high speed/high accuracy/etc.)
-  sl_rtl_aox_set_mode(&aoa_state->libitem, AOX_MODE);
-  // Enable IQ sample quality analysis processing
-  sl_rtl_aox_iq_sample_qa_configure(&aoa_state->libitem);
-  // Add azimuth constraint if min and max values are valid
+  // Sample buffers are per estimator, so independent tags can be processed in parallel
+  // The reference period is sampled on one antenna only
+  // The geometry is fixed for the lifetime of the estimator
+  aoa_state->array = aoa_array_config;
+  aoa_state->array_kernel = aoa_array_get_kernel(&aoa_state->array);
+  aoa_state->aox_mode = aoa_aox_mode;
+  aoa_state->snapshots = aoa_state->array.num_snapshots;
+  memset(&aoa_state->stage_stats, 0, sizeof(aoa_state->stage_stats));
+  angle_tracker_init(&aoa_state->tracker, angle_tracker_motion, angle_tracker_noise);
+  aoa_state->report_time_ns = 0;
+  allocate_2D_float_buffer(&aoa_state->ref_i_samples, 1, aoa_state->array.ref_period_samples);
+  allocate_2D_float_buffer(&aoa_state->ref_q_samples, 1, aoa_state->array.ref_period_samples);
+
+  allocate_2D_float_buffer(&aoa_state->i_samples, aoa_state->array.num_snapshots, aoa_state->array.num_array_elements);
+  allocate_2D_float_buffer(&aoa_state->q_samples, aoa_state->array.num_snapshots, aoa_state->array.num_array_elements);
+  iq_analytics_init(&aoa_state->analytics, aoa_state->array.num_array_elements, aoa_state->array.ref_period_samples);
+  covariance_init(&aoa_state->covariance, aoa_state->array.num_array_elements, covariance_window, covariance_max_age_s,
+                  covariance_fixed_point);
+  memset(aoa_state->spectrum, 0, sizeof(aoa_state->spectrum));
+  aoa_state->joint_pending = 0;
+  if (covariance_enabled(&aoa_state->covariance)) {
+    bool tables = true;
+    for (uint32_t b = 0; b < SPECTRUM_BANDS; b++) {
+      aoa_state->spectrum[b] = spectrum_table_acquire(&aoa_state->array, spectrum_band_frequency(b));
+      tables = tables && (aoa_state->spectrum[b] != NULL);
+    }
+    if (!tables) {
+      app_log("No steering table for the array, covariance estimator off\n");
+      covariance_deinit(&aoa_state->covariance);
+    } else if (spectrum_search_init(&aoa_state->search, aoa_state->spectrum[0], aoa_azimuth_min, aoa_azimuth_max,
+                                    spectrum_coarse_stride, spectrum_peaks) != SL_STATUS_OK) {
+      app_log("The azimuth mask disables every azimuth, ignored\n");
+    }
+  }
+
+  create_estimator(aoa_state);
   if (!isnan(aoa_azimuth_min) && !isnan(aoa_azimuth_max)) {
     app_log("Disable azimuth values between %f and %f\n", aoa_azimuth_min, aoa_azimuth_max);
-    sl_rtl_aox_add_constraint(&aoa_state->libitem, SL_RTL_AOX_CONSTRAINT_TYPE_AZIMUTH, aoa_azimuth_min, aoa_azimuth_max);
   }
-  // Create AoX estimator
-  sl_rtl_aox_create_estimator(&aoa_state->libitem);
   // Initialize an util item
   sl_rtl_util_init(&aoa_state->util_libitem);
   sl_rtl_util_set_parameter(&aoa_state->util_libitem, SL_RTL_UTIL_PARAMETER_AMOUNT_OF_FILTERING, FILTERING_AMOUNT);
@@ -127,16 +155,31 @@ void aoa_init(aoa_libitems_t *aoa_state)
 
   app_log("AOA_NUM_SNAPSHOTS  %i\n\
 AOX_ARRAY_TYPE  %s\n\
-AOX_MODE %s\n",
-		  AOA_NUM_SNAPSHOTS,
-		  ARR_TYP_STRNG[AOX_ARRAY_TYPE],
-		  Strng_Mode[AOX_MODE-3]);
+AOX_MODE %s\n\
+Sample kernel %s\n",
+		  aoa_state->array.num_snapshots,
+		  aoa_array_type_to_string(aoa_state->array.array_type),
+		  aoa_aox_mode_to_string(aoa_state->aox_mode),
+		  aoa_state->array_kernel.name);
+  if (angle_tracker_enabled(&aoa_state->tracker)) {
+    app_log("Angle tracking: motion %.1f deg/s^2, noise %.1f deg\n",
+            aoa_state->tracker.motion, aoa_state->tracker.noise);
+  }
+  if (covariance_enabled(&aoa_state->covariance)) {
+    app_log("Covariance estimator: window %u reports, max age %.1f s, coarse stride %u, %u peaks, %s\n",
+            aoa_state->covariance.window, aoa_state->covariance.max_age_ns / 1e9,
+            aoa_state->search.coarse_stride, aoa_state->search.peaks,
+            aoa_state->covariance.fixed_point ? "Q15" : "float");
+    if (covariance_joint_reports > 1) {
+      app_log("Joint estimate every %u reports over the recent channels\n", covariance_joint_reports);
+    }
+  }
 
 
 }
-char resStrng[128];
-char* parse_qa_res(u32 q_res){
-	char* p= resStrng;
+// Numbers of the quality flags set, res of the caller, re-entrant
+char* parse_qa_res(u32 q_res, char *res){
+	char* p= res;
 
 	for (int i = 0; i < 10; ++i) {
 		if(i==1)continue;
@@ -144,21 +187,84 @@ char* parse_qa_res(u32 q_res){
 		  {* p= ' '; p++; * p= i + 0x30; p++;}
 	}
 	* p= 0;
-	return resStrng;
+	return res;
 }
 
 
 sl_status_t aoa_calculate(aoa_libitems_t *aoa_state, aoa_iq_report_t *iq_report, aoa_angle_t *angle)
 {
-	uint32_t quality_result;
-	char *iq_sample_qa_string;
-	sl_status_t ret_val = SL_STATUS_OK;
+	uint32_t quality_result = 0;
+	uint64_t t0;
+	iq_qa_reason_t reason;
+
+	// Hopeless reports never reach the estimator
+	t0 = trace_span_begin(TRACE_SPAN_QA);
+	reason = quality_gate(aoa_state, iq_report);
+	trace_span_end(TRACE_SPAN_QA, t0);
+	if (reason != IQ_QA_PASS) {
+		return SL_STATUS_ABORT;
+	}
+	metrics_inc(METRICS_IQ_REPORTS);
 
 	// Process new IQ samples and calculate Angle of Arrival (azimuth, elevation)
+	t0 = stage_stats_now();
 	enum sl_rtl_error_code ret = aox_process_samples(aoa_state, iq_report,
 			&angle->azimuth, &angle->elevation, &quality_result);
+	iq_qa_count_estimation(stage_stats_now() - t0);
+	return report_result(aoa_state, iq_report, angle, ret, quality_result);
+}
+
+void aoa_calculate_batch(aoa_libitems_t *const *aoa_states, aoa_iq_report_t *const *iq_reports,
+		aoa_angle_t *angles, sl_status_t *results, uint32_t count)
+{
+	uint32_t lanes[SIMD_BATCH_TAGS];
+	uint32_t lane_count = 0;
+
+	for (uint32_t k = 0; k < count; k++) {
+		if (!batch_eligible(aoa_states[k], iq_reports[k])) {
+			// After the reports before it
+			if (lane_count > 0) {
+				calculate_lanes(aoa_states, iq_reports, angles, results, lanes, lane_count);
+				lane_count = 0;
+			}
+			results[k] = aoa_calculate(aoa_states[k], iq_reports[k], &angles[k]);
+			continue;
+		}
+		// A batch is full, or of another geometry, or has the tag already
+		bool full = (lane_count == SIMD_BATCH_TAGS)
+				|| ((lane_count > 0) && !same_batch(aoa_states[lanes[0]], aoa_states[k]));
+		for (uint32_t t = 0; (t < lane_count) && !full; t++) {
+			full = (aoa_states[lanes[t]] == aoa_states[k]);
+		}
+		if (full) {
+			calculate_lanes(aoa_states, iq_reports, angles, results, lanes, lane_count);
+			lane_count = 0;
+		}
+		lanes[lane_count++] = k;
+	}
+	if (lane_count > 0) {
+		calculate_lanes(aoa_states, iq_reports, angles, results, lanes, lane_count);
+	}
+}
+
+/*
+ * Outcome of the estimator for a report: the distance, the tracking filter
+ * and the log of an angle, the counters either way.
+ */
+static sl_status_t report_result(aoa_libitems_t *aoa_state,
+		aoa_iq_report_t *iq_report,
+		aoa_angle_t *angle,
+		enum sl_rtl_error_code ret,
+		uint32_t quality_result)
+{
+	char *iq_sample_qa_string;
+	char qa_res[QA_RES_LENGTH];
+	sl_status_t ret_val = SL_STATUS_OK;
+	uint64_t t0;
+
 	// sl_rtl_aox_process will return SL_RTL_ERROR_ESTIMATION_IN_PROGRESS until it has received enough packets for angle estimation
 	if (ret == SL_RTL_ERROR_SUCCESS) {
+		metrics_inc(METRICS_ESTIMATES_OK);
 		// Check the IQ sample quality result and present a short string according to it
 		if (quality_result == 0) {
 			iq_sample_qa_string = "Good                                   ";
@@ -173,29 +279,113 @@ sl_status_t aoa_calculate(aoa_libitems_t *aoa_state, aoa_iq_report_t *iq_report,
 			iq_sample_qa_string = "Caution (other)                        ";
 		}
 		// Calculate distance from RSSI, and calculate a rough position estimation
+		t0 = trace_span_begin(TRACE_SPAN_DISTANCE);
 		sl_rtl_util_rssi2distance(TAG_TX_POWER, iq_report->rssi / 1.0,
 				&angle->distance);
 		sl_rtl_util_filter(&aoa_state->util_libitem, angle->distance,
 				&angle->distance);
+		trace_span_end(TRACE_SPAN_DISTANCE, t0);
+
+		// Tracking filter of the angle, outliers are gated
+		if (angle_tracker_enabled(&aoa_state->tracker)) {
+			switch (angle_tracker_update(&aoa_state->tracker, report_time_ns(aoa_state), angle)) {
+			case ANGLE_TRACKER_ACCEPTED:
+				metrics_inc(METRICS_TRACK_ACCEPTED);
+				break;
+			case ANGLE_TRACKER_GATED:
+				metrics_inc(METRICS_TRACK_GATED);
+				log_debug("Angle gated, tracked azimuth %6.1f\n", angle->azimuth);
+				break;
+			default:
+				metrics_inc(METRICS_TRACK_RESTARTED);
+				break;
+			}
+		}
 
 //    app_log("azimuth: %6.1f  elevation: %6.1f  rssi: %6.0f  ch: %2d  Sequence: %5d    Distance: %6.3f  IQ sample Quality: %s quality_result %i\n",
 //            angle->azimuth, angle->elevation, iq_report->rssi / 1.0, iq_report->channel, iq_report->event_counter, angle->distance, iq_sample_qa_string, quality_result);
-		app_log(
+		log_info(
 				"azimuth: %6.1f  rssi: %6.0f  ch: %2d   IQ sample Quality: %s (%s )\n",
 				angle->azimuth, iq_report->rssi / 1.0, iq_report->channel,
-				iq_sample_qa_string, parse_qa_res(quality_result));
+				iq_sample_qa_string, parse_qa_res(quality_result, qa_res));
 		angle->rssi = iq_report->rssi;
 		angle->channel = iq_report->channel;
 		angle->sequence = iq_report->event_counter;
 	} else {
+		metrics_inc((ret == SL_RTL_ERROR_ESTIMATION_IN_PROGRESS)
+				? METRICS_ESTIMATES_IN_PROGRESS : METRICS_ESTIMATES_FAILED);
 
-		app_log("Failed to calculate angle. (%d) \n", ret);
+		if (ret == SL_RTL_ERROR_ESTIMATION_IN_PROGRESS) {
+			log_debug("Estimation in progress. (%d) \n", ret);
+		} else {
+			log_warning("Failed to calculate angle. (%d) \n", ret);
+		}
 		ret_val = SL_STATUS_FAIL;
 	}
 
 	return ret_val;
 }
 
+sl_status_t aoa_set_estimator(aoa_libitems_t *aoa_state, enum sl_rtl_aox_mode mode, uint32_t snapshots)
+{
+	if ((snapshots == 0) || (snapshots > aoa_state->array.num_snapshots)) {
+		return SL_STATUS_INVALID_PARAMETER;
+	}
+	if ((mode == aoa_state->aox_mode) && (snapshots == aoa_state->snapshots)) {
+		return SL_STATUS_OK;
+	}
+	aoa_state->aox_mode = mode;
+	aoa_state->snapshots = snapshots;
+	// The library takes both on creation only, the in-tree estimator the
+	// snapshots per report
+	if (!covariance_enabled(&aoa_state->covariance)) {
+		sl_rtl_aox_deinit(&aoa_state->libitem);
+		create_estimator(aoa_state);
+	}
+	log_debug("Estimator %s, %u snapshots\n", aoa_aox_mode_to_string(mode), snapshots);
+	return SL_STATUS_OK;
+}
+
+sl_status_t aoa_predict(aoa_libitems_t *aoa_state, aoa_iq_report_t *iq_report, aoa_angle_t *angle)
+{
+	if (!angle_tracker_predict(&aoa_state->tracker, report_time_ns(aoa_state), angle)) {
+		return SL_STATUS_NOT_FOUND;
+	}
+	metrics_inc(METRICS_TRACK_PREDICTED);
+	// The RSSI of the report is still valid
+	sl_rtl_util_rssi2distance(TAG_TX_POWER, iq_report->rssi / 1.0, &angle->distance);
+	sl_rtl_util_filter(&aoa_state->util_libitem, angle->distance, &angle->distance);
+	angle->rssi = iq_report->rssi;
+	angle->channel = iq_report->channel;
+	angle->sequence = iq_report->event_counter;
+	return SL_STATUS_OK;
+}
+
+const char *aoa_aox_mode_to_string(enum sl_rtl_aox_mode mode)
+{
+	uint32_t index = (uint32_t)mode - SL_RTL_AOX_MODE_ONE_SHOT_BASIC;
+
+	if ((index >= sizeof(Strng_Mode) / sizeof(Strng_Mode[0])) || (Strng_Mode[index][0] == '\0')) {
+		return "unknown";
+	}
+	return Strng_Mode[index];
+}
+
+sl_status_t aoa_aox_mode_from_string(const char *name, enum sl_rtl_aox_mode *mode)
+{
+	size_t prefix = strlen("SL_RTL_AOX_MODE_");
+
+	for (uint32_t index = 0; index < sizeof(Strng_Mode) / sizeof(Strng_Mode[0]); index++) {
+		if ((Strng_Mode[index][0] != '\0')
+				&& ((strcasecmp(name, Strng_Mode[index]) == 0)
+						|| (strcasecmp(name, Strng_Mode[index] + prefix) == 0))) {
+			*mode = (enum sl_rtl_aox_mode)(SL_RTL_AOX_MODE_ONE_SHOT_BASIC + index);
+			return SL_STATUS_OK;
+		}
+	}
+	return SL_STATUS_NOT_FOUND;
+}
+
 
 //void get_qa_detal(sl_rtl_clib_iq_sample_qa_dataset_t** s,
 //		sl_rtl_clib_iq_sample_qa_antenna_data_t **a){
@@ -204,6 +394,76 @@ sl_status_t aoa_calculate(aoa_libitems_t *aoa_state, aoa_iq_report_t *iq_report,
 //}
 
 
+extern bool onLog;
+extern float OneSwitchRotate;
+
+/*
+ * Library estimator of the mode and snapshots of the tag.
+ */
+static void create_estimator(aoa_libitems_t *aoa_state)
+{
+	// Initialize AoX library
+	sl_rtl_aox_init(&aoa_state->libitem);
+	// Set the number of snapshots - how many times the antennas are scanned during one measurement
+	sl_rtl_aox_set_num_snapshots(&aoa_state->libitem, aoa_state->snapshots);
+	// Set the antenna array type
+	sl_rtl_aox_set_array_type(&aoa_state->libitem, aoa_state->array.aox_array_type);
+	// Select mode (high speed/high accuracy/etc.)
+	sl_rtl_aox_set_mode(&aoa_state->libitem, aoa_state->aox_mode);
+	// Enable IQ sample quality analysis processing
+	sl_rtl_aox_iq_sample_qa_configure(&aoa_state->libitem);
+	// Add azimuth constraint if min and max values are valid
+	if (!isnan(aoa_azimuth_min) && !isnan(aoa_azimuth_max)) {
+		sl_rtl_aox_add_constraint(&aoa_state->libitem, SL_RTL_AOX_CONSTRAINT_TYPE_AZIMUTH, aoa_azimuth_min, aoa_azimuth_max);
+	}
+	// Create AoX estimator
+	sl_rtl_aox_create_estimator(&aoa_state->libitem);
+}
+
+/*
+ * Runs the in-tree IQ sample QA on the report and counts the outcome.
+ * The analysis is shared with the CSV log, so it is done exactly while logging.
+ */
+static iq_qa_reason_t quality_gate(aoa_libitems_t *aoa_state, aoa_iq_report_t *iq_report)
+{
+	iq_qa_reason_t reason;
+	iq_qa_metrics_t metrics;
+	uint64_t t0;
+
+	if (!iq_qa_config.enabled) {
+		return IQ_QA_PASS;
+	}
+	t0 = stage_stats_now();
+	reason = iq_qa_check_length(iq_report, aoa_array_report_length(&aoa_state->array));
+	if (reason == IQ_QA_PASS) {
+		const iq_analytics_t *a = iq_analytics_update(&aoa_state->analytics, iq_report, OneSwitchRotate,
+				onLog ? IQ_ANALYTICS_EXACT : IQ_ANALYTICS_FAST);
+		reason = iq_qa_check(a, &iq_qa_config, &metrics);
+	}
+	iq_qa_count(reason, stage_stats_now() - t0);
+
+	if (reason != IQ_QA_PASS) {
+		log_warning("IQ report rejected (%s): ch %d  rssi %d  length %d\n",
+				iq_qa_reason_to_string(reason), iq_report->channel, iq_report->rssi, iq_report->length);
+	}
+	return reason;
+}
+
+/*
+ * Time of the report in progress for the tracking filter: set by the caller,
+ * else its receipt, else now.
+ */
+static uint64_t report_time_ns(aoa_libitems_t *aoa_state)
+{
+	if (aoa_state->report_time_ns != 0) {
+		return aoa_state->report_time_ns;
+	}
+	if (aoa_state->stage_stats.stamp[STAGE_STATS_RECEIVED] != 0) {
+		return aoa_state->stage_stats.stamp[STAGE_STATS_RECEIVED];
+	}
+	return stage_stats_now();
+}
+
 float REFERENCE_SAMPL_RATE = 1.0;  //us
 
 static enum sl_rtl_error_code aox_process_samples(aoa_libitems_t *aoa_state,
@@ -213,33 +473,59 @@ static enum sl_rtl_error_code aox_process_samples(aoa_libitems_t *aoa_state,
 		uint32_t *qa_result)
 {
   float phase_rotation;
-float fr = calc_frequency_from_channel(iq_report->channel);
+  uint64_t span;
+float fr = aoa_channel_frequency(iq_report->channel);
+
+  // The library QA is not queried, the in-tree gate ran before (quality_gate)
+  *qa_result = 0;
+
+  span = trace_span_begin(TRACE_SPAN_DEINTERLEAVE);
+  if (covariance_enabled(&aoa_state->covariance) && aoa_state->covariance.fixed_point) {
+    covariance_samples_q15(iq_report->samples, iq_report->length, aoa_array_report_length(&aoa_state->array),
+                           aoa_state->i_q15, aoa_state->q_q15);
+    if (onLog) {
+      // The float copy for the sample log only
+      get_samples(aoa_state, iq_report, fr);
+    }
+  } else {
+    get_samples(aoa_state, iq_report,fr);
+  }
+  trace_span_end(TRACE_SPAN_DEINTERLEAVE, span);
+  stage_stats_mark(&aoa_state->stage_stats, STAGE_STATS_SAMPLES);
 
-  get_samples(iq_report,fr);
+  if (covariance_enabled(&aoa_state->covariance)) {
+    return covariance_process_samples(aoa_state, iq_report, fr, azimuth, elevation);
+  }
 
   // Calculate phase rotation from reference IQ samples
+  span = trace_span_begin(TRACE_SPAN_ROTATION);
  enum sl_rtl_error_code e = sl_rtl_aox_calculate_iq_sample_phase_rotation(&aoa_state->libitem,
 		 REFERENCE_SAMPL_RATE,
-		  ref_i_samples[0],
-		  ref_q_samples[0],
-		  AOA_REF_PERIOD_SAMPLES,
+		  aoa_state->ref_i_samples[0],
+		  aoa_state->ref_q_samples[0],
+		  aoa_state->array.ref_period_samples,
 		  &phase_rotation);
 
-	app_log("Phase rotation on ref period:  %.1f - err: (%i) \n", phase_rotation,e);
+	log_debug("Phase rotation on ref period:  %.1f - err: (%i) \n", phase_rotation,e);
 
 
   // Provide calculated phase rotation to the estimator
   e =sl_rtl_aox_set_iq_sample_phase_rotation(&aoa_state->libitem, phase_rotation);
-	app_log("Set Phase rotation.. - err: (%i) \n", e);
-	app_log("Channel freq : %0.1f MHz\n Estimate AOA..\n", fr/1000000.0);
+  trace_span_end(TRACE_SPAN_ROTATION, span);
+  stage_stats_mark(&aoa_state->stage_stats, STAGE_STATS_ROTATION);
+	log_debug("Set Phase rotation.. - err: (%i) \n", e);
+	log_debug("Channel freq : %0.1f MHz\n Estimate AOA..\n", fr/1000000.0);
 
   // Estimate Angle of Arrival / Angle of Departure from IQ samples
+  span = trace_span_begin(TRACE_SPAN_ESTIMATE);
   enum sl_rtl_error_code ret = sl_rtl_aox_process(&aoa_state->libitem,
-		  i_samples,
-		  q_samples,
+		  aoa_state->i_samples,
+		  aoa_state->q_samples,
 		  fr,
 		  azimuth,
 		  elevation);
+  trace_span_end(TRACE_SPAN_ESTIMATE, span);
+  stage_stats_mark(&aoa_state->stage_stats, STAGE_STATS_ESTIMATED);
 
   // fetch the quality results
 //  *qa_result = sl_rtl_aox_iq_sample_qa_get_results(&aoa_state->libitem);
@@ -260,7 +546,264 @@ float fr = calc_frequency_from_channel(iq_report->channel);
   return ret;
 }
 
-static float calc_frequency_from_channel(uint8_t channel)
+extern float SAMPLING_RATE;
+
+/*
+ * In-tree estimator: the report updates the covariance window of its
+ * channel, the angle is the peak of the spectrum of the window with the
+ * steering table of the band of fr. In fixed point from the Q15 samples of
+ * covariance_samples_q15(). With joint reports, every covariance_joint_reports
+ * report gives the angle of the windows of the recent channels instead.
+ */
+static enum sl_rtl_error_code covariance_process_samples(aoa_libitems_t *aoa_state,
+		aoa_iq_report_t *iq_report,
+		float fr,
+		float *azimuth,
+		float *elevation)
+{
+	const uint32_t ref = aoa_state->array.ref_period_samples;
+	const bool fixed_point = aoa_state->covariance.fixed_point;
+	const spectrum_table_t *table = aoa_state->spectrum[spectrum_band(fr)];
+	int16_t matrix[2 * AOA_ARRAY_MAX_ELEMENTS * AOA_ARRAY_MAX_ELEMENTS];
+	const float *covariance;
+	float slot_rotation;
+	uint32_t reports = 0;
+	uint64_t span;
+	sl_status_t sc;
+
+	span = trace_span_begin(TRACE_SPAN_ROTATION);
+	if (fixed_point) {
+		slot_rotation = spectrum_slot_rotation_q15(aoa_state->i_q15, aoa_state->q_q15, ref,
+				SAMPLING_RATE / REFERENCE_SAMPL_RATE);
+		sc = covariance_update_q15(&aoa_state->covariance, iq_report->channel,
+				&aoa_state->i_q15[ref], &aoa_state->q_q15[ref], aoa_state->snapshots,
+				slot_rotation, report_time_ns(aoa_state));
+	} else {
+		slot_rotation = spectrum_slot_rotation(aoa_state->ref_i_samples[0], aoa_state->ref_q_samples[0],
+				ref, SAMPLING_RATE / REFERENCE_SAMPL_RATE);
+		sc = covariance_update(&aoa_state->covariance, iq_report->channel,
+				aoa_state->i_samples, aoa_state->q_samples, aoa_state->snapshots,
+				slot_rotation, report_time_ns(aoa_state));
+	}
+	trace_span_end(TRACE_SPAN_ROTATION, span);
+	stage_stats_mark(&aoa_state->stage_stats, STAGE_STATS_ROTATION);
+	if (sc != SL_STATUS_OK) {
+		log_warning("Covariance update failed: ch %d (0x%04x)\n", iq_report->channel, (int)sc);
+		return SL_RTL_ERROR_ARGUMENT;
+	}
+
+	if (covariance_joint_reports > 1) {
+		if (++aoa_state->joint_pending < covariance_joint_reports) {
+			stage_stats_mark(&aoa_state->stage_stats, STAGE_STATS_ESTIMATED);
+			return SL_RTL_ERROR_ESTIMATION_IN_PROGRESS;
+		}
+		aoa_state->joint_pending = 0;
+		span = trace_span_begin(TRACE_SPAN_ESTIMATE);
+		sc = covariance_estimate_joint(aoa_state, azimuth, elevation, &reports);
+	} else {
+		span = trace_span_begin(TRACE_SPAN_ESTIMATE);
+		if (fixed_point) {
+			sc = covariance_get_q15(&aoa_state->covariance, iq_report->channel, matrix, &reports);
+			if (sc == SL_STATUS_OK) {
+				sc = spectrum_estimate_q15(table, &aoa_state->search, matrix, azimuth, elevation);
+			}
+		} else {
+			covariance = covariance_get(&aoa_state->covariance, iq_report->channel, &reports);
+			sc = spectrum_estimate(table, &aoa_state->search, covariance, azimuth, elevation);
+		}
+	}
+	trace_span_end(TRACE_SPAN_ESTIMATE, span);
+	stage_stats_mark(&aoa_state->stage_stats, STAGE_STATS_ESTIMATED);
+	log_debug("Covariance of %u reports, slot rotation %.2f rad, %u spectrum points\n",
+			reports, slot_rotation, aoa_state->search.points);
+
+	return (sc == SL_STATUS_OK) ? SL_RTL_ERROR_SUCCESS : SL_RTL_ERROR_INCORRECT_MEASUREMENT;
+}
+
+/*
+ * Joint estimate over the windows of the covariance_joint_reports channels
+ * updated last, each with the table of its band. The float window sums are
+ * weighed by their reports, so every channel counts the same as the Q15
+ * means do.
+ */
+static sl_status_t covariance_estimate_joint(aoa_libitems_t *aoa_state, float *azimuth, float *elevation,
+		uint32_t *reports)
+{
+	int16_t matrices[SPECTRUM_MAX_JOINT][2 * AOA_ARRAY_MAX_ELEMENTS * AOA_ARRAY_MAX_ELEMENTS];
+	const spectrum_table_t *tables[SPECTRUM_MAX_JOINT];
+	const float *covariances[SPECTRUM_MAX_JOINT];
+	const int16_t *covariances_q15[SPECTRUM_MAX_JOINT];
+	float weights[SPECTRUM_MAX_JOINT];
+	uint8_t channels[SPECTRUM_MAX_JOINT];
+	uint32_t count, max = covariance_joint_reports;
+	sl_status_t sc = SL_STATUS_OK;
+
+	count = covariance_recent_channels(&aoa_state->covariance, report_time_ns(aoa_state), channels,
+			(max < SPECTRUM_MAX_JOINT) ? max : SPECTRUM_MAX_JOINT);
+	*reports = 0;
+	for (uint32_t k = 0; (k < count) && (sc == SL_STATUS_OK); k++) {
+		uint32_t window = 0;
+		tables[k] = aoa_state->spectrum[spectrum_band(aoa_channel_frequency(channels[k]))];
+		if (aoa_state->covariance.fixed_point) {
+			sc = covariance_get_q15(&aoa_state->covariance, channels[k], matrices[k], &window);
+			covariances_q15[k] = matrices[k];
+		} else {
+			covariances[k] = covariance_get(&aoa_state->covariance, channels[k], &window);
+			weights[k] = 1.0f / window;
+		}
+		*reports += window;
+	}
+	if (sc != SL_STATUS_OK) {
+		return sc;
+	}
+	if (aoa_state->covariance.fixed_point) {
+		return spectrum_estimate_joint_q15(tables, &aoa_state->search, covariances_q15, count, azimuth, elevation);
+	}
+	return spectrum_estimate_joint(tables, &aoa_state->search, covariances, weights, count, azimuth, elevation);
+}
+
+/*
+ * Reports of the batch path: the fixed-point estimator of a report per
+ * angle, complete, not logged, of an array with fewer slots than the lanes
+ * (a 4x4 URA report fills them alone and gains nothing). The others go
+ * through aoa_calculate().
+ */
+static bool batch_eligible(aoa_libitems_t *aoa_state, aoa_iq_report_t *iq_report)
+{
+	return (aoa_state->array.num_array_elements < SIMD_BATCH_TAGS)
+			&& covariance_enabled(&aoa_state->covariance) && aoa_state->covariance.fixed_point
+			&& (covariance_joint_reports <= 1) && !onLog
+			&& (iq_report->length >= aoa_array_report_length(&aoa_state->array));
+}
+
+static bool same_batch(aoa_libitems_t *a, aoa_libitems_t *b)
+{
+	return (a->array.num_array_elements == b->array.num_array_elements)
+			&& (a->array.ref_period_samples == b->array.ref_period_samples)
+			&& (aoa_array_report_length(&a->array) == aoa_array_report_length(&b->array))
+			&& (a->snapshots == b->snapshots);
+}
+
+/*
+ * aoa_calculate() of the reports of up to SIMD_BATCH_TAGS tags of one
+ * geometry, a tag per lane of the batch kernels: the samples of all are
+ * deinterleaved, rotated and summed into their covariance windows at once,
+ * the coarse passes of their spectra evaluated at once. Each report gets
+ * the result it gets alone; the estimation time is shared out evenly.
+ */
+static void calculate_lanes(aoa_libitems_t *const *aoa_states,
+		aoa_iq_report_t *const *iq_reports,
+		aoa_angle_t *angles,
+		sl_status_t *results,
+		const uint32_t *lanes,
+		uint32_t count)
+{
+	int16_t i_planes[AOA_ARRAY_MAX_REPORT_LENGTH / 2 * SIMD_BATCH_TAGS];
+	int16_t q_planes[AOA_ARRAY_MAX_REPORT_LENGTH / 2 * SIMD_BATCH_TAGS];
+	int16_t matrices[SIMD_BATCH_TAGS][2 * AOA_ARRAY_MAX_ELEMENTS * AOA_ARRAY_MAX_ELEMENTS];
+	const aoa_libitems_t *first = aoa_states[lanes[0]];
+	const uint32_t ref = first->array.ref_period_samples;
+	uint32_t passed[SIMD_BATCH_TAGS];
+	const int8_t *samples[SIMD_BATCH_TAGS];
+	covariance_t *covariances[SIMD_BATCH_TAGS];
+	uint8_t channels[SIMD_BATCH_TAGS];
+	float slot_rotations[SIMD_BATCH_TAGS];
+	uint64_t times[SIMD_BATCH_TAGS];
+	sl_status_t updated[SIMD_BATCH_TAGS];
+	const spectrum_table_t *tables[SIMD_BATCH_TAGS];
+	spectrum_search_t *searches[SIMD_BATCH_TAGS];
+	const int16_t *estimated[SIMD_BATCH_TAGS];
+	uint32_t estimated_lane[SIMD_BATCH_TAGS];
+	float azimuth[SIMD_BATCH_TAGS], elevation[SIMD_BATCH_TAGS];
+	sl_status_t estimates[SIMD_BATCH_TAGS];
+	enum sl_rtl_error_code ret[SIMD_BATCH_TAGS];
+	uint32_t n = 0, m = 0;
+	uint64_t t0, span, cost;
+	sl_status_t sc;
+
+	// Hopeless reports never reach the estimator
+	for (uint32_t t = 0; t < count; t++) {
+		const uint32_t k = lanes[t];
+		span = trace_span_begin(TRACE_SPAN_QA);
+		iq_qa_reason_t reason = quality_gate(aoa_states[k], iq_reports[k]);
+		trace_span_end(TRACE_SPAN_QA, span);
+		if (reason != IQ_QA_PASS) {
+			results[k] = SL_STATUS_ABORT;
+			continue;
+		}
+		metrics_inc(METRICS_IQ_REPORTS);
+		samples[n] = iq_reports[k]->samples;
+		passed[n++] = k;
+	}
+	if (n == 0) {
+		return;
+	}
+
+	t0 = stage_stats_now();
+	span = trace_span_begin(TRACE_SPAN_DEINTERLEAVE);
+	simd_kernels->deinterleave_batch_q15(samples, i_planes, q_planes, aoa_array_report_length(&first->array) / 2, n);
+	trace_span_end(TRACE_SPAN_DEINTERLEAVE, span);
+
+	span = trace_span_begin(TRACE_SPAN_ROTATION);
+	for (uint32_t t = 0; t < n; t++) {
+		aoa_libitems_t *aoa_state = aoa_states[passed[t]];
+		int16_t ref_i[AOA_ARRAY_MAX_REPORT_LENGTH / 2], ref_q[AOA_ARRAY_MAX_REPORT_LENGTH / 2];
+		stage_stats_mark(&aoa_state->stage_stats, STAGE_STATS_SAMPLES);
+		for (uint32_t k = 0; k < ref; k++) {
+			ref_i[k] = i_planes[k * SIMD_BATCH_TAGS + t];
+			ref_q[k] = q_planes[k * SIMD_BATCH_TAGS + t];
+		}
+		slot_rotations[t] = spectrum_slot_rotation_q15(ref_i, ref_q, ref, SAMPLING_RATE / REFERENCE_SAMPL_RATE);
+		covariances[t] = &aoa_state->covariance;
+		channels[t] = iq_reports[passed[t]]->channel;
+		times[t] = report_time_ns(aoa_state);
+	}
+	sc = covariance_update_batch_q15(covariances, channels, &i_planes[ref * SIMD_BATCH_TAGS],
+			&q_planes[ref * SIMD_BATCH_TAGS], first->snapshots, slot_rotations, times, updated, n);
+	trace_span_end(TRACE_SPAN_ROTATION, span);
+
+	span = trace_span_begin(TRACE_SPAN_ESTIMATE);
+	for (uint32_t t = 0; t < n; t++) {
+		aoa_libitems_t *aoa_state = aoa_states[passed[t]];
+		uint32_t reports;
+		stage_stats_mark(&aoa_state->stage_stats, STAGE_STATS_ROTATION);
+		if (sc != SL_STATUS_OK) {
+			updated[t] = sc;
+		}
+		if (updated[t] != SL_STATUS_OK) {
+			log_warning("Covariance update failed: ch %d (0x%04x)\n", channels[t], (int)updated[t]);
+			ret[t] = SL_RTL_ERROR_ARGUMENT;
+			continue;
+		}
+		ret[t] = SL_RTL_ERROR_INCORRECT_MEASUREMENT;
+		if (covariance_get_q15(&aoa_state->covariance, channels[t], matrices[m], &reports) == SL_STATUS_OK) {
+			tables[m] = aoa_state->spectrum[spectrum_band(aoa_channel_frequency(channels[t]))];
+			searches[m] = &aoa_state->search;
+			estimated[m] = matrices[m];
+			estimated_lane[m++] = t;
+		}
+	}
+	spectrum_estimate_batch_q15(tables, searches, estimated, m, azimuth, elevation, estimates);
+	for (uint32_t e = 0; e < m; e++) {
+		const uint32_t t = estimated_lane[e];
+		angles[passed[t]].azimuth = azimuth[e];
+		angles[passed[t]].elevation = elevation[e];
+		if (estimates[e] == SL_STATUS_OK) {
+			ret[t] = SL_RTL_ERROR_SUCCESS;
+		}
+	}
+	trace_span_end(TRACE_SPAN_ESTIMATE, span);
+
+	cost = (stage_stats_now() - t0) / n;
+	for (uint32_t t = 0; t < n; t++) {
+		const uint32_t k = passed[t];
+		stage_stats_mark(&aoa_states[k]->stage_stats, STAGE_STATS_ESTIMATED);
+		iq_qa_count_estimation(cost);
+		results[k] = report_result(aoa_states[k], iq_reports[k], &angles[k], ret[t], 0);
+	}
+}
+
+float aoa_channel_frequency(uint8_t channel)
 {
   static const uint8_t logical_to_physical_channel[40] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11,
                                                            13, 14, 15, 16, 17, 18, 19, 20, 21,
@@ -289,6 +832,16 @@ sl_status_t aoa_deinit(aoa_libitems_t *aoa_state)
     retval = SL_STATUS_FAIL;
   }
 
+  free_2D_float_buffer(aoa_state->ref_i_samples, 1);
+  free_2D_float_buffer(aoa_state->ref_q_samples, 1);
+  free_2D_float_buffer(aoa_state->i_samples, aoa_state->array.num_snapshots);
+  free_2D_float_buffer(aoa_state->q_samples, aoa_state->array.num_snapshots);
+  covariance_deinit(&aoa_state->covariance);
+  for (uint32_t b = 0; b < SPECTRUM_BANDS; b++) {
+    spectrum_table_release(aoa_state->spectrum[b]);
+    aoa_state->spectrum[b] = NULL;
+  }
+
   return retval;
 }
 
@@ -308,18 +861,34 @@ static uint32_t allocate_2D_float_buffer(float*** buf, uint32_t rows, uint32_t c
 
   return 1;
 }
-extern FILE *fSampl;
-extern bool onLog;
-extern float SAMPLING_RATE;
+
+static void free_2D_float_buffer(float** buf, uint32_t rows)
+{
+  if (buf == NULL) {
+    return;
+  }
+  for (uint32_t i = 0; i < rows; i++) {
+    free(buf[i]);
+  }
+  free(buf);
+}
+extern log_stream_t sample_stream;
 extern float CTE_FREQ;
-static void get_samples(aoa_iq_report_t *iq_report,float fr)
+static void get_samples(aoa_libitems_t *aoa_state, aoa_iq_report_t *iq_report,float fr)
 {
+  float **ref_i_samples = aoa_state->ref_i_samples;
+  float **ref_q_samples = aoa_state->ref_q_samples;
+  float **i_samples = aoa_state->i_samples;
+  float **q_samples = aoa_state->q_samples;
+
+	log_line_t line = { NULL, 0, 0 };
 
-	if (fSampl  == NULL) {
+	if (sample_stream == LOG_STREAM_INVALID) {
 		if (onLog) {
-			fSampl = fopen("Logs/Sample.csv", "wb");
-			fprintf(fSampl, ";;;****** CREATE SAMPLES IN  get_samples()(aoa.c : 309 file)*****\r\n");
-			fprintf(fSampl,
+			sample_stream = log_writer_open("Logs/Sample.csv");
+			if (log_line_begin(&line, sample_stream, 1024)) {
+			log_line_printf(&line, ";;;****** CREATE SAMPLES IN  get_samples()(aoa.c : 309 file)*****\r\n");
+			log_line_printf(&line,
 					"\r\n===CURRENT SETTINGS=======\r\n \
 				AOX_ARRAY_TYPE;;;%s\r\n \
 				NUM_ARRAY_ELEMENTS;;;%i\r\n \
@@ -329,21 +898,36 @@ static void get_samples(aoa_iq_report_t *iq_report,float fr)
 				SAMPLING_RATE SNAPSHOTS;;;%0.1f;us\r\n \
 				CTE_FREQ;;;%0.1f;kHz\r\n",
 
-					ARR_TYP_STRNG[AOX_ARRAY_TYPE],
-					AOA_NUM_ARRAY_ELEMENTS, Strng_Mode[AOX_MODE - 3],
-					AOA_NUM_SNAPSHOTS, REFERENCE_SAMPL_RATE, SAMPLING_RATE,
+					aoa_array_type_to_string(aoa_state->array.array_type),
+					aoa_state->array.num_array_elements, aoa_aox_mode_to_string(aoa_state->aox_mode),
+					aoa_state->array.num_snapshots, REFERENCE_SAMPL_RATE, SAMPLING_RATE,
 					CTE_FREQ);
-			fprintf(fSampl , "=================================================\r\n\r\n");
+			log_line_printf(&line, "=================================================\r\n\r\n");
+			log_line_end(&line);
+			}
 		}
 	}
 
+  	if((!onLog)&&(sample_stream != LOG_STREAM_INVALID)) {
+			log_writer_close(sample_stream);
+			sample_stream = LOG_STREAM_INVALID;
+  	}
+
+	// Complete report and nothing to log: the copy compiled for the geometry
+	if ((!onLog) && (iq_report->length >= aoa_array_report_length(&aoa_state->array))) {
+		aoa_state->array_kernel.copy_samples(&aoa_state->array, iq_report->samples,
+				ref_i_samples[0], ref_q_samples[0], i_samples, q_samples);
+		return;
+	}
 
 	if(onLog){
-	fprintf(fSampl , "\r\nChannel frq;;;%0.1f;MHz\r\n;;;reference samples;\r\nI;Q\r\n",fr/1000000.0f);
+	// Rendered into the log writer ring, committed once at the end
+	log_line_begin(&line, sample_stream, SAMPLE_LOG_MAX_LEN(&aoa_state->array));
+	log_line_printf(&line, "\r\nChannel frq;;;%0.1f;MHz\r\n;;;reference samples;\r\nI;Q\r\n",fr/1000000.0f);
 	}
   uint32_t index = 0;
   // Write reference IQ samples into the IQ sample buffer (sampled on one antenna)
-  for (uint32_t sample = 0; sample < AOA_REF_PERIOD_SAMPLES; ++sample) {
+  for (uint32_t sample = 0; sample < aoa_state->array.ref_period_samples; ++sample) {
     ref_i_samples[0][sample] = iq_report->samples[index++];// / 127.0;
     if (index == iq_report->length) {
       break;
@@ -354,19 +938,19 @@ static void get_samples(aoa_iq_report_t *iq_report,float fr)
     }
 
 	if(onLog)
-		fprintf(fSampl ,"%i;%i\r\n",(s8)(ref_i_samples[0][sample]),
+		log_line_printf(&line, "%i;%i\r\n",(s8)(ref_i_samples[0][sample]),
 				(s8)(ref_q_samples[0][sample]));
   }
 
 
 	if(onLog)
-		fprintf(fSampl , ";;;snapshots\r\n\r\n");
+		log_line_printf(&line, ";;;snapshots\r\n\r\n");
 
-  index = AOA_REF_PERIOD_SAMPLES * 2;
+  index = aoa_state->array.ref_period_samples * 2;
   // Write antenna IQ samples into the IQ sample buffer (sampled on all antennas)
-  for (uint32_t snapshot = 0; snapshot < AOA_NUM_SNAPSHOTS; ++snapshot) {
+  for (uint32_t snapshot = 0; snapshot < aoa_state->array.num_snapshots; ++snapshot) {
 
-    for (uint32_t antenna = 0; antenna < AOA_NUM_ARRAY_ELEMENTS; ++antenna) {
+    for (uint32_t antenna = 0; antenna < aoa_state->array.num_array_elements; ++antenna) {
       i_samples[snapshot][antenna] = iq_report->samples[index++] ;
       if (index == iq_report->length) {
         break;
@@ -376,22 +960,20 @@ static void get_samples(aoa_iq_report_t *iq_report,float fr)
         break;
       }
 		if(onLog)
-			fprintf(fSampl ,"%i;%i;;;",(s8)(i_samples[snapshot][antenna]),
+			log_line_printf(&line, "%i;%i;;;",(s8)(i_samples[snapshot][antenna]),
 					(s8)(q_samples[snapshot][antenna]));
     }
     if(onLog)
-			fprintf(fSampl ,"\r\n");
+			log_line_printf(&line, "\r\n");
 
     if (index == iq_report->length) {
       break;
     }
   }
-	if(onLog)
-		  fprintf(fSampl, "\r\n============================================\r\n\r\n");
-
-  	if((!onLog)&&(fSampl  != NULL))
-			fclose(fSampl );
-
+	if(onLog) {
+		  log_line_printf(&line, "\r\n============================================\r\n\r\n");
+		  log_line_end(&line);
+	}
 }
 
 //*****************************
@@ -40,6 +40,12 @@ extern "C" {
 #include "sl_bt_api.h"
 #include "sl_rtl_clib_api.h"
 #include "sl_ncp_evt_filter_common.h"
+#include "iq_analytics.h"
+#include "aoa_array.h"
+#include "stage_stats.h"
+#include "angle_tracker.h"
+#include "covariance.h"
+#include "spectrum.h"
 
 /***********************************************************************************************//**
  * \defgroup app Application Code
@@ -73,6 +79,37 @@ extern "C" {
 typedef struct aoa_libitems {
   sl_rtl_aox_libitem libitem;
   sl_rtl_util_libitem util_libitem;
+  // IQ sample buffers handed to the estimator, [snapshot][antenna]
+  float **ref_i_samples;
+  float **ref_q_samples;
+  float **i_samples;
+  float **q_samples;
+  // Geometry the buffers were allocated for, and its sample copy kernel
+  aoa_array_config_t array;
+  aoa_array_kernel_t array_kernel;
+  // Estimator mode the estimator was created with, and the snapshots of a
+  // report it takes, the first ones
+  enum sl_rtl_aox_mode aox_mode;
+  uint32_t snapshots;
+  // Phase/amplitude analysis of the last report
+  iq_analytics_t analytics;
+  // Stage timestamps of the report in progress and the tag's stage counters
+  stage_stats_tag_t stage_stats;
+  // Angle tracking filter, and the time of the report in progress for it if
+  // not the receipt or now, e.g. the capture time in a replay
+  angle_tracker_t tracker;
+  uint64_t report_time_ns;
+  // Covariance window of the in-tree estimator, its steering table per band
+  // and its search of the spectrum; the library estimator runs while the
+  // window is 0. Reports since the last joint estimate.
+  covariance_t covariance;
+  const spectrum_table_t *spectrum[SPECTRUM_BANDS];
+  spectrum_search_t search;
+  uint32_t joint_pending;
+  // The report deinterleaved in Q15 for the fixed-point estimator, the
+  // reference period first
+  int16_t i_q15[AOA_ARRAY_MAX_REPORT_LENGTH / 2];
+  int16_t q_q15[AOA_ARRAY_MAX_REPORT_LENGTH / 2];
 } aoa_libitems_t;
 
 /***************************************************************************************************
@@ -80,15 +117,36 @@ typedef struct aoa_libitems {
  **************************************************************************************************/
 extern float aoa_azimuth_min;
 extern float aoa_azimuth_max;
+// Estimator mode of the estimators created from now on, AOX_MODE by default
+extern enum sl_rtl_aox_mode aoa_aox_mode;
 
 /***************************************************************************************************
  * Function Declarations
  **************************************************************************************************/
 
-void aoa_init_buffers(void);
 void aoa_init(aoa_libitems_t *aoa_state);
 sl_status_t aoa_calculate(aoa_libitems_t *aoa_state, aoa_iq_report_t *iq_report, aoa_angle_t *angle);
+// aoa_calculate() of count reports, iq_reports[k] of the tag aoa_states[k],
+// its angle in angles[k] and its result in results[k]. The reports of the
+// fixed-point covariance estimator (-C ...:q15) are estimated up to
+// SIMD_BATCH_TAGS at once, a tag per SIMD lane; the angles are those of a
+// report at a time, and the reports of a tag in order.
+void aoa_calculate_batch(aoa_libitems_t *const *aoa_states, aoa_iq_report_t *const *iq_reports,
+                         aoa_angle_t *angles, sl_status_t *results, uint32_t count);
+// Angle of the tracking filter at the time of a report the estimator gave no
+// angle for, SL_STATUS_NOT_FOUND without a track.
+sl_status_t aoa_predict(aoa_libitems_t *aoa_state, aoa_iq_report_t *iq_report, aoa_angle_t *angle);
+// Estimator mode and snapshots per report (1..array.num_snapshots) of a tag
+// from its next report on; the library estimator is created anew.
+sl_status_t aoa_set_estimator(aoa_libitems_t *aoa_state, enum sl_rtl_aox_mode mode, uint32_t snapshots);
 sl_status_t aoa_deinit(aoa_libitems_t *aoa_state);
+// Center frequency (Hz) of a BLE channel
+float aoa_channel_frequency(uint8_t channel);
+// Remainder of in over 2xPi, keeps the sign of in
+float restrictRad(float in);
+const char *aoa_aox_mode_to_string(enum sl_rtl_aox_mode mode);
+// Accepts the enum name with or without the SL_RTL_AOX_MODE_ prefix
+sl_status_t aoa_aox_mode_from_string(const char *name, enum sl_rtl_aox_mode *mode);
 
 /** @} (end addtogroup app) */
 /** @} (end addtogroup Application) */
@@ -0,0 +1,263 @@
+/***************************************************************************//**
+ * @file
+ * @brief Antenna array geometry, selected at startup.
+ *
+ * The specialized kernels are the generic loop with the geometry as
+ * constants: the compiler unrolls the antenna loop and drops the bound
+ * checks, which keeps the fixed-geometry throughput of the former build.
+ ******************************************************************************/
+
+#include <string.h>
+
+#include "aoa_array.h"
+#include "app_config.h"
+
+/***************************************************************************************************
+ * Type Definitions
+ **************************************************************************************************/
+
+typedef struct {
+  const char *name;
+  enum sl_rtl_aox_array_type aox_array_type;
+  uint8_t num_snapshots;
+  uint8_t num_array_elements;
+  uint8_t ref_period_samples;
+  uint8_t switching_pattern[AOA_ARRAY_MAX_PATTERN];
+  uint8_t columns;
+} array_defaults_t;
+
+typedef struct {
+  uint8_t num_snapshots;
+  uint8_t num_array_elements;
+  uint8_t ref_period_samples;
+  aoa_array_kernel_t kernel;
+} specialized_kernel_t;
+
+/***************************************************************************************************
+ * Static Function Declarations
+ **************************************************************************************************/
+
+static void copy_samples_generic(const aoa_array_config_t *config,
+                                 const int8_t *samples,
+                                 float *ref_i_samples,
+                                 float *ref_q_samples,
+                                 float **i_samples,
+                                 float **q_samples);
+
+// One kernel per geometry, the shared body gets the geometry as constants.
+#define DEFINE_COPY_SAMPLES(name, snapshots, elements, ref)                     \
+  static void name(const aoa_array_config_t *config,                            \
+                   const int8_t *samples,                                       \
+                   float *ref_i_samples,                                        \
+                   float *ref_q_samples,                                        \
+                   float **i_samples,                                           \
+                   float **q_samples)                                           \
+  {                                                                             \
+    (void)config;                                                               \
+    copy_samples(samples, ref_i_samples, ref_q_samples, i_samples, q_samples,   \
+                 snapshots, elements, ref);                                     \
+  }
+
+static inline __attribute__((always_inline))
+void copy_samples(const int8_t *samples,
+                  float *ref_i_samples,
+                  float *ref_q_samples,
+                  float **i_samples,
+                  float **q_samples,
+                  uint32_t num_snapshots,
+                  uint32_t num_array_elements,
+                  uint32_t ref_period_samples)
+{
+  for (uint32_t sample = 0; sample < ref_period_samples; ++sample) {
+    ref_i_samples[sample] = samples[2 * sample];
+    ref_q_samples[sample] = samples[2 * sample + 1];
+  }
+  samples += 2 * ref_period_samples;
+  for (uint32_t snapshot = 0; snapshot < num_snapshots; ++snapshot) {
+    float *i_row = i_samples[snapshot];
+    float *q_row = q_samples[snapshot];
+    for (uint32_t antenna = 0; antenna < num_array_elements; ++antenna) {
+      i_row[antenna] = samples[2 * antenna];
+      q_row[antenna] = samples[2 * antenna + 1];
+    }
+    samples += 2 * num_array_elements;
+  }
+}
+
+DEFINE_COPY_SAMPLES(copy_samples_4x4_ura,
+                    ARRAY_4x4_URA_NUM_SNAPSHOTS,
+                    ARRAY_4x4_URA_NUM_ARRAY_ELEMENTS,
+                    ARRAY_4x4_URA_REF_PERIOD_SAMPLES)
+DEFINE_COPY_SAMPLES(copy_samples_3x3_ura,
+                    ARRAY_3x3_URA_NUM_SNAPSHOTS,
+                    ARRAY_3x3_URA_NUM_ARRAY_ELEMENTS,
+                    ARRAY_3x3_URA_REF_PERIOD_SAMPLES)
+DEFINE_COPY_SAMPLES(copy_samples_1x4_ula,
+                    ARRAY_1x4_ULA_NUM_SNAPSHOTS,
+                    ARRAY_1x4_ULA_NUM_ARRAY_ELEMENTS,
+                    ARRAY_1x4_ULA_REF_PERIOD_SAMPLES)
+
+/***************************************************************************************************
+ * Static Variables
+ **************************************************************************************************/
+
+// Indexed by ARRAY_TYPE_*
+static const array_defaults_t array_defaults[] = {
+  [ARRAY_TYPE_4x4_URA] = {
+    "ARRAY_TYPE_4x4_URA", SL_RTL_AOX_ARRAY_TYPE_4x4_URA,
+    ARRAY_4x4_URA_NUM_SNAPSHOTS, ARRAY_4x4_URA_NUM_ARRAY_ELEMENTS,
+    ARRAY_4x4_URA_REF_PERIOD_SAMPLES, ARRAY_4x4_URA_SWITCHING_PATTERN, ARRAY_4x4_URA_COLUMNS
+  },
+  [ARRAY_TYPE_3x3_URA] = {
+    "ARRAY_TYPE_3x3_URA", SL_RTL_AOX_ARRAY_TYPE_3x3_URA,
+    ARRAY_3x3_URA_NUM_SNAPSHOTS, ARRAY_3x3_URA_NUM_ARRAY_ELEMENTS,
+    ARRAY_3x3_URA_REF_PERIOD_SAMPLES, ARRAY_3x3_URA_SWITCHING_PATTERN, ARRAY_3x3_URA_COLUMNS
+  },
+  [ARRAY_TYPE_1x4_ULA] = {
+    "ARRAY_TYPE_1x4_ULA", SL_RTL_AOX_ARRAY_TYPE_1x4_ULA,
+    ARRAY_1x4_ULA_NUM_SNAPSHOTS, ARRAY_1x4_ULA_NUM_ARRAY_ELEMENTS,
+    ARRAY_1x4_ULA_REF_PERIOD_SAMPLES, ARRAY_1x4_ULA_SWITCHING_PATTERN, ARRAY_1x4_ULA_COLUMNS
+  }
+};
+
+#define ARRAY_TYPE_COUNT    (sizeof(array_defaults) / sizeof(array_defaults[0]))
+
+static const specialized_kernel_t specialized_kernels[] = {
+  { ARRAY_4x4_URA_NUM_SNAPSHOTS, ARRAY_4x4_URA_NUM_ARRAY_ELEMENTS, ARRAY_4x4_URA_REF_PERIOD_SAMPLES,
+    { "4x4_URA", copy_samples_4x4_ura } },
+  { ARRAY_3x3_URA_NUM_SNAPSHOTS, ARRAY_3x3_URA_NUM_ARRAY_ELEMENTS, ARRAY_3x3_URA_REF_PERIOD_SAMPLES,
+    { "3x3_URA", copy_samples_3x3_ura } },
+  { ARRAY_1x4_ULA_NUM_SNAPSHOTS, ARRAY_1x4_ULA_NUM_ARRAY_ELEMENTS, ARRAY_1x4_ULA_REF_PERIOD_SAMPLES,
+    { "1x4_ULA", copy_samples_1x4_ula } }
+};
+
+/***************************************************************************************************
+ * Public Variables
+ **************************************************************************************************/
+
+aoa_array_config_t aoa_array_config = {
+  .array_type = ARRAY_TYPE,
+  .aox_array_type = AOX_ARRAY_TYPE,
+  .num_snapshots = AOA_NUM_SNAPSHOTS,
+  .num_array_elements = AOA_NUM_ARRAY_ELEMENTS,
+  .ref_period_samples = AOA_REF_PERIOD_SAMPLES,
+  .switching_pattern_length = AOA_NUM_ARRAY_ELEMENTS,
+  .switching_pattern = SWITCHING_PATTERN,
+  .array_columns = AOA_ARRAY_COLUMNS,
+  .element_spacing = ARRAY_ELEMENT_SPACING
+};
+
+/***************************************************************************************************
+ * Public Function Definitions
+ **************************************************************************************************/
+
+sl_status_t aoa_array_set_type(aoa_array_config_t *config, uint8_t array_type)
+{
+  const array_defaults_t *defaults;
+
+  if (array_type >= ARRAY_TYPE_COUNT) {
+    return SL_STATUS_INVALID_PARAMETER;
+  }
+  defaults = &array_defaults[array_type];
+  config->array_type = array_type;
+  config->aox_array_type = defaults->aox_array_type;
+  config->num_snapshots = defaults->num_snapshots;
+  config->num_array_elements = defaults->num_array_elements;
+  config->ref_period_samples = defaults->ref_period_samples;
+  config->switching_pattern_length = defaults->num_array_elements;
+  memcpy(config->switching_pattern, defaults->switching_pattern, sizeof(config->switching_pattern));
+  config->array_columns = defaults->columns;
+  config->element_spacing = ARRAY_ELEMENT_SPACING;
+  return SL_STATUS_OK;
+}
+
+void aoa_array_slot_position(const aoa_array_config_t *config, uint32_t slot, float *x, float *y)
+{
+  uint32_t element = slot;
+  uint32_t columns = (config->array_columns > 0) ? config->array_columns : config->num_array_elements;
+
+  if (config->switching_pattern_length > 0) {
+    element = config->switching_pattern[slot % config->switching_pattern_length];
+  }
+  *x = (float)(element % columns) * config->element_spacing;
+  *y = (float)(element / columns) * config->element_spacing;
+}
+
+sl_status_t aoa_array_type_from_string(const char *name, uint8_t *array_type)
+{
+  static const char prefix[] = "ARRAY_TYPE_";
+
+  if (strncmp(name, prefix, sizeof(prefix) - 1) == 0) {
+    name += sizeof(prefix) - 1;
+  }
+  for (uint8_t t = 0; t < ARRAY_TYPE_COUNT; t++) {
+    if (strcmp(name, array_defaults[t].name + sizeof(prefix) - 1) == 0) {
+      *array_type = t;
+      return SL_STATUS_OK;
+    }
+  }
+  return SL_STATUS_NOT_FOUND;
+}
+
+const char *aoa_array_type_to_string(uint8_t array_type)
+{
+  if (array_type >= ARRAY_TYPE_COUNT) {
+    return "unknown";
+  }
+  return array_defaults[array_type].name;
+}
+
+sl_status_t aoa_array_validate(const aoa_array_config_t *config)
+{
+  if ((config->array_type >= ARRAY_TYPE_COUNT)
+      || (config->num_snapshots == 0)
+      || (config->num_array_elements == 0)
+      || (config->num_array_elements > AOA_ARRAY_MAX_ELEMENTS)
+      || (config->switching_pattern_length != config->num_array_elements)
+      || (config->switching_pattern_length > AOA_ARRAY_MAX_PATTERN)
+      || (aoa_array_report_length(config) > AOA_ARRAY_MAX_REPORT_LENGTH)) {
+    return SL_STATUS_INVALID_PARAMETER;
+  }
+  for (uint32_t slot = 0; slot < config->switching_pattern_length; slot++) {
+    if (config->switching_pattern[slot] >= config->num_array_elements) {
+      return SL_STATUS_INVALID_PARAMETER;
+    }
+  }
+  return SL_STATUS_OK;
+}
+
+uint32_t aoa_array_report_length(const aoa_array_config_t *config)
+{
+  return 2 * (config->ref_period_samples
+              + (uint32_t)config->num_snapshots * config->num_array_elements);
+}
+
+aoa_array_kernel_t aoa_array_get_kernel(const aoa_array_config_t *config)
+{
+  aoa_array_kernel_t generic = { "generic", copy_samples_generic };
+
+  for (uint32_t k = 0; k < sizeof(specialized_kernels) / sizeof(specialized_kernels[0]); k++) {
+    const specialized_kernel_t *s = &specialized_kernels[k];
+    if ((s->num_snapshots == config->num_snapshots)
+        && (s->num_array_elements == config->num_array_elements)
+        && (s->ref_period_samples == config->ref_period_samples)) {
+      return s->kernel;
+    }
+  }
+  return generic;
+}
+
+/***************************************************************************************************
+ * Static Function Definitions
+ **************************************************************************************************/
+
+static void copy_samples_generic(const aoa_array_config_t *config,
+                                 const int8_t *samples,
+                                 float *ref_i_samples,
+                                 float *ref_q_samples,
+                                 float **i_samples,
+                                 float **q_samples)
+{
+  copy_samples(samples, ref_i_samples, ref_q_samples, i_samples, q_samples,
+               config->num_snapshots, config->num_array_elements, config->ref_period_samples);
+}
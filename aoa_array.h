@@ -0,0 +1,111 @@
+/***************************************************************************//**
+ * @file
+ * @brief Antenna array geometry, selected at startup.
+ *
+ * The array type, the number of snapshots, array elements and reference
+ * samples and the switching pattern used to be fixed by app_config.h. They
+ * now live in aoa_array_config, initialized from the app_config.h defaults
+ * and overridden by the "array" object of the locator configuration:
+ *
+ *   "array": {
+ *       "type": "1x4_ULA",              4x4_URA, 3x3_URA or 1x4_ULA
+ *       "num_snapshots": 18,            optional, default of the type
+ *       "num_array_elements": 4,        optional, default of the type
+ *       "ref_period_samples": 7,        optional, default of the type
+ *       "switching_pattern": [0, 1, 2, 3]   optional, default of the type
+ *       "element_spacing": 0.04         optional, m, ARRAY_ELEMENT_SPACING
+ *   }
+ *
+ * The elements lie in rows of array_columns in the xy plane, element e at
+ * (e % columns, e / columns) times the spacing; the switching pattern gives
+ * the element of each antenna slot of a snapshot.
+ *
+ * The copy of the IQ samples into the estimator buffers runs for every
+ * report. aoa_array_get_kernel() returns a version compiled for the geometry
+ * when one exists (the default geometry of each array type), the generic
+ * version otherwise.
+ ******************************************************************************/
+
+#ifndef AOA_ARRAY_H_
+#define AOA_ARRAY_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "sl_status.h"
+#include "sl_rtl_clib_api.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/***************************************************************************************************
+ * Type Definitions
+ **************************************************************************************************/
+
+#define AOA_ARRAY_MAX_ELEMENTS         16
+#define AOA_ARRAY_MAX_PATTERN          16
+// A BGAPI IQ report carries at most 255 samples.
+#define AOA_ARRAY_MAX_REPORT_LENGTH    255
+
+typedef struct {
+  uint8_t array_type;                           // ARRAY_TYPE_* of app_config.h
+  enum sl_rtl_aox_array_type aox_array_type;
+  uint8_t num_snapshots;
+  uint8_t num_array_elements;
+  uint8_t ref_period_samples;
+  uint8_t switching_pattern_length;
+  uint8_t switching_pattern[AOA_ARRAY_MAX_PATTERN];
+  uint8_t array_columns;
+  float element_spacing;                        // m
+} aoa_array_config_t;
+
+// Copies a complete report (aoa_array_report_length() samples) into the
+// reference buffers and the [snapshot][antenna] buffers of the estimator.
+typedef void (*aoa_array_copy_samples_t)(const aoa_array_config_t *config,
+                                         const int8_t *samples,
+                                         float *ref_i_samples,
+                                         float *ref_q_samples,
+                                         float **i_samples,
+                                         float **q_samples);
+
+typedef struct {
+  const char *name;
+  aoa_array_copy_samples_t copy_samples;
+} aoa_array_kernel_t;
+
+/***************************************************************************************************
+ * Public variables
+ **************************************************************************************************/
+
+// Geometry of the running application, set before the first aoa_init().
+extern aoa_array_config_t aoa_array_config;
+
+/***************************************************************************************************
+ * Function Declarations
+ **************************************************************************************************/
+
+// Loads the app_config.h defaults of an array type.
+sl_status_t aoa_array_set_type(aoa_array_config_t *config, uint8_t array_type);
+// Array type from its name, "1x4_ULA" or "ARRAY_TYPE_1x4_ULA".
+sl_status_t aoa_array_type_from_string(const char *name, uint8_t *array_type);
+const char *aoa_array_type_to_string(uint8_t array_type);
+
+// Checks the limits of the sample buffers and of the BGAPI report, and that
+// the switching pattern has an existing element for each antenna slot of a
+// snapshot.
+sl_status_t aoa_array_validate(const aoa_array_config_t *config);
+
+// Number of IQ samples (I and Q each count) of a complete report.
+uint32_t aoa_array_report_length(const aoa_array_config_t *config);
+
+// Position in m of the element sampled in an antenna slot of a snapshot.
+void aoa_array_slot_position(const aoa_array_config_t *config, uint32_t slot, float *x, float *y);
+
+// Sample copy kernel for the geometry.
+aoa_array_kernel_t aoa_array_get_kernel(const aoa_array_config_t *config);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* AOA_ARRAY_H_ */
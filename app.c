@@ -33,13 +33,16 @@
 #include <stdbool.h>
 #include <unistd.h>
 #include <errno.h>
+#include <signal.h>
 #include "system.h"
 #include "sl_bt_api.h"
 #include "sl_bt_ncp_host.h"
 #include "app_log.h"
+#include "log_level.h"
 #include "app_assert.h"
 #include "uart.h"
 #include "app.h"
+#include "app_config.h"
 #include "mqtt.h"
 #include "tcp.h"
 
@@ -49,14 +52,32 @@
 #include "aoa_parse.h"
 #include "aoa_util.h"
 #include "log2CSV.h"
-
-#define USAGE "\nUsage: %s -t <wstk_address> | -u <serial_port> [-b <baud_rate>] [-f <flow control: 1(on, default) or 0(off)>] [-m <mqtt_address>[:<port>]] [-c <config>] [-v <verbose_level>]\n"
+#include "iq_capture.h"
+#include "app_signal.h"
+#include "log_writer.h"
+#include "iq_qa.h"
+#include "simd_kernels.h"
+#include "stage_stats.h"
+#include "metrics.h"
+#include "metrics_server.h"
+#include "trace.h"
+#include "admission.h"
+#include "governor.h"
+#include "mailbox.h"
+#include "scheduler.h"
+#include "position.h"
+#include "aoa_serdes.h"
+#include "cJSON.h"
+
+#define USAGE "\nUsage: %s -t <wstk_address> | -u <serial_port> [-b <baud_rate>] [-f <flow control: 1(on, default) or 0(off)>] [-m <mqtt_address>[:<port>]] [-c <config>] [-v <verbose_level>] [-w <capture_file>] [-l <reports to csv, -1: continuous>] [-s <stage stats interval s>[:<1 in N reports>]] [-e <metrics endpoint: [address:]port | unix:path>] [-T <trace 1 in N reports>[:<trace file>]] [-a <report load %%, 0: admit all>] [-k <newest reports kept per tag>] [-M <estimator mode>] [-F <angle motion deg/s^2>[:<noise deg>]] [-P <positioning config>] [-C <covariance window>[:<max age s>[:q15|float]]] [-J <reports per joint estimate>] [-G <estimation load %%, 0: mode of the build>] [-S <scheduler budget us per cycle, 0: in turn>] [-B <reports estimated at once across the tags>]\n"
 #define DEFAULT_UART_PORT             NULL
 #define DEFAULT_UART_BAUD_RATE        115200
 #define DEFAULT_UART_FLOW_CONTROL     1
 #define DEFAULT_UART_TIMEOUT          100
 #define DEFAULT_TCP_PORT              "4901"
 #define MAX_OPT_LEN                   255
+// AOA_TOPIC_ANGLE_SCAN bounded to the length of an aoa_id_t
+#define ANGLE_TOPIC_SCAN              "silabs/aoa/angle/%19[^/]/%19[^/]"
 
 
 
@@ -67,6 +88,18 @@ static int serial_port_init(char* uartPort, uint32_t uartBaudRate, uint32_t uart
 static void uart_tx_wrapper(uint32_t len, uint8_t *data);
 static void tcp_tx_wrapper(uint32_t len, uint8_t *data);
 static void parse_config(char *filename);
+static void parse_qa_config(const char *buffer);
+static void parse_array_config(const char *buffer);
+static void parse_position_config(char *filename);
+static void on_mqtt_connect(mqtt_handle_t *handle);
+static void on_angle_message(mqtt_handle_t *handle, const char *topic, const char *payload);
+static void publish_position(const char *tag_id, const aoa_position_t *position);
+static void stage_stats_signal_handler(int sig);
+static void dump_stage_stats(void);
+static void trace_signal_handler(int sig);
+static void export_trace(void);
+static void publish_angle(conn_properties_t *tag, aoa_iq_report_t *iq_report, aoa_angle_t *angle, sl_status_t st,
+                          uint64_t end);
 
 // Locator ID
 static aoa_id_t locator_id;
@@ -78,9 +111,29 @@ static char *mqtt_host = NULL;
 // Verbose output
 uint32_t verbose_level;
 
+// Reports of the tags estimated at once (-B)
+uint32_t app_batch_reports;
+
 static char uart_target_port[MAX_OPT_LEN]; // Serail port name of the NCP target
 static char tcp_target_address[MAX_OPT_LEN]; // IP address or host name of the NCP target using TCP connection
 
+// Binary IQ capture, enabled with -w
+static iq_capture_writer_t iq_capture;
+
+// Stage statistics output: every stage_stats_interval_ns (-s, 0 off) and on SIGUSR1
+static uint64_t stage_stats_interval_ns;
+static uint64_t stage_stats_next_ns;
+static volatile sig_atomic_t stage_stats_requested;
+
+// Chrome trace of the sampled reports (-T), written on SIGUSR2 and on exit
+static const char *trace_file = TRACE_DEFAULT_FILE;
+static volatile sig_atomic_t trace_requested;
+
+// Positioning engine (-P), fed with the angles of all locators from the broker
+static position_engine_t position_engine;
+static bool position_enabled;
+static aoa_id_t positioning_id;
+
 /**************************************************************************//**
  * Application Init.
  *****************************************************************************/
@@ -96,8 +149,16 @@ void app_init(int argc, char *argv[])
 
   aoa_whitelist_init();
 
+  // Log files are written on their own thread, start it before -w opens the capture.
+  if (log_writer_start() != SL_STATUS_OK) {
+    app_log("Failed to start the log writer, logging disabled\n");
+  }
+
+  // Numeric kernels for the instruction set of this CPU
+  app_log("SIMD kernels: %s\n", simd_init()->name);
+
   //Parse command line arguments
-  while ((opt = getopt(argc, argv, "t:u:b:m:f:i:c:v:h:l")) != -1) {
+  while ((opt = getopt(argc, argv, "t:u:b:m:f:i:c:v:hl:w:s:e:T:a:k:M:F:P:C:J:G:S:B:")) != -1) {
     switch (opt) {
       case 'c':
         parse_config(optarg);
@@ -129,10 +190,115 @@ void app_init(int argc, char *argv[])
         break;
       case 'v':
         verbose_level = atol(optarg);
+        log_level_set_verbose(verbose_level);
         break;
       case 'l':
     	  cnt_to_csv = atol(optarg);
 
+        break;
+      case 'w': //Binary IQ capture file
+        if (iq_capture_open(&iq_capture, optarg) != SL_STATUS_OK) {
+          app_log("Failed to open capture file: %s\n", optarg);
+          exit(EXIT_FAILURE);
+        }
+        app_log("Capturing IQ reports to %s\n", optarg);
+        break;
+      case 's': //Stage statistics interval and sample rate
+        port_sep = strchr(optarg, ':');
+        if (port_sep != NULL) {
+          *port_sep = '\0';
+          stage_stats_sample_every = atol(port_sep + 1);
+          if (stage_stats_sample_every == 0) {
+            app_log("Stage statistics of 1 in N reports, N at least 1\n");
+            exit(EXIT_FAILURE);
+          }
+        }
+        stage_stats_interval_ns = (uint64_t)(atof(optarg) * 1e9);
+        stage_stats_next_ns = stage_stats_now() + stage_stats_interval_ns;
+        break;
+      case 'e': //Metrics endpoint
+        if (metrics_server_start(optarg) != SL_STATUS_OK) {
+          app_log("Failed to start the metrics endpoint: %s\n", optarg);
+          exit(EXIT_FAILURE);
+        }
+        app_log("Metrics served on %s\n", optarg);
+        break;
+      case 'T': //Report tracing: sample rate and output file
+        port_sep = strchr(optarg, ':');
+        if (port_sep != NULL) {
+          *port_sep = '\0';
+          trace_file = port_sep + 1;
+        }
+        trace_sample_every = atol(optarg);
+        app_log("Tracing 1 in %u reports to %s\n", trace_sample_every, trace_file);
+        break;
+      case 'a': //Event thread load the admission control aims at
+        admission_target_load = atof(optarg) / 100.0;
+        break;
+      case 'k': //Reports kept per tag while the host is behind
+        mailbox_depth = atol(optarg);
+        if ((mailbox_depth < 1) || (mailbox_depth > MAILBOX_MAX_DEPTH)) {
+          app_log("Reports kept per tag shall be 1 to %d\n", MAILBOX_MAX_DEPTH);
+          exit(EXIT_FAILURE);
+        }
+        break;
+      case 'M': //Estimator mode, e.g. REAL_TIME_BASIC
+        if (aoa_aox_mode_from_string(optarg, &aoa_aox_mode) != SL_STATUS_OK) {
+          app_log("Unknown estimator mode: %s\n", optarg);
+          exit(EXIT_FAILURE);
+        }
+        break;
+      case 'F': //Angle tracking filter: motion and measurement noise
+        port_sep = strchr(optarg, ':');
+        if (port_sep != NULL) {
+          *port_sep = '\0';
+          angle_tracker_noise = atof(port_sep + 1);
+        }
+        angle_tracker_motion = atof(optarg);
+        break;
+      case 'P': //Positioning engine: locator poses
+        parse_position_config(optarg);
+        break;
+      case 'C': //In-tree estimator: covariance window per channel and its max age
+        port_sep = strchr(optarg, ':');
+        if (port_sep != NULL) {
+          *port_sep = '\0';
+          covariance_max_age_s = atof(port_sep + 1);
+          port_sep = strchr(port_sep + 1, ':');
+          if (port_sep != NULL) {
+            // Arithmetic, the default Q15 on ARM
+            covariance_fixed_point = (strcmp(port_sep + 1, "q15") == 0);
+            if (!covariance_fixed_point && (strcmp(port_sep + 1, "float") != 0)) {
+              app_log("Covariance arithmetic q15 or float\n");
+              exit(EXIT_FAILURE);
+            }
+          }
+        }
+        covariance_window = (uint32_t)atol(optarg);
+        if (covariance_window > COVARIANCE_MAX_WINDOW) {
+          app_log("Covariance window above %d reports\n", COVARIANCE_MAX_WINDOW);
+          exit(EXIT_FAILURE);
+        }
+        break;
+      case 'J': //In-tree estimator: reports per joint estimate over the recent channels
+        covariance_joint_reports = (uint32_t)atol(optarg);
+        if (covariance_joint_reports > SPECTRUM_MAX_JOINT) {
+          app_log("Joint estimate above %d reports\n", SPECTRUM_MAX_JOINT);
+          exit(EXIT_FAILURE);
+        }
+        break;
+      case 'G': //Event thread load the estimator governor holds the estimation within
+        governor_budget = atof(optarg) / 100.0;
+        break;
+      case 'S': //Event thread time per cycle of the mailbox scheduler
+        scheduler_budget_ns = (uint64_t)(atof(optarg) * 1000.0);
+        break;
+      case 'B': //Reports of the tags estimated at once, a tag per SIMD lane
+        app_batch_reports = (uint32_t)atol(optarg);
+        if ((app_batch_reports < 2) || (app_batch_reports > AOA_MAX_TAGS)) {
+          app_log("Batch of 2 to %d reports\n", AOA_MAX_TAGS);
+          exit(EXIT_FAILURE);
+        }
         break;
       case 'h': //Help!
         app_log(USAGE, argv[0]);
@@ -143,6 +309,12 @@ void app_init(int argc, char *argv[])
     }
   }
 
+  // The scheduler serves one report at a time
+  if ((app_batch_reports > 1) && (scheduler_budget_ns > 0)) {
+    app_log("Batched estimates (-B) and a scheduler budget (-S) can't be combined\n");
+    exit(EXIT_FAILURE);
+  }
+
   if (uart_target_port[0] != '\0') {
     // Initialise serial communication as non-blocking.
     SL_BT_API_INITIALIZE_NONBLOCK(uart_tx_wrapper, uartRx, uartRxPeek);
@@ -150,6 +322,7 @@ void app_init(int argc, char *argv[])
       app_log("Non-blocking serial port init failure\n");
       exit(EXIT_FAILURE);
     }
+    admission_set_backlog(uartRxPeek);
   } else if (tcp_target_address[0] != '\0') {
     // Initialise socket communication
     SL_BT_API_INITIALIZE_NONBLOCK(tcp_tx_wrapper, tcp_rx, tcp_rx_peek);
@@ -157,21 +330,26 @@ void app_init(int argc, char *argv[])
       app_log("Non-blocking TCP connection init failure\n");
       exit(EXIT_FAILURE);
     }
+    admission_set_backlog(tcp_rx_peek);
   } else {
     app_log("Either uart port or TCP address shall be given.\n");
     app_log(USAGE, argv[0]);
     exit(EXIT_FAILURE);
   }
 
+#ifdef SIGUSR1
+  app_signal(SIGUSR1, stage_stats_signal_handler);
+#endif
+#ifdef SIGUSR2
+  app_signal(SIGUSR2, trace_signal_handler);
+#endif
+
   app_log("AoA NCP-host initialised\n");
   app_log("Resetting NCP...\n");
   // Reset NCP to ensure it gets into a defined state.
   // Once the chip successfully boots, boot event should be received.
   sl_bt_system_reset(0);
 
-  // AoA specific init
-  aoa_init_buffers();
-
   init_connection();
 }
 
@@ -214,7 +392,10 @@ void sl_bt_on_event(sl_bt_msg_t *evt)
 
     // Connect to the MQTT broker
     mqtt_handle.client_id = locator_id;
-    mqtt_handle.on_connect = aoa_on_connect;
+    mqtt_handle.on_connect = on_mqtt_connect;
+    if (position_enabled) {
+      mqtt_handle.on_message = on_angle_message;
+    }
     rc = mqtt_init(&mqtt_handle);
     app_assert(rc == MQTT_SUCCESS, "MQTT init failed.\n");
   }
@@ -228,6 +409,70 @@ void sl_bt_on_event(sl_bt_msg_t *evt)
 void app_process_action(void)
 {
   mqtt_step(&mqtt_handle);
+  if (position_enabled) {
+    position_solve(&position_engine, stage_stats_now(), publish_position);
+  }
+  app_process_pending();
+
+  if (stage_stats_requested
+      || ((stage_stats_interval_ns != 0) && (stage_stats_now() >= stage_stats_next_ns))) {
+    stage_stats_requested = 0;
+    stage_stats_next_ns = stage_stats_now() + stage_stats_interval_ns;
+    dump_stage_stats();
+  }
+  if (trace_requested) {
+    trace_requested = 0;
+    export_trace();
+  }
+}
+
+/**************************************************************************//**
+ * Stage statistics request, the output is written by the main loop.
+ *****************************************************************************/
+static void stage_stats_signal_handler(int sig)
+{
+  (void)sig;
+  stage_stats_requested = 1;
+}
+
+/**************************************************************************//**
+ * Trace export request, the file is written by the main loop.
+ *****************************************************************************/
+static void trace_signal_handler(int sig)
+{
+  (void)sig;
+  trace_requested = 1;
+}
+
+/**************************************************************************//**
+ * Chrome trace of the last sampled reports.
+ *****************************************************************************/
+static void export_trace(void)
+{
+  if (trace_sample_every == 0) {
+    return;
+  }
+  if (trace_export(trace_file) == SL_STATUS_OK) {
+    app_log("Trace written to %s\n", trace_file);
+  } else {
+    app_log("Failed to write the trace to %s\n", trace_file);
+  }
+}
+
+/**************************************************************************//**
+ * Stage latency histograms and the counters of every tag.
+ *****************************************************************************/
+static void dump_stage_stats(void)
+{
+  conn_properties_t *tag;
+  aoa_id_t tag_id;
+
+  stage_stats_dump(stdout);
+  for (uint8_t i = 0; (tag = get_connection_by_index(i)) != NULL; i++) {
+    aoa_address_to_id(tag->address.addr, tag->address_type, tag_id);
+    stage_stats_dump_tag(stdout, tag_id, &tag->aoa_states.stage_stats);
+  }
+  fflush(stdout);
 }
 
 /**************************************************************************//**
@@ -305,22 +550,48 @@ uint8_t find_service_in_advertisement(uint8_t *advdata, uint8_t advlen, uint8_t
   return ret;
 }
 
-FILE *fCsv = NULL;
-FILE *fSampl = NULL;
 void app_deinit(void)
 {
+  log_writer_stats_t stats;
+  iq_qa_counters_t qa;
+
   app_log("Shutting down.\n");
+  dump_stage_stats();
+  export_trace();
+  metrics_server_stop();
   mqtt_deinit(&mqtt_handle);
+  if (position_enabled) {
+    position_deinit(&position_engine);
+  }
   if (uart_target_port[0] != '\0') {
     uartClose();
   } else if (tcp_target_address[0] != '\0') {
     tcp_close();
   }
+  if (iq_capture_is_open(&iq_capture)) {
+    iq_capture_close(&iq_capture);
+  }
+  // Drains the queued log output and closes the log files.
+  log_writer_stop();
+  log_writer_get_stats(&stats);
+  if (stats.messages_dropped > 0) {
+    app_log("Log writer dropped %llu messages (%llu bytes), ring high water %u bytes\n",
+            (unsigned long long)stats.messages_dropped, (unsigned long long)stats.bytes_dropped,
+            stats.ring_high_water);
+  }
+  iq_qa_get_counters(&qa);
+  if (qa.checked > 0) {
+    app_log("IQ sample QA: %llu checked, %llu passed, rejected: truncated %llu, amplitude %llu, sndr %llu, phase jitter %llu, saved %.1f ms\n",
+            (unsigned long long)qa.checked,
+            (unsigned long long)qa.results[IQ_QA_PASS],
+            (unsigned long long)qa.results[IQ_QA_REJECT_LENGTH],
+            (unsigned long long)qa.results[IQ_QA_REJECT_AMPLITUDE],
+            (unsigned long long)qa.results[IQ_QA_REJECT_SNDR],
+            (unsigned long long)qa.results[IQ_QA_REJECT_PHASE_JITTER],
+            iq_qa_saved_ns(&qa) / 1e6);
+  }
   if (mqtt_host != NULL) {
     free(mqtt_host);
-
-	if (fCsv != NULL)
-		fclose(fCsv);
   }
 }
 
@@ -329,12 +600,21 @@ extern   sl_rtl_clib_iq_sample_qa_antenna_data_t qa_antenna;
 void app_on_iq_report(conn_properties_t *tag, aoa_iq_report_t *iq_report)
 {
   aoa_angle_t angle;
-  aoa_id_t tag_id;
-  mqtt_status_t rc;
-  char *payload;
-  const char topic_template[] = AOA_TOPIC_ANGLE_PRINT;
-  char topic[sizeof(topic_template) + sizeof(aoa_id_t) + sizeof(aoa_id_t)];
+  uint64_t start, end;
+
+  if (iq_capture_is_open(&iq_capture)) {
+    iq_capture_write(&iq_capture, &tag->address, tag->address_type,
+                     iq_capture_time_us(), iq_report);
+  }
+
+  start = stage_stats_now();
   sl_status_t st =aoa_calculate(&tag->aoa_states, iq_report, &angle);
+  if (st != SL_STATUS_OK) {
+    // Between the estimates the tracking filter, if any, predicts the angle
+    st = aoa_predict(&tag->aoa_states, iq_report, &angle);
+  }
+  end = stage_stats_now();
+  governor_account(&tag->governor, end, end - start);
 //  if (aoa_calculate(&tag->aoa_states, iq_report, &angle) != SL_STATUS_OK)
   {
 
@@ -352,20 +632,90 @@ void app_on_iq_report(conn_properties_t *tag, aoa_iq_report_t *iq_report)
 
   }
 
-  app_log("===========================\n\n");
-  if(st!= SL_STATUS_OK)  return;
+  log_debug("===========================\n\n");
+  publish_angle(tag, iq_report, &angle, st, end);
+}
+
+void app_on_iq_report_batch(conn_properties_t *const *tags, aoa_iq_report_t *const *iq_reports,
+                            const trace_report_t *traces, uint32_t count)
+{
+  aoa_libitems_t *aoa_states[AOA_MAX_TAGS];
+  aoa_angle_t angles[AOA_MAX_TAGS];
+  sl_status_t results[AOA_MAX_TAGS];
+  uint64_t start, end;
+
+  for (uint32_t k = 0; k < count; k++) {
+    if (iq_capture_is_open(&iq_capture)) {
+      iq_capture_write(&iq_capture, &tags[k]->address, tags[k]->address_type,
+                       iq_capture_time_us(), iq_reports[k]);
+    }
+    aoa_states[k] = &tags[k]->aoa_states;
+  }
+
+  start = stage_stats_now();
+  aoa_calculate_batch(aoa_states, iq_reports, angles, results, count);
+  for (uint32_t k = 0; k < count; k++) {
+    if (results[k] != SL_STATUS_OK) {
+      results[k] = aoa_predict(aoa_states[k], iq_reports[k], &angles[k]);
+    }
+  }
+  end = stage_stats_now();
+
+  // The estimation time shared out evenly
+  for (uint32_t k = 0; k < count; k++) {
+    governor_account(&tags[k]->governor, end, (end - start) / count);
+    // The report followed from here to its end in publish_angle()
+    trace_current = traces[k];
+    if (trace_current.active) {
+      trace_record(TRACE_SPAN_ESTIMATE, start, end);
+    }
+    publish_angle(tags[k], iq_reports[k], &angles[k], results[k], end);
+  }
+}
+
+/**************************************************************************//**
+ * The angle of a report, if any, to the broker.
+ *****************************************************************************/
+static void publish_angle(conn_properties_t *tag, aoa_iq_report_t *iq_report, aoa_angle_t *angle, sl_status_t st,
+                          uint64_t end)
+{
+  aoa_id_t tag_id;
+  mqtt_status_t rc;
+  char *payload;
+  const char topic_template[] = AOA_TOPIC_ANGLE_PRINT;
+  char topic[sizeof(topic_template) + sizeof(aoa_id_t) + sizeof(aoa_id_t)];
+  uint64_t span;
+
+  if(st!= SL_STATUS_OK) {
+    stage_stats_end(&tag->aoa_states.stage_stats, false);
+    trace_report_end();
+    return;
+  }
+  scheduler_published(&tag->scheduler, &tag->aoa_states, angle, end);
 
 
   // Compile topic
+  span = trace_span_begin(TRACE_SPAN_SERIALIZE);
   aoa_address_to_id(tag->address.addr, tag->address_type, tag_id);
   snprintf(topic, sizeof(topic), topic_template, locator_id, tag_id);
 
   // Compile payload
-  aoa_angle_to_string(&angle, &payload);
+  aoa_angle_to_string(angle, &payload);
+  trace_span_end(TRACE_SPAN_SERIALIZE, span);
 
   // Send message
+  span = trace_span_begin(TRACE_SPAN_PUBLISH);
   rc = mqtt_publish(&mqtt_handle, topic, payload);
-  app_assert(rc == MQTT_SUCCESS, "Failed to publish to topic '%s'.\n", topic);
+  trace_span_end(TRACE_SPAN_PUBLISH, span);
+  if (rc == MQTT_SUCCESS) {
+    metrics_inc(METRICS_PUBLISHED);
+  } else {
+    // Counted and dropped, the client reconnects on its own
+    metrics_inc(METRICS_PUBLISH_FAILED);
+    log_warning("Failed to publish to topic '%s'.\n", topic);
+  }
+  stage_stats_end(&tag->aoa_states.stage_stats, rc == MQTT_SUCCESS);
+  trace_report_end();
 
   // Clean up
   free(payload);
@@ -409,5 +759,209 @@ static void parse_config(char *filename)
              "[E: 0x%04x] aoa_parse_deinit failed\n",
              (int)sc);
 
+  parse_qa_config(buffer);
+  parse_array_config(buffer);
+
+  free(buffer);
+}
+
+// Optional "iq_qa" object, thresholds of the IQ sample quality gate.
+static void parse_qa_config(const char *buffer)
+{
+  cJSON *root, *qa, *item;
+
+  root = cJSON_Parse(buffer);
+  if (root == NULL) {
+    return;
+  }
+  qa = cJSON_GetObjectItem(root, "iq_qa");
+  if (cJSON_IsObject(qa)) {
+    item = cJSON_GetObjectItem(qa, "enabled");
+    if (cJSON_IsBool(item)) {
+      iq_qa_config.enabled = cJSON_IsTrue(item);
+    }
+    item = cJSON_GetObjectItem(qa, "min_amplitude");
+    if (cJSON_IsNumber(item)) {
+      iq_qa_config.min_amplitude = (float)item->valuedouble;
+    }
+    item = cJSON_GetObjectItem(qa, "min_ref_sndr_db");
+    if (cJSON_IsNumber(item)) {
+      iq_qa_config.min_ref_sndr_db = (float)item->valuedouble;
+    }
+    item = cJSON_GetObjectItem(qa, "max_phase_jitter_deg");
+    if (cJSON_IsNumber(item)) {
+      iq_qa_config.max_phase_jitter = (float)item->valuedouble / rad2Dg;
+    }
+    app_log("IQ sample QA %s: amplitude >= %.1f, ref SNDR >= %.1f dB, phase jitter <= %.1f deg\n",
+            iq_qa_config.enabled ? "enabled" : "disabled",
+            iq_qa_config.min_amplitude, iq_qa_config.min_ref_sndr_db,
+            iq_qa_config.max_phase_jitter * rad2Dg);
+  }
+  cJSON_Delete(root);
+}
+
+// Optional "array" object, antenna array geometry (see aoa_array.h).
+static void parse_array_config(const char *buffer)
+{
+  cJSON *root, *array, *item;
+  aoa_array_config_t config = aoa_array_config;
+  uint8_t array_type;
+  sl_status_t sc;
+
+  root = cJSON_Parse(buffer);
+  if (root == NULL) {
+    return;
+  }
+  array = cJSON_GetObjectItem(root, "array");
+  if (cJSON_IsObject(array)) {
+    item = cJSON_GetObjectItem(array, "type");
+    if (cJSON_IsString(item)) {
+      sc = aoa_array_type_from_string(item->valuestring, &array_type);
+      app_assert(sc == SL_STATUS_OK, "Unknown array type '%s'\n", item->valuestring);
+      aoa_array_set_type(&config, array_type);
+    }
+    item = cJSON_GetObjectItem(array, "num_snapshots");
+    if (cJSON_IsNumber(item)) {
+      config.num_snapshots = (uint8_t)item->valueint;
+    }
+    item = cJSON_GetObjectItem(array, "num_array_elements");
+    if (cJSON_IsNumber(item)) {
+      config.num_array_elements = (uint8_t)item->valueint;
+      config.switching_pattern_length = config.num_array_elements;
+    }
+    item = cJSON_GetObjectItem(array, "ref_period_samples");
+    if (cJSON_IsNumber(item)) {
+      config.ref_period_samples = (uint8_t)item->valueint;
+    }
+    item = cJSON_GetObjectItem(array, "element_spacing");
+    if (cJSON_IsNumber(item)) {
+      config.element_spacing = (float)item->valuedouble;
+    }
+    item = cJSON_GetObjectItem(array, "switching_pattern");
+    if (cJSON_IsArray(item)) {
+      int length = cJSON_GetArraySize(item);
+      app_assert((length > 0) && (length <= AOA_ARRAY_MAX_PATTERN),
+                 "Switching pattern of %d antennas, 1 to %d supported\n",
+                 length, AOA_ARRAY_MAX_PATTERN);
+      for (int i = 0; i < length; i++) {
+        config.switching_pattern[i] = (uint8_t)cJSON_GetArrayItem(item, i)->valueint;
+      }
+      config.switching_pattern_length = (uint8_t)length;
+    }
+    sc = aoa_array_validate(&config);
+    app_assert(sc == SL_STATUS_OK,
+               "[E: 0x%04x] Invalid array configuration: %u snapshots of %u elements, %u reference samples, "
+               "switching pattern of %u\n", (int)sc, config.num_snapshots, config.num_array_elements,
+               config.ref_period_samples, config.switching_pattern_length);
+    aoa_array_config = config;
+    app_log("Antenna array %s: %u snapshots, %u elements, %u reference samples, sample kernel %s\n",
+            aoa_array_type_to_string(config.array_type), config.num_snapshots,
+            config.num_array_elements, config.ref_period_samples,
+            aoa_array_get_kernel(&config).name);
+  }
+  cJSON_Delete(root);
+}
+
+// Positioning engine configuration: the id of the position topics and the
+// pose of every locator whose angles are combined, e.g.
+// { "id": "positioning-room", "max_tags": 4096, "locators": [
+//   { "id": "ble-pd-...", "coordinate": { "x": 0, "y": 0, "z": 3 },
+//     "orientation": { "x": 0, "y": 180, "z": 0 } }, ... ] }
+static void parse_position_config(char *filename)
+{
+  static const char *axes[3] = { "x", "y", "z" };
+  cJSON *root, *item, *locators, *locator, *id;
+  uint32_t max_tags = POSITION_DEFAULT_MAX_TAGS;
+  sl_status_t sc;
+  char *buffer;
+
+  buffer = load_file(filename);
+  app_assert(buffer != NULL, "Failed to load file: %s\n", filename);
+  root = cJSON_Parse(buffer);
+  app_assert(root != NULL, "Invalid positioning config %s\n", filename);
+
+  item = cJSON_GetObjectItem(root, "id");
+  app_assert(cJSON_IsString(item), "Positioning config %s has no id\n", filename);
+  strncpy(positioning_id, item->valuestring, sizeof(positioning_id) - 1);
+  item = cJSON_GetObjectItem(root, "max_tags");
+  if (cJSON_IsNumber(item)) {
+    max_tags = (uint32_t)item->valueint;
+  }
+  sc = position_init(&position_engine, max_tags);
+  app_assert(sc == SL_STATUS_OK, "[E: 0x%04x] Positioning engine init failed\n", (int)sc);
+
+  locators = cJSON_GetObjectItem(root, "locators");
+  for (int i = 0; cJSON_IsArray(locators) && (i < cJSON_GetArraySize(locators)); i++) {
+    float coordinate[3] = { 0 }, orientation[3] = { 0 };
+    locator = cJSON_GetArrayItem(locators, i);
+    id = cJSON_GetObjectItem(locator, "id");
+    app_assert(cJSON_IsString(id), "Locator %d of %s has no id\n", i, filename);
+    for (int a = 0; a < 3; a++) {
+      item = cJSON_GetObjectItem(cJSON_GetObjectItem(locator, "coordinate"), axes[a]);
+      if (cJSON_IsNumber(item)) {
+        coordinate[a] = (float)item->valuedouble;
+      }
+      item = cJSON_GetObjectItem(cJSON_GetObjectItem(locator, "orientation"), axes[a]);
+      if (cJSON_IsNumber(item)) {
+        orientation[a] = (float)item->valuedouble;
+      }
+    }
+    sc = position_add_locator(&position_engine, id->valuestring, coordinate, orientation);
+    app_assert(sc == SL_STATUS_OK, "[E: 0x%04x] Failed to add locator %s\n", (int)sc, id->valuestring);
+    app_log("Locator %s at (%.2f, %.2f, %.2f) m, orientation (%.1f, %.1f, %.1f) deg\n",
+            id->valuestring, coordinate[0], coordinate[1], coordinate[2],
+            orientation[0], orientation[1], orientation[2]);
+  }
+  app_assert(position_engine.locator_count >= 2, "Positioning needs 2 locators at least, %s has %u\n",
+             filename, position_engine.locator_count);
+  position_enabled = true;
+  app_log("Positioning %s: %u locators, up to %u tags\n", positioning_id,
+          position_engine.locator_count, max_tags);
+
+  cJSON_Delete(root);
   free(buffer);
 }
+
+static void on_mqtt_connect(mqtt_handle_t *handle)
+{
+  aoa_on_connect(handle);
+  if (position_enabled && (mqtt_subscribe(handle, AOA_TOPIC_ANGLE_SUBSCRIBE) != MQTT_SUCCESS)) {
+    log_warning("Failed to subscribe to '%s'.\n", AOA_TOPIC_ANGLE_SUBSCRIBE);
+  }
+}
+
+static void on_angle_message(mqtt_handle_t *handle, const char *topic, const char *payload)
+{
+  aoa_id_t locator, tag;
+  aoa_angle_t angle = { 0 };
+  int32_t index;
+
+  (void)handle;
+  if (sscanf(topic, ANGLE_TOPIC_SCAN, locator, tag) != 2) {
+    return;
+  }
+  index = position_find_locator(&position_engine, locator);
+  if (index < 0) {
+    metrics_inc(METRICS_POSITION_UNKNOWN_LOCATOR);
+    return;
+  }
+  if (aoa_string_to_angle((char *)payload, &angle) != SL_STATUS_OK) {
+    log_warning("Invalid angle on topic '%s'.\n", topic);
+    return;
+  }
+  position_add_angle(&position_engine, (uint32_t)index, tag, &angle, stage_stats_now());
+}
+
+static void publish_position(const char *tag_id, const aoa_position_t *position)
+{
+  const char topic_template[] = AOA_TOPIC_POSITION_PRINT;
+  char topic[sizeof(topic_template) + sizeof(aoa_id_t) + sizeof(aoa_id_t)];
+  char *payload;
+
+  snprintf(topic, sizeof(topic), topic_template, positioning_id, tag_id);
+  aoa_position_to_string((aoa_position_t *)position, &payload);
+  if (mqtt_publish(&mqtt_handle, topic, payload) != MQTT_SUCCESS) {
+    log_warning("Failed to publish to topic '%s'.\n", topic);
+  }
+  free(payload);
+}
@@ -38,6 +38,7 @@ extern "C" {
 #include <stdint.h>
 #include "aoa.h"
 #include "conn.h"
+#include "trace.h"
 
 void app_init(int argc, char *argv[]);
 void app_process_action(void);
@@ -57,9 +58,17 @@ void app_deinit(void);
 uint8_t find_service_in_advertisement(uint8_t *advdata, uint8_t advlen, uint8_t *service_uuid);
 void app_bt_on_event(sl_bt_msg_t *evt);
 void app_on_iq_report(conn_properties_t *tag, aoa_iq_report_t *iq_report);
+// The reports of count different tags, up to AOA_MAX_TAGS, estimated at once
+// (aoa_calculate_batch()); traces[k] is the trace of report k begun by
+// trace_report_begin(), its estimate span the time of the whole batch.
+void app_on_iq_report_batch(conn_properties_t *const *tags, aoa_iq_report_t *const *iq_reports,
+                            const trace_report_t *traces, uint32_t count);
+// Reports waiting in the tag mailboxes of the operating mode, called from the main loop
+void app_process_pending(void);
 
 // Variables
 extern uint32_t verbose_level;       // App verbose level
+extern uint32_t app_batch_reports;   // Reports of the tags estimated at once, 0 or 1 one at a time
 
 #ifdef __cplusplus
 };
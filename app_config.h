@@ -44,6 +44,8 @@
 #define ARRAY_TYPE_4x4_URA             0
 #define ARRAY_TYPE_3x3_URA             1
 #define ARRAY_TYPE_1x4_ULA             2
+// Default array type. The "array" object of the runtime configuration
+// selects another one, see aoa_array.h.
 #define ARRAY_TYPE                     ARRAY_TYPE_1x4_ULA
 
 
@@ -82,37 +84,55 @@
 // -----------------------------------------------------------------------------
 // Secondary configuration values based on primary values.
 
+// Geometry of every supported array type, the runtime configuration starts
+// from these values.
+#define ARRAY_4x4_URA_NUM_SNAPSHOTS       (4)
+#define ARRAY_4x4_URA_NUM_ARRAY_ELEMENTS  (4 * 4)
+#define ARRAY_4x4_URA_REF_PERIOD_SAMPLES  (7)
+#define ARRAY_4x4_URA_COLUMNS             (4)
+//#define ARRAY_4x4_URA_SWITCHING_PATTERN { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 }
+#define ARRAY_4x4_URA_SWITCHING_PATTERN   { 0,0, 1,1, 2,2, 3,3, 4,4, 5,5, 6,6, 7,7}
+
+//#define ARRAY_3x3_URA_SWITCHING_PATTERN { 1, 2, 3, 5, 6, 7, 9, 10, 11 }
+#define ARRAY_3x3_URA_NUM_SNAPSHOTS       (4)
+#define ARRAY_3x3_URA_NUM_ARRAY_ELEMENTS  (3 * 3)
+#define ARRAY_3x3_URA_REF_PERIOD_SAMPLES  (7)
+#define ARRAY_3x3_URA_COLUMNS             (3)
+#define ARRAY_3x3_URA_SWITCHING_PATTERN   { 1, 2, 4, 1, 2, 4, 1, 2, 4 }
+
+// 3 element variant: 1 * 3 elements, { 2, 4, 8 }
+#define ARRAY_1x4_ULA_NUM_SNAPSHOTS       (18)
+#define ARRAY_1x4_ULA_NUM_ARRAY_ELEMENTS  (1 * 4)
+#define ARRAY_1x4_ULA_REF_PERIOD_SAMPLES  (7)
+#define ARRAY_1x4_ULA_COLUMNS             (4)
+#define ARRAY_1x4_ULA_SWITCHING_PATTERN   {0,1,2,3}
+
+// Distance of adjacent array elements in m, for the in-tree spectrum estimator
+#define ARRAY_ELEMENT_SPACING             (0.04f)
+
+// Default geometry. The running application takes the geometry from
+// aoa_array_config, these only describe the default array type.
 #if (ARRAY_TYPE == ARRAY_TYPE_4x4_URA)
 #define AOX_ARRAY_TYPE          SL_RTL_AOX_ARRAY_TYPE_4x4_URA
-#define AOA_NUM_SNAPSHOTS       (4)
-#define AOA_NUM_ARRAY_ELEMENTS  (4 * 4)
-#define AOA_REF_PERIOD_SAMPLES  (7)
-//#define SWITCHING_PATTERN       { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 }
-#define SWITCHING_PATTERN       { 0,0, 1,1, 2,2, 3,3, 4,4, 5,5, 6,6, 7,7}
-//#elif (ARRAY_TYPE == ARRAY_TYPE_3x3_URA)
-//#define AOX_ARRAY_TYPE          SL_RTL_AOX_ARRAY_TYPE_3x3_URA
-//#define AOA_NUM_SNAPSHOTS       (4)
-//#define AOA_NUM_ARRAY_ELEMENTS  (3 * 3)
-//#define AOA_REF_PERIOD_SAMPLES  (7)
-//#define SWITCHING_PATTERN       { 1, 2, 3, 5, 6, 7, 9, 10, 11 }
+#define AOA_NUM_SNAPSHOTS       ARRAY_4x4_URA_NUM_SNAPSHOTS
+#define AOA_NUM_ARRAY_ELEMENTS  ARRAY_4x4_URA_NUM_ARRAY_ELEMENTS
+#define AOA_REF_PERIOD_SAMPLES  ARRAY_4x4_URA_REF_PERIOD_SAMPLES
+#define SWITCHING_PATTERN       ARRAY_4x4_URA_SWITCHING_PATTERN
+#define AOA_ARRAY_COLUMNS       ARRAY_4x4_URA_COLUMNS
 #elif (ARRAY_TYPE == ARRAY_TYPE_3x3_URA)
 #define AOX_ARRAY_TYPE          SL_RTL_AOX_ARRAY_TYPE_3x3_URA
-#define AOA_NUM_SNAPSHOTS       (4)
-#define AOA_NUM_ARRAY_ELEMENTS  (3 * 3)
-#define AOA_REF_PERIOD_SAMPLES  (7)
-#define SWITCHING_PATTERN       { 1, 2, 4, 1, 2, 4, 1, 2, 4 }
+#define AOA_NUM_SNAPSHOTS       ARRAY_3x3_URA_NUM_SNAPSHOTS
+#define AOA_NUM_ARRAY_ELEMENTS  ARRAY_3x3_URA_NUM_ARRAY_ELEMENTS
+#define AOA_REF_PERIOD_SAMPLES  ARRAY_3x3_URA_REF_PERIOD_SAMPLES
+#define SWITCHING_PATTERN       ARRAY_3x3_URA_SWITCHING_PATTERN
+#define AOA_ARRAY_COLUMNS       ARRAY_3x3_URA_COLUMNS
 #elif (ARRAY_TYPE == ARRAY_TYPE_1x4_ULA)
 #define AOX_ARRAY_TYPE          SL_RTL_AOX_ARRAY_TYPE_1x4_ULA
-#define AOA_NUM_SNAPSHOTS       (18)
-#define AOA_NUM_ARRAY_ELEMENTS  (1 * 4)
-#define AOA_REF_PERIOD_SAMPLES  (7)
-#define SWITCHING_PATTERN       {0,1,2,3}
-//#elif (ARRAY_TYPE == ARRAY_TYPE_1x4_ULA)
-//#define AOX_ARRAY_TYPE          SL_RTL_AOX_ARRAY_TYPE_1x4_ULA
-//#define AOA_NUM_SNAPSHOTS       (18)
-//#define AOA_NUM_ARRAY_ELEMENTS  (1 * 3)
-//#define AOA_REF_PERIOD_SAMPLES  (7)
-//#define SWITCHING_PATTERN       { 2, 4, 8 }
+#define AOA_NUM_SNAPSHOTS       ARRAY_1x4_ULA_NUM_SNAPSHOTS
+#define AOA_NUM_ARRAY_ELEMENTS  ARRAY_1x4_ULA_NUM_ARRAY_ELEMENTS
+#define AOA_REF_PERIOD_SAMPLES  ARRAY_1x4_ULA_REF_PERIOD_SAMPLES
+#define SWITCHING_PATTERN       ARRAY_1x4_ULA_SWITCHING_PATTERN
+#define AOA_ARRAY_COLUMNS       ARRAY_1x4_ULA_COLUMNS
 #endif
 
 #endif // APP_CONFIG_H
@@ -39,6 +39,7 @@
 #include "sl_bt_api.h"
 #include "sl_bt_ncp_host.h"
 #include "app_log.h"
+#include "log_level.h"
 #include "app_assert.h"
 
 #include "conn.h"
@@ -48,6 +49,7 @@
 #include "app.h"
 #include "aoa_util.h"
 #include "app_config.h"
+#include "trace.h"
 
 // connection parameters
 #define CONN_INTERVAL_MIN             80   //100ms
@@ -69,9 +71,6 @@ static const uint8_t cte_enable_char[CHAR_UUID_LEN] = { 0xdd, 0xc4, 0xfb, 0xc9,
                                                         0x1c, 0x10, 0xd6, 0x57,
                                                         0x72, 0x0b, 0x6a, 0x0d };
 
-// Antenna switching pattern
-static const uint8_t antenna_array[AOA_NUM_ARRAY_ELEMENTS] = SWITCHING_PATTERN;
-
 /**************************************************************************//**
  * Connection specific Bluetooth event handler.
  *****************************************************************************/
@@ -122,9 +121,7 @@ void app_bt_on_event(sl_bt_msg_t *evt)
       // Check if the tag is whitelisted
     {
       if (SL_STATUS_NOT_FOUND == aoa_whitelist_find(evt->data.evt_scanner_scan_report.address.addr)) {
-        if (verbose_level > 0 ) {
-          app_log("Tag is not on the whitelist, ignoring.\n");
-        }
+        log_info("Tag is not on the whitelist, ignoring.\n");
 
         break;
       }
@@ -251,8 +248,8 @@ void app_bt_on_event(sl_bt_msg_t *evt)
                                                         CTE_MIN_LENGTH,
                                                         CTE_TYPE_AOA,
                                                         CTE_SLOT_DURATION,
-                                                        sizeof(antenna_array),
-                                                        antenna_array);
+                                                        aoa_array_config.switching_pattern_length,
+                                                        aoa_array_config.switching_pattern);
           app_assert(sc == SL_STATUS_OK,
                      "[E: 0x%04x] Failed to enable CTE\n",
                      (int)sc);
@@ -284,6 +281,7 @@ void app_bt_on_event(sl_bt_msg_t *evt)
     case sl_bt_evt_cte_receiver_connection_iq_report_id:
     {
       aoa_iq_report_t iq_report;
+      uint64_t received = stage_stats_now();
 
       if (evt->data.evt_cte_receiver_connection_iq_report.samples.len == 0) {
         // Nothing to be processed.
@@ -310,6 +308,8 @@ void app_bt_on_event(sl_bt_msg_t *evt)
 
 
 
+      stage_stats_begin(&conn->aoa_states.stage_stats, received, received);
+      trace_report_begin(received, conn->address.addr, iq_report.event_counter, iq_report.channel);
       app_on_iq_report(conn, &iq_report);
     }
     break;
@@ -320,3 +320,10 @@ void app_bt_on_event(sl_bt_msg_t *evt)
       break;
   }
 }
+
+/**************************************************************************//**
+ * No mailbox or admission control in this mode, every report is processed on arrival.
+ *****************************************************************************/
+void app_process_pending(void)
+{
+}
@@ -39,6 +39,7 @@
 #include "sl_bt_api.h"
 #include "sl_bt_ncp_host.h"
 #include "app_log.h"
+#include "log_level.h"
 #include "app_assert.h"
 
 #include "app.h"
@@ -48,13 +49,11 @@
 #include "app.h"
 #include "aoa_util.h"
 #include "app_config.h"
+#include "trace.h"
 
 // UUIDs defined by Bluetooth SIG
 static const uint8_t cte_service[SERVICE_UUID_LEN] = { 0x50, 0x69, 0x96, 0x81, 0xb7, 0xa8, 0xad, 0x07, 0x96, 0xf2, 0x3f, 0x07, 0x64, 0x36, 0xd0, 0x0e };
 
-// Antenna switching pattern
-static const uint8_t antenna_array[AOA_NUM_ARRAY_ELEMENTS] = SWITCHING_PATTERN;
-
 /**************************************************************************//**
  * Connection specific Bluetooth event handler.
  *****************************************************************************/
@@ -92,9 +91,7 @@ void app_bt_on_event(sl_bt_msg_t *evt)
     {
       // Check if the tag is whitelisted
       if (SL_STATUS_NOT_FOUND == aoa_whitelist_find(evt->data.evt_scanner_scan_report.address.addr)) {
-        if (verbose_level > 0 ) {
-          app_log("Tag is not on the whitelist, ignoring.\n");
-        }
+        log_info("Tag is not on the whitelist, ignoring.\n");
         break;
       }
       // Parse extended advertisement packets
@@ -138,8 +135,8 @@ void app_bt_on_event(sl_bt_msg_t *evt)
       sc = sl_bt_cte_receiver_enable_connectionless_cte(evt->data.evt_sync_opened.sync,
                                                         CTE_SLOT_DURATION,
                                                         CTE_COUNT,
-                                                        sizeof(antenna_array),
-                                                        antenna_array);
+                                                        aoa_array_config.switching_pattern_length,
+                                                        aoa_array_config.switching_pattern);
       app_assert(sc == SL_STATUS_OK,
                  "[E: 0x%04x] Failed to enable CTE\n",
                  (int)sc);
@@ -164,6 +161,7 @@ void app_bt_on_event(sl_bt_msg_t *evt)
     {
       conn_properties_t *tag;
       aoa_iq_report_t iq_report;
+      uint64_t received = stage_stats_now();
 
       if (evt->data.evt_cte_receiver_connectionless_iq_report.samples.len == 0) {
         // Nothing to be processed.
@@ -173,7 +171,7 @@ void app_bt_on_event(sl_bt_msg_t *evt)
       // Check if asset tag is known.
       tag = get_connection_by_handle(evt->data.evt_cte_receiver_connectionless_iq_report.sync);
       if (tag == NULL) {
-        app_log("Unkown tag.\n");
+        log_warning("Unkown tag.\n");
         break;
       }
 
@@ -184,6 +182,8 @@ void app_bt_on_event(sl_bt_msg_t *evt)
       iq_report.length = evt->data.evt_cte_receiver_connectionless_iq_report.samples.len;
       iq_report.samples = (int8_t *)evt->data.evt_cte_receiver_connectionless_iq_report.samples.data;
 
+      stage_stats_begin(&tag->aoa_states.stage_stats, received, received);
+      trace_report_begin(received, tag->address.addr, iq_report.event_counter, iq_report.channel);
       app_on_iq_report(tag, &iq_report);
     }
     break;
@@ -194,3 +194,10 @@ void app_bt_on_event(sl_bt_msg_t *evt)
       break;
   }
 }
+
+/**************************************************************************//**
+ * No mailbox or admission control in this mode, every report is processed on arrival.
+ *****************************************************************************/
+void app_process_pending(void)
+{
+}
@@ -43,6 +43,7 @@
 #include "sl_bt_api.h"
 #include "sl_bt_ncp_host.h"
 #include "app_log.h"
+#include "log_level.h"
 #include "app_assert.h"
 #include "uart.h"
 #include "app.h"
@@ -52,12 +53,19 @@
 #include "aoa.h"
 #include "log2CSV.h"
 #include "Simulator_I_Q.h"
+#include "trace.h"
+#include "admission.h"
+#include "mailbox.h"
+#include "scheduler.h"
 
-// Antenna switching pattern
-static const uint8_t antenna_array[AOA_NUM_ARRAY_ELEMENTS] = SWITCHING_PATTERN;
 extern void get_qa_detal(sl_rtl_clib_iq_sample_qa_dataset_t** s,
 		sl_rtl_clib_iq_sample_qa_antenna_data_t **a);
 
+static void process_iq_report(conn_properties_t *tag, aoa_iq_report_t *iq_report, uint64_t received,
+                              uint64_t dequeued);
+static void process_iq_batch(conn_properties_t **tags, aoa_iq_report_t **iq_reports, const uint64_t *received,
+                             const uint64_t *dequeued, uint32_t count);
+
 /**************************************************************************//**
  * Connection specific Bluetooth event handler.
  *****************************************************************************/
@@ -110,8 +118,8 @@ void app_bt_on_event(sl_bt_msg_t *evt)
       // Start Silabs CTE
       sc = sl_bt_cte_receiver_enable_silabs_cte(CTE_SLOT_DURATION,
                                                 CTE_COUNT,
-                                                sizeof(antenna_array),
-                                                antenna_array);
+                                                aoa_array_config.switching_pattern_length,
+                                                aoa_array_config.switching_pattern);
 
       app_assert(sc == SL_STATUS_OK,
                  "[E: 0x%04x] Failed to enable Silabs CTE\n",
@@ -122,7 +130,7 @@ void app_bt_on_event(sl_bt_msg_t *evt)
     {
 		conn_properties_t *tag;
 		aoa_iq_report_t iq_report;
-		static s8* pSimul_IQ_DATA;
+		uint64_t received = stage_stats_now();
 
 		if (evt->data.evt_cte_receiver_silabs_iq_report.samples.len == 0) {
 			// Nothing to be processed.
@@ -133,9 +141,7 @@ void app_bt_on_event(sl_bt_msg_t *evt)
 		if (SL_STATUS_NOT_FOUND
 				== aoa_whitelist_find(
 						evt->data.evt_cte_receiver_silabs_iq_report.address.addr)) {
-			if (verbose_level > 0) {
-				app_log("Tag is not on the whitelist, ignoring.\n");
-			}
+			log_info("Tag is not on the whitelist, ignoring.\n");
 			break;
 		}
 
@@ -148,11 +154,11 @@ void app_bt_on_event(sl_bt_msg_t *evt)
 			tag = add_connection(0,
 					&evt->data.evt_cte_receiver_silabs_iq_report.address,
 					evt->data.evt_cte_receiver_silabs_iq_report.address_type);
-			app_log("add_connection tag adr \r\n ");
+			log_debug("add_connection tag adr \r\n ");
 
 			// Check if we have enough space for hte new tag.
 			if (tag == NULL) {
-				app_log("Too many tags in the system.\n");
+				log_warning("Too many tags in the system.\n");
 				// Don't continue the process. This will save us CPU time.
 				break;
 			}
@@ -161,50 +167,19 @@ void app_bt_on_event(sl_bt_msg_t *evt)
 		}
 
 		// Convert event to common IQ report format.
-
-		//Divided incoming evt to every CountDivided
-		static u8 CountDivided = 10;
-		if(CountDivided)CountDivided--;
-		else {
-			CountDivided = 3;
-			iq_report.channel =
-					evt->data.evt_cte_receiver_silabs_iq_report.channel;
-			iq_report.rssi = evt->data.evt_cte_receiver_silabs_iq_report.rssi;
-			iq_report.event_counter =
-					evt->data.evt_cte_receiver_silabs_iq_report.packet_counter;
-			iq_report.length =
-					evt->data.evt_cte_receiver_silabs_iq_report.samples.len;
-
+		iq_report.channel =
+				evt->data.evt_cte_receiver_silabs_iq_report.channel;
+		iq_report.rssi = evt->data.evt_cte_receiver_silabs_iq_report.rssi;
+		iq_report.event_counter =
+				evt->data.evt_cte_receiver_silabs_iq_report.packet_counter;
+		iq_report.length =
+				evt->data.evt_cte_receiver_silabs_iq_report.samples.len;
 		iq_report.samples =
 				(int8_t*) evt->data.evt_cte_receiver_silabs_iq_report.samples.data;
 
-		/*
-		 * Here changed real data to simulations
-		 */
-
-
-// create simulation I & Q data
-	pSimul_IQ_DATA = make_I_Q(iq_report.length, 0.0);
-//-----
-			iq_report.channel = 37;
-			iq_report.rssi = -50;
-			iq_report.samples = pSimul_IQ_DATA;
-
-
-//		char *rssi = malloc(160);
-//		sprintf (rssi,"RSSI %i           ",iq_report.rssi);
-//		int max = iq_report.rssi + 90;
-//		char *p = rssi+10;
-//		for (int t = 0; t < max; t++) {*p = '>';p++;};
-//		*p = '\n';p++;*p = 0;
-//		app_log(rssi);
-//		free(rssi);
-
-			app_on_iq_report(tag, &iq_report);
-//
-//			// write I Q data to IQ_Report_data_log.csv file
-			I_Q_to_CSV(&iq_report, iq_report.length, tag);
-		}
+		// Processed from the main loop, newer reports of the tag may supersede it
+		admission_offer(&tag->admission, received);
+		mailbox_post(&tag->mailbox, &iq_report, received);
 
 	}
     break;
@@ -215,3 +190,163 @@ void app_bt_on_event(sl_bt_msg_t *evt)
       break;
   }
 }
+
+/**************************************************************************//**
+ * The next report of a tag with a token: the oldest kept, while the tag is
+ * admitted less than it offers only its newest.
+ *****************************************************************************/
+static aoa_iq_report_t *take_report(conn_properties_t *tag, uint64_t *received)
+{
+	if (admission_overloaded(&tag->admission)) {
+		return mailbox_take_latest(&tag->mailbox, received);
+	}
+	return mailbox_take(&tag->mailbox, received);
+}
+
+/**************************************************************************//**
+ * Reports in the tag mailboxes, the oldest of every tag with a token in turn
+ * (the newest of an overloaded tag), once the host has read the events it is
+ * behind with. With a scheduler
+ * budget the tags go by priority and the cycle ends once the budget is spent.
+ * Without one, the reports of a turn are estimated app_batch_reports at once.
+ *****************************************************************************/
+void app_process_pending(void)
+{
+  conn_properties_t *tag;
+  aoa_iq_report_t *iq_report;
+  uint64_t received, now, start;
+  uint8_t order[AOA_MAX_TAGS];
+  conn_properties_t *batch_tags[AOA_MAX_TAGS];
+  aoa_iq_report_t *batch_reports[AOA_MAX_TAGS];
+  uint64_t batch_received[AOA_MAX_TAGS], batch_dequeued[AOA_MAX_TAGS];
+  uint32_t count;
+  bool served;
+
+  scheduler_cycle(stage_stats_now());
+  if (!mailbox_serve_due(admission_backlog())) {
+    return;
+  }
+  if (scheduler_budget_ns == 0) {
+    do {
+      served = false;
+      count = 0;
+      for (uint8_t i = 0; (tag = get_connection_by_index(i)) != NULL; i++) {
+        now = stage_stats_now();
+        if (!mailbox_empty(&tag->mailbox) && admission_acquire(&tag->admission, now)) {
+          iq_report = take_report(tag, &received);
+          scheduler_served(&tag->scheduler, now);
+          served = true;
+          if (app_batch_reports <= 1) {
+            process_iq_report(tag, iq_report, received, now);
+            continue;
+          }
+          // One report per tag of the turn, valid until the next post
+          batch_tags[count] = tag;
+          batch_reports[count] = iq_report;
+          batch_received[count] = received;
+          batch_dequeued[count++] = now;
+          if (count == app_batch_reports) {
+            process_iq_batch(batch_tags, batch_reports, batch_received, batch_dequeued, count);
+            count = 0;
+          }
+        }
+      }
+      if (count > 0) {
+        process_iq_batch(batch_tags, batch_reports, batch_received, batch_dequeued, count);
+      }
+    } while (served);
+    return;
+  }
+
+  start = stage_stats_now();
+  do {
+    served = false;
+    count = scheduler_order(order, start);
+    for (uint32_t k = 0; k < count; k++) {
+      tag = get_connection_by_index(order[k]);
+      now = stage_stats_now();
+      if (now - start >= scheduler_budget_ns) {
+        return;
+      }
+      if (admission_acquire(&tag->admission, now)) {
+        iq_report = take_report(tag, &received);
+        scheduler_served(&tag->scheduler, now);
+        process_iq_report(tag, iq_report, received, now);
+        served = true;
+      }
+    }
+  } while (served);
+}
+
+/**************************************************************************//**
+ * An admitted report: estimation, publish and CSV log. Its processing time
+ * sets the rate the admission control allows.
+ *****************************************************************************/
+static void process_iq_report(conn_properties_t *tag, aoa_iq_report_t *iq_report, uint64_t received,
+                              uint64_t dequeued)
+{
+	static s8* pSimul_IQ_DATA;
+
+	/*
+	 * Here changed real data to simulations
+	 */
+
+// create simulation I & Q data
+	pSimul_IQ_DATA = make_I_Q(iq_report->length, 0.0);
+//-----
+	iq_report->channel = 37;
+	iq_report->rssi = -50;
+	iq_report->samples = pSimul_IQ_DATA;
+
+	stage_stats_begin(&tag->aoa_states.stage_stats, received, dequeued);
+	trace_report_begin(received, tag->address.addr, iq_report->event_counter, iq_report->channel);
+	if (trace_current.active) {
+		trace_record(TRACE_SPAN_QUEUE, received, dequeued);
+	}
+	app_on_iq_report(tag, iq_report);
+
+	// write I Q data to IQ_Report_data_log.csv file
+	I_Q_to_CSV(iq_report, iq_report->length, tag);
+	admission_account(stage_stats_now() - dequeued);
+}
+
+/**************************************************************************//**
+ * Admitted reports of different tags estimated at once, as
+ * process_iq_report() does one; each accounts an even share of the time.
+ *****************************************************************************/
+static void process_iq_batch(conn_properties_t **tags, aoa_iq_report_t **iq_reports, const uint64_t *received,
+                             const uint64_t *dequeued, uint32_t count)
+{
+	static s8 simul_IQ_DATA[AOA_MAX_TAGS][AOA_ARRAY_MAX_REPORT_LENGTH];
+	static trace_report_t traces[AOA_MAX_TAGS];
+	uint64_t cost;
+
+	for (uint32_t k = 0; k < count; k++) {
+		aoa_iq_report_t *iq_report = iq_reports[k];
+		uint32_t length = (iq_report->length < AOA_ARRAY_MAX_REPORT_LENGTH)
+				? iq_report->length : AOA_ARRAY_MAX_REPORT_LENGTH;
+		// The simulation data of every report, out of the buffer of make_I_Q()
+		memcpy(simul_IQ_DATA[k], make_I_Q(length, 0.0), length);
+		iq_report->channel = 37;
+		iq_report->rssi = -50;
+		iq_report->length = length;
+		iq_report->samples = simul_IQ_DATA[k];
+		stage_stats_begin(&tags[k]->aoa_states.stage_stats, received[k], dequeued[k]);
+		trace_report_begin(received[k], tags[k]->address.addr, iq_report->event_counter, iq_report->channel);
+		if (trace_current.active) {
+			trace_record(TRACE_SPAN_QUEUE, received[k], dequeued[k]);
+		}
+		// Resumed per report at its publish, the batch spans are not of one report
+		traces[k] = trace_current;
+		trace_current.active = false;
+	}
+	app_on_iq_report_batch(tags, iq_reports, traces, count);
+
+	for (uint32_t k = 0; k < count; k++) {
+		I_Q_to_CSV(iq_reports[k], iq_reports[k]->length, tags[k]);
+	}
+	cost = (stage_stats_now() - dequeued[0]) / count;
+	for (uint32_t k = 0; k < count; k++) {
+		admission_account(cost);
+	}
+}
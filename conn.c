@@ -31,6 +31,7 @@
 #include <string.h>
 #include "app_config.h"
 #include "conn.h"
+#include "metrics.h"
 
 #define CONNECTION_HANDLE_INVALID     (uint16_t)0xFFFFu
 #define SERVICE_HANDLE_INVALID        (uint32_t)0xFFFFFFFFu
@@ -75,10 +76,17 @@ conn_properties_t* add_connection(uint16_t connection, bd_addr *address, uint8_t
     conn_properties[active_connections_num].address_type = address_type;
     conn_properties[active_connections_num].connection_state = DISCOVER_SERVICES;
     aoa_init(&conn_properties[active_connections_num].aoa_states);
+    admission_tag_init(&conn_properties[active_connections_num].admission);
+    governor_tag_init(&conn_properties[active_connections_num].governor,
+                      &conn_properties[active_connections_num].aoa_states);
+    mailbox_init(&conn_properties[active_connections_num].mailbox);
+    scheduler_tag_init(&conn_properties[active_connections_num].scheduler);
     // Entry is now valid
     ret = &conn_properties[active_connections_num];
     active_connections_num++;
-
+    metrics_inc(METRICS_TAGS_ADDED);
+  } else {
+    metrics_inc(METRICS_TAG_TABLE_FULL);
   }
   return ret;
 }
@@ -110,6 +118,7 @@ uint8_t remove_connection(uint16_t connection)
 
   // Decrease number of active connections
   active_connections_num--;
+  metrics_inc(METRICS_TAGS_REMOVED);
 
   // Shift entries after the removed connection toward 0 index
   for (i = table_index; i < active_connections_num; i++) {
@@ -147,6 +156,20 @@ conn_properties_t* get_connection_by_handle(uint16_t connection_handle)
   return ret;
 }
 
+uint8_t get_connection_count(void)
+{
+  // May be called from other threads, e.g. the metrics server
+  return __atomic_load_n(&active_connections_num, __ATOMIC_RELAXED);
+}
+
+conn_properties_t* get_connection_by_index(uint8_t index)
+{
+  if (index >= active_connections_num) {
+    return NULL;
+  }
+  return &conn_properties[index];
+}
+
 conn_properties_t* get_connection_by_address(bd_addr* address)
 {
   conn_properties_t* ret = NULL;
@@ -34,6 +34,10 @@
 #include <stdint.h>
 #include "sl_bt_api.h"
 #include "aoa.h"
+#include "admission.h"
+#include "governor.h"
+#include "mailbox.h"
+#include "scheduler.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -74,6 +78,10 @@ typedef struct {
   uint16_t cte_enable_char_handle;
   connection_state_t connection_state;
   aoa_libitems_t aoa_states;
+  admission_tag_t admission;
+  governor_tag_t governor;
+  mailbox_t mailbox;
+  scheduler_tag_t scheduler;
 } conn_properties_t;
 
 /***************************************************************************************************
@@ -90,6 +98,9 @@ uint8_t is_connection_list_full(void);
 
 conn_properties_t* get_connection_by_handle(uint16_t connection_handle);
 conn_properties_t* get_connection_by_address(bd_addr* address);
+uint8_t get_connection_count(void);
+// Entry index of the table, NULL past the active connections
+conn_properties_t* get_connection_by_index(uint8_t index);
 
 /** @} (end addtogroup app) */
 /** @} (end addtogroup Application) */